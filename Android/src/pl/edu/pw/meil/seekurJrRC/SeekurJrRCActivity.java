@@ -1,5 +1,6 @@
 package pl.edu.pw.meil.seekurJrRC;
 
+import java.io.DataInputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.net.InetAddress;
@@ -35,16 +36,28 @@ public class SeekurJrRCActivity
 	
 	private SensorManager mSensorManager;
     private Sensor mAccelerometer;	
+    private Sensor mGyroscope;
 	private boolean mLocked;
 	private AlertDialog mLockedDialog;
 	private Socket robotSocket;
 	private Timer mSocketTimer;
 	private Boolean mSocketGood = false;
+	/** zalecany przez serwer odstęp między wiadomościami jednego czujnika [ns]; 0 = każde wskazanie */
+	private volatile long mSendIntervalNs = 0;
+	/** czas (SensorEvent.timestamp) ostatniej wysłanej wiadomości z akcelerometru i z żyroskopu */
+	private long[] mLastSentNs = new long[2];
+	/** wskazania akcelerometru czekające na wysłanie w jednej paczce (BundleMessage serwera), już z zamienionymi osiami */
+	private float[][] mBundle = new float[BUNDLE_MAX_SAMPLES][3];
+	private long[] mBundleTimestamps = new long[BUNDLE_MAX_SAMPLES];
+	private int mBundleFill = 0;
+	/** stan blokady wskazań w paczce - paczka ma jeden bajt START/STOP, więc zmiana blokady ją zamyka */
+	private boolean mBundleLocked;
 
 	
 	public SeekurJrRCActivity() {
 		mSensorManager = null;
         mAccelerometer = null;
+        mGyroscope = null;
    	}
 
 	
@@ -65,6 +78,8 @@ public class SeekurJrRCActivity
 
         mSensorManager = (SensorManager)getSystemService(SENSOR_SERVICE);
         mAccelerometer = mSensorManager.getDefaultSensor(Sensor.TYPE_ACCELEROMETER);
+        // null, jeżeli telefon nie ma żyroskopu - serwer liczy wtedy modele z fuzją z samego akcelerometru
+        mGyroscope = mSensorManager.getDefaultSensor(Sensor.TYPE_GYROSCOPE);
         
     	mSocketTimer = new Timer();
     	mSocketTimer.schedule(new TimerTask() {
@@ -79,11 +94,13 @@ public class SeekurJrRCActivity
     }
     
     /**
-     * Gdy zostaniemy przywróceni, włączamy akcelerometr
+     * Gdy zostaniemy przywróceni, włączamy akcelerometr (i żyroskop)
      */
     protected void onResume() {
         super.onResume();
         mSensorManager.registerListener(this, mAccelerometer, SensorManager.SENSOR_DELAY_GAME);
+        if (mGyroscope != null)
+        	mSensorManager.registerListener(this, mGyroscope, SensorManager.SENSOR_DELAY_GAME);
     }
 
     /**
@@ -110,6 +127,8 @@ public class SeekurJrRCActivity
         					Integer.parseInt(appPreferences.getString("controlPort", "1025"))
         			);
         	robotSocket.setTcpNoDelay(true);
+        	mSendIntervalNs = 0;
+        	startAdviceReader(robotSocket);
         	mSocketGood = true;
         } catch (IOException e) {
         	mSocketGood = false;
@@ -118,6 +137,35 @@ public class SeekurJrRCActivity
         } 
     }
     
+    /** zalecenie częstotliwości od serwera, jak encodeRateAdvice w message.hpp serwera */
+    private static final int RATE_ADVICE_MAGIC = 0x534A5252;
+    private static final int RATE_ADVICE_LENGTH = 20;
+
+    /**
+     * wątek czytający zalecenia częstotliwości od serwera; kończy się razem z gniazdem
+     */
+    private void startAdviceReader(final Socket socket) {
+    	new Thread(new Runnable() {
+    		public void run() {
+    			try {
+    				DataInputStream in = new DataInputStream(socket.getInputStream());
+    				byte[] advice = new byte[RATE_ADVICE_LENGTH];
+    				for (;;) {
+    					in.readFully(advice);
+    					ByteBuffer buffer = ByteBuffer.wrap(advice);
+    					CRC32 sum = new CRC32();
+    					sum.update(advice, 0, 16);
+    					if (buffer.getInt(0) != RATE_ADVICE_MAGIC || buffer.getInt(16) != (int) sum.getValue())
+    						continue;
+    					// interval in microseconds, unsigned
+    					mSendIntervalNs = (buffer.getInt(4) & 0xffffffffL) * 1000;
+    				}
+    			} catch (IOException e) {
+    				// socket closed; the next connection starts its own reader
+    			}
+    		}
+    	}).start();
+    }
 	
 	/**
 	 * może kiedyś się to do czegoś przyda
@@ -127,28 +175,156 @@ public class SeekurJrRCActivity
     }
 
     /**
-     * główne miejsce, w którym reagujemy na wskazania akcelerometru
+     * główne miejsce, w którym reagujemy na wskazania akcelerometru i żyroskopu; każde wskazanie to jedna wiadomość,
+     * rodzaj wiadomości (3. bajt) mówi serwerowi, z którego czujnika pochodzi; wskazania, które przyszły szybciej,
+     * niż zaleca serwer, są pomijane (oszczędza to Wi-Fi, baterię i procesor serwera).
+     * Przy "bundleSize" > 1 wskazania akcelerometru idą po kilka w jednej paczce (mniej bajtów na wskazanie i mniej
+     * pakietów przy zatłoczonym Wi-Fi, za cenę opóźnienia o bundleSize - 1 wskazań); żyroskop zawsze pojedynczo
      */
     public void onSensorChanged(SensorEvent event) {
     	// just to make sure
     	if (event.sensor.getType() == Sensor.TYPE_ACCELEROMETER) {
+    		if (dueForSending(MESSAGE_KIND_ACCELEROMETER, event.timestamp)) {
+    			int bundleSize = bundleSize();
+    			if (bundleSize > 1 || mBundleFill > 0)
+    				addToBundle(event.timestamp, event.values, bundleSize);
+    			else
+    				sendMessage(MESSAGE_KIND_ACCELEROMETER, event.values);
+    		}
+    	} else if (event.sensor.getType() == Sensor.TYPE_GYROSCOPE) {
+    		if (dueForSending(MESSAGE_KIND_GYROSCOPE, event.timestamp))
+    			sendMessage(MESSAGE_KIND_GYROSCOPE, event.values);
+    	}
+    }
+
+    private boolean dueForSending(byte kind, long timestamp) {
+    	if (timestamp - mLastSentNs[kind] < mSendIntervalNs)
+    		return false;
+    	mLastSentNs[kind] = timestamp;
+    	return true;
+    }
+
+    /** rodzaje wiadomości, jak w message.hpp serwera */
+    private static final byte MESSAGE_KIND_ACCELEROMETER = 0x00;
+    private static final byte MESSAGE_KIND_GYROSCOPE = 0x01;
+    private static final byte MESSAGE_KIND_BUNDLE = 0x02;
+    /** paczka: najwięcej wskazań i jednostka różnic, jak BUNDLE_MAX_SAMPLES i BUNDLE_DELTA_SCALE w message.hpp serwera */
+    private static final int BUNDLE_MAX_SAMPLES = 16;
+    private static final float BUNDLE_DELTA_SCALE = 1000.0f;
+
+    /** liczba wskazań akcelerometru w paczce z ustawień; 1 = każde wskazanie osobno */
+    private int bundleSize() {
+    	SharedPreferences appPreferences = PreferenceManager.getDefaultSharedPreferences(this);
+    	try {
+    		int size = Integer.parseInt(appPreferences.getString("bundleSize", "1"));
+    		return Math.max(1, Math.min(BUNDLE_MAX_SAMPLES, size));
+    	} catch (NumberFormatException e) {
+    		return 1;
+    	}
+    }
+
+    /**
+     * dokłada wskazanie do paczki i wysyła ją, gdy jest pełna; zmiana blokady (START/STOP) albo rozmiaru paczki
+     * najpierw wysyła to, co już w niej jest, więc "stop" nie czeka na zapełnienie paczki
+     */
+    private void addToBundle(long timestamp, float[] values, int bundleSize) {
+    	if (mBundleFill > 0 && (mBundleLocked != mLocked || mBundleFill >= bundleSize))
+    		flushBundle();
+    	mBundleLocked = mLocked;
+    	// the axes are swapped the same way as in single messages
+    	mBundle[mBundleFill][0] = values[2];
+    	mBundle[mBundleFill][1] = values[1];
+    	mBundle[mBundleFill][2] = values[0];
+    	mBundleTimestamps[mBundleFill] = timestamp;
+    	++mBundleFill;
+    	if (mBundleFill >= bundleSize || mBundleLocked)
+    		flushBundle();
+    }
+
+    /** wysyła zebrane wskazania: jedno - zwykłą wiadomością, więcej - paczką */
+    private void flushBundle() {
+    	if (mBundleFill == 1)
+    		sendFrame(encodeMessage(mBundleLocked, MESSAGE_KIND_ACCELEROMETER, mBundle[0][0], mBundle[0][1], mBundle[0][2]));
+    	else if (mBundleFill > 1)
+    		sendFrame(encodeBundle());
+    	mBundleFill = 0;
+    }
+
+    /** różnica w jednostkach paczki, obcięta do zakresu short; jak bundleDelta w message.cpp serwera */
+    private static short bundleDelta(float from, float to) {
+    	float delta = (to - from) * BUNDLE_DELTA_SCALE;
+    	delta = delta < 0 ? delta - 0.5f : delta + 0.5f;
+    	if (delta > Short.MAX_VALUE)
+    		return Short.MAX_VALUE;
+    	if (delta < Short.MIN_VALUE)
+    		return Short.MIN_VALUE;
+    	return (short) delta;
+    }
+
+    /**
+     * paczka jak encodeBundle w message.cpp serwera: najstarsze wskazanie, średni odstęp [10 usec], różnice short
+     * względem wskazań odtworzonych przez serwer (błąd zaokrąglenia się nie kumuluje) i jedno CRC32 na całość
+     */
+    private byte[] encodeBundle() {
+    	int samples = mBundleFill;
+    	int length = 18 + 6 * samples;
+    	ByteBuffer buffer = ByteBuffer.allocate(length);
+    	buffer.put(0, mBundleLocked ? (byte)0x00 : (byte)0xff);
+    	buffer.put(1, steeringModelCode());
+    	buffer.put(2, MESSAGE_KIND_BUNDLE);
+    	buffer.put(3, (byte) samples);
+    	buffer.putInt(4, Float.floatToRawIntBits(mBundle[0][0]));
+    	buffer.putInt(8, Float.floatToRawIntBits(mBundle[0][1]));
+    	buffer.putInt(12, Float.floatToRawIntBits(mBundle[0][2]));
+    	long interval = (mBundleTimestamps[samples - 1] - mBundleTimestamps[0]) / (samples - 1) / 10000;
+    	buffer.putShort(16, (short) Math.max(0, Math.min(0xFFFF, interval)));
+    	buffer.putShort(18, (short) 0);
+    	float[] last = { mBundle[0][0], mBundle[0][1], mBundle[0][2] };
+    	int position = 20;
+    	for (int i = 1; i < samples; ++i) {
+    		for (int axis = 0; axis < 3; ++axis, position += 2) {
+    			short delta = bundleDelta(last[axis], mBundle[i][axis]);
+    			buffer.putShort(position, delta);
+    			last[axis] += delta / BUNDLE_DELTA_SCALE;
+    		}
+    	}
+    	CRC32 sum = new CRC32();
+    	sum.update(buffer.array(), 0, length - 4);
+    	buffer.putInt(length - 4, (int) sum.getValue());
+    	return buffer.array();
+    }
+
+    /** kod modelu sterowania z ustawień */
+    private byte steeringModelCode() {
+    	SharedPreferences appPreferences = PreferenceManager.getDefaultSharedPreferences(this);
+    	return Byte.parseByte(appPreferences.getString("controlCode", "00"), 16);
+    }
+
+    private void sendMessage(byte kind, float[] values) {
+    	// the axes are swapped: the server's x is the phone's z
+    	sendFrame(encodeMessage(mLocked, kind, values[2], values[1], values[0]));
+    }
+
+    private byte[] encodeMessage(boolean locked, byte kind, float x, float y, float z) {
     		ByteBuffer pre_crc32_message_buffer = ByteBuffer.allocate(16);
     		// STOP/START
     		pre_crc32_message_buffer.position(0);
-    		if (mLocked == true)
+    		if (locked == true)
     			pre_crc32_message_buffer.put((byte)0x00);
     		else
     			pre_crc32_message_buffer.put((byte)0xff);
     		
     		// Steering model code
     		pre_crc32_message_buffer.position(1);
-    		SharedPreferences appPreferences = PreferenceManager.getDefaultSharedPreferences(this);        
-        	pre_crc32_message_buffer.put(Byte.parseByte(appPreferences.getString("controlCode", "00"), 16));
+        	pre_crc32_message_buffer.put(steeringModelCode());
+        	
+    		// message kind
+    		pre_crc32_message_buffer.put(kind);
         	
-    		// x,y,z values
-    		pre_crc32_message_buffer.putInt(4, Float.floatToRawIntBits(event.values[2]));
-    		pre_crc32_message_buffer.putInt(8, Float.floatToRawIntBits(event.values[1]));
-    		pre_crc32_message_buffer.putInt(12, Float.floatToRawIntBits(event.values[0]));
+    		// x,y,z values; the gyroscope axes are swapped the same way as the accelerometer's
+    		pre_crc32_message_buffer.putInt(4, Float.floatToRawIntBits(x));
+    		pre_crc32_message_buffer.putInt(8, Float.floatToRawIntBits(y));
+    		pre_crc32_message_buffer.putInt(12, Float.floatToRawIntBits(z));
     		
     		byte[] pre_crc32_message_bytes = pre_crc32_message_buffer.array();
     		
@@ -161,8 +337,10 @@ public class SeekurJrRCActivity
     		post_crc32_message_buffer.put(pre_crc32_message_bytes);
     		post_crc32_message_buffer.putInt(16, crc32_sum);
     		
-    		byte[] post_crc32_message_bytes = post_crc32_message_buffer.array(); 
+    		return post_crc32_message_buffer.array();
+    }
 
+    private void sendFrame(byte[] post_crc32_message_bytes) {
     		try {
     			if (robotSocket == null)
     				throw new IllegalStateException("socket object unitialized");
@@ -191,7 +369,6 @@ public class SeekurJrRCActivity
 				TextView upperText = (TextView) findViewById(R.id.upper_text);
 				upperText.setText("[ERROR] sending message: ".concat(e.getMessage()));
 			}
-    	}
     }
 
     public boolean onKey(DialogInterface dialog, int keyCode, KeyEvent event) {
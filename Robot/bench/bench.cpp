@@ -0,0 +1,578 @@
+/**
+ *
+ * Mikrobenchmarki ścieżki wiadomości: dekodowanie TCPMessage i paczki BundleMessage, CRC32, wszystkie kody modeli sterowania,
+ * oba filtry historii przy różnych długościach historii, fuzja z żyroskopem, interpolacja na rozproszonych punktach
+ * kontrolnych przy rosnącej liczbie punktów, zapis do rejestratora lotu, kontrola dopuszczenia ramek (odrzucenie
+ * ponad limit, tanie sprawdzenie poprawności), skrzynka komend dla cyklu ArRobot, odczyt konfiguracji na ramkę
+ * i wybór modelu w getSteeringModel.
+ * Opóźnienie i szum filtrów (a nie ich koszt) mierzy bench/fusion.cpp.
+ *
+ * Budowane przez "make bench" (z -O2 i liczeniem alokacji, alloc_tracker.hpp). Wynik: ns/op (minimum z kilku
+ * powtórzeń - najmniej zaszumiona miara) i alokacje/op. Wyniki można zapisać jako bazę (--save) i porównać z nią
+ * kolejny pomiar (--baseline), żeby każda optymalizacja miała pokrycie w liczbach.
+ *
+ *   bench [--filter tekst] [--min-time msec] [--repeat n] [--save plik] [--baseline plik]
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "message.hpp"
+#include "utils.hpp"
+#include "steering_model.hpp"
+#include "orientation_filter.hpp"
+#include "control_points.hpp"
+#include "alloc_tracker.hpp"
+#include "flight_recorder.hpp"
+#include "admission.hpp"
+#include "command_mailbox.hpp"
+
+using namespace SeekurJrRC::Core;
+using SeekurJrRC::Utils::AllocTracker;
+
+namespace {
+  /// wyniki trafiają tutaj, żeby kompilator nie wyrzucił mierzonego kodu
+  volatile float sink;
+
+  uint64_t nowNs()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+
+  /// jeden przypadek testowy; run(n) wykonuje mierzoną operację n razy
+  class Case {
+  public:
+    explicit Case(const std::string& name) : name_(name) {};
+    virtual ~Case() {};
+    /// przygotowanie przed każdym powtórzeniem (poza pomiarem)
+    virtual void setUp() {};
+    virtual void run(uint64_t iterations) = 0;
+    const std::string name_;
+  };
+
+  /// ramka w formacie z message.hpp (big endian + CRC32)
+  void buildFrame(uint8_t* buffer, uint8_t model_code, float x, float y, float z)
+  {
+    memset(buffer, 0, MESSAGE_LENGTH);
+    buffer[0] = 0xFF;
+    buffer[1] = model_code;
+    float values[3] = {x, y, z};
+    for (int i = 0; i < 3; ++i) {
+      uint32_t bits;
+      memcpy(&bits, &values[i], 4);
+      if (!SeekurJrRC::Utils::isSystemBigEndian())
+        SeekurJrRC::Utils::swapEndianness(bits);
+      memcpy(buffer + 4 + 4 * i, &bits, 4);
+    }
+    uint32_t crc = SeekurJrRC::Utils::getCrc32(buffer, MESSAGE_LENGTH - 4);
+    if (!SeekurJrRC::Utils::isSystemBigEndian())
+      SeekurJrRC::Utils::swapEndianness(crc);
+    memcpy(buffer + MESSAGE_LENGTH - 4, &crc, 4);
+  }
+
+  class DecodeCase : public Case {
+  public:
+    explicit DecodeCase(bool corrupt) : Case(corrupt ? "message/decode_bad_crc" : "message/decode"), corrupt_(corrupt) {
+      buildFrame(frame_, BILINEAR_SIMPLE_FILT_MODEL_CODE, 0.5, -1.5, 9.5);
+      if (corrupt_)
+        frame_[5] ^= 0x01;
+    };
+    void run(uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i) {
+        try {
+          TCPMessage message(frame_);
+          sink = message.x_;
+        }
+        catch (const char*) {
+          sink = 0;
+        }
+      }
+    }
+  private:
+    bool corrupt_;
+    uint8_t frame_[MESSAGE_LENGTH];
+  };
+
+  /// sprawdzenie poprawności bez wyjątku (TCPMessage::isValid) - tak serwer odrzuca śmieci
+  class ValidateCase : public Case {
+  public:
+    ValidateCase() : Case("message/validate_bad_crc") {
+      buildFrame(frame_, BILINEAR_SIMPLE_FILT_MODEL_CODE, 0.5, -1.5, 9.5);
+      frame_[5] ^= 0x01;
+    };
+    void run(uint64_t iterations) {
+      uint32_t valid = 0;
+      for (uint64_t i = 0; i < iterations; ++i)
+        valid += TCPMessage::isValid(frame_);
+      sink = (float)valid;
+    }
+  private:
+    uint8_t frame_[MESSAGE_LENGTH];
+  };
+
+  /// dekodowanie paczki 8 wskazań (BundleMessage z odtworzeniem wszystkich próbek) - do porównania z 8 x message/decode
+  class BundleDecodeCase : public Case {
+  public:
+    BundleDecodeCase() : Case("message/decode_bundle_8") {
+      float x[8], y[8], z[8];
+      for (int i = 0; i < 8; ++i) {
+        x[i] = 0.5f + 0.01f * i;
+        y[i] = -1.5f - 0.02f * i;
+        z[i] = 9.5f;
+      }
+      encodeBundle(true, BILINEAR_SIMPLE_FILT_MODEL_CODE, 8, 20000, x, y, z, frame_);
+    };
+    void run(uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i) {
+        BundleMessage message(frame_);
+        float x, y, z, sum = 0;
+        for (unsigned int k = 0; k < message.samples_; ++k) {
+          message.sample(k, x, y, z);
+          sum += x;
+        }
+        sink = sum;
+      }
+    }
+  private:
+    uint8_t frame_[MESSAGE_MAX_LENGTH];
+  };
+
+  /**
+   * Kontrola dopuszczenia ramki, razem z odczytem zegara: odrzucenie ramki ponad limit połączenia (koszt ramki
+   * z zalewu) albo przyjęcie przez wspólny limit (compare_exchange na ścieżce każdej przyjętej ramki).
+   */
+  class AdmissionCase : public Case {
+  public:
+    explicit AdmissionCase(bool shared) : Case(shared ? "admission/global_admit" : "admission/session_reject"), shared_(shared) {};
+    void run(uint64_t iterations) {
+      uint32_t admitted = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        const int64_t now = SeekurJrRC::Utils::monotonicNowNs();
+        // 1 Hz without burst rejects everything after the first frame; 1 GHz admits everything
+        if (shared_)
+          admitted += global_.admit(now, 1, 1000);
+        else
+          admitted += session_.admit(now, admissionPeriodNs(1), 1);
+      }
+      sink = (float)admitted;
+    }
+  private:
+    bool shared_;
+    TokenBucket session_;
+    SharedTokenBucket global_;
+  };
+
+  class CrcCase : public Case {
+  public:
+    CrcCase() : Case("utils/crc32_16B") {
+      for (int i = 0; i < MESSAGE_LENGTH; ++i)
+        data_[i] = (uint8_t)(i * 37);
+    };
+    void run(uint64_t iterations) {
+      uint32_t sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        data_[0] = (uint8_t)i;
+        sum += SeekurJrRC::Utils::getCrc32(data_, MESSAGE_LENGTH - 4);
+      }
+      sink = (float)sum;
+    }
+  private:
+    uint8_t data_[MESSAGE_LENGTH];
+  };
+
+  /// pełna ścieżka modelu dla jednego kodu: getSteeringModel + getSpeedValues, historia w stanie ustalonym
+  class ModelCase : public Case {
+  public:
+    ModelCase(uint8_t code, const std::string& name) : Case(name), code_(code), history_(historyCapacity(0)) {};
+    void setUp() {
+      // fill the history up to its steady-state length
+      for (int i = 0; i < 64; ++i)
+        getSteeringModel(code_, history_, Configuration::current(), 0.1f * (i % 7), 0.2f, 9.7f, storage_)->getSpeedValues();
+    }
+    void run(uint64_t iterations) {
+      float sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        SteeringModelBase* model = getSteeringModel(code_, history_, Configuration::current(), 0.1f * (i & 7), -0.3f, 9.6f, storage_);
+        sum += model->getSpeedValues().first;
+      }
+      sink = sum;
+    }
+  private:
+    uint8_t code_;
+    acc_history history_;
+    SteeringModelStorage storage_;
+  };
+
+  /// dostęp do chronionych filtrów modelu bazowego
+  class FilterProbe : public SteeringModelBase {
+  public:
+    FilterProbe(acc_history& history) : SteeringModelBase(history, Configuration::current(), 0, 0, 9.81f) {};
+    std::pair<float, float> getSpeedValues() { return std::make_pair(0.0f, 0.0f); }
+    acc_tuple simple() { return getCurrentValueFilteredSimple(); }
+    acc_tuple exponential() { return getCurrentValueFilteredExponential(); }
+  };
+
+  /// sam filtr przy historii o zadanej długości (niezależnie od [history] max_length)
+  class FilterCase : public Case {
+  public:
+    FilterCase(bool exponential, unsigned int length)
+      : Case(name(exponential, length)), exponential_(exponential), length_(length), history_(historyCapacity(length)), probe_(history_) {};
+    void setUp() {
+      // fresh samples, so that getHistory() drops nothing during the measurement
+      history_.clear();
+      for (unsigned int i = 0; i < length_; ++i) {
+        acc_tuple sample(0.1f * i, 0.2f, 9.7f);
+        gettimeofday(&sample.get<3>(), NULL);
+        history_.push_front(sample);
+      }
+    }
+    void run(uint64_t iterations) {
+      float sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i)
+        sum += (exponential_ ? probe_.exponential() : probe_.simple()).get<0>();
+      sink = sum;
+    }
+  private:
+    static std::string name(bool exponential, unsigned int length) {
+      std::ostringstream out;
+      out << "filter/" << (exponential ? "exponential" : "simple") << "/" << length;
+      return out.str();
+    }
+    bool exponential_;
+    unsigned int length_;
+    acc_history history_;
+    FilterProbe probe_;
+  };
+
+  /// para wiadomości żyroskop + akcelerometr w OrientationFilter
+  class FusionCase : public Case {
+  public:
+    explicit FusionCase(bool kalman) : Case(kalman ? "fusion/kalman" : "fusion/complementary"), config_(Configuration::current()) {
+      config_.fusion_kalman_ = kalman;
+    };
+    void run(uint64_t iterations) {
+      double t = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        t += 0.02;
+        filter_.gyroRates(0.01f * (i & 7), -0.02f, 0.03f, t, config_);
+        filter_.acceleration(0.1f * (i & 7), -0.3f, 9.6f, t, config_);
+      }
+      sink = filter_.phiRad();
+    }
+  private:
+    Config config_;
+    OrientationFilter filter_;
+  };
+
+  /// n losowych punktów kontrolnych w [-90, 90] x [-90, 90], wartości z gładkiej funkcji
+  std::vector<ControlPoint> randomControlPoints(unsigned int n)
+  {
+    std::vector<ControlPoint> points(n);
+    srand(n);
+    for (unsigned int i = 0; i < n; ++i) {
+      points[i].phi_ = 180.0f * rand() / RAND_MAX - 90;
+      points[i].theta_ = 180.0f * rand() / RAND_MAX - 90;
+      points[i].alpha_ = points[i].theta_ / 90;
+      points[i].beta_ = points[i].phi_ * points[i].theta_ / 8100;
+    }
+    return points;
+  }
+
+  /// interpolacja na n rozproszonych punktach: lokalna (ControlPointSet) albo, dla porównania, Shepard po wszystkich punktach
+  class ControlPointsCase : public Case {
+  public:
+    enum Method { SHEPARD, LOCAL_LINEAR, SHEPARD_ALL };
+    ControlPointsCase(Method method, unsigned int n)
+      : Case(name(method, n)), method_(method), points_(randomControlPoints(n)), set_(points_, 0) {};
+    void run(uint64_t iterations) {
+      float sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        // queries spread over the whole domain
+        const float phi = (float)((i * 37) % 180) - 89.5f;
+        const float theta = (float)((i * 101) % 180) - 89.5f;
+        if (method_ == SHEPARD)
+          sum += set_.shepard(phi, theta, 1.5).first;
+        else if (method_ == LOCAL_LINEAR)
+          sum += set_.localLinear(phi, theta).first;
+        else
+          sum += shepardAll(phi, theta, 1.5);
+      }
+      sink = sum;
+    }
+  private:
+    static std::string name(Method method, unsigned int n) {
+      static const char* names[] = {"shepard", "local_linear", "shepard_all_points"};
+      std::ostringstream out;
+      out << "control_points/" << names[method] << "/" << n;
+      return out.str();
+    }
+    /// jak dawny SteeringModelBase::shepard, tylko dla dowolnej liczby punktów
+    float shepardAll(float phi, float theta, float p) {
+      float weight_sum = 0;
+      float nominator = 0;
+      for (size_t i = 0; i < points_.size(); ++i) {
+        float weight = pow(sqrt(pow(phi - points_[i].phi_, 2) + pow(theta - points_[i].theta_, 2)), -p);
+        weight_sum += weight;
+        nominator += weight * points_[i].alpha_;
+      }
+      return nominator / weight_sum;
+    }
+    Method method_;
+    std::vector<ControlPoint> points_;
+    ControlPointSet set_;
+  };
+
+  /// koszt samego wyboru modelu: getSteeringModel vs bezpośrednie emplace tego samego modelu
+  class DispatchCase : public Case {
+  public:
+    DispatchCase(uint8_t code, bool direct, const std::string& name) : Case(name), code_(code), direct_(direct), history_(historyCapacity(0)) {};
+    void run(uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i) {
+        SteeringModelBase* model = direct_
+          ? storage_.emplace<Genetic2ExpFiltModel>(history_, Configuration::current(), 0.1f, 0.2f, 9.7f)
+          : getSteeringModel(code_, history_, Configuration::current(), 0.1f, 0.2f, 9.7f, storage_);
+        sink = (float)(size_t)model;
+      }
+    }
+  private:
+    uint8_t code_;
+    bool direct_;
+    acc_history history_;
+    SteeringModelStorage storage_;
+  };
+
+  /// koszt jednego zapisu do rejestratora lotu (na ścieżce wiadomości są trzy: ramka, orientacja, komenda)
+  class RecorderCase : public Case {
+  public:
+    RecorderCase() : Case("recorder/record") {};
+    void run(uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; ++i)
+        FlightRecorder::record(FLIGHT_COMMAND, 0, 0, i, 2.0f, 3.0f, 4.0f);
+    }
+  };
+
+  /// wystawienie komendy w skrzynce i jej odbiór (jak w cyklu ArRobot), na jednym wątku - koszt samych operacji atomowych
+  class MailboxCase : public Case {
+  public:
+    MailboxCase() : Case("mailbox/publish_take") {};
+    void run(uint64_t iterations) {
+      MotionCommand command;
+      command.stop_ = false;
+      command.published_ns_ = 0;
+      float sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        command.v_trans_ = command.omega_ = i;
+        mailbox_.publish(command);
+        if (mailbox_.take(command))
+          sum += command.v_trans_;
+      }
+      sink = sum;
+    }
+  private:
+    CommandMailbox mailbox_;
+  };
+
+  /// odczyt konfiguracji na ramkę: ConfigGuard (ścieżka ramki) vs snapshot() (ścieżki zimne)
+  class ConfigReadCase : public Case {
+  public:
+    explicit ConfigReadCase(bool guard) : Case(guard ? "config/guard" : "config/snapshot"), guard_(guard) {};
+    void run(uint64_t iterations) {
+      float sum = 0;
+      for (uint64_t i = 0; i < iterations; ++i) {
+        if (guard_) {
+          const ConfigGuard guard;
+          sum += guard.config().v_max_;
+        }
+        else
+          sum += Configuration::snapshot()->v_max_;
+      }
+      sink = sum;
+    }
+  private:
+    bool guard_;
+  };
+
+  struct Result {
+    double ns_per_op_;
+    double allocs_per_op_;
+  };
+
+  Result measure(Case& bench, uint64_t min_time_ns, int repeat)
+  {
+    // calibrate: double the iteration count until one run takes at least min_time_ns
+    uint64_t iterations = 1;
+    for (;;) {
+      bench.setUp();
+      uint64_t start = nowNs();
+      bench.run(iterations);
+      if (nowNs() - start >= min_time_ns || iterations >= (1ULL << 40))
+        break;
+      iterations *= 2;
+    }
+
+    Result result;
+    result.ns_per_op_ = 0;
+    result.allocs_per_op_ = 0;
+    for (int r = 0; r < repeat; ++r) {
+      bench.setUp();
+      uint64_t allocations = AllocTracker::threadAllocations();
+      uint64_t start = nowNs();
+      bench.run(iterations);
+      double ns_per_op = (double)(nowNs() - start) / iterations;
+      allocations = AllocTracker::threadAllocations() - allocations;
+      if (r == 0 || ns_per_op < result.ns_per_op_)
+        result.ns_per_op_ = ns_per_op;
+      result.allocs_per_op_ = (double)allocations / iterations;
+    }
+    return result;
+  }
+
+  /// plik bazy: w każdej linii "nazwa ns/op alokacje/op"
+  std::map<std::string, Result> readBaseline(const std::string& path)
+  {
+    std::map<std::string, Result> baseline;
+    std::ifstream in(path.c_str());
+    if (!in)
+      std::cerr << "Cannot read baseline " << path << std::endl;
+    std::string name;
+    Result result;
+    while (in >> name >> result.ns_per_op_ >> result.allocs_per_op_)
+      baseline[name] = result;
+    return baseline;
+  }
+
+  void usage(const char* program)
+  {
+    std::cerr << "usage: " << program << " [--filter text] [--min-time msec] [--repeat n] [--save file] [--baseline file]" << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::string filter, save_path, baseline_path;
+  long min_time_ms = 100;
+  int repeat = 5;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (arg == "--filter")
+      filter = argv[++i];
+    else if (arg == "--min-time")
+      min_time_ms = atol(argv[++i]);
+    else if (arg == "--repeat")
+      repeat = atoi(argv[++i]);
+    else if (arg == "--save")
+      save_path = argv[++i];
+    else if (arg == "--baseline")
+      baseline_path = argv[++i];
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (repeat < 1)
+    repeat = 1;
+
+  // codes 9-11 (genetic_1) are commented out in getSteeringModel and would only measure bilinear/none again,
+  // so they are left out; the fused codes 15-19 need a Driver (OrientationFilter) and are measured as fusion/* instead
+  static const char* model_names[15] = {
+    "bilinear/none", "bilinear/simple", "bilinear/exponential",
+    "shepard_1_5/none", "shepard_1_5/simple", "shepard_1_5/exponential",
+    "shepard_4_5/none", "shepard_4_5/simple", "shepard_4_5/exponential",
+    "genetic_1/none", "genetic_1/simple", "genetic_1/exponential",
+    "genetic_2/none", "genetic_2/simple", "genetic_2/exponential"
+  };
+  static const unsigned int filter_lengths[] = {1, 5, 20, 50, 100};
+  static const unsigned int control_point_counts[] = {9, 100, 1000, 10000};
+
+  std::vector<Case*> cases;
+  cases.push_back(new DecodeCase(false));
+  cases.push_back(new DecodeCase(true));
+  cases.push_back(new ValidateCase());
+  cases.push_back(new BundleDecodeCase());
+  cases.push_back(new CrcCase());
+  for (int code = 0; code < 15; ++code) {
+    if (!hasSteeringModel(code))
+      continue;
+    std::ostringstream name;
+    name << "model/" << code << "_" << model_names[code];
+    cases.push_back(new ModelCase(code, name.str()));
+  }
+  for (unsigned int i = 0; i < sizeof(filter_lengths) / sizeof(filter_lengths[0]); ++i) {
+    cases.push_back(new FilterCase(false, filter_lengths[i]));
+    cases.push_back(new FilterCase(true, filter_lengths[i]));
+  }
+  for (unsigned int i = 0; i < sizeof(control_point_counts) / sizeof(control_point_counts[0]); ++i) {
+    cases.push_back(new ControlPointsCase(ControlPointsCase::SHEPARD, control_point_counts[i]));
+    cases.push_back(new ControlPointsCase(ControlPointsCase::LOCAL_LINEAR, control_point_counts[i]));
+    cases.push_back(new ControlPointsCase(ControlPointsCase::SHEPARD_ALL, control_point_counts[i]));
+  }
+  cases.push_back(new FusionCase(false));
+  cases.push_back(new FusionCase(true));
+  // the last code walks the whole if-chain in getSteeringModel
+  // the recorder's ring is allocated by its service, as in the server
+  boost::asio::io_service ios;
+  boost::asio::use_service<FlightRecorder>(ios);
+  cases.push_back(new RecorderCase());
+  cases.push_back(new MailboxCase());
+  cases.push_back(new ConfigReadCase(true));
+  cases.push_back(new ConfigReadCase(false));
+  cases.push_back(new AdmissionCase(false));
+  cases.push_back(new AdmissionCase(true));
+  cases.push_back(new DispatchCase(GENETIC_2_EXP_FILT_MODEL_CODE, true, "dispatch/direct_emplace"));
+  cases.push_back(new DispatchCase(GENETIC_2_EXP_FILT_MODEL_CODE, false, "dispatch/getSteeringModel"));
+
+  std::map<std::string, Result> baseline;
+  if (!baseline_path.empty())
+    baseline = readBaseline(baseline_path);
+  std::ofstream save;
+  if (!save_path.empty())
+    save.open(save_path.c_str());
+
+  if (!AllocTracker::enabled())
+    std::cout << "(allocation counting not compiled in, allocs/op is always 0)" << std::endl;
+  std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op";
+  if (!baseline.empty())
+    std::cout << std::setw(12) << "base ns/op" << std::setw(10) << "change";
+  std::cout << std::endl;
+
+  for (unsigned int i = 0; i < cases.size(); ++i) {
+    Case& bench = *cases[i];
+    if (!filter.empty() && bench.name_.find(filter) == std::string::npos)
+      continue;
+    Result result = measure(bench, (uint64_t)min_time_ms * 1000000ULL, repeat);
+
+    std::cout << std::left << std::setw(40) << bench.name_ << std::right << std::fixed
+              << std::setw(12) << std::setprecision(1) << result.ns_per_op_
+              << std::setw(12) << std::setprecision(2) << result.allocs_per_op_;
+    std::map<std::string, Result>::const_iterator base = baseline.find(bench.name_);
+    if (base != baseline.end()) {
+      double change = 100.0 * (result.ns_per_op_ - base->second.ns_per_op_) / base->second.ns_per_op_;
+      std::cout << std::setw(12) << std::setprecision(1) << base->second.ns_per_op_
+                << std::setw(9) << std::showpos << change << "%" << std::noshowpos;
+      if (result.allocs_per_op_ > base->second.allocs_per_op_)
+        std::cout << "  more allocations!";
+    }
+    std::cout << std::endl;
+    if (save)
+      save << bench.name_ << " " << result.ns_per_op_ << " " << result.allocs_per_op_ << std::endl;
+  }
+
+  for (unsigned int i = 0; i < cases.size(); ++i)
+    delete cases[i];
+  return 0;
+}
@@ -0,0 +1,362 @@
+/**
+ *
+ * Dokładność i koszt jąder stałoprzecinkowych (fixed_point.hpp) względem ścieżki float, na której dotychczas
+ * liczą modele sterowania: normalizacja, kąty phi/theta, metoda Sheparda (p = 1.5 i 4.5), interpolacja dwuliniowa
+ * na domyślnej siatce punktów kontrolnych i filtry historii (SMA, EMA). Wzory float są przepisane z SteeringModelBase.
+ *
+ * Wejście to losowe wskazania akcelerometru (kierunek z całej sfery, długość 0.5-1.5 g). Dla każdego jądra: najgorsze
+ * i średnie odchylenie od float, dopuszczalne odchylenie (FIXED_MAX_* z fixed_point.hpp) oraz ns/op obu wersji.
+ * Blisko pionu (|theta| > 89 deg) kąt phi jest nieokreślony - takie próbki nie wchodzą do porównania kątów
+ * i interpolacji; tuż przy phi = +-180 deg (gdzie modele mają skok) nie jest porównywana interpolacja.
+ * Kod wyjścia 1, jeżeli któreś odchylenie przekracza dopuszczalne.
+ *
+ *   fixed_accuracy [--samples n] [--seed n]
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <time.h>
+
+#include "fixed_point.hpp"
+
+using namespace SeekurJrRC::Utils;
+
+namespace {
+  const float g = 9.81;
+  const double rad_to_deg = 57.2957795;
+  /// próbki bliżej pionu nie mają określonego phi
+  const float max_theta_deg = 89;
+  const int history_length = 10;
+  /// tyle od phi = +-180 deg interpolacja nie jest porównywana
+  const float seam_deg = 0.01;
+
+  /// domyślna siatka punktów kontrolnych (config.cpp)
+  const float grid_phi[9] =   { -90,    0,   90, -90,   0,  90, -90,   0,   90};
+  const float grid_theta[9] = { -90,  -90,  -90,   0,   0,   0,  90,  90,   90};
+  const float grid_a[9] =     {-0.5, -1.0, -0.5, 0.0, 0.0, 0.0, 0.5, 1.0,  0.5};
+  const float grid_b[9] =     {-0.5,    0,  0.5, 0.0, 0.0, 0.0, 0.5, 0.0, -0.5};
+  fixed_t fixed_grid_phi[9], fixed_grid_theta[9], fixed_grid_a[9], fixed_grid_b[9];
+
+  /// wyniki trafiają tutaj, żeby kompilator nie wyrzucił mierzonego kodu
+  volatile float sink;
+  volatile fixed_t fixed_sink;
+
+  uint64_t nowNs()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+
+  float uniform(float from, float to)
+  {
+    return from + (to - from) * rand() / (float)RAND_MAX;
+  }
+
+  struct Sample {
+    /// surowe wskazanie [m/s^2], po normalizacji (float) i po normalizacji stałoprzecinkowej (FIXED_UNIT_BITS)
+    float raw_[3];
+    float normalized_[3];
+    fixed_t fixed_[3];
+    /// kąty ścieżki float [deg]
+    float phi_, theta_;
+  };
+
+  // --- the float path, as in SteeringModelBase ---
+
+  void floatNormalize(const float* in, float* out)
+  {
+    float len = sqrt(in[0] * in[0] + in[1] * in[1] + in[2] * in[2]);
+    for (int i = 0; i < 3; ++i)
+      out[i] = in[i] / len;
+  }
+
+  void floatOrientation(const float* a, float& phi, float& theta)
+  {
+    float phi_r = atan2(a[1], a[2]);
+    phi = rad_to_deg * phi_r;
+    theta = rad_to_deg * -atan2(-a[0], a[1] * sin(phi_r) + a[2] * cos(phi_r));
+  }
+
+  float dist(float x1, float y1, float x2, float y2)
+  {
+    return sqrt(pow((x1 - x2), 2) + pow((y1 - y2), 2));
+  }
+
+  std::pair<float, float> floatShepard(float phi, float theta, float p)
+  {
+    float weight_sum = 0, nominator_a = 0, nominator_b = 0;
+    for (int i = 0; i < 9; ++i) {
+      float weight = pow(dist(phi, theta, grid_phi[i], grid_theta[i]), -p);
+      weight_sum += weight;
+      nominator_a += weight * grid_a[i];
+      nominator_b += weight * grid_b[i];
+    }
+    return std::make_pair(nominator_a / weight_sum, nominator_b / weight_sum);
+  }
+
+  /// indeksy rogów prostokąta siatki, w którym leży punkt (jak w SteeringModelBase::bilinear)
+  void quadrant(float phi, float theta, int& i_11, int& i_12, int& i_21, int& i_22)
+  {
+    if (phi >= 0) {
+      if (theta >= 0) { i_11 = 4; i_12 = 7; i_21 = 5; i_22 = 8; }
+      else { i_11 = 1; i_12 = 4; i_21 = 2; i_22 = 5; }
+    }
+    else {
+      if (theta >= 0) { i_11 = 3; i_12 = 6; i_21 = 4; i_22 = 7; }
+      else { i_11 = 0; i_12 = 3; i_21 = 1; i_22 = 4; }
+    }
+  }
+
+  std::pair<float, float> floatBilinear(float phi, float theta)
+  {
+    int i_11, i_12, i_21, i_22;
+    quadrant(phi, theta, i_11, i_12, i_21, i_22);
+    float dx = grid_phi[i_22] - grid_phi[i_11];
+    float dy = grid_theta[i_22] - grid_theta[i_11];
+    float f_R1_a = grid_a[i_11] * (grid_phi[i_22] - phi) / dx + grid_a[i_21] * (phi - grid_phi[i_11]) / dx;
+    float f_R1_b = grid_b[i_11] * (grid_phi[i_22] - phi) / dx + grid_b[i_21] * (phi - grid_phi[i_11]) / dx;
+    float f_R2_a = grid_a[i_12] * (grid_phi[i_22] - phi) / dx + grid_a[i_22] * (phi - grid_phi[i_11]) / dx;
+    float f_R2_b = grid_b[i_12] * (grid_phi[i_22] - phi) / dx + grid_b[i_22] * (phi - grid_phi[i_11]) / dx;
+    return std::make_pair(f_R1_a * (grid_theta[i_22] - theta) / dy + f_R2_a * (theta - grid_theta[i_11]) / dy,
+                          f_R1_b * (grid_theta[i_22] - theta) / dy + f_R2_b * (theta - grid_theta[i_11]) / dy);
+  }
+
+  /// SMA albo EMA n próbek od first (najnowsza pierwsza)
+  void floatAverage(const Sample* first, int n, bool exponential, float* out)
+  {
+    out[0] = out[1] = out[2] = 0;
+    const float alpha = 2.0 / (n + 1);
+    float denum = 0;
+    float coeff = exponential ? 1.0 / (1 - alpha) : 1;
+    for (int i = 0; i < n; ++i) {
+      if (exponential)
+        coeff *= (1 - alpha);
+      denum += coeff;
+      for (int k = 0; k < 3; ++k)
+        out[k] += coeff * first[i].normalized_[k];
+    }
+    for (int k = 0; k < 3; ++k)
+      out[k] /= denum;
+  }
+
+  // --- the fixed-point path ---
+
+  std::pair<fixed_t, fixed_t> fixedBilinearAt(fixed_t phi, fixed_t theta)
+  {
+    int i_11, i_12, i_21, i_22;
+    quadrant(toFloat(phi), toFloat(theta), i_11, i_12, i_21, i_22);
+    return fixedBilinear(phi, theta, fixed_grid_phi, fixed_grid_theta, fixed_grid_a, fixed_grid_b, i_11, i_12, i_21, i_22);
+  }
+
+  void fixedAverageOf(const Sample* first, int n, bool exponential, fixed_t* out)
+  {
+    FixedAverage average(exponential, n);
+    for (int i = 0; i < n; ++i)
+      average.add(first[i].fixed_[0], first[i].fixed_[1], first[i].fixed_[2]);
+    average.result(out[0], out[1], out[2]);
+  }
+
+  /// odchylenie jednego jądra
+  struct Error {
+    Error() : max_(0), sum_(0), count_(0) {};
+    void add(double error) {
+      error = fabs(error);
+      if (error > max_)
+        max_ = error;
+      sum_ += error;
+      ++count_;
+    }
+    double max_;
+    double sum_;
+    uint64_t count_;
+  };
+
+  /// różnica kątów z uwzględnieniem przejścia przez +-180 deg
+  double angleDiff(double a, double b)
+  {
+    double diff = fmod(a - b, 360.0);
+    if (diff > 180)
+      diff -= 360;
+    if (diff < -180)
+      diff += 360;
+    return diff;
+  }
+
+  bool report(const char* name, const Error& error, double bound, double float_ns, double fixed_ns)
+  {
+    const bool ok = error.max_ <= bound;
+    std::cout << std::left << std::setw(22) << name << std::right << std::scientific << std::setprecision(2)
+              << std::setw(11) << error.max_ << std::setw(11) << (error.count_ ? error.sum_ / error.count_ : 0)
+              << std::setw(11) << bound << std::fixed << std::setprecision(1)
+              << std::setw(10) << float_ns << std::setw(10) << fixed_ns
+              << (ok ? "" : "   EXCEEDED") << std::endl;
+    return ok;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned int samples = 200000;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--samples" && i + 1 < argc)
+      samples = atoi(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else {
+      std::cerr << "usage: fixed_accuracy [--samples n] [--seed n]" << std::endl;
+      return 2;
+    }
+  }
+  if (samples < (unsigned int)history_length)
+    samples = history_length;
+  srand(seed);
+  for (int i = 0; i < 9; ++i) {
+    fixed_grid_phi[i] = toFixed(grid_phi[i]);
+    fixed_grid_theta[i] = toFixed(grid_theta[i]);
+    fixed_grid_a[i] = toFixed(grid_a[i]);
+    fixed_grid_b[i] = toFixed(grid_b[i]);
+  }
+
+  std::vector<Sample> data(samples);
+  for (unsigned int i = 0; i < samples; ++i) {
+    Sample& s = data[i];
+    // uniform direction on the sphere, 0.5-1.5 g long
+    const float z = uniform(-1, 1), angle = uniform(-M_PI, M_PI), length = g * uniform(0.5, 1.5);
+    s.raw_[0] = length * sqrt(1 - z * z) * cos(angle);
+    s.raw_[1] = length * sqrt(1 - z * z) * sin(angle);
+    s.raw_[2] = length * z;
+    floatNormalize(s.raw_, s.normalized_);
+    for (int k = 0; k < 3; ++k)
+      s.fixed_[k] = toFixed(s.raw_[k], FIXED_RAW_BITS);
+    fixedNormalize(s.fixed_[0], s.fixed_[1], s.fixed_[2]);
+    floatOrientation(s.normalized_, s.phi_, s.theta_);
+  }
+
+  Error normalize_error, phi_error, theta_error, shepard15_error, shepard45_error, bilinear_error, sma_error, ema_error;
+  unsigned int near_vertical = 0, at_seam = 0;
+  for (unsigned int i = 0; i < samples; ++i) {
+    const Sample& s = data[i];
+    for (int k = 0; k < 3; ++k)
+      normalize_error.add(toFloat(s.fixed_[k], FIXED_UNIT_BITS) - s.normalized_[k]);
+    if (fabs(s.theta_) > max_theta_deg) {
+      ++near_vertical;
+      continue;
+    }
+    fixed_t phi, theta;
+    fixedOrientationDeg(s.fixed_[0], s.fixed_[1], s.fixed_[2], phi, theta);
+    phi_error.add(angleDiff(toFloat(phi), s.phi_));
+    theta_error.add(toFloat(theta) - s.theta_);
+    // the models jump at phi = +-180 deg; an angle error of 0.001 deg there is a different side of the jump
+    if (fabs(s.phi_) > 180 - seam_deg) {
+      ++at_seam;
+      continue;
+    }
+
+    // end to end: the fixed angles into the fixed interpolation against the float path
+    std::pair<float, float> f = floatShepard(s.phi_, s.theta_, 1.5);
+    std::pair<fixed_t, fixed_t> x = fixedShepard(phi, theta, fixed_grid_phi, fixed_grid_theta, fixed_grid_a, fixed_grid_b, 9, 3);
+    shepard15_error.add(toFloat(x.first) - f.first);
+    shepard15_error.add(toFloat(x.second) - f.second);
+    f = floatShepard(s.phi_, s.theta_, 4.5);
+    x = fixedShepard(phi, theta, fixed_grid_phi, fixed_grid_theta, fixed_grid_a, fixed_grid_b, 9, 9);
+    shepard45_error.add(toFloat(x.first) - f.first);
+    shepard45_error.add(toFloat(x.second) - f.second);
+    f = floatBilinear(s.phi_, s.theta_);
+    x = fixedBilinearAt(phi, theta);
+    bilinear_error.add(toFloat(x.first) - f.first);
+    bilinear_error.add(toFloat(x.second) - f.second);
+  }
+  for (unsigned int i = 0; i + history_length <= samples; i += history_length) {
+    float f[3];
+    fixed_t x[3];
+    floatAverage(&data[i], history_length, false, f);
+    fixedAverageOf(&data[i], history_length, false, x);
+    for (int k = 0; k < 3; ++k)
+      sma_error.add(toFloat(x[k], FIXED_UNIT_BITS) - f[k]);
+    floatAverage(&data[i], history_length, true, f);
+    fixedAverageOf(&data[i], history_length, true, x);
+    for (int k = 0; k < 3; ++k)
+      ema_error.add(toFloat(x[k], FIXED_UNIT_BITS) - f[k]);
+  }
+
+  // cost: the same inputs through both paths, ns per call
+  double float_ns[7], fixed_ns[7];
+  uint64_t start;
+  const double n = samples;
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) { float out[3]; floatNormalize(data[i].raw_, out); sink = out[0] + out[1] + out[2]; }
+  float_ns[0] = (nowNs() - start) / n;
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) {
+    fixed_t x = toFixed(data[i].raw_[0], FIXED_RAW_BITS), y = toFixed(data[i].raw_[1], FIXED_RAW_BITS),
+            z = toFixed(data[i].raw_[2], FIXED_RAW_BITS);
+    fixedNormalize(x, y, z);
+    fixed_sink = x + y + z;
+  }
+  fixed_ns[0] = (nowNs() - start) / n;
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) { float phi, theta; floatOrientation(data[i].normalized_, phi, theta); sink = phi + theta; }
+  float_ns[1] = (nowNs() - start) / n;
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) {
+    fixed_t phi, theta;
+    fixedOrientationDeg(data[i].fixed_[0], data[i].fixed_[1], data[i].fixed_[2], phi, theta);
+    fixed_sink = phi + theta;
+  }
+  fixed_ns[1] = (nowNs() - start) / n;
+  const float p[2] = {1.5, 4.5};
+  for (int j = 0; j < 2; ++j) {
+    start = nowNs();
+    for (unsigned int i = 0; i < samples; ++i) { std::pair<float, float> f = floatShepard(data[i].phi_, data[i].theta_, p[j]); sink = f.first + f.second; }
+    float_ns[2 + j] = (nowNs() - start) / n;
+    start = nowNs();
+    for (unsigned int i = 0; i < samples; ++i) {
+      std::pair<fixed_t, fixed_t> x = fixedShepard(toFixed(data[i].phi_), toFixed(data[i].theta_), fixed_grid_phi, fixed_grid_theta,
+                                                   fixed_grid_a, fixed_grid_b, 9, (unsigned int)(2 * p[j] + 0.5f));
+      fixed_sink = x.first + x.second;
+    }
+    fixed_ns[2 + j] = (nowNs() - start) / n;
+  }
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) { std::pair<float, float> f = floatBilinear(data[i].phi_, data[i].theta_); sink = f.first + f.second; }
+  float_ns[4] = (nowNs() - start) / n;
+  start = nowNs();
+  for (unsigned int i = 0; i < samples; ++i) {
+    std::pair<fixed_t, fixed_t> x = fixedBilinearAt(toFixed(data[i].phi_), toFixed(data[i].theta_));
+    fixed_sink = x.first + x.second;
+  }
+  fixed_ns[4] = (nowNs() - start) / n;
+  const double windows = samples / history_length;
+  for (int j = 0; j < 2; ++j) {
+    start = nowNs();
+    for (unsigned int i = 0; i + history_length <= samples; i += history_length) { float f[3]; floatAverage(&data[i], history_length, j, f); sink = f[0]; }
+    float_ns[5 + j] = (nowNs() - start) / windows;
+    start = nowNs();
+    for (unsigned int i = 0; i + history_length <= samples; i += history_length) { fixed_t x[3]; fixedAverageOf(&data[i], history_length, j, x); fixed_sink = x[0]; }
+    fixed_ns[5 + j] = (nowNs() - start) / windows;
+  }
+
+  std::cout << samples << " samples, " << near_vertical << " within " << 90 - max_theta_deg
+            << " deg of vertical left out of the angle and interpolation checks, " << at_seam << " within " << seam_deg
+            << " deg of phi = 180 out of the interpolation checks" << std::endl;
+  std::cout << std::left << std::setw(22) << "kernel" << std::right << std::setw(11) << "max err" << std::setw(11) << "mean err"
+            << std::setw(11) << "bound" << std::setw(10) << "float ns" << std::setw(10) << "fixed ns" << std::endl;
+  bool ok = true;
+  ok &= report("normalize", normalize_error, FIXED_MAX_NORMALIZED_ERROR, float_ns[0], fixed_ns[0]);
+  ok &= report("phi [deg]", phi_error, FIXED_MAX_ANGLE_ERROR_DEG, float_ns[1], fixed_ns[1]);
+  ok &= report("theta [deg]", theta_error, FIXED_MAX_ANGLE_ERROR_DEG, float_ns[1], fixed_ns[1]);
+  ok &= report("shepard p=1.5", shepard15_error, FIXED_MAX_INTERPOLATION_ERROR, float_ns[2], fixed_ns[2]);
+  ok &= report("shepard p=4.5", shepard45_error, FIXED_MAX_INTERPOLATION_ERROR, float_ns[3], fixed_ns[3]);
+  ok &= report("bilinear", bilinear_error, FIXED_MAX_INTERPOLATION_ERROR, float_ns[4], fixed_ns[4]);
+  ok &= report("history SMA (10)", sma_error, FIXED_MAX_NORMALIZED_ERROR, float_ns[5], fixed_ns[5]);
+  ok &= report("history EMA (10)", ema_error, FIXED_MAX_NORMALIZED_ERROR, float_ns[6], fixed_ns[6]);
+  return ok ? 0 : 1;
+}
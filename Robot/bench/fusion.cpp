@@ -0,0 +1,368 @@
+/**
+ *
+ * Opóźnienie i szum kątów phi/theta dla wszystkich sposobów filtrowania: bez filtra, średnie z historii
+ * (getCurrentValueFilteredSimple/Exponential, dokładnie kod serwera) i fuzja z żyroskopem (OrientationFilter)
+ * przy kilku nastawach.
+ *
+ * Wejście to nagranie wskazań telefonu: w każdej linii "t ax ay az gx gy gz [phi theta]" - czas [s], akcelerometr
+ * [m/s^2] i żyroskop [rad/s] w osiach wiadomości (jak wysyła je klient), opcjonalnie prawdziwe kąty [deg].
+ * Linie zaczynające się od # są pomijane. Bez --input nagranie jest generowane: operator przechyla telefon skokami
+ * do losowych kątów, akcelerometr ma szum i drgania ręki, żyroskop szum i stały dryf; --record zapisuje je do pliku.
+ *
+ * Odniesieniem są prawdziwe kąty, a jeżeli nagranie ich nie ma - krótka (5 próbek) średnia ruchoma z kątów
+ * akcelerometru, wyśrodkowana w czasie (bez opóźnienia, ale możliwa tylko offline; zostaje w niej część szumu). Opóźnienie to przesunięcie wyniku względem odniesienia,
+ * przy którym błąd jest najmniejszy; szum to błąd RMS przy tym przesunięciu, błąd - RMS bez przesunięcia.
+ *
+ *   fusion [--input plik] [--record plik] [--rate Hz] [--duration s] [--seed n]
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+#include "config.hpp"
+#include "steering_model.hpp"
+#include "orientation_filter.hpp"
+
+using namespace SeekurJrRC::Core;
+
+namespace {
+  const float g = 9.81;
+
+  struct Sample {
+    double t_;
+    float acc_[3];
+    float gyro_[3];
+    /// prawdziwe kąty [deg], jeżeli są znane
+    float truth_[2];
+  };
+
+  struct Recording {
+    std::vector<Sample> samples_;
+    bool has_truth_;
+  };
+
+  /// rozkład normalny (Box-Muller)
+  float gaussian(float sigma)
+  {
+    float u1 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    float u2 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    return sigma * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+  }
+
+  float uniform(float from, float to)
+  {
+    return from + (to - from) * rand() / (float)RAND_MAX;
+  }
+
+  /// wektor grawitacji o kątach (phi, theta) [rad]; odwrotność SteeringModelBase::getPhiRad/getThetaRad
+  void gravity(float phi, float theta, float* v)
+  {
+    v[0] = sin(theta);
+    v[1] = cos(theta) * sin(phi);
+    v[2] = cos(theta) * cos(phi);
+  }
+
+  /// ruch telefonu: przejścia (0.2-0.6 s, podniesiony kosinus) do losowych kątów, trzymanych przez 0.5-2 s
+  class Trajectory {
+  public:
+    explicit Trajectory(double duration) {
+      Segment segment;
+      segment.start_ = 0;
+      segment.from_[0] = segment.from_[1] = 0;
+      while (segment.start_ < duration) {
+        segment.ramp_ = uniform(0.2, 0.6);
+        segment.end_ = segment.start_ + segment.ramp_ + uniform(0.5, 2.0);
+        segment.to_[0] = uniform(-50, 50) / RAD_TO_DEG;
+        segment.to_[1] = uniform(-50, 50) / RAD_TO_DEG;
+        segments_.push_back(segment);
+        segment.start_ = segment.end_;
+        segment.from_[0] = segment.to_[0];
+        segment.from_[1] = segment.to_[1];
+      }
+    }
+    /// kąty (phi, theta) [rad] w chwili t
+    void angles(double t, float* angles) const {
+      unsigned int i = 0;
+      while (i + 1 < segments_.size() && segments_[i].end_ <= t)
+        ++i;
+      const Segment& s = segments_[i];
+      double progress = (t - s.start_) / s.ramp_;
+      double weight = progress <= 0 ? 0 : progress >= 1 ? 1 : 0.5 - 0.5 * cos(M_PI * progress);
+      for (int k = 0; k < 2; ++k)
+        angles[k] = s.from_[k] + weight * (s.to_[k] - s.from_[k]);
+    }
+  private:
+    struct Segment {
+      double start_, end_, ramp_;
+      float from_[2], to_[2];
+    };
+    std::vector<Segment> segments_;
+  };
+
+  Recording synthesize(double rate, double duration)
+  {
+    Trajectory trajectory(duration);
+    const float gyro_bias[3] = {0.03, -0.02, 0.015};
+    const float tremor_phase[3] = {0, 2.1, 4.2};
+    Recording recording;
+    recording.has_truth_ = true;
+    for (double t = 0; t < duration; t += 1.0 / rate) {
+      Sample sample;
+      sample.t_ = t;
+      float angles[2], before[2], after[2], v[3], v_before[3], v_after[3];
+      const double h = 1e-4;
+      trajectory.angles(t, angles);
+      trajectory.angles(t - h, before);
+      trajectory.angles(t + h, after);
+      gravity(angles[0], angles[1], v);
+      gravity(before[0], before[1], v_before);
+      gravity(after[0], after[1], v_after);
+      // the client's axes are left-handed (x and z swapped), so dv/dt = omega x v and omega = v x dv/dt,
+      // plus a slow turn about gravity that moves neither angle
+      float v_dot[3];
+      for (int k = 0; k < 3; ++k)
+        v_dot[k] = (v_after[k] - v_before[k]) / (2 * h);
+      const float yaw_rate = 0.3 * sin(0.5 * t);
+      float omega[3] = {
+        v[1] * v_dot[2] - v[2] * v_dot[1] + yaw_rate * v[0],
+        v[2] * v_dot[0] - v[0] * v_dot[2] + yaw_rate * v[1],
+        v[0] * v_dot[1] - v[1] * v_dot[0] + yaw_rate * v[2]
+      };
+      for (int k = 0; k < 3; ++k) {
+        // hand tremor (~9 Hz) and sensor noise on top of gravity
+        sample.acc_[k] = g * v[k] + 0.4 * sin(2 * M_PI * 9 * t + tremor_phase[k]) + gaussian(0.25);
+        sample.gyro_[k] = omega[k] + gyro_bias[k] + gaussian(0.03);
+      }
+      sample.truth_[0] = RAD_TO_DEG * angles[0];
+      sample.truth_[1] = RAD_TO_DEG * angles[1];
+      recording.samples_.push_back(sample);
+    }
+    return recording;
+  }
+
+  bool load(const std::string& path, Recording& recording)
+  {
+    std::ifstream in(path.c_str());
+    if (!in) {
+      std::cerr << "Cannot read " << path << std::endl;
+      return false;
+    }
+    recording.has_truth_ = true;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::istringstream fields(line);
+      Sample sample;
+      fields >> sample.t_ >> sample.acc_[0] >> sample.acc_[1] >> sample.acc_[2]
+             >> sample.gyro_[0] >> sample.gyro_[1] >> sample.gyro_[2];
+      if (!fields) {
+        std::cerr << path << ": bad line: " << line << std::endl;
+        return false;
+      }
+      if (!(fields >> sample.truth_[0] >> sample.truth_[1]))
+        recording.has_truth_ = false;
+      recording.samples_.push_back(sample);
+    }
+    return !recording.samples_.empty();
+  }
+
+  void save(const std::string& path, const Recording& recording)
+  {
+    std::ofstream out(path.c_str());
+    out << "# t ax ay az gx gy gz phi theta" << std::endl;
+    for (unsigned int i = 0; i < recording.samples_.size(); ++i) {
+      const Sample& s = recording.samples_[i];
+      out << s.t_ << " " << s.acc_[0] << " " << s.acc_[1] << " " << s.acc_[2] << " "
+          << s.gyro_[0] << " " << s.gyro_[1] << " " << s.gyro_[2] << " " << s.truth_[0] << " " << s.truth_[1] << std::endl;
+    }
+  }
+
+  /// kąty [deg] z akcelerometru po filtrze historii serwera; model konstruowany przy każdej próbce, jak w Driver'ze
+  class HistoryProbe : public SteeringModelBase {
+  public:
+    HistoryProbe(acc_history& history, const float* acc) : SteeringModelBase(history, Configuration::current(), acc[0], acc[1], acc[2]) {};
+    std::pair<float, float> getSpeedValues() { return std::make_pair(0.0f, 0.0f); }
+    void angles(int filter, float* angles) {
+      acc_tuple acc = filter == 0 ? current_acc_ : filter == 1 ? getCurrentValueFilteredSimple() : getCurrentValueFilteredExponential();
+      angles[0] = getPhiDeg(acc);
+      angles[1] = getThetaDeg(acc);
+    }
+  };
+
+  /// jeden sposób filtrowania: nazwa i kąty [deg] dla każdej próbki
+  struct Output {
+    std::string name_;
+    std::vector<float> angles_[2];
+  };
+
+  Output runHistory(const Recording& recording, int filter, const char* name)
+  {
+    Output output;
+    output.name_ = name;
+    acc_history history(historyCapacity(Configuration::current().max_history_length_));
+    for (unsigned int i = 0; i < recording.samples_.size(); ++i) {
+      HistoryProbe probe(history, recording.samples_[i].acc_);
+      float angles[2];
+      probe.angles(filter, angles);
+      output.angles_[0].push_back(angles[0]);
+      output.angles_[1].push_back(angles[1]);
+    }
+    return output;
+  }
+
+  Output runFusion(const Recording& recording, const Config& config, const std::string& name)
+  {
+    Output output;
+    output.name_ = name;
+    OrientationFilter filter;
+    for (unsigned int i = 0; i < recording.samples_.size(); ++i) {
+      const Sample& s = recording.samples_[i];
+      filter.gyroRates(s.gyro_[0], s.gyro_[1], s.gyro_[2], s.t_, config);
+      filter.acceleration(s.acc_[0], s.acc_[1], s.acc_[2], s.t_, config);
+      output.angles_[0].push_back(RAD_TO_DEG * filter.phiRad());
+      output.angles_[1].push_back(RAD_TO_DEG * filter.thetaRad());
+    }
+    return output;
+  }
+
+  /// odniesienie bez opóźnienia: prawdziwe kąty albo wyśrodkowana średnia ruchoma kątów akcelerometru (+-half próbek)
+  Output reference(const Recording& recording, const Output& raw, int half)
+  {
+    Output output;
+    output.name_ = "reference";
+    int n = recording.samples_.size();
+    for (int i = 0; i < n; ++i) {
+      for (int k = 0; k < 2; ++k) {
+        if (recording.has_truth_) {
+          output.angles_[k].push_back(recording.samples_[i].truth_[k]);
+          continue;
+        }
+        float sum = 0;
+        int count = 0;
+        for (int j = std::max(0, i - half); j <= std::min(n - 1, i + half); ++j, ++count)
+          sum += raw.angles_[k][j];
+        output.angles_[k].push_back(sum / count);
+      }
+    }
+    return output;
+  }
+
+  /// błąd RMS [deg] wyniku względem odniesienia przesuniętego o shift próbek w przód (oba kąty)
+  double rmsError(const Output& output, const Output& ref, int shift, int skip)
+  {
+    double sum = 0;
+    int count = 0;
+    for (unsigned int i = skip + shift; i < ref.angles_[0].size(); ++i, ++count)
+      for (int k = 0; k < 2; ++k) {
+        double e = output.angles_[k][i] - ref.angles_[k][i - shift];
+        sum += e * e;
+      }
+    return count ? sqrt(sum / (2 * count)) : 0;
+  }
+
+  void usage(const char* program)
+  {
+    std::cerr << "usage: " << program << " [--input file] [--record file] [--rate Hz] [--duration s] [--seed n]" << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::string input, record;
+  double rate = 50;
+  double duration = 120;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (arg == "--input")
+      input = argv[++i];
+    else if (arg == "--record")
+      record = argv[++i];
+    else if (arg == "--rate")
+      rate = atof(argv[++i]);
+    else if (arg == "--duration")
+      duration = atof(argv[++i]);
+    else if (arg == "--seed")
+      seed = atoi(argv[++i]);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  Recording recording;
+  if (!input.empty()) {
+    if (!load(input, recording))
+      return 1;
+  }
+  else {
+    srand(seed);
+    recording = synthesize(rate, duration);
+  }
+  if (!record.empty())
+    save(record, recording);
+
+  const unsigned int n = recording.samples_.size();
+  const double period = (recording.samples_[n - 1].t_ - recording.samples_[0].t_) / (n - 1);
+  std::cout << n << " samples, " << std::setprecision(3) << 1 / period << " Hz, reference: "
+            << (recording.has_truth_ ? "true angles" : "centred moving average") << std::endl;
+
+  std::vector<Output> outputs;
+  outputs.push_back(runHistory(recording, 0, "accelerometer only"));
+  outputs.push_back(runHistory(recording, 1, "history SMA"));
+  outputs.push_back(runHistory(recording, 2, "history EMA"));
+  static const float time_constants[] = {0.1, 0.25, 0.5, 1.0};
+  for (unsigned int i = 0; i < sizeof(time_constants) / sizeof(time_constants[0]); ++i) {
+    Config config(Configuration::current());
+    config.fusion_kalman_ = false;
+    config.fusion_time_constant_ = time_constants[i];
+    std::ostringstream name;
+    name << "complementary tau=" << time_constants[i];
+    outputs.push_back(runFusion(recording, config, name.str()));
+  }
+  static const float r_angles[] = {0.003, 0.03, 0.3};
+  for (unsigned int i = 0; i < sizeof(r_angles) / sizeof(r_angles[0]); ++i) {
+    Config config(Configuration::current());
+    config.fusion_kalman_ = true;
+    config.fusion_r_angle_ = r_angles[i];
+    std::ostringstream name;
+    name << "kalman r=" << r_angles[i];
+    outputs.push_back(runFusion(recording, config, name.str()));
+  }
+
+  // a short window: a longer one smears the steps and favours the history filters, which smear them the same way
+  const int half = 2;
+  Output ref = reference(recording, outputs[0], half);
+  // skip the start-up (history filling, filter settling) and leave room for the largest shift
+  const int max_shift = (int)(0.5 / period);
+  const int skip = (int)(2.0 / period);
+
+  std::cout << std::left << std::setw(28) << "filter" << std::right << std::setw(10) << "lag ms"
+            << std::setw(12) << "noise deg" << std::setw(12) << "error deg" << std::endl;
+  for (unsigned int i = 0; i < outputs.size(); ++i) {
+    int best_shift = 0;
+    double best = rmsError(outputs[i], ref, 0, skip);
+    for (int shift = 1; shift <= max_shift; ++shift) {
+      double error = rmsError(outputs[i], ref, shift, skip);
+      if (error < best) {
+        best = error;
+        best_shift = shift;
+      }
+    }
+    std::cout << std::left << std::setw(28) << outputs[i].name_ << std::right << std::fixed
+              << std::setw(10) << std::setprecision(0) << 1000 * best_shift * period
+              << std::setw(12) << std::setprecision(2) << best
+              << std::setw(12) << std::setprecision(2) << rmsError(outputs[i], ref, 0, skip) << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef ADMISSION_HPP_
+#define ADMISSION_HPP_
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Limit częstotliwości ramek w postaci GCRA (generic cell rate algorithm) - odpowiednik wiadra z żetonami,
+     * w którym cały stan to jedna liczba: teoretyczna chwila przyjścia następnej ramki (tat_). Ramka jest przyjmowana,
+     * jeżeli tat_ wyprzedza teraźniejszość o nie więcej niż (burst - 1) okresów; przyjęcie przesuwa tat_ o jeden okres.
+     *
+     * Parametry podaje się przy każdym wywołaniu, więc zmiana konfiguracji działa od następnej ramki.
+     * Wersja dla jednego wątku (połączenie żyje w wątku swojego robota).
+     */
+    class TokenBucket {
+    public:
+      TokenBucket() : tat_(0) {};
+
+      /**
+       * \param now_ns - CLOCK_MONOTONIC [ns]
+       * \param period_ns - odstęp między ramkami przy granicznej częstotliwości [ns]; 0 = bez limitu
+       * \param burst - ile ramek może przyjść naraz po przerwie (co najmniej 1)
+       */
+      bool admit(int64_t now_ns, int64_t period_ns, unsigned int burst) {
+        if (period_ns <= 0)
+          return true;
+        const int64_t tat = tat_ > now_ns ? tat_ : now_ns;
+        if (tat - now_ns > (int64_t)(burst ? burst - 1 : 0) * period_ns)
+          return false;
+        tat_ = tat + period_ns;
+        return true;
+      }
+
+    private:
+      int64_t tat_;
+    };
+
+    /**
+     *
+     * To samo co TokenBucket, ale wspólne dla wszystkich wątków floty: tat_ jest atomowe i przesuwane przez
+     * compare_exchange, bez blokad. Odrzucenie kosztuje tylko jeden odczyt atomowy.
+     */
+    class SharedTokenBucket {
+    public:
+      SharedTokenBucket() : tat_(0) {};
+
+      bool admit(int64_t now_ns, int64_t period_ns, unsigned int burst) {
+        if (period_ns <= 0)
+          return true;
+        const int64_t tolerance = (int64_t)(burst ? burst - 1 : 0) * period_ns;
+        int64_t old_tat = tat_.load(boost::memory_order_relaxed);
+        for (;;) {
+          const int64_t tat = old_tat > now_ns ? old_tat : now_ns;
+          if (tat - now_ns > tolerance)
+            return false;
+          // on failure old_tat is reloaded; another thread took a token meanwhile, try again with its value
+          if (tat_.compare_exchange_weak(old_tat, tat + period_ns, boost::memory_order_relaxed))
+            return true;
+        }
+      }
+
+    private:
+      boost::atomic<int64_t> tat_;
+    };
+
+    /// odstęp między ramkami [ns] dla częstotliwości [Hz]; 0 Hz = bez limitu (0)
+    inline int64_t admissionPeriodNs(unsigned int rate_hz)
+    {
+      return rate_hz ? 1000000000LL / rate_hz : 0;
+    }
+  }
+}
+
+#endif
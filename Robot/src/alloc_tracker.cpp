@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+
+#include <boost/atomic.hpp>
+
+#include "alloc_tracker.hpp"
+
+using SeekurJrRC::Utils::AllocTracker;
+
+#ifdef SEEKURJRRC_ALLOC_TRACKING
+
+// operator new/delete signatures differ between C++03 and C++11
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#define NO_THROW noexcept
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#define NO_THROW throw()
+#endif
+
+namespace {
+  __thread uint64_t thread_allocations = 0;
+  __thread uint64_t thread_messages = 0;
+  boost::atomic<uint64_t> steady_messages(0);
+  boost::atomic<uint64_t> steady_allocations(0);
+  boost::atomic<uint64_t> regressed_messages(0);
+
+  void* countedAllocate(std::size_t size)
+  {
+    ++thread_allocations;
+    void* pointer = malloc(size ? size : 1);
+    if (!pointer)
+      throw std::bad_alloc();
+    return pointer;
+  }
+}
+
+void* operator new(std::size_t size) THROW_BAD_ALLOC { return countedAllocate(size); }
+void* operator new[](std::size_t size) THROW_BAD_ALLOC { return countedAllocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) NO_THROW { ++thread_allocations; return malloc(size ? size : 1); }
+void* operator new[](std::size_t size, const std::nothrow_t&) NO_THROW { ++thread_allocations; return malloc(size ? size : 1); }
+void operator delete(void* pointer) NO_THROW { free(pointer); }
+void operator delete[](void* pointer) NO_THROW { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) NO_THROW { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) NO_THROW { free(pointer); }
+
+uint64_t AllocTracker::threadAllocations()
+{
+  return thread_allocations;
+}
+
+bool AllocTracker::enabled()
+{
+  return true;
+}
+
+void AllocTracker::endMessage(uint64_t begin)
+{
+  if (++thread_messages <= warmup_)
+    return;
+  uint64_t allocations = thread_allocations - begin;
+  steady_messages.fetch_add(1, boost::memory_order_relaxed);
+  if (allocations) {
+    steady_allocations.fetch_add(allocations, boost::memory_order_relaxed);
+    // report only the first regression, a flood of these would be useless
+    if (regressed_messages.fetch_add(1, boost::memory_order_relaxed) == 0)
+      std::cerr << "\rAllocation regression: " << allocations << " allocation(s) while handling message #" << thread_messages << std::endl;
+  }
+}
+
+bool AllocTracker::failed()
+{
+  return regressed_messages.load(boost::memory_order_relaxed) != 0;
+}
+
+void AllocTracker::report()
+{
+  std::cout << "Allocation tracking: " << steady_messages.load() << " messages after warm-up, "
+            << regressed_messages.load() << " of them allocated (" << steady_allocations.load() << " allocations)" << std::endl;
+}
+
+#else
+
+uint64_t AllocTracker::threadAllocations()
+{
+  return 0;
+}
+
+bool AllocTracker::enabled()
+{
+  return false;
+}
+
+void AllocTracker::endMessage(uint64_t /*begin*/)
+{
+}
+
+bool AllocTracker::failed()
+{
+  return false;
+}
+
+void AllocTracker::report()
+{
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef ALLOC_TRACKER_HPP_
+#define ALLOC_TRACKER_HPP_
+
+#include <stdint.h>
+
+namespace SeekurJrRC {
+  namespace Utils {
+
+    /**
+     *
+     * Licznik alokacji na stercie, do pilnowania, że ścieżka wiadomości w stanie ustalonym nic nie alokuje.
+     * Liczenie jest włączane w czasie kompilacji (make ALLOC_TRACKING=1, czyli -DSEEKURJRRC_ALLOC_TRACKING),
+     * które podmienia globalne operator new/delete; w zwykłym buildzie wszystkie metody są puste.
+     *
+     * Liczniki są per wątek, więc alokacje wątków ARIA czy innych wątków floty nie fałszują pomiaru.
+     * Jeżeli po rozgrzewce (pierwsze warmup_ wiadomości) jakakolwiek wiadomość zaalokuje pamięć, failed() zwraca true,
+     * a program kończy się kodem 1 - skrypt testowy (np. odtwarzający nagrany ruch) może na tej podstawie zgłosić regresję.
+     */
+    class AllocTracker {
+    public:
+      /// liczba alokacji wykonanych dotychczas przez wywołujący wątek
+      static uint64_t threadAllocations();
+      static bool enabled();
+
+      /// wywołane na początku obsługi wiadomości
+      static uint64_t beginMessage() { return threadAllocations(); }
+      /// wywołane na końcu; begin - wynik beginMessage()
+      static void endMessage(uint64_t begin);
+
+      /// czy wykryto alokację w stanie ustalonym
+      static bool failed();
+      /// podsumowanie na standardowe wyjście
+      static void report();
+
+      static const uint64_t warmup_ = 200;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef COMMAND_MAILBOX_HPP_
+#define COMMAND_MAILBOX_HPP_
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /// komenda dla firmware'u: prędkości [mm/s], [deg/s] albo zatrzymanie, z chwilą wystawienia (CLOCK_MONOTONIC) [ns]
+    struct MotionCommand {
+      float v_trans_;
+      float omega_;
+      bool stop_;
+      int64_t published_ns_;
+    };
+
+    /**
+     *
+     * Jednomiejscowa skrzynka na komendy pomiędzy wątkiem robota (Driver, jeden piszący) a cyklem ArRobot
+     * (jeden czytający). Potrójny bufor: piszący wypełnia swoją kopię i wymienia ją z środkową jedną operacją
+     * atomową, czytający - jeżeli środkowa jest nowa - wymienia z nią swoją. Obie strony bez blokad i bez czekania;
+     * nowsza komenda zastępuje nieodebraną, a każda odebrana jest odbierana dokładnie raz.
+     *
+     * Strona czytająca (take() i discard()) ma jedną kopię, front_, więc w danej chwili może działać tylko jeden
+     * czytający. Poza cyklem ArRobot skrzynkę wolno opróżnić tylko przez discard(), i tylko gdy cykl nie może
+     * równocześnie wołać take().
+     */
+    class CommandMailbox {
+    public:
+      CommandMailbox() : middle_(1), back_(0), front_(2), superseded_(0) {};
+
+      /// wołane tylko z wątku robota
+      void publish(const MotionCommand& command) {
+        slots_[back_] = command;
+        const uint8_t previous = middle_.exchange(back_ | fresh_, boost::memory_order_acq_rel);
+        // nobody took the previous one: the cycle only ever sees the newest
+        if (previous & fresh_)
+          superseded_.fetch_add(1, boost::memory_order_relaxed);
+        back_ = previous & ~fresh_;
+      }
+
+      /// wołane tylko z cyklu ArRobot; false, jeżeli od ostatniego odbioru nie przyszło nic nowego
+      bool take(MotionCommand& command) {
+        if (!(middle_.load(boost::memory_order_relaxed) & fresh_))
+          return false;
+        front_ = middle_.exchange(front_, boost::memory_order_acq_rel) & ~fresh_;
+        command = slots_[front_];
+        return true;
+      }
+
+      /**
+       * Porzuca nieodebraną komendę spoza cyklu ArRobot. Warunek: take() nie może działać równocześnie - cykl
+       * jest zatrzymany (przed runAsync()) albo wołający trzyma lock() robota, pod którym cykl wykonuje swoje
+       * zadania. Komenda wystawiona równocześnie przez publish() może przetrwać i zostać odebrana przez cykl.
+       */
+      void discard() {
+        if (middle_.load(boost::memory_order_relaxed) & fresh_)
+          front_ = middle_.exchange(front_, boost::memory_order_acq_rel) & ~fresh_;
+      }
+
+      /// nieodebrana komenda czeka w skrzynce
+      bool pending() const { return middle_.load(boost::memory_order_acquire) & fresh_; }
+      /// komendy zastąpione przez nowsze, zanim cykl je odebrał
+      uint64_t superseded() const { return superseded_.load(boost::memory_order_relaxed); }
+
+    private:
+      static const uint8_t fresh_ = 4;
+
+      MotionCommand slots_[3];
+      /// indeks środkowej kopii i bit fresh_ (nowa, jeszcze nieodebrana)
+      boost::atomic<uint8_t> middle_;
+      /// kopie piszącego i czytającego, każda używana tylko przez swoją stronę
+      uint8_t back_;
+      uint8_t front_;
+      boost::atomic<uint64_t> superseded_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include <cmath>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "command_shaper.hpp"
+#include "config.hpp"
+#include "utils.hpp"
+
+using SeekurJrRC::Core::CommandShaper;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigGuard;
+using SeekurJrRC::Core::makeCustomAllocHandler;
+using SeekurJrRC::Utils::monotonicNowNs;
+
+CommandShaper::CommandShaper(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend)
+  : robot_id_(robot_id), backend_(backend), timer_(ios), armed_(false),
+    sent_(false), stopped_(false), sent_v_trans_(0), sent_omega_(0), last_send_ns_(0),
+    has_pending_(false), pending_v_trans_(0), pending_omega_(0),
+    first_command_ns_(0), offered_commands_(0), offered_stops_(0), sent_commands_(0), sent_stops_(0),
+    suppressed_(0), merged_(0), refreshes_(0)
+{
+}
+
+bool CommandShaper::connect()
+{
+  return backend_->connect();
+}
+
+void CommandShaper::disconnect()
+{
+  boost::system::error_code ignored;
+  timer_.cancel(ignored);
+  armed_ = false;
+  has_pending_ = false;
+  sent_ = false;
+  backend_->disconnect();
+}
+
+bool CommandShaper::isConnected()
+{
+  return backend_->isConnected();
+}
+
+bool CommandShaper::areMotorsEnabled()
+{
+  return backend_->areMotorsEnabled();
+}
+
+unsigned int CommandShaper::cycleTimeMs()
+{
+  return backend_->cycleTimeMs();
+}
+
+void CommandShaper::setVelocities(float v_trans, float omega)
+{
+  if (!offered_commands_ && !offered_stops_)
+    first_command_ns_ = monotonicNowNs();
+  ++offered_commands_;
+  const Config& config = Configuration::current();
+  if (!config.shaper_enabled_) {
+    send(v_trans, omega);
+    return;
+  }
+
+  const bool stopping = (v_trans == 0 && omega == 0);
+  if (sent_ && fabs(v_trans - sent_v_trans_) <= config.shaper_min_delta_trans_
+      && fabs(omega - sent_omega_) <= config.shaper_min_delta_rot_ && !(stopping && !stopped_)) {
+    // the robot already has about this; a value still waiting for the cycle is out of date as well
+    has_pending_ = false;
+    ++suppressed_;
+    return;
+  }
+  // a stop does not wait, and neither does anything coming a whole cycle after the last command
+  if (stopping || !sent_ || monotonicNowNs() - last_send_ns_ >= 1000000LL * backend_->cycleTimeMs()) {
+    has_pending_ = false;
+    send(v_trans, omega);
+    schedule();
+    return;
+  }
+  if (has_pending_)
+    ++merged_;
+  has_pending_ = true;
+  pending_v_trans_ = v_trans;
+  pending_omega_ = omega;
+  schedule();
+}
+
+void CommandShaper::stop()
+{
+  if (!offered_commands_ && !offered_stops_)
+    first_command_ns_ = monotonicNowNs();
+  ++offered_stops_;
+  const Config& config = Configuration::current();
+  has_pending_ = false;
+  // the watchdog keeps stopping a stopped robot on every check; once per refresh_interval is enough
+  if (config.shaper_enabled_ && sent_ && stopped_
+      && monotonicNowNs() - last_send_ns_ < config.shaper_refresh_interval_ * 1000000LL) {
+    ++suppressed_;
+    return;
+  }
+  sendStop();
+}
+
+void CommandShaper::send(float v_trans, float omega)
+{
+  backend_->setVelocities(v_trans, omega);
+  sent_ = true;
+  stopped_ = (v_trans == 0 && omega == 0);
+  sent_v_trans_ = v_trans;
+  sent_omega_ = omega;
+  last_send_ns_ = monotonicNowNs();
+  ++sent_commands_;
+}
+
+void CommandShaper::sendStop()
+{
+  backend_->stop();
+  sent_ = true;
+  stopped_ = true;
+  sent_v_trans_ = 0;
+  sent_omega_ = 0;
+  last_send_ns_ = monotonicNowNs();
+  ++sent_stops_;
+}
+
+void CommandShaper::schedule()
+{
+  if (armed_ || !Configuration::current().shaper_enabled_)
+    return;
+  const int64_t now_ns = monotonicNowNs();
+  const int64_t cycle_ns = 1000000LL * backend_->cycleTimeMs();
+  int64_t due_ns;
+  if (has_pending_)
+    due_ns = last_send_ns_ + cycle_ns;
+  // a moving robot is looked at once per cycle, for the refresh
+  else if (sent_ && !stopped_)
+    due_ns = now_ns + cycle_ns;
+  else
+    return;
+  armed_ = true;
+  // rounded up: woken a fraction of a microsecond early, flush() would find the cycle not over and wait 0 again
+  timer_.expires_from_now(boost::posix_time::microseconds(due_ns > now_ns ? (due_ns - now_ns + 999) / 1000 : 0));
+  timer_.async_wait(
+    makeCustomAllocHandler(
+      handler_memory_,
+      boost::bind(
+        &CommandShaper::flush,
+        this,
+        boost::asio::placeholders::error
+      )
+    )
+  );
+}
+
+void CommandShaper::flush(const boost::system::error_code& error)
+{
+  if (error)
+    return;
+  armed_ = false;
+  const ConfigGuard guard;
+  const Config& config = guard.config();
+  const int64_t since_send_ns = monotonicNowNs() - last_send_ns_;
+
+  if (has_pending_) {
+    // otherwise a stop went out in the meantime: a whole cycle from it
+    if (since_send_ns >= 1000000LL * backend_->cycleTimeMs()) {
+      has_pending_ = false;
+      send(pending_v_trans_, pending_omega_);
+    }
+    schedule();
+    return;
+  }
+  // nothing new: a stopped robot needs nothing, a moving one a refresh now and then
+  if (!sent_ || stopped_)
+    return;
+  if (since_send_ns >= config.shaper_refresh_interval_ * 1000000LL) {
+    ++refreshes_;
+    send(sent_v_trans_, sent_omega_);
+  }
+  schedule();
+}
+
+void CommandShaper::printStats(std::ostream& out) const
+{
+  out << "Robot " << robot_id_ << " link: ";
+  if (!offered_commands_ && !offered_stops_) {
+    out << "no commands";
+    return;
+  }
+  const double seconds = (monotonicNowNs() - first_command_ns_) / 1e9;
+  // 8N1: ten bits on the wire per byte
+  const double capacity = Configuration::current().shaper_link_baud_ / 10.0;
+  const double offered_rate = (offered_commands_ * SHAPER_VELOCITY_BYTES + offered_stops_ * SHAPER_STOP_BYTES) / std::max(seconds, 1e-3);
+  const double sent_rate = (sent_commands_ * SHAPER_VELOCITY_BYTES + sent_stops_ * SHAPER_STOP_BYTES) / std::max(seconds, 1e-3);
+  out << offered_commands_ << " commands and " << offered_stops_ << " stops offered (" << offered_rate << " B/s, "
+      << 100 * offered_rate / capacity << "% of the link), " << sent_commands_ << " and " << sent_stops_ << " sent ("
+      << sent_rate << " B/s, " << 100 * sent_rate / capacity << "%); " << suppressed_ << " suppressed, "
+      << merged_ << " merged, " << refreshes_ << " refreshes";
+}
@@ -0,0 +1,83 @@
+#ifndef COMMAND_SHAPER_HPP_
+#define COMMAND_SHAPER_HPP_
+
+#include <ostream>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+
+#include "robot_backend.hpp"
+#include "handler_allocator.hpp"
+#include "virtual_timer.hpp"
+
+/// bajty na łączu szeregowym: pakiety ARIA VEL i ROTATE (po 9 bajtów z nagłówkiem i sumą kontrolną) oraz STOP
+#define SHAPER_VELOCITY_BYTES 18
+#define SHAPER_STOP_BYTES 6
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Kształtowanie komend na łączu szeregowym robota ([shaper]), pomiędzy Driver'em (i ControlLoop) a backend'em.
+     * Prędkości postępowa i obrotowa są jednym stanem oczekującym, a robot dostaje:
+     *   - zmianę tylko wtedy, gdy różni się od ostatnio wysłanej o co najmniej min_delta_trans / min_delta_rot,
+     *   - najwyżej jedną komendę na cykl robota; nowsze wartości z tego samego cyklu zastępują oczekującą,
+     *   - zatrzymanie (stop() albo zerowe prędkości) od razu, bez czekania na cykl,
+     *   - powtórzenie ostatniej komendy co refresh_interval, żeby nie zatrzymał go watchdog firmware'u.
+     * Przy wyłączonym kształtowaniu komendy przechodzą bez zmian, ale są liczone, więc w obu przypadkach na koniec
+     * wypisujemy obciążenie łącza: ile komend przyszło, ile zostało wysłanych, i jaka to część przepustowości.
+     * Wszystko z wątku robota; setVelocities() i stop() wołane wewnątrz ConfigGuard'a (ramka, takt pętli, watchdog).
+     */
+    class CommandShaper : public RobotBackend {
+    public:
+      CommandShaper(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend);
+      bool connect();
+      /// porzuca stan oczekujący; po ponownym połączeniu pierwsza komenda idzie bez względu na próg
+      void disconnect();
+      bool isConnected();
+      bool areMotorsEnabled();
+      void setVelocities(float v_trans, float omega);
+      void stop();
+      unsigned int cycleTimeMs();
+
+      /// statystyki łącza (Driver::shutdown)
+      void printStats(std::ostream& out) const;
+
+    private:
+      void send(float v_trans, float omega);
+      void sendStop();
+      /// następne sprawdzenie po cyklu robota od ostatniej komendy
+      void schedule();
+      void flush(const boost::system::error_code& error);
+
+      uint32_t robot_id_;
+      RobotBackend* backend_;
+      SeekurJrRC::Utils::Timer timer_;
+      HandlerMemory handler_memory_;
+      bool armed_;
+
+      /// ostatnio wysłany stan; sent_ == false przed pierwszą komendą (i po rozłączeniu)
+      bool sent_;
+      bool stopped_;
+      float sent_v_trans_;
+      float sent_omega_;
+      int64_t last_send_ns_;
+      bool has_pending_;
+      float pending_v_trans_;
+      float pending_omega_;
+
+      /// statystyki
+      int64_t first_command_ns_;
+      uint64_t offered_commands_;
+      uint64_t offered_stops_;
+      uint64_t sent_commands_;
+      uint64_t sent_stops_;
+      uint64_t suppressed_;
+      uint64_t merged_;
+      uint64_t refreshes_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,486 @@
+#include <iostream>
+#include <sstream>
+#include <csignal>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#include <sched.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+#include "config.hpp"
+#include "control_points.hpp"
+#include "steering_model.hpp"
+#include "message.hpp"
+#include "utils.hpp"
+
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+
+boost::asio::io_service::id Configuration::id;
+
+namespace {
+  /// defaults_ is static: its ConfigPtr must never delete it
+  struct NoDelete {
+    void operator()(const Config*) const {}
+  };
+}
+
+// kolejność ma znaczenie: defaults_ musi być zainicjalizowane przed current_
+const Config Configuration::defaults_;
+boost::atomic<const Config*> Configuration::current_(&Configuration::defaults_);
+ConfigPtr Configuration::owner_(&Configuration::defaults_, NoDelete());
+boost::atomic<uint64_t> Configuration::epoch_(1);
+Configuration::ReaderSlot Configuration::reader_slots_[CONFIG_READER_SLOTS];
+boost::atomic<unsigned int> Configuration::reader_slots_used_(0);
+Configuration::ReaderSlot Configuration::overflow_slot_;
+boost::atomic<unsigned int> Configuration::overflow_readers_(0);
+__thread Configuration::ReaderSlot* Configuration::reader_slot_ = NULL;
+__thread unsigned int Configuration::reader_depth_ = 0;
+std::deque<Configuration::Retired> Configuration::retired_;
+std::string Configuration::path_(DEFAULT_CONFIG_PATH);
+
+namespace {
+  const float default_c_arr_phi[CONTROL_POINTS_COUNT] =   { -90,    0,   90, -90,   0,  90, -90,   0,   90};
+  const float default_c_arr_theta[CONTROL_POINTS_COUNT] = { -90,  -90,  -90,   0,   0,   0,  90,  90,   90};
+  const float default_c_arr_z_a[CONTROL_POINTS_COUNT] =   {-0.5, -1.0, -0.5, 0.0, 0.0, 0.0, 0.5, 1.0,  0.5};
+  const float default_c_arr_z_b[CONTROL_POINTS_COUNT] =   {-0.5,    0,  0.5, 0.0, 0.0, 0.0, 0.5, 0.0, -0.5};
+
+  /// wczytuje listę CONTROL_POINTS_COUNT liczb oddzielonych spacjami; jeżeli klucza nie ma, zostawia tablicę bez zmian
+  void readTable(const boost::property_tree::ptree& tree, const std::string& key, float* table)
+  {
+    boost::optional<std::string> value = tree.get_optional<std::string>(key);
+    if (!value)
+      return;
+    std::istringstream stream(*value);
+    float parsed[CONTROL_POINTS_COUNT];
+    for (int i = 0; i < CONTROL_POINTS_COUNT; ++i) {
+      if (!(stream >> parsed[i]))
+        throw std::runtime_error(key + ": expected 9 numbers");
+    }
+    std::copy(parsed, parsed + CONTROL_POINTS_COUNT, table);
+  }
+
+  /// wczytuje listę liczb całkowitych oddzielonych spacjami; jeżeli klucza nie ma, zostawia listę bez zmian
+  void readList(const boost::property_tree::ptree& tree, const std::string& key, std::vector<int>& list)
+  {
+    boost::optional<std::string> value = tree.get_optional<std::string>(key);
+    if (!value)
+      return;
+    std::istringstream stream(*value);
+    std::vector<int> parsed;
+    int item;
+    while (stream >> item)
+      parsed.push_back(item);
+    if (!stream.eof())
+      throw std::runtime_error(key + ": expected a list of integers");
+    list.swap(parsed);
+  }
+
+  /// wczytuje listę robotów floty; robot bez własnej sekcji [robot_<id>] dostaje
+  /// backend fleet.default_backend i port base_port + pozycja na liście
+  void readRobots(const boost::property_tree::ptree& tree, unsigned short base_port, std::vector<SeekurJrRC::Core::RobotConfig>& robots)
+  {
+    std::istringstream ids(tree.get<std::string>("fleet.robots", "0"));
+    std::string default_backend = tree.get<std::string>("fleet.default_backend", "aria");
+    robots.clear();
+    uint32_t id;
+    while (ids >> id) {
+      std::ostringstream section;
+      section << "robot_" << id << ".";
+      SeekurJrRC::Core::RobotConfig robot;
+      robot.id_ = id;
+      robot.backend_ = tree.get<std::string>(section.str() + "backend", default_backend);
+      robot.port_ = tree.get<unsigned short>(section.str() + "port", base_port + robots.size());
+      robot.aria_args_ = tree.get<std::string>(section.str() + "aria_args", "");
+      robot.connect_delay_ = tree.get<long>(section.str() + "connect_delay", 0);
+      robot.connect_failures_ = tree.get<unsigned int>(section.str() + "connect_failures", 0);
+      robot.link_lifetime_ = tree.get<long>(section.str() + "link_lifetime", 0);
+      if (robot.backend_ != "aria" && robot.backend_ != "simulated")
+        throw std::runtime_error(section.str() + "backend: expected aria or simulated");
+      robots.push_back(robot);
+    }
+    if (!ids.eof())
+      throw std::runtime_error("fleet.robots: expected a list of robot ids");
+    if (robots.empty())
+      throw std::runtime_error("fleet.robots: at least one robot is required");
+  }
+}
+
+Config::Config()
+  : v_max_(1200),
+    wheelbase_divisor_(20.0),
+    control_points_radius_(0),
+    max_history_length_(20),
+    max_history_time_(1000),
+    fusion_kalman_(false),
+    fusion_time_constant_(0.25),
+    fusion_q_angle_(0.001),
+    fusion_q_bias_(0.003),
+    fusion_r_angle_(0.03),
+    fusion_gyro_timeout_(200),
+    stop_motors_timeout_(300),
+    stop_motors_check_interval_(50),
+    control_rate_hz_(0),
+    control_extrapolation_(100),
+    control_max_accel_(2000),
+    control_max_rot_accel_(200),
+    shaper_enabled_(false),
+    shaper_min_delta_trans_(5),
+    shaper_min_delta_rot_(0.5),
+    shaper_refresh_interval_(500),
+    shaper_link_baud_(9600),
+    conn_port_(1024),
+    max_sessions_(16),
+    idle_timeout_(5000),
+    coroutine_read_loop_(true),
+    io_uring_backend_(false),
+    admission_session_rate_(250),
+    admission_session_burst_(50),
+    admission_global_rate_(2000),
+    admission_global_burst_(200),
+    admission_flood_close_(5000),
+    rate_advice_enabled_(true),
+    rate_max_hz_(100),
+    rate_min_hz_(10),
+    rate_oversample_(2.0f),
+    rate_target_load_(0.5f),
+    rate_interval_(1000),
+    realtime_enabled_(false),
+    realtime_control_priority_(80),
+    realtime_driver_priority_(70),
+    realtime_lock_memory_(true),
+    realtime_prefault_stack_(512),
+    realtime_prefault_heap_(8192),
+    fleet_threads_(0),
+    fleet_port_(0),
+    connect_retry_min_(500),
+    connect_retry_max_(10000),
+    shm_enabled_(false),
+    shm_prefix_("/seekurjrrc_robot_"),
+    shm_poll_interval_(1000),
+    recorder_enabled_(true),
+    recorder_capacity_(65536),
+    recorder_prefix_("flight-"),
+    recorder_dump_on_watchdog_(true),
+    recorder_max_dumps_(8),
+    trace_enabled_(false),
+    trace_capacity_(16384),
+    trace_sample_every_(100),
+    trace_slow_threshold_(5000),
+    trace_prefix_("trace-"),
+    telemetry_port_(0),
+    telemetry_rate_hz_(20),
+    telemetry_max_observers_(64),
+    shadow_enabled_(false),
+    shadow_capacity_(256),
+    shadow_poll_interval_(10),
+    shadow_report_interval_(0),
+    simulation_enabled_(false),
+    simulation_duration_(3600),
+    simulation_seed_(1),
+    simulation_rate_hz_(50),
+    simulation_jitter_(5),
+    simulation_model_(BILINEAR_SIMPLE_FILT_MODEL_CODE),
+    simulation_drive_time_(20000),
+    simulation_pause_time_(3000),
+    simulation_bundle_(1)
+{
+  std::copy(default_c_arr_phi, default_c_arr_phi + CONTROL_POINTS_COUNT, c_arr_phi_);
+  std::copy(default_c_arr_theta, default_c_arr_theta + CONTROL_POINTS_COUNT, c_arr_theta_);
+  std::copy(default_c_arr_z_a, default_c_arr_z_a + CONTROL_POINTS_COUNT, c_arr_z_a_);
+  std::copy(default_c_arr_z_b, default_c_arr_z_b + CONTROL_POINTS_COUNT, c_arr_z_b_);
+  updateFixedPoints();
+
+  RobotConfig robot;
+  robot.id_ = 0;
+  robot.backend_ = "aria";
+  robot.port_ = conn_port_;
+  robot.connect_delay_ = 0;
+  robot.connect_failures_ = 0;
+  robot.link_lifetime_ = 0;
+  robots_.push_back(robot);
+}
+
+void Config::updateFixedPoints()
+{
+  for (int i = 0; i < CONTROL_POINTS_COUNT; ++i) {
+    c_fixed_phi_[i] = SeekurJrRC::Utils::toFixed(c_arr_phi_[i]);
+    c_fixed_theta_[i] = SeekurJrRC::Utils::toFixed(c_arr_theta_[i]);
+    c_fixed_z_a_[i] = SeekurJrRC::Utils::toFixed(c_arr_z_a_[i]);
+    c_fixed_z_b_[i] = SeekurJrRC::Utils::toFixed(c_arr_z_b_[i]);
+  }
+}
+
+Configuration::Configuration(boost::asio::io_service& ios) : service(ios), signals_(ios, SIGHUP)
+{
+  scheduleSignalWait();
+}
+
+void Configuration::shutdown_service()
+{
+  boost::system::error_code ignored;
+  signals_.cancel(ignored);
+}
+
+void Configuration::scheduleSignalWait()
+{
+  signals_.async_wait(
+    boost::bind(
+      &Configuration::handleSignal,
+      this,
+      boost::asio::placeholders::error,
+      boost::asio::placeholders::signal_number
+    )
+  );
+}
+
+void Configuration::handleSignal(const boost::system::error_code& error, int signal_number)
+{
+  if (error)
+    return;
+  std::cout << "\rSignal " << signal_number << " (SIGHUP) received, reloading " << path_ << std::endl;
+  reload();
+  scheduleSignalWait();
+}
+
+bool Configuration::load(const std::string& path)
+{
+  path_ = path;
+  // start from the defaults, so that a file may override only a subset of the parameters
+  Config* snapshot = new Config(defaults_);
+  try {
+    boost::property_tree::ptree tree;
+    boost::property_tree::ini_parser::read_ini(path, tree);
+
+    snapshot->v_max_ = tree.get<float>("steering.v_max", snapshot->v_max_);
+    snapshot->wheelbase_divisor_ = tree.get<float>("steering.wheelbase_divisor", snapshot->wheelbase_divisor_);
+    readTable(tree, "steering.control_points_phi", snapshot->c_arr_phi_);
+    readTable(tree, "steering.control_points_theta", snapshot->c_arr_theta_);
+    readTable(tree, "steering.control_points_alpha", snapshot->c_arr_z_a_);
+    readTable(tree, "steering.control_points_beta", snapshot->c_arr_z_b_);
+    snapshot->updateFixedPoints();
+    snapshot->control_points_file_ = tree.get<std::string>("steering.control_points_file", snapshot->control_points_file_);
+    snapshot->control_points_radius_ = tree.get<float>("steering.neighbor_radius", snapshot->control_points_radius_);
+    if (!snapshot->control_points_file_.empty()) {
+      // re-read on every reload, so that a new calibration needs only a SIGHUP
+      snapshot->control_points_.reset(ControlPointSet::load(snapshot->control_points_file_, snapshot->control_points_radius_));
+      std::cout << "\r" << snapshot->control_points_->size() << " control points from " << snapshot->control_points_file_
+                << ", neighbor radius " << snapshot->control_points_->radius() << " deg" << std::endl;
+    }
+
+    snapshot->max_history_length_ = tree.get<unsigned int>("history.max_length", snapshot->max_history_length_);
+    snapshot->max_history_time_ = tree.get<unsigned int>("history.max_time", snapshot->max_history_time_);
+
+    std::string fusion = tree.get<std::string>("fusion.filter", snapshot->fusion_kalman_ ? "kalman" : "complementary");
+    if (fusion != "complementary" && fusion != "kalman")
+      throw std::runtime_error("fusion.filter: expected complementary or kalman");
+    snapshot->fusion_kalman_ = (fusion == "kalman");
+    snapshot->fusion_time_constant_ = tree.get<float>("fusion.time_constant", snapshot->fusion_time_constant_);
+    snapshot->fusion_q_angle_ = tree.get<float>("fusion.kalman_q_angle", snapshot->fusion_q_angle_);
+    snapshot->fusion_q_bias_ = tree.get<float>("fusion.kalman_q_bias", snapshot->fusion_q_bias_);
+    snapshot->fusion_r_angle_ = tree.get<float>("fusion.kalman_r_angle", snapshot->fusion_r_angle_);
+    snapshot->fusion_gyro_timeout_ = tree.get<long>("fusion.gyro_timeout", snapshot->fusion_gyro_timeout_);
+
+    snapshot->stop_motors_timeout_ = tree.get<long>("watchdog.timeout", snapshot->stop_motors_timeout_);
+    snapshot->stop_motors_check_interval_ = tree.get<long>("watchdog.check_interval", snapshot->stop_motors_check_interval_);
+
+    snapshot->control_rate_hz_ = tree.get<unsigned int>("control.rate_hz", snapshot->control_rate_hz_);
+    snapshot->control_extrapolation_ = tree.get<long>("control.extrapolation", snapshot->control_extrapolation_);
+    snapshot->control_max_accel_ = tree.get<float>("control.max_accel", snapshot->control_max_accel_);
+    snapshot->control_max_rot_accel_ = tree.get<float>("control.max_rot_accel", snapshot->control_max_rot_accel_);
+    if (snapshot->control_rate_hz_ > 1000 || snapshot->control_extrapolation_ < 0)
+      throw std::runtime_error("control: rate_hz must be between 0 (off) and 1000 and extrapolation must not be negative");
+
+    snapshot->shaper_enabled_ = tree.get<bool>("shaper.enabled", snapshot->shaper_enabled_);
+    snapshot->shaper_min_delta_trans_ = tree.get<float>("shaper.min_delta_trans", snapshot->shaper_min_delta_trans_);
+    snapshot->shaper_min_delta_rot_ = tree.get<float>("shaper.min_delta_rot", snapshot->shaper_min_delta_rot_);
+    snapshot->shaper_refresh_interval_ = tree.get<long>("shaper.refresh_interval", snapshot->shaper_refresh_interval_);
+    snapshot->shaper_link_baud_ = tree.get<unsigned int>("shaper.link_baud", snapshot->shaper_link_baud_);
+    if (snapshot->shaper_min_delta_trans_ < 0 || snapshot->shaper_min_delta_rot_ < 0
+        || snapshot->shaper_refresh_interval_ <= 0 || snapshot->shaper_link_baud_ == 0)
+      throw std::runtime_error("shaper: expected non-negative thresholds, a positive refresh_interval and link_baud");
+
+    snapshot->conn_port_ = tree.get<unsigned short>("server.port", snapshot->conn_port_);
+    snapshot->max_sessions_ = tree.get<unsigned int>("server.max_sessions", snapshot->max_sessions_);
+    snapshot->idle_timeout_ = tree.get<long>("server.idle_timeout", snapshot->idle_timeout_);
+    std::string read_loop = tree.get<std::string>("server.read_loop", snapshot->coroutine_read_loop_ ? "coroutine" : "callback");
+    if (read_loop != "coroutine" && read_loop != "callback")
+      throw std::runtime_error("server.read_loop: expected coroutine or callback");
+    snapshot->coroutine_read_loop_ = (read_loop == "coroutine");
+    std::string backend = tree.get<std::string>("server.backend", snapshot->io_uring_backend_ ? "io_uring" : "epoll");
+    if (backend != "epoll" && backend != "io_uring")
+      throw std::runtime_error("server.backend: expected epoll or io_uring");
+    snapshot->io_uring_backend_ = (backend == "io_uring");
+
+    snapshot->admission_session_rate_ = tree.get<unsigned int>("admission.session_rate", snapshot->admission_session_rate_);
+    snapshot->admission_session_burst_ = tree.get<unsigned int>("admission.session_burst", snapshot->admission_session_burst_);
+    snapshot->admission_global_rate_ = tree.get<unsigned int>("admission.global_rate", snapshot->admission_global_rate_);
+    snapshot->admission_global_burst_ = tree.get<unsigned int>("admission.global_burst", snapshot->admission_global_burst_);
+    snapshot->admission_flood_close_ = tree.get<unsigned int>("admission.flood_close", snapshot->admission_flood_close_);
+    if (snapshot->admission_session_burst_ < 1 || snapshot->admission_global_burst_ < 1)
+      throw std::runtime_error("admission: session_burst and global_burst must be at least 1");
+    if (snapshot->admission_session_rate_ > 1000000000 || snapshot->admission_global_rate_ > 1000000000)
+      throw std::runtime_error("admission: rate must be at most 10^9 Hz");
+
+    snapshot->rate_advice_enabled_ = tree.get<bool>("rate.enabled", snapshot->rate_advice_enabled_);
+    snapshot->rate_max_hz_ = tree.get<unsigned int>("rate.max_hz", snapshot->rate_max_hz_);
+    snapshot->rate_min_hz_ = tree.get<unsigned int>("rate.min_hz", snapshot->rate_min_hz_);
+    snapshot->rate_oversample_ = tree.get<float>("rate.oversample", snapshot->rate_oversample_);
+    snapshot->rate_target_load_ = tree.get<float>("rate.target_load", snapshot->rate_target_load_);
+    snapshot->rate_interval_ = tree.get<long>("rate.interval", snapshot->rate_interval_);
+    if (snapshot->rate_min_hz_ < 1 || snapshot->rate_min_hz_ > snapshot->rate_max_hz_ || snapshot->rate_max_hz_ > 1000000)
+      throw std::runtime_error("rate: expected 1 <= min_hz <= max_hz <= 10^6");
+    if (snapshot->rate_oversample_ <= 0 || snapshot->rate_target_load_ <= 0 || snapshot->rate_target_load_ > 1 || snapshot->rate_interval_ <= 0)
+      throw std::runtime_error("rate: oversample and interval must be positive, target_load in (0, 1]");
+
+    snapshot->realtime_enabled_ = tree.get<bool>("realtime.enabled", snapshot->realtime_enabled_);
+    readList(tree, "realtime.control_cpus", snapshot->realtime_control_cpus_);
+    snapshot->realtime_control_priority_ = tree.get<int>("realtime.control_priority", snapshot->realtime_control_priority_);
+    readList(tree, "realtime.driver_cpus", snapshot->realtime_driver_cpus_);
+    snapshot->realtime_driver_priority_ = tree.get<int>("realtime.driver_priority", snapshot->realtime_driver_priority_);
+    snapshot->realtime_lock_memory_ = tree.get<bool>("realtime.lock_memory", snapshot->realtime_lock_memory_);
+    snapshot->realtime_prefault_stack_ = tree.get<unsigned int>("realtime.prefault_stack", snapshot->realtime_prefault_stack_);
+    snapshot->realtime_prefault_heap_ = tree.get<unsigned int>("realtime.prefault_heap", snapshot->realtime_prefault_heap_);
+    // CPU_SET outside of a cpu_set_t is undefined behaviour
+    const std::vector<int>* cpu_lists[] = { &snapshot->realtime_control_cpus_, &snapshot->realtime_driver_cpus_ };
+    for (unsigned int list = 0; list < 2; ++list)
+      for (unsigned int i = 0; i < cpu_lists[list]->size(); ++i)
+        if ((*cpu_lists[list])[i] < 0 || (*cpu_lists[list])[i] >= CPU_SETSIZE)
+          throw std::runtime_error("realtime: control_cpus and driver_cpus must be CPU numbers between 0 and CPU_SETSIZE - 1");
+
+    snapshot->fleet_threads_ = tree.get<unsigned int>("fleet.threads", snapshot->fleet_threads_);
+    snapshot->fleet_port_ = tree.get<unsigned short>("fleet.handshake_port", snapshot->fleet_port_);
+    snapshot->connect_retry_min_ = tree.get<long>("fleet.connect_retry_min", snapshot->connect_retry_min_);
+    snapshot->connect_retry_max_ = tree.get<long>("fleet.connect_retry_max", snapshot->connect_retry_max_);
+    if (snapshot->connect_retry_min_ < 1 || snapshot->connect_retry_max_ < snapshot->connect_retry_min_)
+      throw std::runtime_error("fleet: expected 1 <= connect_retry_min <= connect_retry_max");
+    readRobots(tree, snapshot->conn_port_, snapshot->robots_);
+
+    snapshot->shm_enabled_ = tree.get<bool>("shm.enabled", snapshot->shm_enabled_);
+    snapshot->shm_prefix_ = tree.get<std::string>("shm.prefix", snapshot->shm_prefix_);
+    snapshot->shm_poll_interval_ = tree.get<long>("shm.poll_interval", snapshot->shm_poll_interval_);
+
+    snapshot->recorder_enabled_ = tree.get<bool>("recorder.enabled", snapshot->recorder_enabled_);
+    snapshot->recorder_capacity_ = tree.get<unsigned int>("recorder.capacity", snapshot->recorder_capacity_);
+    snapshot->recorder_prefix_ = tree.get<std::string>("recorder.prefix", snapshot->recorder_prefix_);
+    snapshot->recorder_dump_on_watchdog_ = tree.get<bool>("recorder.dump_on_watchdog", snapshot->recorder_dump_on_watchdog_);
+    snapshot->recorder_max_dumps_ = tree.get<unsigned int>("recorder.max_dumps", snapshot->recorder_max_dumps_);
+
+    snapshot->trace_enabled_ = tree.get<bool>("trace.enabled", snapshot->trace_enabled_);
+    snapshot->trace_capacity_ = tree.get<unsigned int>("trace.capacity", snapshot->trace_capacity_);
+    snapshot->trace_sample_every_ = tree.get<unsigned int>("trace.sample_every", snapshot->trace_sample_every_);
+    snapshot->trace_slow_threshold_ = tree.get<long>("trace.slow_threshold", snapshot->trace_slow_threshold_);
+    snapshot->trace_prefix_ = tree.get<std::string>("trace.prefix", snapshot->trace_prefix_);
+    if (snapshot->trace_capacity_ == 0 || snapshot->trace_capacity_ > (1u << 24) || snapshot->trace_slow_threshold_ < 0)
+      throw std::runtime_error("trace: capacity must be between 1 and 16777216 and slow_threshold not negative");
+
+    snapshot->telemetry_port_ = tree.get<unsigned short>("telemetry.port", snapshot->telemetry_port_);
+    snapshot->telemetry_rate_hz_ = tree.get<unsigned int>("telemetry.rate_hz", snapshot->telemetry_rate_hz_);
+    snapshot->telemetry_max_observers_ = tree.get<unsigned int>("telemetry.max_observers", snapshot->telemetry_max_observers_);
+
+    snapshot->shadow_enabled_ = tree.get<bool>("shadow.enabled", snapshot->shadow_enabled_);
+    readList(tree, "shadow.models", snapshot->shadow_models_);
+    snapshot->shadow_capacity_ = tree.get<unsigned int>("shadow.capacity", snapshot->shadow_capacity_);
+    snapshot->shadow_poll_interval_ = tree.get<long>("shadow.poll_interval", snapshot->shadow_poll_interval_);
+    snapshot->shadow_report_interval_ = tree.get<long>("shadow.report_interval", snapshot->shadow_report_interval_);
+    for (unsigned int i = 0; i < snapshot->shadow_models_.size(); ++i)
+      if (snapshot->shadow_models_[i] < 0 || snapshot->shadow_models_[i] > GENETIC_2_FUSED_MODEL_CODE)
+        throw std::runtime_error("shadow.models: expected model codes 0-19");
+    if (snapshot->shadow_capacity_ == 0 || snapshot->shadow_capacity_ > 65536 || snapshot->shadow_poll_interval_ <= 0)
+      throw std::runtime_error("shadow: capacity must be between 1 and 65536 and poll_interval positive");
+
+    snapshot->simulation_enabled_ = tree.get<bool>("simulation.enabled", snapshot->simulation_enabled_);
+    snapshot->simulation_duration_ = tree.get<long>("simulation.duration", snapshot->simulation_duration_);
+    snapshot->simulation_replay_ = tree.get<std::string>("simulation.replay", snapshot->simulation_replay_);
+    snapshot->simulation_seed_ = tree.get<unsigned int>("simulation.seed", snapshot->simulation_seed_);
+    snapshot->simulation_rate_hz_ = tree.get<unsigned int>("simulation.rate_hz", snapshot->simulation_rate_hz_);
+    snapshot->simulation_jitter_ = tree.get<long>("simulation.jitter", snapshot->simulation_jitter_);
+    snapshot->simulation_model_ = tree.get<int>("simulation.model", snapshot->simulation_model_);
+    snapshot->simulation_drive_time_ = tree.get<long>("simulation.drive_time", snapshot->simulation_drive_time_);
+    snapshot->simulation_pause_time_ = tree.get<long>("simulation.pause_time", snapshot->simulation_pause_time_);
+    snapshot->simulation_bundle_ = tree.get<unsigned int>("simulation.bundle", snapshot->simulation_bundle_);
+    if (snapshot->simulation_duration_ < 0 || (snapshot->simulation_duration_ == 0 && snapshot->simulation_replay_.empty()))
+      throw std::runtime_error("simulation.duration must be positive (or 0 with simulation.replay)");
+    if (snapshot->simulation_rate_hz_ == 0 || snapshot->simulation_rate_hz_ > 1000
+        || snapshot->simulation_jitter_ < 0 || snapshot->simulation_jitter_ * snapshot->simulation_rate_hz_ >= 500)
+      throw std::runtime_error("simulation: rate_hz must be between 1 and 1000 and jitter below half of the frame interval");
+    if (snapshot->simulation_model_ < 0 || snapshot->simulation_model_ > GENETIC_2_FUSED_MODEL_CODE
+        || snapshot->simulation_drive_time_ <= 0 || snapshot->simulation_pause_time_ < 0)
+      throw std::runtime_error("simulation: expected a model code 0-19, a positive drive_time and a non-negative pause_time");
+    if (snapshot->simulation_bundle_ == 0 || snapshot->simulation_bundle_ > BUNDLE_MAX_SAMPLES)
+      throw std::runtime_error("simulation.bundle must be between 1 and 16");
+
+    if (snapshot->wheelbase_divisor_ == 0 || snapshot->stop_motors_check_interval_ <= 0)
+      throw std::runtime_error("wheelbase_divisor and check_interval must be positive");
+    if (snapshot->fusion_time_constant_ < 0 || snapshot->fusion_r_angle_ <= 0)
+      throw std::runtime_error("fusion.time_constant must not be negative and fusion.kalman_r_angle must be positive");
+    if (snapshot->recorder_capacity_ == 0 || snapshot->recorder_capacity_ > (1u << 24))
+      throw std::runtime_error("recorder.capacity must be between 1 and 16777216");
+    if (snapshot->recorder_max_dumps_ == 0)
+      throw std::runtime_error("recorder.max_dumps must be positive");
+    if (snapshot->telemetry_rate_hz_ == 0 || snapshot->telemetry_rate_hz_ > 1000)
+      throw std::runtime_error("telemetry.rate_hz must be between 1 and 1000");
+  } catch (const std::exception& e) {
+    std::cerr << "Loading configuration from " << path << ": " << e.what() << ". Keeping previous configuration." << std::endl;
+    delete snapshot;
+    return false;
+  }
+
+  publish(snapshot);
+  return true;
+}
+
+bool Configuration::reload()
+{
+  return load(path_);
+}
+
+void Configuration::claimReaderSlot()
+{
+  // a slot is never given back: reader threads (shards, shadow, ingress) live as long as the process
+  // seq_cst: a reclaim() that does not see this slot yet comes before the reader's first load of current_
+  const unsigned int slot = reader_slots_used_.fetch_add(1, boost::memory_order_seq_cst);
+  if (slot < CONFIG_READER_SLOTS)
+    reader_slot_ = &reader_slots_[slot];
+  else
+    reader_slot_ = &overflow_slot_;
+}
+
+void Configuration::publish(const Config* snapshot)
+{
+  ConfigPtr owner(snapshot);
+  ConfigPtr previous = boost::atomic_exchange(&owner_, owner);
+  current_.store(snapshot, boost::memory_order_seq_cst);
+  // a reader announcing this epoch or a later one loads current_ after the store above, so never sees previous
+  const uint64_t epoch = epoch_.fetch_add(1, boost::memory_order_seq_cst) + 1;
+
+  Retired retired;
+  retired.snapshot_ = previous;
+  retired.epoch_ = epoch;
+  retired.retired_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+  retired_.push_back(retired);
+  reclaim();
+}
+
+void Configuration::reclaim()
+{
+  // the oldest epoch any ConfigGuard is reading in; a snapshot retired after it may still be in use
+  uint64_t oldest_reader = overflow_readers_.load(boost::memory_order_seq_cst) ? 0 : std::numeric_limits<uint64_t>::max();
+  const unsigned int slots = std::min(reader_slots_used_.load(boost::memory_order_seq_cst), (unsigned int)CONFIG_READER_SLOTS);
+  for (unsigned int i = 0; i < slots; ++i) {
+    const uint64_t epoch = reader_slots_[i].epoch_.load(boost::memory_order_seq_cst);
+    if (epoch)
+      oldest_reader = std::min(oldest_reader, epoch);
+  }
+  // retired_ is ordered by epoch and time; whoever took a snapshot() keeps it alive as long as needed
+  const int64_t now_ns = SeekurJrRC::Utils::monotonicNowNs();
+  while (!retired_.empty() && retired_.front().epoch_ <= oldest_reader
+         && now_ns - retired_.front().retired_ns_ >= retire_grace_ms_ * 1000000LL)
+    retired_.pop_front();
+}
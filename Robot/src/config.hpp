@@ -0,0 +1,352 @@
+#ifndef CONFIG_HPP_
+#define CONFIG_HPP_
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "fixed_point.hpp"
+
+#define CONTROL_POINTS_COUNT 9
+#define DEFAULT_CONFIG_PATH "server.ini"
+/// liczba wątków, które mogą czytać konfigurację przez ConfigGuard bez dzielenia licznika (główny, floty, cień...)
+#define CONFIG_READER_SLOTS 64
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    class ControlPointSet;
+
+    /**
+     *
+     * Opis jednego robota floty: identyfikator (z wiadomości powitalnej), rodzaj backendu
+     * ("aria" albo "simulated"), port, na którym nasłuchuje jego serwer (0 = tylko przez port floty)
+     * i dodatkowe argumenty dla ARIA.
+     */
+    struct RobotConfig {
+      uint32_t id_;
+      std::string backend_;
+      unsigned short port_;
+      std::string aria_args_;
+      /// tylko robot symulowany - udawanie łącza szeregowego: czas nawiązania połączenia [msec], liczba pierwszych
+      /// nieudanych prób i czas, po którym łącze się zrywa [msec] (0 = nigdy)
+      long connect_delay_;
+      unsigned int connect_failures_;
+      long link_lifetime_;
+    };
+
+    /**
+     *
+     * Niezmienna (po opublikowaniu) migawka wszystkich parametrów, które dotychczas były stałymi w kodzie.
+     * Konstruktor domyślny ustawia wartości, które były zaszyte w kodzie, więc brak pliku konfiguracyjnego
+     * oznacza dokładnie dotychczasowe zachowanie programu.
+     */
+    struct Config {
+      Config();
+
+      /// maksymalna prędkość kół [mm/s] (dawniej V_MAX)
+      float v_max_;
+      /// dzielnik przeliczający różnicę prędkości kół na prędkość obrotową (dawniej 20.0 w Driver::processMessage)
+      float wheelbase_divisor_;
+
+      /// punkty kontrolne interpolacji (dawniej SteeringModelBase::c_arr_*)
+      float c_arr_phi_[CONTROL_POINTS_COUNT];
+      float c_arr_theta_[CONTROL_POINTS_COUNT];
+      float c_arr_z_a_[CONTROL_POINTS_COUNT];
+      float c_arr_z_b_[CONTROL_POINTS_COUNT];
+      /// te same punkty w Q16.16 dla jąder stałoprzecinkowych (SEEKURJRRC_FIXED_POINT); uzupełniane przez updateFixedPoints()
+      SeekurJrRC::Utils::fixed_t c_fixed_phi_[CONTROL_POINTS_COUNT];
+      SeekurJrRC::Utils::fixed_t c_fixed_theta_[CONTROL_POINTS_COUNT];
+      SeekurJrRC::Utils::fixed_t c_fixed_z_a_[CONTROL_POINTS_COUNT];
+      SeekurJrRC::Utils::fixed_t c_fixed_z_b_[CONTROL_POINTS_COUNT];
+      void updateFixedPoints();
+      /// rozproszone punkty kontrolne z pliku ([steering] control_points_file), wczytywane przy każdym przeładowaniu;
+      /// jeżeli są, modele Sheparda i dwuliniowe liczą lokalnie na nich zamiast na siatce c_arr_*.
+      /// Promień sąsiedztwa [deg]; 0 = dobierany automatycznie do gęstości punktów
+      std::string control_points_file_;
+      float control_points_radius_;
+      boost::shared_ptr<const ControlPointSet> control_points_;
+
+      /// maksymalna liczba elementów historii wskazań akcelerometru
+      unsigned int max_history_length_;
+      /// maksymalny wiek elementów historii [msec]
+      unsigned int max_history_time_;
+
+      /// fuzja akcelerometru z żyroskopem (OrientationFilter): filtr Kalmana (true) albo komplementarny; stała czasowa
+      /// filtra komplementarnego [s]; wariancje szumu procesu (kąt, dryf żyroskopu) i pomiaru kąta filtra Kalmana [rad^2];
+      /// czas, po którym ostatnie prędkości z żyroskopu przestają być całkowane [msec]
+      bool fusion_kalman_;
+      float fusion_time_constant_;
+      float fusion_q_angle_;
+      float fusion_q_bias_;
+      float fusion_r_angle_;
+      long fusion_gyro_timeout_;
+
+      /// timeout na zatrzymanie silników [msec]
+      long stop_motors_timeout_;
+      /// odstęp czasowy kolejnych wywołań watchdog'a [msec]
+      long stop_motors_check_interval_;
+
+      /// częstotliwość pętli sterowania [Hz]; 0 = komenda do robota przy każdej wiadomości (jak dotychczas). Czytana przy starcie.
+      unsigned int control_rate_hz_;
+      /// maksymalny czas ekstrapolacji przy spóźnionych wiadomościach [msec]
+      long control_extrapolation_;
+      /// ograniczenie zmiany prędkości postępowej [mm/s^2] i obrotowej [deg/s^2]; 0 = bez ograniczenia
+      float control_max_accel_;
+      float control_max_rot_accel_;
+
+      /// kształtowanie komend na łączu szeregowym (CommandShaper): włączone, próg zmiany prędkości postępowej [mm/s]
+      /// i obrotowej [deg/s], odstęp powtórzeń komendy dla watchdog'a firmware'u [msec], prędkość łącza [bit/s]
+      bool shaper_enabled_;
+      float shaper_min_delta_trans_;
+      float shaper_min_delta_rot_;
+      long shaper_refresh_interval_;
+      unsigned int shaper_link_baud_;
+
+      /// port serwera TCP; czytany tylko przy starcie (zmiana wymaga restartu)
+      unsigned short conn_port_;
+
+      /// maksymalna liczba jednoczesnych połączeń (w całym procesie)
+      unsigned int max_sessions_;
+      /// czas bezczynności, po którym zamykamy połączenie [msec]; 0 = bez limitu
+      long idle_timeout_;
+      /// pętla czytania połączeń: korutyna (true) albo dawne wywołania zwrotne; dotyczy nowych połączeń
+      bool coroutine_read_loop_;
+      /// accept i odbiór przez io_uring zamiast epoll (boost::asio); czytane przy starcie serwerów
+      bool io_uring_backend_;
+
+      /// limit ramek jednego połączenia [Hz] i liczba ramek, które mogą przyjść naraz; 0 Hz = bez limitu
+      unsigned int admission_session_rate_;
+      unsigned int admission_session_burst_;
+      /// limit ramek wszystkich połączeń razem [Hz] i jego zapas; 0 Hz = bez limitu
+      unsigned int admission_global_rate_;
+      unsigned int admission_global_burst_;
+      /// liczba odrzuconych ramek w ciągu sekundy, po której połączenie jest zamykane; 0 = nigdy
+      unsigned int admission_flood_close_;
+
+      /// zalecana częstotliwość wysyłania ramek przez telefon (RateAdvice): czy wysyłać zalecenia; górna i dolna
+      /// granica [Hz] (z jednego czujnika); krotność częstotliwości pętli sterowania, o którą prosimy, gdy pętla działa;
+      /// docelowa część czasu wątku na ramki jednego połączenia; co ile przeliczać zalecenie [msec]
+      bool rate_advice_enabled_;
+      unsigned int rate_max_hz_;
+      unsigned int rate_min_hz_;
+      float rate_oversample_;
+      float rate_target_load_;
+      long rate_interval_;
+
+      /// tryb czasu rzeczywistego (czytany tylko przy starcie): przypięcie wątków pętli sterowania (główny + floty)
+      /// i wątków ARIA do rdzeni, SCHED_FIFO, mlockall i prefault stosu/sterty [KB]
+      bool realtime_enabled_;
+      std::vector<int> realtime_control_cpus_;
+      int realtime_control_priority_;
+      std::vector<int> realtime_driver_cpus_;
+      int realtime_driver_priority_;
+      bool realtime_lock_memory_;
+      unsigned int realtime_prefault_stack_;
+      unsigned int realtime_prefault_heap_;
+
+      /// roboty floty; domyślnie jeden robot ARIA o id 0 na porcie conn_port_. Czytane tylko przy starcie.
+      std::vector<RobotConfig> robots_;
+      /// liczba wątków, na które rozdzielamy roboty; 0 = wszystko w głównej pętli (jak dotychczas)
+      unsigned int fleet_threads_;
+      /// wspólny port, na którym robota wybiera się wiadomością powitalną; 0 = wyłączony
+      unsigned short fleet_port_;
+      /// przerwa po nieudanej próbie połączenia z robotem [msec]; podwajana po każdej kolejnej, aż do maksimum
+      long connect_retry_min_;
+      long connect_retry_max_;
+
+      /// wejście komend przez pamięć współdzieloną (czytane przy starcie): segment <shm_prefix_><id robota>
+      /// i okres odpytywania pierścienia [usec]; 0 = odpytywanie ciągłe
+      bool shm_enabled_;
+      std::string shm_prefix_;
+      long shm_poll_interval_;
+
+      /// rejestrator lotu (FlightRecorder, czytane przy starcie): liczba rekordów (zaokrąglana w górę do potęgi dwójki),
+      /// przedrostek ścieżki plików zrzutów, czy zrzucać, gdy watchdog zatrzyma robota, który jechał, i ile plików
+      /// zrzutów najwyżej zostawia jeden proces (kolejne nadpisują najstarsze)
+      bool recorder_enabled_;
+      unsigned int recorder_capacity_;
+      std::string recorder_prefix_;
+      bool recorder_dump_on_watchdog_;
+      unsigned int recorder_max_dumps_;
+
+      /// ślady ramek (FrameTracer, czytane przy starcie): pojemność pierścienia [ramki] (zaokrąglana w górę do potęgi
+      /// dwójki), co która ramka jest zapisywana (0 = tylko wolne), próg ramki wolnej [usec] i przedrostek plików eksportu
+      bool trace_enabled_;
+      unsigned int trace_capacity_;
+      unsigned int trace_sample_every_;
+      long trace_slow_threshold_;
+      std::string trace_prefix_;
+
+      /// telemetria dla obserwatorów (TelemetryHub, czytane przy starcie): port (0 = wyłączona), częstotliwość
+      /// próbkowania stanu robotów [Hz] i maksymalna liczba obserwatorów
+      unsigned short telemetry_port_;
+      unsigned int telemetry_rate_hz_;
+      unsigned int telemetry_max_observers_;
+
+      /// tryb cienia (ShadowEvaluator, czytane przy starcie): kody modeli liczonych obok aktywnego, pojemność kolejki
+      /// migawek jednego robota [ramki], okres opróżniania kolejek i okres wypisywania statystyk [msec] (0 = przy końcu)
+      bool shadow_enabled_;
+      std::vector<int> shadow_models_;
+      unsigned int shadow_capacity_;
+      long shadow_poll_interval_;
+      long shadow_report_interval_;
+
+      /// tryb symulacji (Simulation, czytane przy starcie): czas wirtualny zamiast zegara, wejście z nagrania
+      /// rejestratora (replay_) albo z generatora; długość symulacji [s] (0 = do końca nagrania)
+      bool simulation_enabled_;
+      long simulation_duration_;
+      std::string simulation_replay_;
+      /// generator: ziarno, częstotliwość ramek [Hz], rozrzut chwil ramek [msec], kod modelu, długość jazdy
+      /// i przerwy pomiędzy jazdami [msec]
+      unsigned int simulation_seed_;
+      unsigned int simulation_rate_hz_;
+      long simulation_jitter_;
+      int simulation_model_;
+      long simulation_drive_time_;
+      long simulation_pause_time_;
+      /// generator: liczba wskazań w paczce (BundleMessage); 1 = zwykłe ramki
+      unsigned int simulation_bundle_;
+    };
+
+    /// migawka konfiguracji ze zliczaniem referencji
+    typedef boost::shared_ptr<const Config> ConfigPtr;
+
+    /**
+     *
+     * Przechowalnia aktualnej konfiguracji, w stylu RCU. Przeładowanie parsuje plik do nowej migawki i podmienia
+     * ją atomowo; migawki są zliczane (ConfigPtr), więc stara żyje, dopóki ktoś ją trzyma.
+     *
+     * Ścieżka ramki (i każde inne zdarzenie obsługiwane często) czyta konfigurację przez ConfigGuard: ogłoszenie
+     * epoki w slocie wątku i jeden atomowy odczyt wskaźnika, bez blokad i bez licznika referencji, a dalej
+     * przekazuje const Config&. Migawka wycofana przez przeładowanie jest zwalniana dopiero wtedy, gdy żaden
+     * czytelnik nie ogłosił epoki sprzed jej wycofania (i minęło co najmniej retire_grace_ms_ - to dla pojedynczych
+     * odczytów current() poza ConfigGuard, np. Configuration::current().idle_timeout_ w rzadkich zdarzeniach).
+     * snapshot() (spinlock boost::atomic_load i licznik referencji) jest dla ścieżek zimnych: konstruktory, start(),
+     * wątki, które trzymają konfigurację długo.
+     *
+     * Jako usługa boost::asio::io_service::service nasłuchuje na SIGHUP i przeładowuje plik.
+     */
+    class Configuration : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor, ustawia nasłuchiwanie na SIGHUP
+      explicit Configuration(boost::asio::io_service& ios);
+      ~Configuration() {};
+
+      /// aktualna migawka konfiguracji; wait-free. Ważna do końca ConfigGuard'a wołającego (albo jednego wyrażenia)
+      static const Config& current() {
+        return *current_.load(boost::memory_order_acquire);
+      }
+
+      /// aktualna migawka, trzymana przez wołającego (spinlock boost::atomic_load na czas zwiększenia licznika);
+      /// tylko poza ścieżką ramki
+      static ConfigPtr snapshot() {
+        return boost::atomic_load(&owner_);
+      }
+
+      /**
+       * \param path - ścieżka do pliku w formacie INI
+       *
+       * Wczytuje plik i publikuje nową migawkę. W razie błędu zostawia poprzednią migawkę i zwraca false.
+       */
+      static bool load(const std::string& path);
+
+      /// ponowne wczytanie ostatnio użytego pliku
+      static bool reload();
+
+    private:
+      friend class ConfigGuard;
+
+      /// slot ogłoszonej epoki jednego wątku czytającego; 0 = wątek nie czyta. Każdy w osobnej linii pamięci podręcznej
+      struct ReaderSlot {
+        boost::atomic<uint64_t> epoch_;
+        char padding_[64 - sizeof(boost::atomic<uint64_t>)];
+      };
+
+      /// wejście do/wyjście z sekcji czytania (ConfigGuard); zagnieżdżone wejścia liczą się jako jedno
+      static void enterRead() {
+        if (reader_depth_++)
+          return;
+        if (!reader_slot_)
+          claimReaderSlot();
+        if (reader_slot_ == &overflow_slot_)
+          overflow_readers_.fetch_add(1, boost::memory_order_seq_cst);
+        else
+          // seq_cst, parą z publish(): albo publish() widzi tę epokę, albo my widzimy nowy current_
+          reader_slot_->epoch_.store(epoch_.load(boost::memory_order_relaxed), boost::memory_order_seq_cst);
+      }
+      static void leaveRead() {
+        if (--reader_depth_)
+          return;
+        if (reader_slot_ == &overflow_slot_)
+          overflow_readers_.fetch_sub(1, boost::memory_order_release);
+        else
+          reader_slot_->epoch_.store(0, boost::memory_order_release);
+      }
+      /// pierwszy ConfigGuard wątku; wątki ponad CONFIG_READER_SLOTS dzielą licznik overflow_readers_
+      static void claimReaderSlot();
+      /// zwalnia migawki, których nie może już czytać żaden ConfigGuard
+      static void reclaim();
+
+      void shutdown_service();
+      void scheduleSignalWait();
+      void handleSignal(const boost::system::error_code& error, int signal_number);
+      static void publish(const Config* snapshot);
+
+      boost::asio::signal_set signals_;
+
+      /// migawka wycofana przez przeładowanie, epoka, od której czytelnicy jej nie widzą, i chwila wycofania
+      /// (CLOCK_MONOTONIC) [ns]
+      struct Retired {
+        ConfigPtr snapshot_;
+        uint64_t epoch_;
+        int64_t retired_ns_;
+      };
+
+      static boost::atomic<const Config*> current_;
+      /// właściciel migawki wskazywanej przez current_
+      static ConfigPtr owner_;
+      /// migawka domyślna, nigdy nie zwalniana
+      static const Config defaults_;
+      /// epoka konfiguracji (od 1), zwiększana przy każdej publikacji, i sloty czytelników
+      static boost::atomic<uint64_t> epoch_;
+      static ReaderSlot reader_slots_[CONFIG_READER_SLOTS];
+      static boost::atomic<unsigned int> reader_slots_used_;
+      static ReaderSlot overflow_slot_;
+      static boost::atomic<unsigned int> overflow_readers_;
+      static __thread ReaderSlot* reader_slot_;
+      static __thread unsigned int reader_depth_;
+      /// migawki wycofane, jeszcze nie zwolnione; zwalniane przy przeładowaniu (reclaim())
+      static std::deque<Retired> retired_;
+      static const long retire_grace_ms_ = 1000;
+      static std::string path_;
+    };
+
+    /**
+     *
+     * Czytanie konfiguracji na czas obsługi jednego zdarzenia (ramki, taktu pętli sterowania, opróżnienia pierścienia):
+     * migawka z config() żyje co najmniej do końca guard'a, także jeżeli w tym czasie nastąpi przeładowanie.
+     * Tylko na stosie, w jednym wątku; dalej przekazujemy const Config&, zamiast brać migawkę w każdej funkcji.
+     */
+    class ConfigGuard : private boost::noncopyable {
+    public:
+      ConfigGuard() : config_((Configuration::enterRead(), *Configuration::current_.load(boost::memory_order_seq_cst))) {}
+      ~ConfigGuard() { Configuration::leaveRead(); }
+      const Config& config() const { return config_; }
+
+    private:
+      const Config& config_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "connection_manager.hpp"
+#include "config.hpp"
+
+using SeekurJrRC::Core::ConnectionManager;
+using SeekurJrRC::Core::TCPConnection;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+
+boost::asio::io_service::id ConnectionManager::id;
+boost::atomic<int> ConnectionManager::sessions_(0);
+
+namespace {
+  void printCounters(const char* reason, const TCPConnection& connection)
+  {
+    const TCPConnection::Counters& c = connection.counters();
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::cout << "\rConnection " << connection.peer() << " " << reason << ": "
+              << c.frames_ << " frames, " << c.bad_frames_ << " bad, " << c.rate_limited_ << " over the session limit, "
+              << c.global_limited_ << " over the global limit, " << c.bytes_ << " bytes in "
+              << (now - c.connected_).total_milliseconds() << " ms, " << c.rate_advices_ << " rate advices (last "
+              << c.advised_interval_us_ << " us)" << std::endl;
+  }
+}
+
+ConnectionManager::ConnectionManager(boost::asio::io_service& ios)
+  : service(ios), sweep_timer_(ios), shutting_down_(false), rejected_(0), idle_closed_(0)
+{
+  scheduleSweep();
+}
+
+ConnectionManager::~ConnectionManager()
+{
+  // the read loops of these connections will never be resumed; break their self-references
+  for (unsigned int i = 0; i < closed_at_shutdown_.size(); ++i)
+    closed_at_shutdown_[i]->abandon();
+}
+
+bool ConnectionManager::start(boost::shared_ptr<TCPConnection> connection)
+{
+  connection->opened();
+  if (shutting_down_) {
+    connection->close();
+    return false;
+  }
+  if (sessions_.fetch_add(1, boost::memory_order_relaxed) >= (int) Configuration::current().max_sessions_) {
+    sessions_.fetch_sub(1, boost::memory_order_relaxed);
+    ++rejected_;
+    std::cerr << "Connection " << connection->peer() << " rejected: session limit reached ("
+              << rejected_ << " rejected so far)" << std::endl;
+    connection->close();
+    return false;
+  }
+  connections_.insert(connection);
+  connection->start();
+  return true;
+}
+
+void ConnectionManager::stop(boost::shared_ptr<TCPConnection> connection)
+{
+  if (connections_.erase(connection)) {
+    sessions_.fetch_sub(1, boost::memory_order_relaxed);
+    printCounters("closed", *connection);
+  }
+  connection->close();
+}
+
+void ConnectionManager::release(boost::shared_ptr<TCPConnection> connection)
+{
+  if (connections_.erase(connection))
+    sessions_.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+void ConnectionManager::shutdown_service()
+{
+  shutting_down_ = true;
+  boost::system::error_code ignored;
+  sweep_timer_.cancel(ignored);
+
+  // copy first - stop() modifies the set
+  std::vector<boost::shared_ptr<TCPConnection> > all(connections_.begin(), connections_.end());
+  for (unsigned int i = 0; i < all.size(); ++i)
+    stop(all[i]);
+  closed_at_shutdown_.swap(all);
+  if (rejected_ || idle_closed_)
+    std::cout << "Connection manager: " << rejected_ << " rejected, " << idle_closed_ << " closed as idle" << std::endl;
+}
+
+void ConnectionManager::scheduleSweep()
+{
+  // check often enough to close an idle connection at most ~25% late
+  long interval = Configuration::current().idle_timeout_ / 4;
+  if (interval < 50)
+    interval = 50;
+  if (interval > 1000)
+    interval = 1000;
+  sweep_timer_.expires_from_now(boost::posix_time::milliseconds(interval));
+  sweep_timer_.async_wait(
+    boost::bind(
+      &ConnectionManager::sweep,
+      this,
+      boost::asio::placeholders::error
+    )
+  );
+}
+
+void ConnectionManager::sweep(const boost::system::error_code& error)
+{
+  if (error || shutting_down_)
+    return;
+
+  long idle_timeout = Configuration::current().idle_timeout_;
+  if (idle_timeout > 0) {
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::vector<boost::shared_ptr<TCPConnection> > idle;
+    for (std::set<boost::shared_ptr<TCPConnection> >::const_iterator it = connections_.begin(); it != connections_.end(); ++it) {
+      if ((now - (*it)->counters().last_activity_).total_milliseconds() > idle_timeout)
+        idle.push_back(*it);
+    }
+    for (unsigned int i = 0; i < idle.size(); ++i) {
+      ++idle_closed_;
+      if (connections_.erase(idle[i])) {
+        sessions_.fetch_sub(1, boost::memory_order_relaxed);
+        printCounters("idle", *idle[i]);
+      }
+      idle[i]->close();
+    }
+  }
+  scheduleSweep();
+}
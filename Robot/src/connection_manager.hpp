@@ -0,0 +1,63 @@
+#ifndef CONNECTION_MANAGER_HPP_
+#define CONNECTION_MANAGER_HPP_
+
+#include <set>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "server.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Usługa (jedna na io_service, czyli na wątek floty) śledząca żywe połączenia TCP.
+     *   - zamyka połączenia po błędzie/EOF (stop) oraz po server.idle_timeout [msec] bez żadnej wiadomości,
+     *   - pilnuje limitu server.max_sessions jednoczesnych połączeń w całym procesie,
+     *   - przy zamknięciu połączenia wypisuje jego liczniki (TCPConnection::Counters).
+     * Wszystkie metody poza start() wołane z wątku własnego io_service; start() też, jeżeli połączenie przeszło z innego wątku,
+     * należy je zlecić przez post().
+     */
+    class ConnectionManager : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      explicit ConnectionManager(boost::asio::io_service& ios);
+      ~ConnectionManager();
+
+      /// rejestruje i uruchamia połączenie; jeżeli limit połączeń jest przekroczony, zamyka je i zwraca false
+      bool start(boost::shared_ptr<TCPConnection> connection);
+      /// wyrejestrowuje i zamyka połączenie
+      void stop(boost::shared_ptr<TCPConnection> connection);
+      /// wyrejestrowuje połączenie bez zamykania socket'u (socket przejęło inne połączenie)
+      void release(boost::shared_ptr<TCPConnection> connection);
+
+      /// liczba połączeń we wszystkich wątkach
+      static int sessions() { return sessions_.load(boost::memory_order_relaxed); }
+
+    private:
+      void shutdown_service();
+      void scheduleSweep();
+      /// zamknięcie połączeń bezczynnych dłużej niż server.idle_timeout
+      void sweep(const boost::system::error_code& error);
+
+      std::set<boost::shared_ptr<TCPConnection> > connections_;
+      /// połączenia zamknięte przy zakończeniu; zwalniane w destruktorze, kiedy io_service zniszczył już oczekujące handlery
+      std::vector<boost::shared_ptr<TCPConnection> > closed_at_shutdown_;
+      boost::asio::deadline_timer sweep_timer_;
+      bool shutting_down_;
+      uint64_t rejected_;
+      uint64_t idle_closed_;
+
+      static boost::atomic<int> sessions_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <cmath>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "control_loop.hpp"
+#include "config.hpp"
+
+using SeekurJrRC::Core::ControlLoop;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::ConfigGuard;
+using SeekurJrRC::Core::makeCustomAllocHandler;
+using boost::posix_time::ptime;
+using boost::posix_time::time_duration;
+using SeekurJrRC::Utils::universalTime;
+
+ControlLoop::ControlLoop(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend)
+  : robot_id_(robot_id), backend_(backend), timer_(ios), enabled_(false), samples_(0),
+    commanded_v_trans_(0), commanded_omega_(0),
+    ticks_(0), overruns_(0), extrapolated_ticks_(0)
+{
+}
+
+void ControlLoop::start()
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.control_rate_hz_ <= 0)
+    return;
+
+  // align with the robot cycle: an integer number of ticks per cycle
+  long period_us = 1000000 / config.control_rate_hz_;
+  long cycle_us = 1000 * (long) backend_->cycleTimeMs();
+  if (cycle_us > 0) {
+    long ticks_per_cycle = (cycle_us + period_us / 2) / period_us;
+    if (ticks_per_cycle < 1)
+      ticks_per_cycle = 1;
+    period_us = cycle_us / ticks_per_cycle;
+  }
+  period_ = boost::posix_time::microseconds(period_us);
+  enabled_ = true;
+  // after a reconnect: do not extrapolate from targets set before the link was lost
+  samples_ = 0;
+
+  std::cout << "Robot " << robot_id_ << ": control loop every " << period_us << " us" << std::endl;
+  timer_.expires_from_now(period_);
+  scheduleTick();
+}
+
+void ControlLoop::stop()
+{
+  if (!enabled_)
+    return;
+  enabled_ = false;
+  boost::system::error_code ignored;
+  timer_.cancel(ignored);
+
+  std::cout << "Robot " << robot_id_ << " control loop: " << ticks_ << " ticks, "
+            << extrapolated_ticks_ << " extrapolated, " << overruns_ << " overruns, ";
+  jitter_.print(std::cout);
+  std::cout << std::endl;
+}
+
+void ControlLoop::setTarget(float v_trans, float omega)
+{
+  previous_ = latest_;
+  latest_.v_trans_ = v_trans;
+  latest_.omega_ = omega;
+  latest_.time_ = universalTime();
+  if (samples_ < 2)
+    ++samples_;
+}
+
+void ControlLoop::scheduleTick()
+{
+  timer_.async_wait(
+    makeCustomAllocHandler(
+      handler_memory_,
+      boost::bind(
+        &ControlLoop::tick,
+        this,
+        boost::asio::placeholders::error
+      )
+    )
+  );
+}
+
+float ControlLoop::slew(float current, float target, float max_step)
+{
+  if (max_step <= 0)
+    return target;
+  if (target > current + max_step)
+    return current + max_step;
+  if (target < current - max_step)
+    return current - max_step;
+  return target;
+}
+
+void ControlLoop::tick(const boost::system::error_code& error)
+{
+  if (error || !enabled_)
+    return;
+
+  const ConfigGuard guard;
+  const Config& config = guard.config();
+  ptime now = universalTime();
+
+  // jitter: how late did we wake up; more than a period late means we have missed ticks
+  long jitter_us = (now - timer_.expires_at()).total_microseconds();
+  if (jitter_us < 0)
+    jitter_us = 0;
+  ++ticks_;
+  jitter_.record(jitter_us);
+  long missed = jitter_us / period_.total_microseconds();
+  overruns_ += missed;
+
+  // keep the phase: skip the missed ticks instead of bursting to catch up
+  timer_.expires_at(timer_.expires_at() + period_ * (int)(missed + 1));
+  scheduleTick();
+
+  if (!samples_)
+    return;
+
+  long age_ms = (now - latest_.time_).total_milliseconds();
+  if (age_ms > config.stop_motors_timeout_) {
+    // stale input - the watchdog stops the robot, we just forget our state
+    samples_ = 0;
+    commanded_v_trans_ = 0;
+    commanded_omega_ = 0;
+    return;
+  }
+
+  float v_trans = latest_.v_trans_;
+  float omega = latest_.omega_;
+  if (samples_ >= 2 && age_ms > 0 && config.control_extrapolation_ > 0) {
+    // linear extrapolation from the last two samples, bounded in time
+    long span_ms = (latest_.time_ - previous_.time_).total_milliseconds();
+    long ahead_ms = (age_ms < config.control_extrapolation_) ? age_ms : config.control_extrapolation_;
+    if (span_ms > 0) {
+      float k = (float) ahead_ms / (float) span_ms;
+      v_trans += k * (latest_.v_trans_ - previous_.v_trans_);
+      omega += k * (latest_.omega_ - previous_.omega_);
+      ++extrapolated_ticks_;
+    }
+  }
+
+  // extrapolation must not leave the range the models can produce: both wheels within v_max
+  if (v_trans > config.v_max_)
+    v_trans = config.v_max_;
+  if (v_trans < -config.v_max_)
+    v_trans = -config.v_max_;
+  const float omega_max = fabs(2 * config.v_max_ / config.wheelbase_divisor_);
+  if (omega > omega_max)
+    omega = omega_max;
+  if (omega < -omega_max)
+    omega = -omega_max;
+
+  float dt = period_.total_microseconds() / 1000000.0;
+  commanded_v_trans_ = slew(commanded_v_trans_, v_trans, config.control_max_accel_ * dt);
+  commanded_omega_ = slew(commanded_omega_, omega, config.control_max_rot_accel_ * dt);
+  backend_->setVelocities(commanded_v_trans_, commanded_omega_);
+}
@@ -0,0 +1,73 @@
+#ifndef CONTROL_LOOP_HPP_
+#define CONTROL_LOOP_HPP_
+
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "robot_backend.hpp"
+#include "utils.hpp"
+#include "handler_allocator.hpp"
+#include "virtual_timer.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Pętla sterowania o stałej częstotliwości (control.rate_hz). Wiadomości z telefonu tylko aktualizują
+     * zadaną prędkość (setTarget), a robot dostaje dokładnie jedną komendę na takt:
+     *   - jeżeli nowa próbka nie przyszła, ekstrapolujemy liniowo z dwóch ostatnich próbek, ale najwyżej
+     *     przez control.extrapolation [msec]; potem trzymamy ostatnią wartość (sample-and-hold),
+     *   - jeżeli próbka jest starsza niż timeout watchdog'a, nic nie wysyłamy - robota zatrzymuje watchdog,
+     *   - zmiana prędkości pomiędzy taktami jest ograniczona przez control.max_accel / control.max_rot_accel.
+     * Okres jest dobierany tak, żeby w cyklu robota mieściła się całkowita liczba taktów.
+     * Zbieramy statystyki jittera (opóźnienie obudzenia względem planu) i przepełnień (pominiętych taktów).
+     */
+    class ControlLoop {
+    public:
+      ControlLoop(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend);
+      /// uruchamia pętlę, jeżeli jest włączona w konfiguracji
+      void start();
+      /// zatrzymuje pętlę i wypisuje statystyki
+      void stop();
+      bool enabled() const { return enabled_; }
+      /// nowa zadana prędkość (z modelu sterowania)
+      void setTarget(float v_trans, float omega);
+
+    private:
+      void scheduleTick();
+      void tick(const boost::system::error_code& error);
+      /// ograniczenie zmiany wartości do max_step
+      static float slew(float current, float target, float max_step);
+
+      struct Sample {
+        float v_trans_;
+        float omega_;
+        boost::posix_time::ptime time_;
+      };
+
+      uint32_t robot_id_;
+      RobotBackend* backend_;
+      SeekurJrRC::Utils::Timer timer_;
+      HandlerMemory handler_memory_;
+      boost::posix_time::time_duration period_;
+      bool enabled_;
+
+      Sample latest_;
+      Sample previous_;
+      unsigned int samples_;
+      float commanded_v_trans_;
+      float commanded_omega_;
+
+      /// statystyki
+      uint64_t ticks_;
+      uint64_t overruns_;
+      uint64_t extrapolated_ticks_;
+      SeekurJrRC::Utils::JitterStats jitter_;
+    };
+  }
+}
+
+#endif
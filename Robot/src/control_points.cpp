@@ -0,0 +1,199 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "control_points.hpp"
+
+using SeekurJrRC::Core::ControlPoint;
+using SeekurJrRC::Core::ControlPointSet;
+
+namespace {
+  /// górna granica liczby kubełków (przy bardzo małym promieniu kubełki są większe niż promień)
+  const int max_cells_per_axis = 1024;
+}
+
+ControlPointSet::ControlPointSet(const std::vector<ControlPoint>& points, float radius)
+{
+  if (points.empty())
+    throw std::runtime_error("no control points");
+
+  float max_phi = points[0].phi_;
+  float max_theta = points[0].theta_;
+  min_phi_ = points[0].phi_;
+  min_theta_ = points[0].theta_;
+  for (size_t i = 1; i < points.size(); ++i) {
+    min_phi_ = std::min(min_phi_, points[i].phi_);
+    max_phi = std::max(max_phi, points[i].phi_);
+    min_theta_ = std::min(min_theta_, points[i].theta_);
+    max_theta = std::max(max_theta, points[i].theta_);
+  }
+  const float extent_phi = std::max(max_phi - min_phi_, 1.0f);
+  const float extent_theta = std::max(max_theta - min_theta_, 1.0f);
+
+  // uniformly spread points: pi R^2 n / area = neighbors_target_
+  radius_ = radius > 0 ? radius : sqrt(neighbors_target_ * extent_phi * extent_theta / (M_PI * points.size()));
+  cell_size_ = std::max(radius_, std::max(extent_phi, extent_theta) / max_cells_per_axis);
+  cells_x_ = (int)(extent_phi / cell_size_) + 1;
+  cells_y_ = (int)(extent_theta / cell_size_) + 1;
+
+  // counting sort of the points by cell
+  std::vector<uint32_t> cells(points.size());
+  cell_start_.assign(cells_x_ * cells_y_ + 1, 0);
+  for (size_t i = 0; i < points.size(); ++i) {
+    int x, y;
+    cellOf(points[i].phi_, points[i].theta_, x, y);
+    cells[i] = y * cells_x_ + x;
+    ++cell_start_[cells[i] + 1];
+  }
+  for (size_t c = 1; c < cell_start_.size(); ++c)
+    cell_start_[c] += cell_start_[c - 1];
+  std::vector<uint32_t> next(cell_start_.begin(), cell_start_.end() - 1);
+  points_.resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+    points_[next[cells[i]]++] = points[i];
+}
+
+ControlPointSet* ControlPointSet::load(const std::string& path, float radius)
+{
+  std::ifstream in(path.c_str());
+  if (!in)
+    throw std::runtime_error("cannot read control points from " + path);
+  std::vector<ControlPoint> points;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    ControlPoint point;
+    if (!(fields >> point.phi_ >> point.theta_ >> point.alpha_ >> point.beta_))
+      throw std::runtime_error(path + ": expected \"phi theta alpha beta\" in line: " + line);
+    points.push_back(point);
+  }
+  if (points.empty())
+    throw std::runtime_error(path + ": no control points");
+  return new ControlPointSet(points, radius);
+}
+
+void ControlPointSet::cellOf(float phi, float theta, int& x, int& y) const
+{
+  x = std::max(0, std::min(cells_x_ - 1, (int)floor((phi - min_phi_) / cell_size_)));
+  y = std::max(0, std::min(cells_y_ - 1, (int)floor((theta - min_theta_) / cell_size_)));
+}
+
+std::pair<float, float> ControlPointSet::shepard(float phi, float theta, float p) const
+{
+  int cx, cy;
+  cellOf(phi, theta, cx, cy);
+  double weight_sum = 0;
+  double nominator_a = 0;
+  double nominator_b = 0;
+  // cells are at least radius_ wide, so every point closer than radius_ is in the 3x3 block around the query
+  for (int y = std::max(0, cy - 1); y <= std::min(cells_y_ - 1, cy + 1); ++y) {
+    for (int x = std::max(0, cx - 1); x <= std::min(cells_x_ - 1, cx + 1); ++x) {
+      const uint32_t cell = y * cells_x_ + x;
+      for (uint32_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+        const ControlPoint& point = points_[i];
+        const float d = sqrt((point.phi_ - phi) * (point.phi_ - phi) + (point.theta_ - theta) * (point.theta_ - theta));
+        if (d >= radius_)
+          continue;
+        if (d == 0)
+          return std::make_pair(point.alpha_, point.beta_);
+        const double weight = pow((radius_ - d) / (radius_ * d), p);
+        weight_sum += weight;
+        nominator_a += weight * point.alpha_;
+        nominator_b += weight * point.beta_;
+      }
+    }
+  }
+  if (weight_sum == 0)
+    return nearest(phi, theta);
+  return std::make_pair((float)(nominator_a / weight_sum), (float)(nominator_b / weight_sum));
+}
+
+std::pair<float, float> ControlPointSet::localLinear(float phi, float theta) const
+{
+  int cx, cy;
+  cellOf(phi, theta, cx, cy);
+  // weighted normal equations of f = c0 + c1 u + c2 v, with u, v the offsets from the query in radii;
+  // the value at the query is c0
+  double s[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  double r_a[3] = {0, 0, 0};
+  double r_b[3] = {0, 0, 0};
+  int count = 0;
+  for (int y = std::max(0, cy - 1); y <= std::min(cells_y_ - 1, cy + 1); ++y) {
+    for (int x = std::max(0, cx - 1); x <= std::min(cells_x_ - 1, cx + 1); ++x) {
+      const uint32_t cell = y * cells_x_ + x;
+      for (uint32_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+        const ControlPoint& point = points_[i];
+        const double u = (point.phi_ - phi) / radius_;
+        const double v = (point.theta_ - theta) / radius_;
+        const double d = sqrt(u * u + v * v);
+        if (d >= 1)
+          continue;
+        if (d == 0)
+          return std::make_pair(point.alpha_, point.beta_);
+        // the same weights as shepard() with p = 2, so the fit passes through the points
+        const double w = ((1 - d) / d) * ((1 - d) / d);
+        const double basis[3] = {1, u, v};
+        for (int j = 0; j < 3; ++j) {
+          for (int k = 0; k < 3; ++k)
+            s[j][k] += w * basis[j] * basis[k];
+          r_a[j] += w * basis[j] * point.alpha_;
+          r_b[j] += w * basis[j] * point.beta_;
+        }
+        ++count;
+      }
+    }
+  }
+  if (count == 0)
+    return nearest(phi, theta);
+
+  // Cramer's rule for c0 only
+  const double minor0 = s[1][1] * s[2][2] - s[1][2] * s[2][1];
+  const double minor1 = s[1][0] * s[2][2] - s[1][2] * s[2][0];
+  const double minor2 = s[1][0] * s[2][1] - s[1][1] * s[2][0];
+  const double det = s[0][0] * minor0 - s[0][1] * minor1 + s[0][2] * minor2;
+  // fewer than three points, or all of them on one line: no plane, fall back to the weighted mean
+  // (det <= s00 s11 s22 for a Gram matrix, so the ratio does not depend on how much one close point dominates)
+  if (count < 3 || fabs(det) < 1e-6 * s[0][0] * s[1][1] * s[2][2])
+    return std::make_pair((float)(r_a[0] / s[0][0]), (float)(r_b[0] / s[0][0]));
+  const double alpha = (r_a[0] * minor0 - s[0][1] * (r_a[1] * s[2][2] - s[1][2] * r_a[2]) + s[0][2] * (r_a[1] * s[2][1] - s[1][1] * r_a[2])) / det;
+  const double beta = (r_b[0] * minor0 - s[0][1] * (r_b[1] * s[2][2] - s[1][2] * r_b[2]) + s[0][2] * (r_b[1] * s[2][1] - s[1][1] * r_b[2])) / det;
+  return std::make_pair((float)alpha, (float)beta);
+}
+
+std::pair<float, float> ControlPointSet::nearest(float phi, float theta) const
+{
+  int cx, cy;
+  cellOf(phi, theta, cx, cy);
+  const ControlPoint* best = &points_[0];
+  float best_distance = -1;
+  // rings of cells around the query; ring r is at least (r - 1) cells away, so stop once the best point is closer
+  const int max_ring = std::max(cells_x_, cells_y_);
+  for (int ring = 0; ring <= max_ring; ++ring) {
+    if (best_distance >= 0 && best_distance <= (ring - 1) * cell_size_)
+      break;
+    for (int y = cy - ring; y <= cy + ring; ++y) {
+      if (y < 0 || y >= cells_y_)
+        continue;
+      // the inner rows only have the two border cells of the ring
+      const int step = (y == cy - ring || y == cy + ring || ring == 0) ? 1 : 2 * ring;
+      for (int x = cx - ring; x <= cx + ring; x += step) {
+        if (x < 0 || x >= cells_x_)
+          continue;
+        const uint32_t cell = y * cells_x_ + x;
+        for (uint32_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+          const ControlPoint& point = points_[i];
+          const float d = sqrt((point.phi_ - phi) * (point.phi_ - phi) + (point.theta_ - theta) * (point.theta_ - theta));
+          if (best_distance < 0 || d < best_distance) {
+            best_distance = d;
+            best = &point;
+          }
+        }
+      }
+    }
+  }
+  return std::make_pair(best->alpha_, best->beta_);
+}
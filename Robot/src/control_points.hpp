@@ -0,0 +1,77 @@
+#ifndef CONTROL_POINTS_HPP_
+#define CONTROL_POINTS_HPP_
+
+#include <string>
+#include <vector>
+#include <utility> // for std::pair
+#include <stdint.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /// punkt kontrolny interpolacji: kąty [deg] i wartości alpha/beta w tym punkcie
+    struct ControlPoint {
+      float phi_;
+      float theta_;
+      float alpha_;
+      float beta_;
+    };
+
+    /**
+     *
+     * Dowolny (rozproszony) zbiór punktów kontrolnych, np. z sesji kalibracyjnych - setki punktów zamiast siatki 3x3
+     * z [steering] control_points_*. Niezmienny po zbudowaniu; należy do migawki konfiguracji.
+     *
+     * Punkty leżą w równomiernej siatce o boku równym promieniowi sąsiedztwa (kubełki w jednej tablicy, jak CSR),
+     * więc sąsiedzi punktu zapytania są w 3x3 kubełkach wokół niego. Interpolacje są lokalne - biorą pod uwagę tylko
+     * punkty w promieniu, więc koszt zapytania zależy od liczby sąsiadów, a nie od liczby wszystkich punktów:
+     *   - shepard     - zmodyfikowana metoda Sheparda (wagi Franke-Little ((R - d)+ / (R d))^p),
+     *   - localLinear - odpowiednik interpolacji dwuliniowej dla punktów rozproszonych: płaszczyzna dopasowana
+     *                   ważoną metodą najmniejszych kwadratów do sąsiadów, odtwarza funkcje liniowe dokładnie.
+     * Poza zasięgiem wszystkich punktów zwracana jest wartość najbliższego punktu.
+     *
+     * Zapytania nie alokują i mogą być wołane z wielu wątków naraz.
+     */
+    class ControlPointSet : private boost::noncopyable {
+    public:
+      /// radius [deg] <= 0 - dobierany tak, żeby w kole mieściło się średnio neighbors_target_ punktów
+      ControlPointSet(const std::vector<ControlPoint>& points, float radius);
+
+      /**
+       * \param path - plik tekstowy; w każdej linii "phi theta alpha beta", linie zaczynające się od # są pomijane
+       *
+       * Wczytuje punkty z pliku; rzuca std::runtime_error, jeżeli pliku nie da się przeczytać albo nie ma w nim punktów.
+       */
+      static ControlPointSet* load(const std::string& path, float radius);
+
+      std::pair<float, float> shepard(float phi, float theta, float p) const;
+      std::pair<float, float> localLinear(float phi, float theta) const;
+
+      size_t size() const { return points_.size(); }
+      float radius() const { return radius_; }
+
+    private:
+      /// kubełek siatki, w którym leży punkt (przycięty do siatki)
+      void cellOf(float phi, float theta, int& x, int& y) const;
+      std::pair<float, float> nearest(float phi, float theta) const;
+
+      /// średnia liczba punktów w promieniu przy automatycznym doborze promienia
+      static const int neighbors_target_ = 12;
+
+      /// punkty posortowane według kubełków; punkty kubełka c to points_[cell_start_[c]] .. points_[cell_start_[c + 1] - 1]
+      std::vector<ControlPoint> points_;
+      std::vector<uint32_t> cell_start_;
+      float radius_;
+      /// bok kubełka; równy promieniowi, chyba że przy małym promieniu kubełków byłoby za dużo
+      float cell_size_;
+      float min_phi_;
+      float min_theta_;
+      int cells_x_;
+      int cells_y_;
+    };
+  }
+}
+
+#endif
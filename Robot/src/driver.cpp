@@ -1,133 +1,384 @@
 #include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <stdint.h>
 
-#include <sys/time.h> // for gettimeofday
+#include <sys/time.h> // for struct timeval
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
-#include "Aria.h"
-
 #include "driver.hpp"
-#include "server.hpp"
 #include "utils.hpp"
 #include "steering_model.hpp"
+#include "config.hpp"
+#include "frame_trace.hpp"
 
 using SeekurJrRC::Core::Driver;
 using SeekurJrRC::Core::SteeringModelBase;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::ConfigGuard;
+using SeekurJrRC::Core::FlightRecorder;
+using SeekurJrRC::Core::FrameTracer;
+using SeekurJrRC::Core::makeCustomAllocHandler;
 
+namespace {
+  /// dwa razy największy zakres żyroskopów w telefonach (2000 st./s) [rad/s]; więcej to błędny odczyt
+  const float max_gyro_rate = 4000.0 / 57.2957795;
+}
 
-boost::asio::io_service::id Driver::id;
-struct timeval Driver::nowTime_;
-struct timeval Driver::lastMotorsUpdate_;
-
-struct timeval dummy;
-uint64_t counter = 0;
-uint64_t skip_first = 200;
-float average = 0;
-
-void Driver::checkMotors(boost::shared_ptr<boost::asio::deadline_timer>& p_checkMotorsTimer)
+void Driver::checkMotors(boost::shared_ptr<SeekurJrRC::Utils::Timer>& p_checkMotorsTimer)
 {
+  const ConfigGuard guard;
+  const Config& config = guard.config();
+  watchdog_jitter_.record((SeekurJrRC::Utils::universalTime() - p_checkMotorsTimer->expires_at()).total_microseconds());
+
   // re-set the timer
-  p_checkMotorsTimer->expires_at(p_checkMotorsTimer->expires_at() + boost::posix_time::milliseconds(stopMotorsCheckInterval_));
+  p_checkMotorsTimer->expires_at(p_checkMotorsTimer->expires_at() + boost::posix_time::milliseconds(config.stop_motors_check_interval_));
   p_checkMotorsTimer->async_wait(
-    boost::bind(
-      &Driver::checkMotors,
-      this,
-      p_checkMotorsTimer
+    makeCustomAllocHandler(
+      watchdog_handler_memory_,
+      boost::bind(
+        &Driver::checkMotors,
+        this,
+        p_checkMotorsTimer
+      )
     )
   );
-  
+
 //   std::cout << "Checking motors speed update interval." << std::endl;
-  
-  gettimeofday(&nowTime_, NULL);
-  if (SeekurJrRC::Utils::gTODDiffToMsec(&nowTime_, &lastMotorsUpdate_) > stopMotorsTimeout_) {
-    // stop the motors    
-    std::cout << "\rTimeout reached. Stopping motors." << std::endl;
-    robot_->lock();
-    robot_->stop();
-    robot_->unlock();
-  }
-}
-
-Driver::Driver(boost::asio::io_service& ios) : service(ios), p_IOService_(&ios)
-{
-  Aria::init();
-  robot_ = new ArRobot();
-  
-  int _argc = 1;
-  char _argv[] = "server";
-  char * _p_argv = &_argv[0];
-  robot_arg_parser_ = new ArArgumentParser(&_argc, &_p_argv);
-  robot_connector_ = new ArRobotConnector(robot_arg_parser_, robot_);
-
-  if (!robot_connector_->connectRobot())
-  {
-    ArLog::log(ArLog::Terse, "Error, could not connect to robot.");
-    Aria::exit(1);
-  }
-  
-  robot_->runAsync(false);
-  robot_->enableMotors();
-  
-  boost::shared_ptr<boost::asio::deadline_timer> p_checkMotorsTimer(
-    new boost::asio::deadline_timer(
-      ios, 
-      boost::posix_time::milliseconds(stopMotorsCheckInterval_)
+
+  // until connected the backend belongs to the connecting thread
+  if (!connected_)
+    return;
+  if (!backend_->isConnected()) {
+    handleLinkLost();
+    return;
+  }
+
+  SeekurJrRC::Utils::timeOfDay(&nowTime_);
+  long since_update = SeekurJrRC::Utils::gTODDiffToMsec(&nowTime_, &lastMotorsUpdate_);
+  if (since_update > config.stop_motors_timeout_) {
+    // stop the motors
+    std::cout << "\rRobot " << robot_id_ << ": Timeout reached. Stopping motors." << std::endl;
+    shaper_.stop();
+    if (driving_) {
+      driving_ = false;
+      telemetry_sample_.left_ = telemetry_sample_.right_ = telemetry_sample_.v_trans_ = telemetry_sample_.omega_ = 0;
+      publishTelemetry();
+      FlightRecorder::record(SeekurJrRC::Core::FLIGHT_WATCHDOG_STOP, robot_id_, stop_requested_, since_update, config.stop_motors_timeout_);
+      // the commands stopped coming without a "stop" from the client: keep what led up to it, written by the
+      // recorder's own thread (not in a simulation, where the dump's name and wall clock would be the only things
+      // differing between runs)
+      if (!stop_requested_ && config.recorder_dump_on_watchdog_ && !SeekurJrRC::Utils::VirtualClock::enabled())
+        FlightRecorder::requestDump(SeekurJrRC::Core::FLIGHT_DUMP_WATCHDOG, robot_id_);
+    }
+  }
+  else if (driving_)
+    FlightRecorder::record(SeekurJrRC::Core::FLIGHT_WATCHDOG_OK, robot_id_, 0, since_update, config.stop_motors_timeout_);
+}
+
+Driver::Driver(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend)
+  : robot_id_(robot_id), backend_(backend), p_IOService_(&ios), shaper_(ios, robot_id, backend),
+    control_loop_(ios, robot_id, &shaper_),
+    history_(historyCapacity(Configuration::current().max_history_length_)), connect_timer_(ios), stopping_(false), connected_(false),
+    connect_started_ns_(0), links_(0), rejected_commands_(0), rejected_gyro_rates_(0), fallback_models_(0), driving_(false), stop_requested_(false),
+    counter_(0), skip_first_(200), average_(0)
+{
+  lastMotorsUpdate_.tv_sec = 0;
+  lastMotorsUpdate_.tv_usec = 0;
+  memset(&telemetry_sample_, 0, sizeof(telemetry_sample_));
+  telemetry_sample_.robot_id_ = robot_id_;
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.shadow_enabled_ && !config.shadow_models_.empty())
+    shadow_.allocate(config.shadow_capacity_);
+
+  p_checkMotorsTimer_.reset(
+    new SeekurJrRC::Utils::Timer(
+      ios,
+      boost::posix_time::milliseconds(Configuration::current().stop_motors_check_interval_)
     )
   );
-  
+
   // Timer object is being passed to the handler
-  p_checkMotorsTimer->async_wait(
-    boost::bind(
-      &Driver::checkMotors,
-      this,
-      p_checkMotorsTimer
+  p_checkMotorsTimer_->async_wait(
+    makeCustomAllocHandler(
+      watchdog_handler_memory_,
+      boost::bind(
+        &Driver::checkMotors,
+        this,
+        p_checkMotorsTimer_
+      )
     )
   );
+
+  startConnecting();
+}
+
+Driver::~Driver()
+{
+  delete backend_;
+}
+
+void Driver::startConnecting()
+{
+  // the previous connecting thread has finished: it only ends after handing the backend over (or on shutdown)
+  if (connect_thread_.joinable())
+    connect_thread_.join();
+  connect_started_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+  if (SeekurJrRC::Utils::VirtualClock::enabled()) {
+    // a simulation has no threads besides the main one: the attempts are timer events
+    connect_timer_.expires_from_now(boost::posix_time::milliseconds(0));
+    connect_timer_.async_wait(boost::bind(&Driver::connectAttempt, this, 1, Configuration::current().connect_retry_min_));
+    return;
+  }
+  connect_thread_ = boost::thread(boost::bind(&Driver::connectLoop, this));
+}
+
+void Driver::connectAttempt(unsigned int attempt, long delay)
+{
+  if (stopping_.load(boost::memory_order_relaxed))
+    return;
+  if (backend_->connect()) {
+    handleConnected(attempt);
+    return;
+  }
+  std::cerr << "\rRobot " << robot_id_ << ": connection attempt " << attempt << " failed, retrying in " << delay << " ms" << std::endl;
+  connect_timer_.expires_from_now(boost::posix_time::milliseconds(delay));
+  connect_timer_.async_wait(
+    boost::bind(&Driver::connectAttempt, this, attempt + 1, std::min(2 * delay, Configuration::current().connect_retry_max_)));
 }
 
-void Driver::shutdown_service() {
-  robot_->lock();
-  robot_->stop();
-  robot_->unlock();
-  robot_->stopRunning();
-  delete robot_;
-  delete robot_arg_parser_;
-  delete robot_connector_;
-  Aria::shutdown();
-}
-
-void Driver::processMessage(TCPMessage& message)
-{
-  if (message.startStop_) {
-    boost::shared_ptr<SteeringModelBase> model = SeekurJrRC::Core::getSteeringModel(message.steeringModelCode_, message.x_, message.y_, message.z_);
-    if (model != NULL) {
-      if (!robot_->areMotorsEnabled())
-        std::cout << "Motors disabled." << std::endl;
-      if (skip_first)
-        skip_first--;
-      else {
-        gettimeofday(&dummy, NULL);
-        average = (average * counter + SeekurJrRC::Utils::gTODDiffToMsec(&dummy, &lastMotorsUpdate_)) / (float)(counter+1);
-        counter++;
-        std::cout << "\r" << average << std::flush;
+void Driver::connectLoop()
+{
+  long delay = Configuration::current().connect_retry_min_;
+  try {
+    for (unsigned int attempt = 1; !stopping_.load(boost::memory_order_relaxed); ++attempt) {
+      if (backend_->connect()) {
+        // hand the backend over to the robot's thread
+        p_IOService_->post(boost::bind(&Driver::handleConnected, this, attempt));
+        return;
       }
-      std::pair<float, float> v = model->getSpeedValues();
-//       std::cout << "\rL: " << v.first << " R: " << v.second << std::flush;
-//       std::cout << "Model returned: v1=" << v.first << ", v2=" << v.second << std::endl;
-//       robot_->lock();
-//       robot_->setVel2(v.first, v.second);
-//       robot_->setVel2(50, -50);
-//       robot_->setRotVel(50);
-      float v_trans = 0.5 * (v.first + v.second);
-      float omega = (v.second - v.first) / 20.0;
-      robot_->setRotVel(omega);
-      robot_->setVel(v_trans);
-      robot_->unlock();
-      gettimeofday(&lastMotorsUpdate_, NULL);
+      std::cerr << "\rRobot " << robot_id_ << ": connection attempt " << attempt << " failed, retrying in " << delay << " ms" << std::endl;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(delay));
+      delay = std::min(2 * delay, Configuration::current().connect_retry_max_);
     }
   }
+  catch (const boost::thread_interrupted&) {
+    // shutdown() while waiting
+  }
 }
 
+void Driver::handleConnected(unsigned int attempts)
+{
+  if (stopping_.load(boost::memory_order_relaxed))
+    return;
+  connected_ = true;
+  ++links_;
+  std::cout << "\rRobot " << robot_id_ << " connected in " << (SeekurJrRC::Utils::monotonicNowNs() - connect_started_ns_) / 1000000
+            << " ms (" << attempts << (attempts == 1 ? " attempt" : " attempts") << ")" << std::endl;
+  publishTelemetry();
+  control_loop_.start();
+}
 
+void Driver::handleLinkLost()
+{
+  std::cerr << "\rRobot " << robot_id_ << ": link lost, reconnecting" << std::endl;
+  connected_ = false;
+  control_loop_.stop();
+  shaper_.disconnect();
+  if (driving_) {
+    driving_ = false;
+    telemetry_sample_.left_ = telemetry_sample_.right_ = telemetry_sample_.v_trans_ = telemetry_sample_.omega_ = 0;
+  }
+  publishTelemetry();
+  startConnecting();
+}
+
+void Driver::shutdown() {
+  stopping_.store(true, boost::memory_order_relaxed);
+  // a backoff sleep is interrupted; a connection attempt in progress is waited for
+  connect_thread_.interrupt();
+  if (connect_thread_.joinable())
+    connect_thread_.join();
+  boost::system::error_code ignored;
+  connect_timer_.cancel(ignored);
+  p_checkMotorsTimer_->cancel(ignored);
+  control_loop_.stop();
+  std::cout << "Robot " << robot_id_ << " watchdog: ";
+  watchdog_jitter_.print(std::cout);
+  std::cout << std::endl;
+  if (rejected_commands_ || links_ != 1)
+    std::cout << "Robot " << robot_id_ << ": connected " << links_ << " time(s), " << rejected_commands_
+              << " commands rejected while not connected" << std::endl;
+  if (rejected_gyro_rates_)
+    std::cout << "Robot " << robot_id_ << ": " << rejected_gyro_rates_ << " gyroscope readings rejected" << std::endl;
+  if (counter_)
+    std::cout << "Robot " << robot_id_ << ": " << counter_ << " commands, average interval " << average_ << " ms" << std::endl;
+  if (fallback_models_)
+    std::cout << "Robot " << robot_id_ << ": " << fallback_models_ << " frames with an unavailable model code, driven by bilinear" << std::endl;
+  shaper_.printStats(std::cout);
+  std::cout << std::endl;
+  shaper_.disconnect();
+}
+
+void Driver::processMessage(TCPMessage& message, const Config& config)
+{
+  if (message.kind_ == MESSAGE_KIND_GYROSCOPE) {
+    FlightRecorder::record(SeekurJrRC::Core::FLIGHT_FRAME_GYRO, robot_id_, message.steeringModelCode_, message.x_, message.y_, message.z_);
+    processGyroRates(message.x_, message.y_, message.z_, config);
+  }
+  else
+    processAccelerometer(message.startStop_, message.steeringModelCode_, message.x_, message.y_, message.z_, config);
+}
+
+void Driver::processBundle(const BundleMessage& bundle, const Config& config)
+{
+  const unsigned int newest = bundle.samples_ - 1;
+  const int64_t now_ns = SeekurJrRC::Utils::monotonicNowNs();
+  struct timeval now;
+  SeekurJrRC::Utils::timeOfDay(&now);
+  // the older samples, in the order they were measured, only feed the filter history and the fusion
+  for (unsigned int i = 0; i < newest; ++i) {
+    float x, y, z;
+    bundle.sample(i, x, y, z);
+    const int64_t age_us = (int64_t)(newest - i) * bundle.intervalUs_;
+    FlightRecorder::record(SeekurJrRC::Core::FLIGHT_FRAME_BUNDLED, robot_id_, bundle.steeringModelCode_, x, y, z, age_us / 1000.0f);
+    orientation_.acceleration(x, y, z, 1e-9 * (now_ns - 1000 * age_us), config);
+    // as with single frames, the history only grows while driving
+    if (bundle.startStop_) {
+      struct timeval measured;
+      const int64_t measured_us = (int64_t)now.tv_sec * 1000000 + now.tv_usec - age_us;
+      measured.tv_sec = measured_us / 1000000;
+      measured.tv_usec = measured_us % 1000000;
+      SteeringModelBase::addToHistory(history_, config, x, y, z, measured);
+    }
+  }
+  float x, y, z;
+  bundle.sample(newest, x, y, z);
+  processAccelerometer(bundle.startStop_, bundle.steeringModelCode_, x, y, z, config);
+}
+
+void Driver::processAccelerometer(bool start_stop, uint8_t steering_model_code, float x, float y, float z, const Config& config)
+{
+  if (start_stop) {
+    FlightRecorder::record(SeekurJrRC::Core::FLIGHT_FRAME_DRIVE, robot_id_, steering_model_code, x, y, z);
+    processOrientation(steering_model_code, x, y, z, config);
+  }
+  else {
+    FlightRecorder::record(SeekurJrRC::Core::FLIGHT_FRAME_IDLE, robot_id_, steering_model_code, x, y, z);
+    processIdle();
+    // not driving, but the fusion keeps following the phone, so it is settled once the operator starts
+    orientation_.acceleration(x, y, z, 1e-9 * SeekurJrRC::Utils::monotonicNowNs(), config);
+  }
+}
+
+void Driver::processIdle()
+{
+  if (!stop_requested_) {
+    stop_requested_ = true;
+    publishTelemetry();
+  }
+}
+
+void Driver::publishTelemetry()
+{
+  telemetry_sample_.time_us_ = SeekurJrRC::Utils::monotonicNowNs() / 1000;
+  telemetry_sample_.flags_ = (driving_ ? TELEMETRY_FLAG_DRIVING : 0) | (stop_requested_ ? TELEMETRY_FLAG_STOP_REQUESTED : 0)
+    | (connected_ ? TELEMETRY_FLAG_CONNECTED : 0);
+  telemetry_.publish(telemetry_sample_);
+}
+
+void Driver::processGyroRates(float x, float y, float z, const Config& config)
+{
+  // the filter integrates these, so one NaN or absurd rate would spoil the orientation until a reset;
+  // the negated comparisons are false for NaN as well
+  if (!(fabs(x) <= max_gyro_rate) || !(fabs(y) <= max_gyro_rate) || !(fabs(z) <= max_gyro_rate)) {
+    ++rejected_gyro_rates_;
+    return;
+  }
+  orientation_.gyroRates(x, y, z, 1e-9 * SeekurJrRC::Utils::monotonicNowNs(), config);
+}
+
+void Driver::processOrientation(uint8_t steering_model_code, float x, float y, float z, const Config& config)
+{
+  orientation_.acceleration(x, y, z, 1e-9 * SeekurJrRC::Utils::monotonicNowNs(), config);
+  // the shadow models get the reading as it came, whichever model is active
+  const uint8_t requested_code = steering_model_code;
+  const float raw_x = x, raw_y = y, raw_z = z;
+  if (isFusedModelCode(steering_model_code)) {
+    // the interpolation models take the fused gravity vector in place of the raw accelerometer reading
+    orientation_.gravity(x, y, z);
+    steering_model_code = fusedModelBaseCode(steering_model_code);
+  }
+  if (!hasSteeringModel(steering_model_code)) {
+    // genetic1 (9-11, fused 18) is disabled and codes past 19 do not exist; the robot is driven by bilinear, but say so
+    ++fallback_models_;
+    if (!(fallback_models_ & (fallback_models_ - 1)))
+      std::cerr << "\rRobot " << robot_id_ << ": no model for code " << (int)requested_code << ", using bilinear without filter ("
+                << fallback_models_ << " frames so far)" << std::endl;
+  }
+  FlightRecorder::record(SeekurJrRC::Core::FLIGHT_ORIENTATION, robot_id_, steering_model_code, x, y, z);
+  telemetry_sample_.steering_model_code_ = steering_model_code;
+  telemetry_sample_.x_ = x;
+  telemetry_sample_.y_ = y;
+  telemetry_sample_.z_ = z;
+  SteeringModelBase* model = SeekurJrRC::Core::getSteeringModel(steering_model_code, history_, config, x, y, z, model_storage_);
+  FrameTracer::mark(SeekurJrRC::Core::TRACE_HISTORY_UPDATED);
+  if (model != NULL) {
+    std::pair<float, float> v = model->getSpeedValues();
+    FrameTracer::mark(SeekurJrRC::Core::TRACE_MODEL_EVALUATED);
+//     std::cout << "\rL: " << v.first << " R: " << v.second << std::endl;
+//     std::cout << "Model returned: v1=" << v.first << ", v2=" << v.second << std::endl;
+    processWheelVelocities(v.first, v.second, config);
+    // the command is out; only now hand the same input to the shadow models
+    if (shadow_.enabled()) {
+      float gravity_x, gravity_y, gravity_z;
+      orientation_.gravity(gravity_x, gravity_y, gravity_z);
+      shadow_.publish(requested_code, v.first, v.second, raw_x, raw_y, raw_z, gravity_x, gravity_y, gravity_z, history_);
+    }
+  }
+}
+
+void Driver::processWheelVelocities(float left, float right, const Config& config)
+{
+  if (!connected_) {
+    // no robot to send it to yet (or again); the client keeps sending, so just drop it
+    ++rejected_commands_;
+    if (!(rejected_commands_ & (rejected_commands_ - 1)))
+      std::cerr << "\rRobot " << robot_id_ << " not connected: " << rejected_commands_ << " commands rejected so far" << std::endl;
+    return;
+  }
+  if (!backend_->areMotorsEnabled())
+    std::cout << "Motors disabled." << std::endl;
+  if (skip_first_)
+    skip_first_--;
+  else {
+    struct timeval dummy;
+    SeekurJrRC::Utils::timeOfDay(&dummy);
+    average_ = (average_ * counter_ + SeekurJrRC::Utils::gTODDiffToMsec(&dummy, &lastMotorsUpdate_)) / (float)(counter_+1);
+    counter_++;
+  }
+  float v_trans = 0.5 * (left + right);
+  float omega = (right - left) / config.wheelbase_divisor_;
+  FlightRecorder::record(SeekurJrRC::Core::FLIGHT_COMMAND, robot_id_, 0, left, right, v_trans, omega);
+  driving_ = true;
+  stop_requested_ = false;
+  ++telemetry_sample_.commands_;
+  telemetry_sample_.left_ = left;
+  telemetry_sample_.right_ = right;
+  telemetry_sample_.v_trans_ = v_trans;
+  telemetry_sample_.omega_ = omega;
+  publishTelemetry();
+  if (control_loop_.enabled())
+    control_loop_.setTarget(v_trans, omega);
+  else
+    shaper_.setVelocities(v_trans, omega);
+  FrameTracer::mark(SeekurJrRC::Core::TRACE_COMMAND_SENT);
+  SeekurJrRC::Utils::timeOfDay(&lastMotorsUpdate_);
+  FrameTracer::mark(SeekurJrRC::Core::TRACE_WATCHDOG_REARMED);
+}
@@ -2,63 +2,154 @@
 #define DRIVE_HPP_
 
 #include <sys/time.h> // for struct timeval
+#include <stdint.h>
 
 // boost
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
-#include "Aria.h"
-
-#include "server.hpp"
+#include "message.hpp"
+#include "robot_backend.hpp"
+#include "steering_model.hpp"
+#include "control_loop.hpp"
+#include "orientation_filter.hpp"
+#include "utils.hpp"
+#include "handler_allocator.hpp"
+#include "flight_recorder.hpp"
+#include "telemetry.hpp"
+#include "shadow.hpp"
+#include "virtual_timer.hpp"
+#include "command_shaper.hpp"
 
 namespace SeekurJrRC {
   namespace Core {
     /**
-     * 
-     * Klasa komunikująca się bezpośrednio z firmware'm robota; w tej klasie jest też zaimplementowany watchdog.
+     *
+     * Klasa komunikująca się bezpośrednio z firmware'm robota (przez RobotBackend); w tej klasie jest też zaimplementowany watchdog.
      * Watchdog sprawdza co określony czas, czy od ostatniego ustawienia prędkości silników nie minął ustalony wcześniej timeout;
-     * jeżeli tak, wyłącza silniki
+     * jeżeli tak, wyłącza silniki.
+     *
+     * Jeden Driver obsługuje jednego robota floty i ma własny stan (watchdog, historię wskazań akcelerometru).
+     * Wszystkie metody muszą być wołane z wątku, który obsługuje io_service przekazany w konstruktorze.
+     *
+     * Połączenie z robotem jest nawiązywane w tle, we własnym wątku (connectLoop), z rosnącą przerwą między próbami
+     * ([fleet] connect_retry_min/max), więc serwer przyjmuje połączenia od razu, a zerwane łącze nie kończy procesu.
+     * Dopóki robot nie jest połączony, komendy są odrzucane (i liczone); zerwanie łącza wykrywa watchdog
+     * i wtedy zaczyna łączyć się od nowa. W trybie symulacji (VirtualClock) zamiast wątku kolejne próby są zdarzeniami
+     * timera connect_timer_.
      */
-    class Driver  : public boost::asio::io_service::service
+    class Driver
     {
     public:
-      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
-      static boost::asio::io_service::id id;
-      /// konstruktor, ustawia timer
-      explicit Driver(boost::asio::io_service& ios);
-      /// pusty destruktor
-      ~Driver() {};
+      /// konstruktor, ustawia timer i zaczyna łączyć się z robotem (w tle); przejmuje backend na własność
+      Driver(boost::asio::io_service& ios, uint32_t robot_id, RobotBackend* backend);
+      ~Driver();
       /**
-       * 
+       *
        * Callback timera (watchdog'a). Jednocześnie po sprawdzeniu na nowo ustawia timer
        */
-      void checkMotors(boost::shared_ptr<boost::asio::deadline_timer> & p_checkMotorsTimer);
+      void checkMotors(boost::shared_ptr<SeekurJrRC::Utils::Timer> & p_checkMotorsTimer);
       /**
-       * 
+       *
        * Przyjęcie wiadomości od usługi serwera TCP i jej przetworzenie, tj. obliczenie prędkości obu stron
-       * w/g odpowiedniego modelu sterowania i nadanie tych prędkości robotowi
+       * w/g odpowiedniego modelu sterowania i nadanie tych prędkości robotowi.
+       * config - migawka z ConfigGuard'a wołającego, wspólna dla całej ramki (tak samo w metodach poniżej)
        */
-      void processMessage(TCPMessage& message);
-      
+      void processMessage(TCPMessage& message, const Config& config);
+      /// paczka wskazań akcelerometru: starsze tylko do historii i fuzji, komenda - z najnowszego
+      void processBundle(const BundleMessage& bundle, const Config& config);
+      /// orientacja urządzenia (jak w TCPMessage) -> prędkości kół w/g modelu steering_model_code
+      void processOrientation(uint8_t steering_model_code, float x, float y, float z, const Config& config);
+      /// prędkości kątowe z żyroskopu [rad/s]; tylko aktualizują fuzję, robot jedzie dopiero po wskazaniu akcelerometru
+      void processGyroRates(float x, float y, float z, const Config& config);
+      /// gotowe prędkości kół [mm/s]; wspólny koniec ścieżki wszystkich źródeł komend (TCP, pamięć współdzielona)
+      void processWheelVelocities(float left, float right, const Config& config);
+      /// komenda "nie jedź" (startStop == 0): robot zatrzyma watchdog, ale na życzenie operatora, więc bez zrzutu rejestratora
+      void processIdle();
+      /// zatrzymanie robota i watchdog'a; wołane przy zakończeniu programu
+      void shutdown();
+
+      boost::asio::io_service& ioService() { return *p_IOService_; }
+      uint32_t robotId() const { return robot_id_; }
+      /// ostatni stan robota dla obserwatorów; czytany przez wątek telemetrii
+      const TelemetrySlot& telemetry() const { return telemetry_; }
+      /// robot połączony i przyjmuje komendy
+      bool connected() const { return connected_; }
+      /// migawki wejścia modeli dla trybu cienia; czytane przez wątek ShadowEvaluator
+      ShadowChannel& shadow() { return shadow_; }
+
     private:
-      ArRobot* robot_;
-      ArRobotConnector* robot_connector_;
-      ArArgumentParser* robot_arg_parser_;
+      /// wskazanie akcelerometru z ramki albo najnowsze z paczki: jazda albo "nie jedź"
+      void processAccelerometer(bool start_stop, uint8_t steering_model_code, float x, float y, float z, const Config& config);
+      /// start wątku łączącego się z robotem
+      void startConnecting();
+      /// wątek łączący: próby connect() z rosnącą przerwą, aż do skutku albo shutdown()
+      void connectLoop();
+      /// to samo w trybie symulacji: jedna próba, a po niepowodzeniu następna po delay [msec] czasu wirtualnego
+      void connectAttempt(unsigned int attempt, long delay);
+      /// udane połączenie (zlecone przez connectLoop do wątku robota)
+      void handleConnected(unsigned int attempts);
+      /// zerwane łącze wykryte przez watchdog
+      void handleLinkLost();
+
+      /// aktualizacja czasu i flag telemetry_sample_ i publikacja
+      void publishTelemetry();
+
+      uint32_t robot_id_;
+      RobotBackend* backend_;
       /// pointer do naszego właściciela (w sumie czemu nie referencja?)
       boost::asio::io_service* p_IOService_;
-      /// timeout na zatrzymanie silników
-      const static long stopMotorsTimeout_ = 300; // in milliseconds
-      /// odstęp czasowy kolejnych wywołań watchdog'a
-      const static long stopMotorsCheckInterval_ = 50; // in milliseconds
+      boost::shared_ptr<SeekurJrRC::Utils::Timer> p_checkMotorsTimer_;
+      /// pamięć na oczekujący handler watchdog'a (bez alokacji co stopMotorsCheckInterval)
+      HandlerMemory watchdog_handler_memory_;
+      /// komendy do robota (także z pętli sterowania) idą przez kształtowanie na łączu szeregowym
+      CommandShaper shaper_;
+      /// opcjonalna pętla sterowania o stałej częstotliwości
+      ControlLoop control_loop_;
+      /// historia wskazań akcelerometru tego robota (stan filtrów)
+      acc_history history_;
+      /// fuzja akcelerometru i żyroskopu tego robota (modele *_FUSED_MODEL_CODE)
+      OrientationFilter orientation_;
+      /// miejsce na model sterowania bieżącej wiadomości
+      SteeringModelStorage model_storage_;
       /// czas ostatniej zmiany prędkości silników
-      static struct timeval lastMotorsUpdate_;
-      /// ficzer boost::asio::io_service; przy zakończeniu programu będziemy mogli spokojnie zatrzymac robota
-      void shutdown_service();
-      static struct timeval nowTime_;
+      struct timeval lastMotorsUpdate_;
+      /// wątek łączący; backend należy do niego, dopóki connected_ == false
+      boost::thread connect_thread_;
+      SeekurJrRC::Utils::Timer connect_timer_;
+      boost::atomic<bool> stopping_;
+      bool connected_;
+      /// początek bieżącego łączenia (CLOCK_MONOTONIC) [ns], liczba udanych połączeń i komend odrzuconych bez robota
+      int64_t connect_started_ns_;
+      unsigned int links_;
+      uint64_t rejected_commands_;
+      /// odczyty żyroskopu odrzucone jako NaN/inf albo poza zakresem
+      uint64_t rejected_gyro_rates_;
+      /// ramki z kodem modelu, którego nie ma (liczone przez BilinearNoFiltModel)
+      uint64_t fallback_models_;
+      /// robot jedzie (od komendy do zatrzymania przez watchdog) i czy klient poprosił o zatrzymanie
+      bool driving_;
+      bool stop_requested_;
+      /// stan dla telemetrii: składany tutaj, publikowany w telemetry_ po każdej zmianie
+      TelemetrySample telemetry_sample_;
+      TelemetrySlot telemetry_;
+      /// kolejka migawek do trybu cienia (pusta, jeżeli tryb cienia jest wyłączony)
+      ShadowChannel shadow_;
+      struct timeval nowTime_;
+
+      /// jitter watchdog'a
+      SeekurJrRC::Utils::JitterStats watchdog_jitter_;
+      /// statystyka odstępów pomiędzy kolejnymi komendami
+      uint64_t counter_;
+      uint64_t skip_first_;
+      float average_;
     };
-    
-    
+
+
   }
 }
 
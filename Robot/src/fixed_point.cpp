@@ -0,0 +1,150 @@
+#include "fixed_point.hpp"
+
+using SeekurJrRC::Utils::fixed_t;
+using SeekurJrRC::Utils::fixedMul;
+using SeekurJrRC::Utils::fixedDiv;
+using SeekurJrRC::Utils::fixedSqrt;
+using SeekurJrRC::Utils::isqrt64;
+
+namespace {
+  /// atan(2^-i) [deg] w Q16.16
+  const fixed_t cordic_angles[FIXED_CORDIC_ITERATIONS] = {
+    2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335, 14668, 7334, 3667,
+    1833, 917, 458, 229, 115, 57, 29, 14, 7, 4, 2
+  };
+
+  /// najwięcej punktów, na których liczy fixedShepard (siatka ma CONTROL_POINTS_COUNT)
+  const int shepard_max_points = 16;
+
+  inline int64_t abs64(int64_t value)
+  {
+    return value < 0 ? -value : value;
+  }
+}
+
+fixed_t SeekurJrRC::Utils::fixedAtan2Deg(fixed_t y, fixed_t x)
+{
+  int64_t scaled_x = x, scaled_y = y;
+  int64_t magnitude = abs64(scaled_x) > abs64(scaled_y) ? abs64(scaled_x) : abs64(scaled_y);
+  if (!magnitude)
+    return 0;
+  // the angle does not depend on the length; bring the larger coordinate to [2^28, 2^29) for the full precision
+  // of the rotations, leaving room for the CORDIC gain (~1.65) and the diagonal (sqrt(2)) below 2^31
+  while (magnitude < (1LL << 28)) {
+    scaled_x <<= 1;
+    scaled_y <<= 1;
+    magnitude <<= 1;
+  }
+  while (magnitude >= (1LL << 29)) {
+    scaled_x >>= 1;
+    scaled_y >>= 1;
+    magnitude >>= 1;
+  }
+  int32_t cx = (int32_t)scaled_x, cy = (int32_t)scaled_y;
+  fixed_t angle = 0;
+  // CORDIC converges for |angle| < ~99 deg; the left half-plane is first turned by 90 deg
+  if (cx < 0) {
+    const int32_t old_x = cx;
+    if (cy >= 0) {
+      cx = cy;
+      cy = -old_x;
+      angle = 90 * FIXED_ONE;
+    }
+    else {
+      cx = -cy;
+      cy = old_x;
+      angle = -90 * FIXED_ONE;
+    }
+  }
+  // vectoring mode: rotate towards the x axis, summing up the rotations
+  for (int i = 0; i < FIXED_CORDIC_ITERATIONS; ++i) {
+    const int32_t next_x = (cy > 0) ? cx + (cy >> i) : cx - (cy >> i);
+    if (cy > 0) {
+      cy -= cx >> i;
+      angle += cordic_angles[i];
+    }
+    else {
+      cy += cx >> i;
+      angle -= cordic_angles[i];
+    }
+    cx = next_x;
+  }
+  return angle;
+}
+
+void SeekurJrRC::Utils::fixedNormalize(fixed_t& x, fixed_t& y, fixed_t& z)
+{
+  // |x|, |y|, |z| < 2^31: the squares sum up below 2^64, the length below 2^32
+  const int64_t length = isqrt64((uint64_t)((int64_t)x * x) + (uint64_t)((int64_t)y * y) + (uint64_t)((int64_t)z * z));
+  if (!length)
+    return;
+  // multiplied rather than shifted: shifting a negative value left is undefined
+  x = (fixed_t)(((int64_t)x * ((int64_t)1 << FIXED_UNIT_BITS)) / length);
+  y = (fixed_t)(((int64_t)y * ((int64_t)1 << FIXED_UNIT_BITS)) / length);
+  z = (fixed_t)(((int64_t)z * ((int64_t)1 << FIXED_UNIT_BITS)) / length);
+}
+
+void SeekurJrRC::Utils::fixedOrientationDeg(fixed_t a_x, fixed_t a_y, fixed_t a_z, fixed_t& phi, fixed_t& theta)
+{
+  phi = fixedAtan2Deg(a_y, a_z);
+  const fixed_t yz_length = (fixed_t)isqrt64((uint64_t)((int64_t)a_y * a_y) + (uint64_t)((int64_t)a_z * a_z));
+  theta = fixedAtan2Deg(a_x, yz_length);
+}
+
+std::pair<fixed_t, fixed_t> SeekurJrRC::Utils::fixedShepard(fixed_t phi, fixed_t theta, const fixed_t* c_phi, const fixed_t* c_theta,
+                                                             const fixed_t* c_a, const fixed_t* c_b, int count, unsigned int twice_p)
+{
+  if (count <= 0)
+    return std::make_pair(0, 0);
+  if (count > shepard_max_points)
+    count = shepard_max_points;
+  fixed_t distance[shepard_max_points];
+  int nearest = 0;
+  for (int i = 0; i < count; ++i) {
+    const int64_t d_phi = (int64_t)phi - c_phi[i];
+    const int64_t d_theta = (int64_t)theta - c_theta[i];
+    distance[i] = (fixed_t)isqrt64((uint64_t)(d_phi * d_phi + d_theta * d_theta));
+    if (distance[i] < distance[nearest])
+      nearest = i;
+  }
+  if (!distance[nearest])
+    return std::make_pair(c_a[nearest], c_b[nearest]);
+
+  int64_t weight_sum = 0;
+  int64_t nominator_a = 0;
+  int64_t nominator_b = 0;
+  for (int i = 0; i < count; ++i) {
+    // (d_min / d)^p: p / 2 multiplications and a square root for the half
+    const fixed_t ratio = fixedDiv(distance[nearest], distance[i]);
+    fixed_t weight = FIXED_ONE;
+    for (unsigned int k = 0; k < twice_p / 2; ++k)
+      weight = fixedMul(weight, ratio);
+    if (twice_p & 1)
+      weight = fixedMul(weight, fixedSqrt(ratio));
+    weight_sum += weight;
+    nominator_a += (int64_t)weight * c_a[i];
+    nominator_b += (int64_t)weight * c_b[i];
+  }
+  // the nearest point has weight 1, so the sum is never 0
+  return std::make_pair((fixed_t)(nominator_a / weight_sum), (fixed_t)(nominator_b / weight_sum));
+}
+
+std::pair<fixed_t, fixed_t> SeekurJrRC::Utils::fixedBilinear(fixed_t phi, fixed_t theta, const fixed_t* c_phi, const fixed_t* c_theta,
+                                                              const fixed_t* c_a, const fixed_t* c_b, int i_11, int i_12, int i_21, int i_22)
+{
+  const int64_t dx = (int64_t)c_phi[i_22] - c_phi[i_11];
+  const int64_t dy = (int64_t)c_theta[i_22] - c_theta[i_11];
+  const int64_t to_right = (int64_t)c_phi[i_22] - phi;
+  const int64_t from_left = (int64_t)phi - c_phi[i_11];
+  const int64_t to_top = (int64_t)c_theta[i_22] - theta;
+  const int64_t from_bottom = (int64_t)theta - c_theta[i_11];
+
+  // along phi on the bottom (R1) and the top (R2) edge, then along theta
+  const int64_t f_R1_a = (c_a[i_11] * to_right + c_a[i_21] * from_left) / dx;
+  const int64_t f_R1_b = (c_b[i_11] * to_right + c_b[i_21] * from_left) / dx;
+  const int64_t f_R2_a = (c_a[i_12] * to_right + c_a[i_22] * from_left) / dx;
+  const int64_t f_R2_b = (c_b[i_12] * to_right + c_b[i_22] * from_left) / dx;
+
+  return std::make_pair((fixed_t)((f_R1_a * to_top + f_R2_a * from_bottom) / dy),
+                        (fixed_t)((f_R1_b * to_top + f_R2_b * from_bottom) / dy));
+}
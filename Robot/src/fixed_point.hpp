@@ -0,0 +1,183 @@
+#ifndef FIXED_POINT_HPP_
+#define FIXED_POINT_HPP_
+
+#include <stdint.h>
+#include <utility> // for std::pair
+
+/// liczba bitów części ułamkowej (Q16.16); kąty są w stopniach, więc zakres +-32768 z dużym zapasem wystarcza
+#define FIXED_FRACTION_BITS 16
+#define FIXED_ONE (1 << FIXED_FRACTION_BITS)
+/// składowe wektorów jednostkowych (|v| <= 1) mają więcej bitów ułamka (Q2.29): kąt z dwóch małych składowych
+/// (telefon blisko pionu) w Q16.16 byłby obarczony błędem kwantyzacji rzędu setnych stopnia
+#define FIXED_UNIT_BITS 29
+/// surowe wskazania akcelerometru [m/s^2] na wejściu normalizacji (Q12.20, zakres +-2048 m/s^2) - z tego samego powodu
+#define FIXED_RAW_BITS 20
+/// liczba obrotów CORDIC; kolejne obroty (atan(2^-i) < 2^-16 stopnia) nie zmieniają już wyniku
+#define FIXED_CORDIC_ITERATIONS 22
+
+/// gwarantowane (sprawdzane przez bench/fixed_accuracy.cpp) odchylenie jąder stałoprzecinkowych od ścieżki float:
+/// kąty phi/theta [deg], składowe wektora znormalizowanego, wyniki interpolacji alpha/beta (przy |z| <= 1)
+#define FIXED_MAX_ANGLE_ERROR_DEG 0.002
+#define FIXED_MAX_NORMALIZED_ERROR 0.0001
+#define FIXED_MAX_INTERPOLATION_ERROR 0.001
+
+namespace SeekurJrRC {
+  namespace Utils {
+
+    /**
+     *
+     * Jądra stałoprzecinkowe ścieżki sterowania, dla komputerów robota bez (szybkiego) FPU: normalizacja wskazania
+     * akcelerometru, kąty phi/theta, interpolacja Sheparda i dwuliniowa na siatce punktów kontrolnych oraz filtry
+     * historii. Wybierane przy kompilacji (make FIXED_POINT=1, SEEKURJRRC_FIXED_POINT); bez tej flagi modele liczą
+     * jak dotychczas na float i libm.
+     *
+     * Wszystko w Q16.16 na int32_t, iloczyny i ilorazy przez int64_t. Pierwiastek to pierwiastek całkowitoliczbowy
+     * (cyfra po cyfrze), atan2 - CORDIC w trybie wektorowym z tablicą kątów w stopniach; potęga odległości w metodzie
+     * Sheparda (wykładnik p = n/2) to n mnożeń i jeden pierwiastek, bez pow(). Żadne jądro nie woła libm.
+     * Dokładność względem ścieżki float: FIXED_MAX_*; sprawdza ją (i mierzy oba warianty) bench/fixed_accuracy.cpp.
+     */
+    typedef int32_t fixed_t;
+
+    /// konwersje na granicy (wartości z sieci i z konfiguracji, wynik dla robota); bits - liczba bitów ułamka.
+    /// Wartość spoza zakresu fixed_t jest przycinana do niego, a NaN i nieskończoność dają 0 - wskazania z sieci
+    /// (np. |x| >= 2048 w Q12.20) nie są wcześniej sprawdzane, a rzutowanie takiego floata na int32_t jest niezdefiniowane
+    inline fixed_t toFixed(float value, int bits = FIXED_FRACTION_BITS)
+    {
+      const float scaled = value * (float)(1 << bits);
+      // NaN and +-inf (also after the scaling) are the only values for which this is not 0
+      if (scaled - scaled != 0)
+        return 0;
+      if (scaled >= 2147483648.0f)
+        return 2147483647;
+      if (scaled <= -2147483648.0f)
+        return -2147483647 - 1;
+      return (fixed_t)(scaled + (value >= 0 ? 0.5f : -0.5f));
+    }
+
+    inline float toFloat(fixed_t value, int bits = FIXED_FRACTION_BITS)
+    {
+      return value * (1.0f / (1 << bits));
+    }
+
+    /// iloczyn z zaokrągleniem
+    inline fixed_t fixedMul(fixed_t a, fixed_t b)
+    {
+      return (fixed_t)(((int64_t)a * b + (FIXED_ONE >> 1)) >> FIXED_FRACTION_BITS);
+    }
+
+    /// iloraz; b != 0
+    inline fixed_t fixedDiv(fixed_t a, fixed_t b)
+    {
+      return (fixed_t)(((int64_t)a * ((int64_t)1 << FIXED_FRACTION_BITS)) / b);
+    }
+
+    /// część całkowita pierwiastka (metoda cyfra po cyfrze, tylko przesunięcia i odejmowania)
+    inline uint32_t isqrt64(uint64_t value)
+    {
+      if (!value)
+        return 0;
+      uint64_t result = 0;
+      // the highest power of four not above the value
+      uint64_t bit = (uint64_t)1 << ((63 - __builtin_clzll(value)) & ~1);
+      while (bit) {
+        if (value >= result + bit) {
+          value -= result + bit;
+          result = (result >> 1) + bit;
+        }
+        else
+          result >>= 1;
+        bit >>= 2;
+      }
+      return (uint32_t)result;
+    }
+
+    /// pierwiastek z liczby nieujemnej
+    inline fixed_t fixedSqrt(fixed_t value)
+    {
+      return value <= 0 ? 0 : (fixed_t)isqrt64((uint64_t)value << FIXED_FRACTION_BITS);
+    }
+
+    /// sqrt(x^2 + y^2 + z^2), bez przepełnienia dla |x|, |y|, |z| < 2^15
+    inline fixed_t fixedLength(fixed_t x, fixed_t y, fixed_t z)
+    {
+      return (fixed_t)isqrt64((uint64_t)((int64_t)x * x) + (uint64_t)((int64_t)y * y) + (uint64_t)((int64_t)z * z));
+    }
+
+    /// atan2(y, x) w stopniach (Q16.16, (-180, 180]); x i y w dowolnej wspólnej skali; atan2(0, 0) = 0 jak w libm
+    fixed_t fixedAtan2Deg(fixed_t y, fixed_t x);
+
+    /// normalizacja wektora w miejscu: wejście w dowolnej skali (w modelach FIXED_RAW_BITS), wynik w FIXED_UNIT_BITS;
+    /// wektor zerowy zostaje zerowy
+    void fixedNormalize(fixed_t& x, fixed_t& y, fixed_t& z);
+
+    /**
+     * \param a_x, a_y, a_z - wektor grawitacji w dowolnej wspólnej skali (np. jednostkowy w FIXED_UNIT_BITS), |a| < 2^30
+     * \param phi, theta    - kąty jak SteeringModelBase::getPhiDeg / getThetaDeg [deg]
+     *
+     * theta liczone jest jako atan2(a_x, sqrt(a_y^2 + a_z^2)), co jest tożsame ze wzorem ścieżki float
+     * (a_y sin(phi) + a_z cos(phi) = sqrt(a_y^2 + a_z^2)), a nie potrzebuje sinusa ani cosinusa.
+     */
+    void fixedOrientationDeg(fixed_t a_x, fixed_t a_y, fixed_t a_z, fixed_t& phi, fixed_t& theta);
+
+    /**
+     * \param twice_p - podwojony wykładnik metody Sheparda (3 dla p = 1.5, 9 dla p = 4.5)
+     *
+     * Metoda Sheparda na count punktach. Wagi to (d_min / d_i)^p zamiast d_i^-p - ten sam wynik po podzieleniu przez
+     * sumę wag, a wszystkie wagi są w (0, 1], więc nic nie wychodzi poza zakres Q16.16. Punkt trafiony dokładnie
+     * (d = 0) daje swoją wartość (ścieżka float daje wtedy NaN).
+     */
+    std::pair<fixed_t, fixed_t> fixedShepard(fixed_t phi, fixed_t theta, const fixed_t* c_phi, const fixed_t* c_theta,
+                                             const fixed_t* c_a, const fixed_t* c_b, int count, unsigned int twice_p);
+
+    /**
+     * Interpolacja dwuliniowa w prostokącie punktów i_11 (lewy dolny), i_21, i_12, i_22 (prawy górny) -
+     * te same indeksy i wzór co SteeringModelBase::bilinear.
+     */
+    std::pair<fixed_t, fixed_t> fixedBilinear(fixed_t phi, fixed_t theta, const fixed_t* c_phi, const fixed_t* c_theta,
+                                              const fixed_t* c_a, const fixed_t* c_b, int i_11, int i_12, int i_21, int i_22);
+
+    /**
+     *
+     * Średnie wektorów historii (najnowszy pierwszy): zwykła (SMA) i wykładnicza (EMA, alpha = 2 / (n + 1)),
+     * jak SteeringModelBase::getCurrentValueFiltered*. Wektory dokłada się po kolei przez add(), bez kopiowania historii;
+     * wynik ma ten sam format co wejście (w modelach - wektory jednostkowe w FIXED_UNIT_BITS).
+     */
+    class FixedAverage {
+    public:
+      /// exponential - EMA zamiast SMA; size - liczba wektorów, które zostaną dodane
+      FixedAverage(bool exponential, unsigned int size)
+        : sum_x_(0), sum_y_(0), sum_z_(0), weight_sum_(0), coeff_(FIXED_ONE), decay_(FIXED_ONE), exponential_(exponential)
+      {
+        if (exponential)
+          decay_ = FIXED_ONE - fixedDiv(2 * FIXED_ONE, (fixed_t)(size + 1) * FIXED_ONE);
+      };
+
+      void add(fixed_t x, fixed_t y, fixed_t z) {
+        sum_x_ += (int64_t)coeff_ * x;
+        sum_y_ += (int64_t)coeff_ * y;
+        sum_z_ += (int64_t)coeff_ * z;
+        weight_sum_ += coeff_;
+        if (exponential_)
+          coeff_ = fixedMul(coeff_, decay_);
+      }
+
+      /// średnia; pusta historia daje wektor zerowy
+      void result(fixed_t& x, fixed_t& y, fixed_t& z) const {
+        const int64_t weight_sum = weight_sum_ ? weight_sum_ : FIXED_ONE;
+        x = (fixed_t)(sum_x_ / weight_sum);
+        y = (fixed_t)(sum_y_ / weight_sum);
+        z = (fixed_t)(sum_z_ / weight_sum);
+      }
+
+    private:
+      /// sumy ważone (waga w Q16.16 razy wejście) i suma wag w Q16.16
+      int64_t sum_x_, sum_y_, sum_z_;
+      int64_t weight_sum_;
+      fixed_t coeff_;
+      fixed_t decay_;
+      bool exponential_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <sstream>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "fleet.hpp"
+#include "config.hpp"
+#include "robot_backend.hpp"
+#include "realtime.hpp"
+
+using SeekurJrRC::Core::Fleet;
+using SeekurJrRC::Core::Driver;
+using SeekurJrRC::Core::ShmIngress;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::RobotConfig;
+
+boost::asio::io_service::id Fleet::id;
+
+Fleet::Fleet(boost::asio::io_service& ios) : service(ios)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  // a simulation (simulation.hpp) runs everything in the main thread, on simulated robots and without network input
+  const bool simulation = SeekurJrRC::Utils::VirtualClock::enabled();
+
+  for (unsigned int i = 0; i < config.fleet_threads_ && !simulation; ++i)
+    shards_.push_back(new Shard());
+
+  for (unsigned int i = 0; i < config.robots_.size(); ++i) {
+    const RobotConfig& robot = config.robots_[i];
+    boost::asio::io_service& robot_ios = shards_.empty() ? ios : shards_[i % shards_.size()]->ios_;
+
+    RobotBackend* backend;
+    if (robot.backend_ == "simulated" || simulation)
+      backend = new SimulatedRobotBackend(robot);
+    else
+      backend = new AriaRobotBackend(robot);
+
+    std::cout << "Robot " << robot.id_ << " (" << (simulation ? "simulated" : robot.backend_) << ")" << std::endl;
+    Driver* driver = new Driver(robot_ios, robot.id_, backend);
+    drivers_.push_back(driver);
+    drivers_by_id_[robot.id_] = driver;
+
+    if (simulation)
+      continue;
+
+    if (robot.port_)
+      servers_.push_back(new TCPServer(robot_ios, robot.port_, driver));
+
+    if (config.shm_enabled_)
+      ingresses_.push_back(new ShmIngress(robot_ios, driver, shmSegmentName(config.shm_prefix_, robot.id_), config.shm_poll_interval_));
+  }
+
+  if (config.fleet_port_ && !simulation)
+    servers_.push_back(new TCPServer(ios, config.fleet_port_, NULL));
+
+  // start the threads only when every robot is in place
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+    shards_[i]->thread_ = boost::thread(boost::bind(&Fleet::runShard, shards_[i], i));
+}
+
+void Fleet::runShard(Shard* shard, unsigned int index)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.realtime_enabled_) {
+    std::ostringstream name;
+    name << "fleet thread " << index;
+    SeekurJrRC::Utils::applyRealtimeThreadPolicy(config.realtime_control_cpus_, config.realtime_control_priority_, name.str().c_str());
+  }
+  shard->ios_.run();
+}
+
+Driver* Fleet::findDriver(uint32_t robot_id)
+{
+  std::map<uint32_t, Driver*>::const_iterator it = drivers_by_id_.find(robot_id);
+  return (it == drivers_by_id_.end()) ? NULL : it->second;
+}
+
+void Fleet::shutdown_service()
+{
+  for (unsigned int i = 0; i < shards_.size(); ++i) {
+    shards_[i]->ios_.stop();
+    shards_[i]->thread_.join();
+  }
+
+  for (unsigned int i = 0; i < servers_.size(); ++i)
+    delete servers_[i];
+  servers_.clear();
+
+  for (unsigned int i = 0; i < ingresses_.size(); ++i) {
+    ingresses_[i]->shutdown();
+    delete ingresses_[i];
+  }
+  ingresses_.clear();
+
+  for (unsigned int i = 0; i < drivers_.size(); ++i) {
+    drivers_[i]->shutdown();
+    delete drivers_[i];
+  }
+  drivers_.clear();
+  drivers_by_id_.clear();
+
+  for (unsigned int i = 0; i < shards_.size(); ++i)
+    delete shards_[i];
+  shards_.clear();
+}
@@ -0,0 +1,67 @@
+#ifndef FLEET_HPP_
+#define FLEET_HPP_
+
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include "driver.hpp"
+#include "server.hpp"
+#include "shm_ingress.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Usługa zarządzająca wszystkimi robotami procesu. Dla każdego robota z konfiguracji tworzy backend, Driver'a
+     * (z własnym watchdog'iem i historią) oraz - jeżeli robot ma własny port - TCPServer.
+     *
+     * Roboty są rozdzielane (round-robin) na fleet_threads_ wątków; każdy wątek ma własny io_service, więc wszystko, co
+     * dotyczy jednego robota (połączenie, model, watchdog), dzieje się w jednym wątku i bez blokad.
+     * Przy włączonym [shm] każdy robot dostaje też wejście komend przez pamięć współdzieloną (ShmIngress).
+     * Przy fleet_threads_ == 0 wszystko działa w głównej pętli programu, tak jak dawniej; w trybie symulacji
+     * (simulation.hpp) też, a do tego wszystkie roboty są symulowane, bez portów i bez [shm].
+     */
+    class Fleet : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      explicit Fleet(boost::asio::io_service& ios);
+      ~Fleet() {};
+
+      /// Driver robota o podanym id albo NULL; wolno wołać z dowolnego wątku (mapa nie zmienia się po starcie)
+      Driver* findDriver(uint32_t robot_id);
+      /// wszystkie Driver'y, w kolejności z konfiguracji (lista nie zmienia się po starcie)
+      const std::vector<Driver*>& drivers() const { return drivers_; }
+
+    private:
+      /// ficzer boost::asio::io_service; przy zakończeniu programu zatrzymujemy wątki i roboty
+      void shutdown_service();
+
+      struct Shard;
+      /// pętla wątku floty; w trybie czasu rzeczywistego najpierw ustawia politykę wątku
+      static void runShard(Shard* shard, unsigned int index);
+
+      /// wątek obsługujący część robotów
+      struct Shard {
+        Shard() : work_(ios_) {};
+        boost::asio::io_service ios_;
+        boost::asio::io_service::work work_;
+        boost::thread thread_;
+      };
+
+      std::vector<Shard*> shards_;
+      std::vector<Driver*> drivers_;
+      std::vector<TCPServer*> servers_;
+      std::vector<ShmIngress*> ingresses_;
+      std::map<uint32_t, Driver*> drivers_by_id_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include "flight_recorder.hpp"
+#include "config.hpp"
+#include "realtime.hpp"
+
+using SeekurJrRC::Core::FlightRecorder;
+using SeekurJrRC::Core::FlightRecord;
+using SeekurJrRC::Core::FlightDumpHeader;
+using SeekurJrRC::Core::FlightDumpReason;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+
+boost::asio::io_service::id FlightRecorder::id;
+FlightRecorder::Slot* FlightRecorder::slots_ = NULL;
+uint64_t FlightRecorder::mask_ = 0;
+boost::atomic<uint64_t> FlightRecorder::next_(0);
+FlightRecord* FlightRecorder::scratch_ = NULL;
+boost::atomic<bool> FlightRecorder::dumping_(false);
+boost::atomic<uint32_t> FlightRecorder::dumps_(0);
+uint32_t FlightRecorder::max_dumps_ = 1;
+FlightRecorder* FlightRecorder::writer_ = NULL;
+boost::atomic<bool> FlightRecorder::dump_requested_(false);
+char FlightRecorder::prefix_[256] = "";
+
+namespace {
+  const int fatal_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+  /// dopisuje liczbę dziesiętną (snprintf nie jest bezpieczny w handlerze sygnału); false, gdy brakuje miejsca
+  bool appendNumber(char*& out, char* end, uint64_t number)
+  {
+    char digits[20];
+    int count = 0;
+    do {
+      digits[count++] = '0' + number % 10;
+      number /= 10;
+    } while (number);
+    if (end - out < count)
+      return false;
+    while (count)
+      *out++ = digits[--count];
+    return true;
+  }
+
+  bool appendString(char*& out, char* end, const char* text)
+  {
+    size_t length = strlen(text);
+    if ((size_t)(end - out) < length)
+      return false;
+    memcpy(out, text, length);
+    out += length;
+    return true;
+  }
+
+  /// write(2) do skutku albo do błędu
+  bool writeAll(int fd, const void* data, size_t size)
+  {
+    const char* p = static_cast<const char*>(data);
+    while (size) {
+      ssize_t written = ::write(fd, p, size);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return false;
+      p += written;
+      size -= written;
+    }
+    return true;
+  }
+
+  int64_t realtimeNowNs()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+  }
+}
+
+FlightRecorder::FlightRecorder(boost::asio::io_service& ios) : service(ios), signals_(ios, SIGUSR1)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (!config.recorder_enabled_ || slots_ != NULL)
+    return;
+
+  uint64_t capacity = 1;
+  while (capacity < config.recorder_capacity_)
+    capacity <<= 1;
+  Slot* slots = new Slot[capacity];
+  for (uint64_t i = 0; i < capacity; ++i)
+    slots[i].sequence_.store(0, boost::memory_order_relaxed);
+  scratch_ = new FlightRecord[capacity];
+  // touch the copy now, so that the first dump (maybe in a signal handler) does not have to fault its pages in
+  memset(scratch_, 0, capacity * sizeof(FlightRecord));
+  strncpy(prefix_, config.recorder_prefix_.c_str(), sizeof(prefix_) - 1);
+  max_dumps_ = config.recorder_max_dumps_;
+  mask_ = capacity - 1;
+  slots_ = slots;
+  std::cout << "Flight recorder: " << capacity << " records (" << capacity * sizeof(FlightRecord) / 1024 << " KB), dumps to "
+            << prefix_ << "<pid>-<n>.bin, at most " << max_dumps_ << " per process" << std::endl;
+
+  work_.reset(new boost::asio::io_service::work(ios_));
+  thread_ = boost::thread(boost::bind(&FlightRecorder::run, this));
+  writer_ = this;
+  scheduleSignalWait();
+}
+
+void FlightRecorder::run()
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.realtime_enabled_)
+    SeekurJrRC::Utils::applyBackgroundThreadPolicy(config.realtime_control_cpus_, "flight recorder");
+  ios_.run();
+}
+
+void FlightRecorder::installFatalHandlers()
+{
+  if (slots_ == NULL)
+    return;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &FlightRecorder::handleFatalSignal;
+  sigemptyset(&action.sa_mask);
+  // one shot: the handler re-raises the signal with the default action (core dump)
+  action.sa_flags = SA_RESETHAND;
+  for (size_t i = 0; i < sizeof(fatal_signals) / sizeof(fatal_signals[0]); ++i)
+    sigaction(fatal_signals[i], &action, NULL);
+}
+
+void FlightRecorder::shutdown_service()
+{
+  boost::system::error_code ignored;
+  signals_.cancel(ignored);
+  if (writer_ != this)
+    return;
+  // the robots are already stopped (Fleet shuts down first); a dump still queued is written before the thread ends
+  work_.reset();
+  thread_.join();
+  writer_ = NULL;
+}
+
+void FlightRecorder::scheduleSignalWait()
+{
+  signals_.async_wait(
+    boost::bind(
+      &FlightRecorder::handleSignal,
+      this,
+      boost::asio::placeholders::error,
+      boost::asio::placeholders::signal_number
+    )
+  );
+}
+
+void FlightRecorder::handleSignal(const boost::system::error_code& error, int signal_number)
+{
+  if (error)
+    return;
+  requestDump(FLIGHT_DUMP_SIGNAL, signal_number);
+  scheduleSignalWait();
+}
+
+void FlightRecorder::requestDump(FlightDumpReason reason, uint32_t detail)
+{
+  FlightRecorder* writer = writer_;
+  if (writer == NULL || dump_requested_.exchange(true, boost::memory_order_acq_rel))
+    return;
+  writer->ios_.post(boost::bind(&FlightRecorder::writeDump, writer, reason, detail));
+}
+
+void FlightRecorder::writeDump(FlightDumpReason reason, uint32_t detail)
+{
+  // cleared before the copy starts: whatever happens from now on can be covered by the next dump
+  dump_requested_.store(false, boost::memory_order_release);
+  char path[512];
+  if (!dump(reason, detail, path, sizeof(path)))
+    return;
+  if (reason == FLIGHT_DUMP_WATCHDOG)
+    std::cout << "\rRobot " << detail << ": flight recorder dumped to " << path << std::endl;
+  else
+    std::cout << "\rSIGUSR1 received, flight recorder dumped to " << path << std::endl;
+}
+
+void FlightRecorder::handleFatalSignal(int signal_number)
+{
+  // a dump on the recorder's thread would make this one give up; let it finish first (at most a second)
+  struct timespec pause = {0, 10000000};
+  for (int i = 0; i < 100 && dumping_.load(boost::memory_order_acquire); ++i)
+    nanosleep(&pause, NULL);
+  char path[512];
+  if (dump(FLIGHT_DUMP_FATAL, signal_number, path, sizeof(path))) {
+    static const char message[] = "\nFatal signal, flight recorder dumped to ";
+    writeAll(STDERR_FILENO, message, sizeof(message) - 1);
+    writeAll(STDERR_FILENO, path, strlen(path));
+    writeAll(STDERR_FILENO, "\n", 1);
+  }
+  raise(signal_number);
+}
+
+bool FlightRecorder::dump(FlightDumpReason reason, uint32_t detail, char* path, size_t path_size)
+{
+  if (slots_ == NULL || path_size == 0)
+    return false;
+  // a fatal signal during a dump, or two robots stopping at once: the dump already in progress covers both
+  if (dumping_.exchange(true, boost::memory_order_acquire))
+    return false;
+
+  record(FLIGHT_DUMP, reason == FLIGHT_DUMP_WATCHDOG ? detail : 0, reason, reason == FLIGHT_DUMP_WATCHDOG ? 0 : detail);
+
+  char* out = path;
+  char* end = path + path_size - 1;
+  bool named = appendString(out, end, prefix_) && appendNumber(out, end, getpid()) && appendString(out, end, "-")
+    && appendNumber(out, end, dumps_.fetch_add(1, boost::memory_order_relaxed) % max_dumps_) && appendString(out, end, ".bin");
+  *out = '\0';
+
+  FlightDumpHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic_ = FLIGHT_DUMP_MAGIC;
+  header.version_ = FLIGHT_DUMP_VERSION;
+  header.record_size_ = sizeof(FlightRecord);
+  header.capacity_ = mask_ + 1;
+  header.reason_ = reason;
+  header.detail_ = detail;
+  header.next_ = next_.load(boost::memory_order_acquire);
+  header.monotonic_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+  header.realtime_ns_ = realtimeNowNs();
+  header.pid_ = getpid();
+
+  // seqlock read of every slot; records written concurrently are left out (sequence_ = 0)
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    const Slot& slot = slots_[i];
+    FlightRecord& copy = scratch_[i];
+    const uint32_t before = slot.sequence_.load(boost::memory_order_acquire);
+    copy.time_ns_ = slot.time_ns_;
+    memcpy(copy.values_, slot.values_, sizeof(copy.values_));
+    copy.robot_id_ = slot.robot_id_;
+    copy.event_ = slot.event_;
+    copy.code_ = slot.code_;
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    copy.sequence_ = (slot.sequence_.load(boost::memory_order_relaxed) == before) ? before : 0;
+  }
+
+  bool written = false;
+  if (named) {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      written = writeAll(fd, &header, sizeof(header)) && writeAll(fd, scratch_, (mask_ + 1) * sizeof(FlightRecord));
+      ::close(fd);
+    }
+  }
+  dumping_.store(false, boost::memory_order_release);
+  return written;
+}
@@ -0,0 +1,203 @@
+#ifndef FLIGHT_RECORDER_HPP_
+#define FLIGHT_RECORDER_HPP_
+
+#include <string>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/static_assert.hpp>
+
+#include "utils.hpp"
+
+#define FLIGHT_DUMP_MAGIC 0x5246434A /* "JCFR" */
+#define FLIGHT_DUMP_VERSION 1
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /// rodzaj zdarzenia w rejestratorze; znaczenie values_ w nawiasach
+    enum FlightEvent {
+      /// ramka z akcelerometru, startStop == 1 (x, y, z); code_ = kod modelu
+      FLIGHT_FRAME_DRIVE = 1,
+      /// ramka z akcelerometru, startStop == 0 - robot ma stać (x, y, z); code_ = kod modelu
+      FLIGHT_FRAME_IDLE = 2,
+      /// ramka z żyroskopu (x, y, z [rad/s])
+      FLIGHT_FRAME_GYRO = 3,
+      /// wektor podany modelowi, po ewentualnej fuzji (x, y, z); code_ = kod modelu, którego użyto
+      FLIGHT_ORIENTATION = 4,
+      /// komenda dla robota (lewe koło, prawe koło [mm/s], v_trans [mm/s], omega [deg/s])
+      FLIGHT_COMMAND = 5,
+      /// sprawdzenie watchdog'a w czasie jazdy, bez zatrzymania (czas od ostatniej komendy [msec], timeout [msec])
+      FLIGHT_WATCHDOG_OK = 6,
+      /// watchdog zatrzymał jadącego robota (czas od ostatniej komendy [msec], timeout [msec]);
+      /// code_ = 1, jeżeli klient wcześniej poprosił o zatrzymanie
+      FLIGHT_WATCHDOG_STOP = 7,
+      /// zrzut rejestratora; code_ = FlightDumpReason, values_[0] = numer sygnału
+      FLIGHT_DUMP = 8,
+      /// starsze wskazanie z paczki, tylko do historii (x, y, z, wiek względem najnowszego [msec]); code_ = kod modelu.
+      /// Najnowsze wskazanie paczki jest zapisywane jako zwykła ramka (FLIGHT_FRAME_DRIVE / FLIGHT_FRAME_IDLE)
+      FLIGHT_FRAME_BUNDLED = 9
+    };
+
+    /// powód zrzutu, zapisany w nagłówku pliku
+    enum FlightDumpReason {
+      FLIGHT_DUMP_WATCHDOG = 1,
+      FLIGHT_DUMP_SIGNAL = 2,
+      FLIGHT_DUMP_FATAL = 3
+    };
+
+    /**
+     *
+     * Jeden rekord rejestratora, 32 bajty; w pliku zrzutu w tej samej postaci (little endian, jak na robocie).
+     * sequence_ to numer rekordu + 1 (modulo 2^32); 0 oznacza rekord pusty albo w trakcie zapisu.
+     */
+    struct FlightRecord {
+      /// CLOCK_MONOTONIC [ns]
+      int64_t time_ns_;
+      float values_[4];
+      /// id robota (mniej znaczące 16 bitów)
+      uint16_t robot_id_;
+      uint8_t event_;
+      uint8_t code_;
+      uint32_t sequence_;
+    };
+
+    /// nagłówek pliku zrzutu; po nim capacity_ rekordów w kolejności miejsc w pierścieniu (nie chronologicznej)
+    struct FlightDumpHeader {
+      uint32_t magic_;
+      uint32_t version_;
+      uint32_t record_size_;
+      uint32_t capacity_;
+      /// FlightDumpReason
+      uint32_t reason_;
+      /// numer sygnału albo id robota (watchdog)
+      uint32_t detail_;
+      /// liczba rekordów zapisanych od startu (najnowszy rekord ma sequence_ == next_ mod 2^32)
+      uint64_t next_;
+      /// chwila zrzutu wg CLOCK_MONOTONIC i CLOCK_REALTIME [ns] - do przeliczenia czasów rekordów na czas zegarowy
+      int64_t monotonic_ns_;
+      int64_t realtime_ns_;
+      uint32_t pid_;
+      uint32_t reserved_;
+    };
+
+    BOOST_STATIC_ASSERT(sizeof(FlightRecord) == 32);
+    BOOST_STATIC_ASSERT(sizeof(FlightDumpHeader) == 56);
+
+    /**
+     *
+     * Rejestrator lotu: zawsze włączony pierścień ostatnich zdarzeń ścieżki sterowania (ramki, orientacja, komendy,
+     * decyzje watchdog'a) w pamięci, zrzucany do pliku, gdy robot niespodziewanie stanie - po zatrzymaniu przez
+     * watchdog, na SIGUSR1 i przy sygnale krytycznym (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT). Zrzut dekoduje
+     * tools/flight_decode.cpp (make flight_decode).
+     *
+     * Zapis jest wait-free: jedno fetch_add na wspólnym liczniku wybiera miejsce, a każde miejsce jest osobnym
+     * seqlock'iem (sequence_ = 0, dane, sequence_ = numer), więc zapisujące wątki floty nigdy na siebie nie czekają,
+     * a zrzut pomija rekordy zapisywane akurat w chwili kopiowania. Bez alokacji i bez wywołań systemowych
+     * (poza clock_gettime przez vDSO).
+     *
+     * Pierścień jest alokowany raz, przy tworzeniu usługi ([recorder], czytane przy starcie), i nigdy nie zwalniany,
+     * bo handler sygnału krytycznego może go potrzebować w dowolnej chwili. Zrzut używa tylko funkcji bezpiecznych
+     * w handlerze sygnału (open, write, close, clock_gettime), więc wszystkie trzy ścieżki dzielą jeden kod.
+     *
+     * Zrzuty po watchdog'u i na SIGUSR1 (requestDump) zapisuje własny wątek usługi, a nie wątek robota - kopiowanie
+     * i zapis pierścienia (2 MB przy 65536 rekordach) wstrzymałyby cały shard floty. Tylko sygnał krytyczny zrzuca
+     * synchronicznie. Numery plików idą po kole ([recorder] max_dumps), więc proces nie zostawia ich więcej.
+     */
+    class FlightRecorder : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor, alokuje pierścień (przed startem wątków floty) i ustawia nasłuchiwanie na SIGUSR1
+      explicit FlightRecorder(boost::asio::io_service& ios);
+      ~FlightRecorder() {};
+
+      /// handlery sygnałów krytycznych; wołane po utworzeniu robotów, bo Aria::init ustawia własne
+      static void installFatalHandlers();
+
+      /// zapis zdarzenia; wait-free, bezpieczny z każdego wątku; bez włączonego rejestratora nic nie robi
+      static void record(FlightEvent event, uint32_t robot_id, uint8_t code, float a, float b = 0, float c = 0, float d = 0)
+      {
+        Slot* slots = slots_;
+        if (slots == NULL)
+          return;
+        const uint64_t index = next_.fetch_add(1, boost::memory_order_relaxed);
+        Slot& slot = slots[index & mask_];
+        slot.sequence_.store(0, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        slot.time_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+        slot.values_[0] = a;
+        slot.values_[1] = b;
+        slot.values_[2] = c;
+        slot.values_[3] = d;
+        slot.robot_id_ = robot_id;
+        slot.event_ = event;
+        slot.code_ = code;
+        slot.sequence_.store((uint32_t)(index + 1), boost::memory_order_release);
+      }
+
+      /// zleca zrzut wątkowi rejestratora i od razu wraca; zlecenie, gdy poprzednie jeszcze czeka, jest pomijane
+      /// (zrzut, który czeka, obejmie oba zdarzenia); wołane z dowolnego wątku
+      static void requestDump(FlightDumpReason reason, uint32_t detail);
+
+      /**
+       * \param detail - numer sygnału albo id robota
+       * \param path - bufor na nazwę pliku zrzutu, <prefix><pid>-<n mod max_dumps>.bin
+       *
+       * Zapisuje pierścień do pliku. Bezpieczne w handlerze sygnału; jeżeli rejestrator jest wyłączony, inny zrzut
+       * właśnie trwa albo zapis się nie udał, zwraca false.
+       */
+      static bool dump(FlightDumpReason reason, uint32_t detail, char* path, size_t path_size);
+
+    private:
+      /// miejsce w pierścieniu; układ taki jak FlightRecord, tylko sequence_ jest atomowe
+      struct Slot {
+        int64_t time_ns_;
+        float values_[4];
+        uint16_t robot_id_;
+        uint8_t event_;
+        uint8_t code_;
+        boost::atomic<uint32_t> sequence_;
+      };
+      BOOST_STATIC_ASSERT(sizeof(Slot) == sizeof(FlightRecord));
+
+      void shutdown_service();
+      void scheduleSignalWait();
+      void handleSignal(const boost::system::error_code& error, int signal_number);
+      static void handleFatalSignal(int signal_number);
+      void writeDump(FlightDumpReason reason, uint32_t detail);
+      void run();
+
+      boost::asio::signal_set signals_;
+      /// własna pętla wątku zapisującego zrzuty; work_ zwalniane przy zamykaniu, żeby zlecony zrzut się dokończył
+      boost::asio::io_service ios_;
+      boost::scoped_ptr<boost::asio::io_service::work> work_;
+      boost::thread thread_;
+
+      /// usługa z wątkiem zapisu (NULL, jeżeli rejestrator jest wyłączony albo już zamknięty)
+      static FlightRecorder* writer_;
+      /// zrzut zlecony i jeszcze nie rozpoczęty
+      static boost::atomic<bool> dump_requested_;
+
+      static Slot* slots_;
+      static uint64_t mask_;
+      static boost::atomic<uint64_t> next_;
+      /// kopia pierścienia do zrzutu (bez rekordów w trakcie zapisu); chroniona przez dumping_
+      static FlightRecord* scratch_;
+      static boost::atomic<bool> dumping_;
+      static boost::atomic<uint32_t> dumps_;
+      /// liczba plików zrzutów na proces; numer pliku to dumps_ modulo max_dumps_
+      static uint32_t max_dumps_;
+      /// przedrostek nazw plików zrzutów; tablica, a nie std::string, bo czytana w handlerze sygnału
+      static char prefix_[256];
+    };
+
+    BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT_LOCK_FREE == 2);
+  }
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include "frame_trace.hpp"
+#include "message.hpp"
+#include "config.hpp"
+
+using SeekurJrRC::Core::FrameTracer;
+using SeekurJrRC::Core::FrameTrace;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+
+boost::asio::io_service::id FrameTracer::id;
+FrameTracer::Slot* FrameTracer::slots_ = NULL;
+uint64_t FrameTracer::mask_ = 0;
+boost::atomic<uint64_t> FrameTracer::next_slot_(0);
+boost::atomic<uint64_t> FrameTracer::next_id_(1);
+boost::atomic<uint32_t> FrameTracer::exports_(0);
+uint64_t FrameTracer::sample_every_ = 0;
+int64_t FrameTracer::slow_threshold_ns_ = 0;
+std::string FrameTracer::prefix_;
+__thread bool FrameTracer::active_ = false;
+__thread FrameTrace FrameTracer::current_;
+
+namespace {
+  /// nazwy przedziałów kończących się danym etapem (TraceStage)
+  const char* const stage_names[] = {"receive", "crc", "decode", "history", "model", "command", "watchdog", "rest"};
+
+  bool earlier(const FrameTrace& a, const FrameTrace& b)
+  {
+    return a.stamps_[SeekurJrRC::Core::TRACE_RECEIVED] < b.stamps_[SeekurJrRC::Core::TRACE_RECEIVED];
+  }
+
+  const char* kindName(uint32_t kind)
+  {
+    if (kind == MESSAGE_KIND_ACCELEROMETER)
+      return "accelerometer";
+    if (kind == MESSAGE_KIND_GYROSCOPE)
+      return "gyroscope";
+    if (kind == MESSAGE_KIND_BUNDLE)
+      return "bundle";
+    return "rejected";
+  }
+
+  void writeSpan(std::ostream& out, const char* name, const FrameTrace& trace, int64_t begin_ns, int64_t end_ns, int pid)
+  {
+    char times[64];
+    snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", begin_ns / 1e3, (end_ns - begin_ns) / 1e3);
+    out << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"X\"," << times << ",\"pid\":" << pid
+        << ",\"tid\":" << trace.robot_id_ << ",\"args\":{\"trace\":" << trace.id_ << ",\"kind\":\"" << kindName(trace.kind_) << "\"}}";
+  }
+}
+
+FrameTracer::FrameTracer(boost::asio::io_service& ios) : service(ios), signals_(ios, SIGUSR2)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (!config.trace_enabled_ || slots_ != NULL)
+    return;
+
+  uint64_t capacity = 1;
+  while (capacity < config.trace_capacity_)
+    capacity <<= 1;
+  Slot* slots = new Slot[capacity];
+  for (uint64_t i = 0; i < capacity; ++i)
+    slots[i].sequence_.store(0, boost::memory_order_relaxed);
+  sample_every_ = config.trace_sample_every_;
+  slow_threshold_ns_ = config.trace_slow_threshold_ * 1000LL;
+  prefix_ = config.trace_prefix_;
+  mask_ = capacity - 1;
+  slots_ = slots;
+  std::cout << "Frame traces: " << capacity << " frames, every " << sample_every_ << " and slower than "
+            << config.trace_slow_threshold_ << " us, exported to " << prefix_ << "<pid>-<n>.json" << std::endl;
+
+  scheduleSignalWait();
+}
+
+void FrameTracer::shutdown_service()
+{
+  boost::system::error_code ignored;
+  signals_.cancel(ignored);
+  // the robots have stopped by now (the fleet goes down before this service): whatever is in the ring is final
+  std::string path;
+  if (slots_ != NULL && next_slot_.load(boost::memory_order_acquire) && exportJson(path))
+    std::cout << "Frame traces exported to " << path << std::endl;
+}
+
+void FrameTracer::scheduleSignalWait()
+{
+  signals_.async_wait(
+    boost::bind(
+      &FrameTracer::handleSignal,
+      this,
+      boost::asio::placeholders::error,
+      boost::asio::placeholders::signal_number
+    )
+  );
+}
+
+void FrameTracer::handleSignal(const boost::system::error_code& error, int /*signal_number*/)
+{
+  if (error)
+    return;
+  std::string path;
+  if (exportJson(path))
+    std::cout << "\rSIGUSR2 received, frame traces exported to " << path << std::endl;
+  scheduleSignalWait();
+}
+
+void FrameTracer::end()
+{
+  if (!active_)
+    return;
+  active_ = false;
+  FrameTrace& trace = current_;
+  trace.stamps_[TRACE_DONE] = SeekurJrRC::Utils::monotonicNowNs();
+  const bool sampled = sample_every_ && trace.id_ % sample_every_ == 0;
+  if (!sampled && trace.stamps_[TRACE_DONE] - trace.stamps_[TRACE_RECEIVED] < slow_threshold_ns_)
+    return;
+
+  const uint64_t index = next_slot_.fetch_add(1, boost::memory_order_relaxed);
+  Slot& slot = slots_[index & mask_];
+  slot.sequence_.store(0, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  slot.trace_ = trace;
+  slot.sequence_.store((uint32_t)(index + 1), boost::memory_order_release);
+}
+
+bool FrameTracer::exportJson(std::string& path)
+{
+  if (slots_ == NULL)
+    return false;
+
+  // seqlock read of every slot; traces written concurrently are left out
+  std::vector<FrameTrace> traces;
+  traces.reserve(mask_ + 1);
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    const Slot& slot = slots_[i];
+    const uint32_t before = slot.sequence_.load(boost::memory_order_acquire);
+    if (!before)
+      continue;
+    FrameTrace copy = slot.trace_;
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if (slot.sequence_.load(boost::memory_order_relaxed) == before)
+      traces.push_back(copy);
+  }
+  std::sort(traces.begin(), traces.end(), earlier);
+
+  std::ostringstream name;
+  name << prefix_ << getpid() << "-" << exports_.fetch_add(1, boost::memory_order_relaxed) << ".json";
+  path = name.str();
+  std::ofstream out(path.c_str());
+  if (!out)
+    return false;
+
+  const int pid = getpid();
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+      << ",\"args\":{\"name\":\"SeekurJrRC server\"}}";
+  std::vector<uint32_t> robots;
+  for (std::vector<FrameTrace>::const_iterator it = traces.begin(); it != traces.end(); ++it) {
+    if (std::find(robots.begin(), robots.end(), it->robot_id_) == robots.end()) {
+      robots.push_back(it->robot_id_);
+      out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << it->robot_id_
+          << ",\"args\":{\"name\":\"robot " << it->robot_id_ << "\"}}";
+    }
+    writeSpan(out, "frame", *it, it->stamps_[TRACE_RECEIVED], it->stamps_[TRACE_DONE], pid);
+    // a stage the frame never reached has no span; the next one starts where the last reached stage ended
+    int64_t previous = it->stamps_[TRACE_RECEIVED];
+    for (int stage = TRACE_RECEIVED + 1; stage < TRACE_STAGES; ++stage) {
+      if (!it->stamps_[stage])
+        continue;
+      writeSpan(out, stage_names[stage], *it, previous, it->stamps_[stage], pid);
+      previous = it->stamps_[stage];
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+  return !out.fail();
+}
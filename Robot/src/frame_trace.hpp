@@ -0,0 +1,139 @@
+#ifndef FRAME_TRACE_HPP_
+#define FRAME_TRACE_HPP_
+
+#include <string>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+
+#include "utils.hpp"
+
+/// rodzaj ramki w FrameTrace::kind_ dla ramek odrzuconych przed dekodowaniem (limit albo zła suma kontrolna)
+#define TRACE_KIND_REJECTED 0xff
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /// chwile, w których ramka kończy kolejne etapy ścieżki; etap, do którego ramka nie doszła, ma znacznik 0
+    enum TraceStage {
+      /// ramka odebrana (handler czytania)
+      TRACE_RECEIVED = 0,
+      /// po kontroli dopuszczenia i sumy kontrolnej
+      TRACE_CRC_CHECKED,
+      /// po dekodowaniu TCPMessage
+      TRACE_DECODED,
+      /// po dopisaniu wskazania do historii (konstrukcja modelu sterowania)
+      TRACE_HISTORY_UPDATED,
+      /// po obliczeniu prędkości przez model
+      TRACE_MODEL_EVALUATED,
+      /// po przekazaniu komendy robotowi (CommandShaper albo pętli sterowania)
+      TRACE_COMMAND_SENT,
+      /// po odnowieniu czasu ostatniej komendy, tj. odsunięciu watchdog'a
+      TRACE_WATCHDOG_REARMED,
+      /// koniec obsługi ramki (z telemetrią, trybem cienia i zaleceniem częstotliwości)
+      TRACE_DONE,
+      TRACE_STAGES
+    };
+
+    /// ślad jednej ramki; znaczniki wg CLOCK_MONOTONIC (albo czasu symulacji) [ns]
+    struct FrameTrace {
+      uint64_t id_;
+      int64_t stamps_[TRACE_STAGES];
+      uint32_t robot_id_;
+      /// MESSAGE_KIND_* albo TRACE_KIND_REJECTED
+      uint32_t kind_;
+    };
+
+    BOOST_STATIC_ASSERT(sizeof(FrameTrace) == 80);
+
+    /**
+     *
+     * Ślady pojedynczych ramek ([trace]): każda ramka odebrana przez TCPConnection dostaje numer, a na kolejnych etapach
+     * (TraceStage) - znacznik czasu. Średnie nie tłumaczą pojedynczych szarpnięć; ślad pokazuje, na którym etapie
+     * konkretna ramka straciła 40 ms.
+     *
+     * Ramka w obsłudze jest zmienną lokalną wątku, więc Driver oznacza etapy przez mark() bez przekazywania czegokolwiek,
+     * a znacznik kosztuje odczyt zegara (vDSO). Po zakończeniu ramka trafia do pierścienia, jeżeli jest próbkowana
+     * (co sample_every-ta) albo wolna (dłuższa niż slow_threshold); zapis jak w FlightRecorder - wait-free, miejsce
+     * wybiera fetch_add, a każde miejsce jest osobnym seqlock'iem.
+     *
+     * Pierścień jest eksportowany jako JSON w formacie trace-event Chrome'a (chrome://tracing, ui.perfetto.dev)
+     * na SIGUSR2 i przy zakończeniu programu: każda ramka to zdarzenie "frame", a jej etapy - zagnieżdżone w nim
+     * przedziały, jeden wiersz (tid) na robota. Bez włączonego [trace] begin() i mark() tylko sprawdzają flagę.
+     */
+    class FrameTracer : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor, alokuje pierścień (przed startem wątków floty) i ustawia nasłuchiwanie na SIGUSR2
+      explicit FrameTracer(boost::asio::io_service& ios);
+      ~FrameTracer() {};
+
+      /// początek ramki w tym wątku: nowy numer śladu i znacznik TRACE_RECEIVED
+      static void begin(uint32_t robot_id)
+      {
+        if (slots_ == NULL)
+          return;
+        active_ = true;
+        current_.id_ = next_id_.fetch_add(1, boost::memory_order_relaxed);
+        current_.robot_id_ = robot_id;
+        current_.kind_ = TRACE_KIND_REJECTED;
+        current_.stamps_[TRACE_RECEIVED] = SeekurJrRC::Utils::monotonicNowNs();
+        for (int stage = TRACE_RECEIVED + 1; stage < TRACE_STAGES; ++stage)
+          current_.stamps_[stage] = 0;
+      }
+
+      /// koniec etapu ramki obsługiwanej w tym wątku; poza ramką (np. pętla sterowania, symulacja) nic nie robi
+      static void mark(TraceStage stage)
+      {
+        if (active_)
+          current_.stamps_[stage] = SeekurJrRC::Utils::monotonicNowNs();
+      }
+
+      /// rodzaj ramki (MESSAGE_KIND_*), po dekodowaniu
+      static void kind(uint8_t kind)
+      {
+        if (active_)
+          current_.kind_ = kind;
+      }
+
+      /// koniec ramki: znacznik TRACE_DONE i zapis do pierścienia, jeżeli ramka jest próbkowana albo wolna
+      static void end();
+
+      /// zapis pierścienia do <prefix><pid>-<n>.json; false, jeżeli śledzenie jest wyłączone albo zapis się nie udał
+      static bool exportJson(std::string& path);
+
+    private:
+      /// miejsce w pierścieniu; sequence_ = 0 oznacza miejsce puste albo w trakcie zapisu
+      struct Slot {
+        FrameTrace trace_;
+        boost::atomic<uint32_t> sequence_;
+      };
+
+      void shutdown_service();
+      void scheduleSignalWait();
+      void handleSignal(const boost::system::error_code& error, int signal_number);
+
+      boost::asio::signal_set signals_;
+
+      static Slot* slots_;
+      static uint64_t mask_;
+      static boost::atomic<uint64_t> next_slot_;
+      static boost::atomic<uint64_t> next_id_;
+      static boost::atomic<uint32_t> exports_;
+      /// próbkowanie i próg ramki wolnej [ns] (czytane przy starcie)
+      static uint64_t sample_every_;
+      static int64_t slow_threshold_ns_;
+      static std::string prefix_;
+
+      /// ramka obsługiwana w tym wątku
+      static __thread bool active_;
+      static __thread FrameTrace current_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HANDLER_ALLOCATOR_HPP_
+#define HANDLER_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <new>
+
+#include <boost/noncopyable.hpp>
+#include <boost/aligned_storage.hpp>
+
+#define HANDLER_MEMORY_SIZE 256
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Blok pamięci na jeden oczekujący handler boost::asio (wzorowane na przykładzie "allocation" z boost::asio).
+     * Łańcuch wywołań zwrotnych (czytanie z socket'u, timer watchdog'a) ma w danej chwili tylko jeden oczekujący
+     * handler, więc jeden blok, zaalokowany razem z właścicielem, wystarcza - w stanie ustalonym nie ma żadnych alokacji.
+     * Gdyby handler się nie zmieścił albo blok był zajęty, wracamy do zwykłego operator new.
+     */
+    class HandlerMemory : private boost::noncopyable {
+    public:
+      HandlerMemory() : in_use_(false) {};
+
+      void* allocate(std::size_t size) {
+        if (!in_use_ && size <= sizeof(storage_)) {
+          in_use_ = true;
+          return storage_.address();
+        }
+        return ::operator new(size);
+      }
+
+      void deallocate(void* pointer) {
+        if (pointer == storage_.address())
+          in_use_ = false;
+        else
+          ::operator delete(pointer);
+      }
+
+    private:
+      boost::aligned_storage<HANDLER_MEMORY_SIZE> storage_;
+      bool in_use_;
+    };
+
+    /**
+     *
+     * Opakowanie handler'a, przez które boost::asio (asio_handler_allocate/deallocate) bierze pamięć z HandlerMemory.
+     */
+    template <typename Handler>
+    class CustomAllocHandler {
+    public:
+      CustomAllocHandler(HandlerMemory& memory, Handler handler) : memory_(memory), handler_(handler) {};
+
+      void operator()() {
+        handler_();
+      }
+
+      template <typename Arg1>
+      void operator()(Arg1 arg1) {
+        handler_(arg1);
+      }
+
+      template <typename Arg1, typename Arg2>
+      void operator()(Arg1 arg1, Arg2 arg2) {
+        handler_(arg1, arg2);
+      }
+
+      friend void* asio_handler_allocate(std::size_t size, CustomAllocHandler<Handler>* this_handler) {
+        return this_handler->memory_.allocate(size);
+      }
+
+      friend void asio_handler_deallocate(void* pointer, std::size_t /*size*/, CustomAllocHandler<Handler>* this_handler) {
+        this_handler->memory_.deallocate(pointer);
+      }
+
+    private:
+      HandlerMemory& memory_;
+      Handler handler_;
+    };
+
+    template <typename Handler>
+    inline CustomAllocHandler<Handler> makeCustomAllocHandler(HandlerMemory& memory, Handler handler) {
+      return CustomAllocHandler<Handler>(memory, handler);
+    }
+  }
+}
+
+#endif
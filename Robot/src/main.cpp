@@ -1,17 +1,73 @@
 #include <iostream>
+#include <csignal>
+#include <stdexcept>
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
 
-#include "driver.hpp"
-#include "server.hpp"
+#include "config.hpp"
+#include "fleet.hpp"
+#include "realtime.hpp"
+#include "alloc_tracker.hpp"
+#include "flight_recorder.hpp"
+#include "frame_trace.hpp"
+#include "telemetry.hpp"
+#include "shadow.hpp"
+#include "simulation.hpp"
+#include "utils.hpp"
 
-int main()
+int main(int argc, char* argv[])
 {
+  const int64_t started_ns = SeekurJrRC::Utils::monotonicNowNs();
+  // plik konfiguracyjny: pierwszy argument albo DEFAULT_CONFIG_PATH; brak pliku = wartości domyślne
+  std::string config_path = (argc > 1) ? argv[1] : DEFAULT_CONFIG_PATH;
+  if (!SeekurJrRC::Core::Configuration::load(config_path))
+    std::cout << "Using default configuration." << std::endl;
+
+  // tryb czasu rzeczywistego: pamięć blokujemy przed utworzeniem wątków, żeby ich stosy też były zablokowane
+  const SeekurJrRC::Core::ConfigPtr pinned_config = SeekurJrRC::Core::Configuration::snapshot();
+  const SeekurJrRC::Core::Config& config = *pinned_config;
+  // tryb symulacji: zegar wirtualny, zanim cokolwiek zapamięta czas
+  if (config.simulation_enabled_)
+    SeekurJrRC::Utils::VirtualClock::enable();
+  if (config.realtime_enabled_ && !config.simulation_enabled_) {
+    if (config.realtime_lock_memory_)
+      SeekurJrRC::Utils::lockAndPrefaultMemory(1024 * config.realtime_prefault_stack_, 1024 * config.realtime_prefault_heap_);
+    SeekurJrRC::Utils::applyRealtimeThreadPolicy(config.realtime_control_cpus_, config.realtime_control_priority_, "main loop");
+  }
+
   boost::asio::io_service program_loop;
-  boost::asio::use_service<SeekurJrRC::Core::Driver>(program_loop);
-  boost::asio::use_service<SeekurJrRC::Core::TCPServer>(program_loop);
+  boost::asio::use_service<SeekurJrRC::Core::Configuration>(program_loop);
+  // rejestrator przed flotą (pierścień musi istnieć, zanim wystartują wątki robotów), handlery sygnałów krytycznych
+  // po niej, bo Aria::init w backendzie ARIA ustawia własne
+  boost::asio::use_service<SeekurJrRC::Core::FlightRecorder>(program_loop);
+  // ślady ramek tak samo; zatrzymywane po flocie, więc eksport przy zakończeniu ma już wszystkie ramki
+  boost::asio::use_service<SeekurJrRC::Core::FrameTracer>(program_loop);
+  boost::asio::use_service<SeekurJrRC::Core::Fleet>(program_loop);
+  SeekurJrRC::Core::FlightRecorder::installFatalHandlers();
+  // SIGINT/SIGTERM kończą pętlę; usługi zatrzymują wtedy roboty i wypisują statystyki
+  boost::asio::signal_set stop_signals(program_loop, SIGINT, SIGTERM);
+  stop_signals.async_wait(boost::bind(&boost::asio::io_service::stop, &program_loop));
   std::cout << std::setprecision(10);
-  std::cout << "Starting program loop." << std::endl;
-  program_loop.run();
+  if (config.simulation_enabled_) {
+    // zamiast sieci wejście z nagrania albo generatora, a zamiast czekania na timery - skok do następnego zdarzenia
+    try {
+      boost::asio::use_service<SeekurJrRC::Core::Simulation>(program_loop).run();
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else {
+    // telemetria bierze listę robotów z floty; zatrzymywana (w odwrotnej kolejności) przed nią
+    boost::asio::use_service<SeekurJrRC::Core::TelemetryHub>(program_loop);
+    // tryb cienia tak samo: czyta kolejki robotów z floty
+    boost::asio::use_service<SeekurJrRC::Core::ShadowEvaluator>(program_loop);
+    // roboty łączą się w tle, więc od tej chwili serwer przyjmuje połączenia
+    std::cout << "Starting program loop, ready in " << (SeekurJrRC::Utils::monotonicNowNs() - started_ns) / 1000000 << " ms." << std::endl;
+    program_loop.run();
+  }
   std::cout << "Exiting program loop." << std::endl;
-  return 0;
+  // w buildzie z ALLOC_TRACKING=1 alokacja w stanie ustalonym kończy program kodem 1
+  SeekurJrRC::Utils::AllocTracker::report();
+  return SeekurJrRC::Utils::AllocTracker::failed() ? 1 : 0;
 }
@@ -8,8 +8,73 @@
 #include <stdio.h>
 
 using SeekurJrRC::Core::TCPMessage;
+using SeekurJrRC::Core::HandshakeMessage;
+using SeekurJrRC::Core::BundleMessage;
+using SeekurJrRC::Core::TelemetrySample;
 
-TCPMessage::TCPMessage(const uint8_t* const buffer) : x_(rw_x_), y_(rw_y_), z_(rw_z_), steeringModelCode_(rw_steeringModelCode_), startStop_(rw_startStop_)
+namespace {
+  void putUint32(uint8_t* buffer, uint32_t value)
+  {
+    if (!SeekurJrRC::Utils::isSystemBigEndian())
+      SeekurJrRC::Utils::swapEndianness(value);
+    memcpy(buffer, &value, 4);
+  }
+
+  void putFloat(uint8_t* buffer, float value)
+  {
+    union {
+      uint32_t i;
+      float f;
+    } uint32_t_float_conv;
+    uint32_t_float_conv.f = value;
+    putUint32(buffer, uint32_t_float_conv.i);
+  }
+
+  uint32_t getUint32(const uint8_t* buffer)
+  {
+    uint32_t value;
+    memcpy(&value, buffer, 4);
+    if (!SeekurJrRC::Utils::isSystemBigEndian())
+      SeekurJrRC::Utils::swapEndianness(value);
+    return value;
+  }
+
+  float getFloat(const uint8_t* buffer)
+  {
+    union {
+      uint32_t i;
+      float f;
+    } uint32_t_float_conv;
+    uint32_t_float_conv.i = getUint32(buffer);
+    return uint32_t_float_conv.f;
+  }
+
+  /// big endian, niezależnie od platformy
+  int16_t getInt16(const uint8_t* buffer)
+  {
+    return (int16_t)(((uint16_t)buffer[0] << 8) | buffer[1]);
+  }
+
+  void putInt16(uint8_t* buffer, int16_t value)
+  {
+    buffer[0] = (uint16_t)value >> 8;
+    buffer[1] = (uint16_t)value & 0xFF;
+  }
+
+  /// różnica w jednostkach paczki, obcięta do zakresu int16_t
+  int16_t bundleDelta(float from, float to)
+  {
+    float delta = (to - from) * BUNDLE_DELTA_SCALE;
+    delta = delta < 0 ? delta - 0.5f : delta + 0.5f;
+    if (delta > 32767)
+      return 32767;
+    if (delta < -32768)
+      return -32768;
+    return (int16_t)delta;
+  }
+}
+
+TCPMessage::TCPMessage(const uint8_t* const buffer) : startStop_(rw_startStop_), steeringModelCode_(rw_steeringModelCode_), kind_(rw_kind_), x_(rw_x_), y_(rw_y_), z_(rw_z_)
 {
   
   uint8_t message_part[offsetCRC32_];
@@ -56,7 +121,150 @@ TCPMessage::TCPMessage(const uint8_t* const buffer) : x_(rw_x_), y_(rw_y_), z_(r
   
   memcpy(&dummy_uint8, buffer + offsetSteeringModelCode_, 1);
   rw_steeringModelCode_ = dummy_uint8;
+
+  memcpy(&dummy_uint8, buffer + offsetKind_, 1);
+  if (dummy_uint8 != MESSAGE_KIND_ACCELEROMETER && dummy_uint8 != MESSAGE_KIND_GYROSCOPE)
+    throw "Unknown message kind.";
+  rw_kind_ = dummy_uint8;
   
   memcpy(&dummy_uint8, buffer + offsetStartStop_, 1); // we don't have to worry about endianness, if all bits are 1, drive, otherwise, stop
   rw_startStop_ = (dummy_uint8 == ((uint8_t)-1));
 }
+
+bool TCPMessage::isValid(const uint8_t* const buffer)
+{
+  uint32_t packet_crc32_checksum;
+  memcpy(&packet_crc32_checksum, buffer + offsetCRC32_, 4);
+  if (!SeekurJrRC::Utils::isSystemBigEndian())
+    SeekurJrRC::Utils::swapEndianness(packet_crc32_checksum);
+  if (SeekurJrRC::Utils::getCrc32(buffer, messageLength_-4) != packet_crc32_checksum)
+    return false;
+  const uint8_t kind = buffer[offsetKind_];
+  return kind == MESSAGE_KIND_ACCELEROMETER || kind == MESSAGE_KIND_GYROSCOPE;
+}
+
+BundleMessage::BundleMessage(const uint8_t* const buffer)
+  : startStop_(rw_startStop_), steeringModelCode_(rw_steeringModelCode_), samples_(rw_samples_), intervalUs_(rw_intervalUs_)
+{
+  if (!isValid(buffer))
+    throw "Bad bundle (checksum or sample count).";
+
+  rw_startStop_ = (buffer[0] == ((uint8_t)-1));
+  rw_steeringModelCode_ = buffer[1];
+  rw_samples_ = buffer[3];
+  rw_intervalUs_ = 10 * (((uint32_t)buffer[16] << 8) | buffer[17]);
+
+  x_[0] = getFloat(buffer + 4);
+  y_[0] = getFloat(buffer + 8);
+  z_[0] = getFloat(buffer + 12);
+  const uint8_t* delta = buffer + 20;
+  for (unsigned int i = 1; i < rw_samples_; ++i, delta += 6) {
+    x_[i] = x_[i - 1] + getInt16(delta) / BUNDLE_DELTA_SCALE;
+    y_[i] = y_[i - 1] + getInt16(delta + 2) / BUNDLE_DELTA_SCALE;
+    z_[i] = z_[i - 1] + getInt16(delta + 4) / BUNDLE_DELTA_SCALE;
+  }
+}
+
+bool BundleMessage::isValid(const uint8_t* const buffer)
+{
+  if (buffer[2] != MESSAGE_KIND_BUNDLE)
+    return false;
+  const unsigned int length = SeekurJrRC::Core::messageLength(buffer);
+  // a count out of range leaves the length of a plain frame
+  if (length == MESSAGE_LENGTH)
+    return false;
+  return SeekurJrRC::Utils::getCrc32(buffer, length - 4) == getUint32(buffer + length - 4);
+}
+
+HandshakeMessage::HandshakeMessage(const uint8_t* const buffer) : robotId_(rw_robotId_)
+{
+  uint32_t packet_crc32_checksum;
+  memcpy(&packet_crc32_checksum, buffer + offsetCRC32_, 4);
+  uint32_t magic;
+  memcpy(&magic, buffer + offsetMagic_, 4);
+  memcpy(&rw_robotId_, buffer + offsetRobotId_, 4);
+
+  if (!SeekurJrRC::Utils::isSystemBigEndian()) {
+    SeekurJrRC::Utils::swapEndianness(packet_crc32_checksum);
+    SeekurJrRC::Utils::swapEndianness(magic);
+    SeekurJrRC::Utils::swapEndianness(rw_robotId_);
+  }
+
+  if (magic != HANDSHAKE_MAGIC)
+    throw "Not a handshake message.";
+
+  if (SeekurJrRC::Utils::getCrc32(buffer, offsetCRC32_) != packet_crc32_checksum)
+    throw "Checksums don't check out.";
+}
+
+void SeekurJrRC::Core::encodeTelemetry(const TelemetrySample& sample, uint8_t* buffer)
+{
+  putUint32(buffer + 0, TELEMETRY_MAGIC);
+  putUint32(buffer + 4, sample.robot_id_);
+  putUint32(buffer + 8, (uint64_t)sample.time_us_ >> 32);
+  putUint32(buffer + 12, (uint32_t)sample.time_us_);
+  putUint32(buffer + 16, sample.commands_);
+  buffer[20] = sample.steering_model_code_;
+  buffer[21] = sample.flags_;
+  buffer[22] = buffer[23] = 0;
+  putFloat(buffer + 24, sample.x_);
+  putFloat(buffer + 28, sample.y_);
+  putFloat(buffer + 32, sample.z_);
+  putFloat(buffer + 36, sample.left_);
+  putFloat(buffer + 40, sample.right_);
+  putFloat(buffer + 44, sample.v_trans_);
+  putFloat(buffer + 48, sample.omega_);
+  putUint32(buffer + 52, SeekurJrRC::Utils::getCrc32(buffer, TELEMETRY_LENGTH - 4));
+}
+
+void SeekurJrRC::Core::encodeRateAdvice(uint32_t interval_us, uint32_t load_permille, uint32_t control_rate_hz, uint8_t* buffer)
+{
+  putUint32(buffer + 0, RATE_ADVICE_MAGIC);
+  putUint32(buffer + 4, interval_us);
+  putUint32(buffer + 8, load_permille);
+  putUint32(buffer + 12, control_rate_hz);
+  putUint32(buffer + 16, SeekurJrRC::Utils::getCrc32(buffer, MESSAGE_LENGTH - 4));
+}
+
+void SeekurJrRC::Core::encodeMessage(bool startStop, uint8_t steering_model_code, uint8_t kind, float x, float y, float z, uint8_t* buffer)
+{
+  buffer[0] = startStop ? 0xFF : 0;
+  buffer[1] = steering_model_code;
+  buffer[2] = kind;
+  buffer[3] = 0;
+  putFloat(buffer + 4, x);
+  putFloat(buffer + 8, y);
+  putFloat(buffer + 12, z);
+  putUint32(buffer + 16, SeekurJrRC::Utils::getCrc32(buffer, MESSAGE_LENGTH - 4));
+}
+
+unsigned int SeekurJrRC::Core::encodeBundle(bool startStop, uint8_t steering_model_code, unsigned int samples, uint32_t interval_us,
+                                            const float* x, const float* y, const float* z, uint8_t* buffer)
+{
+  buffer[0] = startStop ? 0xFF : 0;
+  buffer[1] = steering_model_code;
+  buffer[2] = MESSAGE_KIND_BUNDLE;
+  buffer[3] = samples;
+  putFloat(buffer + 4, x[0]);
+  putFloat(buffer + 8, y[0]);
+  putFloat(buffer + 12, z[0]);
+  const uint32_t interval = interval_us / 10;
+  buffer[16] = (interval > 0xFFFF ? 0xFFFF : interval) >> 8;
+  buffer[17] = (interval > 0xFFFF ? 0xFFFF : interval) & 0xFF;
+  buffer[18] = buffer[19] = 0;
+  // the deltas follow what the receiver reconstructs, not the exact previous sample
+  float last_x = x[0], last_y = y[0], last_z = z[0];
+  uint8_t* delta = buffer + 20;
+  for (unsigned int i = 1; i < samples; ++i, delta += 6) {
+    const int16_t dx = bundleDelta(last_x, x[i]), dy = bundleDelta(last_y, y[i]), dz = bundleDelta(last_z, z[i]);
+    putInt16(delta, dx);
+    putInt16(delta + 2, dy);
+    putInt16(delta + 4, dz);
+    last_x += dx / BUNDLE_DELTA_SCALE;
+    last_y += dy / BUNDLE_DELTA_SCALE;
+    last_z += dz / BUNDLE_DELTA_SCALE;
+  }
+  const unsigned int length = 18 + 6 * samples;
+  putUint32(buffer + length - 4, SeekurJrRC::Utils::getCrc32(buffer, length - 4));
+  return length;
+}
@@ -1,7 +1,29 @@
 #ifndef MESSAGE_HPP_
 #define MESSAGE_HPP_
 
+#include <stdint.h>
+
 #define MESSAGE_LENGTH 20 // 20B
+#define HANDSHAKE_MAGIC 0x534A5248 // "SJRH"
+#define TELEMETRY_LENGTH 56 // 56B
+#define TELEMETRY_MAGIC 0x534A5254 // "SJRT"
+#define RATE_ADVICE_MAGIC 0x534A5252 // "SJRR"
+
+/// flagi telemetrii (bajt 21)
+#define TELEMETRY_FLAG_DRIVING 0x01
+#define TELEMETRY_FLAG_STOP_REQUESTED 0x02
+#define TELEMETRY_FLAG_CONNECTED 0x04
+
+/// rodzaje wiadomości (3. bajt); starsi klienci wysyłają tam 0
+#define MESSAGE_KIND_ACCELEROMETER 0
+#define MESSAGE_KIND_GYROSCOPE 1
+/// paczka kolejnych wskazań akcelerometru (BundleMessage); 4. bajt - liczba wskazań
+#define MESSAGE_KIND_BUNDLE 2
+
+/// paczka: najwięcej wskazań, jednostka różnic (1/BUNDLE_DELTA_SCALE jednostki czujnika) i największa długość ramki
+#define BUNDLE_MAX_SAMPLES 16
+#define BUNDLE_DELTA_SCALE 1000.0f
+#define MESSAGE_MAX_LENGTH (18 + 6 * BUNDLE_MAX_SAMPLES)
 
 namespace SeekurJrRC {
   namespace Core {
@@ -12,11 +34,12 @@ namespace SeekurJrRC {
      * 1: drobnica
      *   - 1. bajt - START/STOP - START jeżeli wszystkie 1, w innym wypadku STOP
      *   - 2. bajt - kod typu sterowania (uint8_t) !! BIG ENDIAN !!
-     *   - 3. bajt - wolny
+     *   - 3. bajt - rodzaj wiadomości: MESSAGE_KIND_ACCELEROMETER (wskazania akcelerometru) albo
+     *               MESSAGE_KIND_GYROSCOPE (prędkości kątowe z żyroskopu [rad/s], w tych samych osiach co akcelerometr)
      *   - 4. bajt - wolny
      * 2: float x w postaci bitów intowych (uint32_t)  !! BIG ENDIAN !!
-     * 3: float x w postaci bitów intowych (uint32_t)  !! BIG ENDIAN !!
-     * 4: float x w postaci bitów intowych (uint32_t)  !! BIG ENDIAN !!
+     * 3: float y w postaci bitów intowych (uint32_t)  !! BIG ENDIAN !!
+     * 4: float z w postaci bitów intowych (uint32_t)  !! BIG ENDIAN !!
      * 5: uint32_t CRC32  !! BIG ENDIAN !!
      * Klasa jest inicjalizowana buforem - tablicą charów, w której zawarta jest wiadomość.
      * 
@@ -33,6 +56,14 @@ namespace SeekurJrRC {
        * jest nieprawidłowa (np. suma CRC32 się nie zgadza), konstruktor rzuca wyjątek.
        */
       TCPMessage(const uint8_t* const buffer);
+
+      /**
+       * \param buffer	- bufor otrzymany poprzez TCP
+       *
+       * Te same sprawdzenia co w konstruktorze (CRC32, rodzaj wiadomości), ale bez wyjątku - tanie odrzucenie
+       * śmieci przed jakąkolwiek dalszą pracą.
+       */
+      static bool isValid(const uint8_t* const buffer);
       
       /**
        * 
@@ -45,6 +76,9 @@ namespace SeekurJrRC {
 
       /// kod modelu sterowania; model sterowania określa sposób tłumaczenia wskazań akcelerometru na prędkość robota - w wersji READ-ONLY
       const uint8_t& steeringModelCode_;
+
+      /// rodzaj wiadomości (MESSAGE_KIND_*) - w wersji READ-ONLY
+      const uint8_t& kind_;
       
       const float& x_;	/// wartość x-owa wskazań akcelerometru - w wersji READ-ONLY
       const float& y_;	/// wartość y-owa wskazań akcelerometru - w wersji READ-ONLY
@@ -56,6 +90,9 @@ namespace SeekurJrRC {
       
       /// kod modelu sterowania; model sterowania określa sposób tłumaczenia wskazań akcelerometru na prędkość robota - w wersji READ-WRITE
       uint8_t rw_steeringModelCode_;
+
+      /// rodzaj wiadomości - w wersji READ-WRITE
+      uint8_t rw_kind_;
       
       float rw_x_;	/// wartość x-owa wskazań akcelerometru - w wersji READ-WRITE
       float rw_y_;	/// wartość y-owa wskazań akcelerometru - w wersji READ-WRITE
@@ -64,12 +101,155 @@ namespace SeekurJrRC {
       /// Parametry rozmieszczenia wartości w wiadomości; więcej w pracy dyplomowej
       static const int offsetStartStop_ = 0;
       static const int offsetSteeringModelCode_ = 1;
+      static const int offsetKind_ = 2;
       static const int offsetX_ = 4;
       static const int offsetY_ = 8;
       static const int offsetZ_ = 12;
       static const int offsetCRC32_ = 16; // 16B
       static const int messageLength_ = MESSAGE_LENGTH;
     };
+
+    /**
+     *
+     * Paczka kolejnych wskazań akcelerometru w jednej ramce - przy zatłoczonym Wi-Fi koszt pakietu przeważa nad
+     * 12 bajtami wskazania. Długość 18 + 6 * K bajtów (K = 2..BUNDLE_MAX_SAMPLES), wszystko !! BIG ENDIAN !!:
+     *   - bajt 0      - START/STOP, jak w TCPMessage
+     *   - bajt 1      - kod modelu sterowania
+     *   - bajt 2      - MESSAGE_KIND_BUNDLE
+     *   - bajt 3      - K, liczba wskazań
+     *   - bajty 4-15  - najstarsze wskazanie: x, y, z (float)
+     *   - bajty 16-17 - odstęp pomiędzy wskazaniami [10 usec] (uint16_t)
+     *   - bajty 18-19 - wolne
+     *   - po 6 bajtów na każde kolejne wskazanie - różnica x, y, z względem poprzedniego (int16_t,
+     *     w jednostkach 1/BUNDLE_DELTA_SCALE), wskazania od najstarszego do najnowszego
+     *   - ostatnie 4 bajty - CRC32 wszystkich poprzednich
+     * Pierwsze 20 bajtów ma układ nagłówka TCPMessage, więc serwer czyta najpierw tyle co zwykle, a resztę dopiero
+     * po rozpoznaniu paczki (messageLength). Przy K = 8: 8,25 B na wskazanie zamiast 20 i ósma część pakietów.
+     * Konstruktor rzuca wyjątek, jeżeli ramka jest nieprawidłowa.
+     */
+    class BundleMessage {
+    public:
+      BundleMessage(const uint8_t* const buffer);
+
+      /// CRC32 i liczba wskazań, bez wyjątku (jak TCPMessage::isValid)
+      static bool isValid(const uint8_t* const buffer);
+
+      /// wskazanie i (0 - najstarsze, samples_ - 1 - najnowsze)
+      void sample(unsigned int i, float& x, float& y, float& z) const {
+        x = x_[i];
+        y = y_[i];
+        z = z_[i];
+      }
+
+      const bool& startStop_;
+      const uint8_t& steeringModelCode_;
+      /// liczba wskazań i odstęp pomiędzy nimi [usec] - w wersji READ-ONLY
+      const unsigned int& samples_;
+      const uint32_t& intervalUs_;
+
+    private:
+      bool rw_startStop_;
+      uint8_t rw_steeringModelCode_;
+      unsigned int rw_samples_;
+      uint32_t rw_intervalUs_;
+      /// wskazania odtworzone z różnic
+      float x_[BUNDLE_MAX_SAMPLES];
+      float y_[BUNDLE_MAX_SAMPLES];
+      float z_[BUNDLE_MAX_SAMPLES];
+    };
+
+    /// długość ramki, której pierwsze MESSAGE_LENGTH bajtów jest w header: paczki - z nagłówka, każdej innej - MESSAGE_LENGTH
+    inline unsigned int messageLength(const uint8_t* header) {
+      if (header[2] == MESSAGE_KIND_BUNDLE && header[3] >= 2 && header[3] <= BUNDLE_MAX_SAMPLES)
+        return 18 + 6 * header[3];
+      return MESSAGE_LENGTH;
+    }
+
+    /**
+     *
+     * Wiadomość powitalna, wysyłana (jako pierwsza) na wspólny port floty; wskazuje robota, którym chcemy sterować.
+     * Ma tę samą długość co TCPMessage:
+     *   - bajty 0-3   - HANDSHAKE_MAGIC (uint32_t) !! BIG ENDIAN !!
+     *   - bajty 4-7   - identyfikator robota (uint32_t) !! BIG ENDIAN !!
+     *   - bajty 8-15  - wolne
+     *   - bajty 16-19 - CRC32 bajtów 0-15 !! BIG ENDIAN !!
+     * Podobnie jak TCPMessage, konstruktor rzuca wyjątek, jeżeli wiadomość jest nieprawidłowa.
+     */
+    class HandshakeMessage {
+    public:
+      HandshakeMessage(const uint8_t* const buffer);
+
+      /// identyfikator robota - w wersji READ-ONLY
+      const uint32_t& robotId_;
+
+    private:
+      uint32_t rw_robotId_;
+
+      static const int offsetMagic_ = 0;
+      static const int offsetRobotId_ = 4;
+      static const int offsetCRC32_ = 16;
+    };
+
+    /// stan jednego robota w telemetrii; pola opisane przy encodeTelemetry
+    struct TelemetrySample {
+      uint32_t robot_id_;
+      int64_t time_us_;
+      uint32_t commands_;
+      uint8_t steering_model_code_;
+      uint8_t flags_;
+      float x_;
+      float y_;
+      float z_;
+      float left_;
+      float right_;
+      float v_trans_;
+      float omega_;
+    };
+
+    /**
+     *
+     * Ramka telemetrii wysyłana obserwatorom (TelemetryHub); TELEMETRY_LENGTH bajtów, wszystko !! BIG ENDIAN !!:
+     *   - bajty 0-3   - TELEMETRY_MAGIC (uint32_t)
+     *   - bajty 4-7   - identyfikator robota (uint32_t)
+     *   - bajty 8-15  - czas ostatniej zmiany stanu, CLOCK_MONOTONIC serwera [usec] (uint64_t)
+     *   - bajty 16-19 - liczba komend wysłanych do robota (uint32_t)
+     *   - bajt 20     - kod modelu sterowania, którego użyto ostatnio
+     *   - bajt 21     - flagi TELEMETRY_FLAG_*: robot jedzie / klient poprosił o zatrzymanie / robot połączony
+     *   - bajty 22-23 - wolne
+     *   - bajty 24-35 - x, y, z (float) - orientacja podana modelowi (po ewentualnej fuzji)
+     *   - bajty 36-51 - prędkości kół lewa, prawa [mm/s], v_trans [mm/s], omega [deg/s] (float) - ostatnia komenda
+     *   - bajty 52-55 - CRC32 bajtów 0-51
+     */
+    void encodeTelemetry(const TelemetrySample& sample, uint8_t* buffer);
+
+    /**
+     *
+     * Jedyna wiadomość od serwera do telefonu: zalecany odstęp między ramkami jednego czujnika. Ma tę samą długość
+     * co TCPMessage (MESSAGE_LENGTH), wszystko !! BIG ENDIAN !!:
+     *   - bajty 0-3   - RATE_ADVICE_MAGIC (uint32_t)
+     *   - bajty 4-7   - zalecany odstęp [usec] (uint32_t); telefon pomija wskazania czujnika, które przyszły wcześniej
+     *   - bajty 8-11  - zmierzone obciążenie: część czasu wątku zajęta ramkami tego połączenia [promile] (uint32_t)
+     *   - bajty 12-15 - częstotliwość pętli sterowania serwera [Hz] (uint32_t); 0 = komenda przy każdej ramce
+     *   - bajty 16-19 - CRC32 bajtów 0-15
+     * Starsi klienci nic nie czytają; kilka takich wiadomości czeka wtedy w buforze jądra i niczemu nie szkodzi.
+     */
+    void encodeRateAdvice(uint32_t interval_us, uint32_t load_permille, uint32_t control_rate_hz, uint8_t* buffer);
+
+    /**
+     *
+     * Ramka telefonu w formacie TCPMessage (MESSAGE_LENGTH bajtów), np. dla wejścia syntetycznego lub odtwarzanego
+     * w trybie symulacji; startStop - START (same jedynki) albo STOP, kind - MESSAGE_KIND_*.
+     */
+    void encodeMessage(bool startStop, uint8_t steering_model_code, uint8_t kind, float x, float y, float z, uint8_t* buffer);
+
+    /**
+     *
+     * Paczka (BundleMessage) z samples wskazań x, y, z (od najstarszego); zwraca jej długość. Różnice są liczone
+     * względem wskazań odtworzonych po stronie odbiorcy, więc błąd zaokrąglenia się nie kumuluje, a różnica
+     * ponad zakres int16_t jest nadrabiana w kolejnych wskazaniach.
+     */
+    unsigned int encodeBundle(bool startStop, uint8_t steering_model_code, unsigned int samples, uint32_t interval_us,
+                              const float* x, const float* y, const float* z, uint8_t* buffer);
   }
 }
 
@@ -0,0 +1,145 @@
+#include <cmath>
+
+#include "orientation_filter.hpp"
+
+using SeekurJrRC::Core::OrientationFilter;
+using SeekurJrRC::Core::Config;
+
+namespace {
+  /// największe |theta| w członie sprzęgającym (tan theta rośnie do nieskończoności przy 90 stopniach)
+  const float max_coupling_theta = 80.0 / 57.2957795;
+
+  /// sprowadzenie do [-pi, pi]; remainderf zamiast pętli, więc czas nie zależy od wielkości kąta
+  float wrapAngle(float angle)
+  {
+    return remainderf(angle, 2 * M_PI);
+  }
+}
+
+OrientationFilter::OrientationFilter()
+{
+  reset();
+}
+
+void OrientationFilter::reset()
+{
+  for (int i = 0; i < 2; ++i) {
+    axes_[i].angle_ = 0;
+    axes_[i].bias_ = 0;
+    axes_[i].p_[0][0] = axes_[i].p_[0][1] = axes_[i].p_[1][0] = axes_[i].p_[1][1] = 0;
+  }
+  rates_[0] = rates_[1] = rates_[2] = 0;
+  rates_time_ = 0;
+  time_ = 0;
+  correction_time_ = 0;
+  valid_ = false;
+}
+
+void OrientationFilter::gyroRates(float x, float y, float z, double now, const Config& config)
+{
+  // integrate the previous rates up to now, then hold the new ones until the next event
+  propagate(now, config);
+  rates_[0] = x;
+  rates_[1] = y;
+  rates_[2] = z;
+  rates_time_ = now;
+}
+
+void OrientationFilter::acceleration(float x, float y, float z, double now, const Config& config)
+{
+  if (x == 0 && y == 0 && z == 0)
+    return;
+  const float phi = atan2(y, z);
+  const float theta = atan2(x, y * sin(phi) + z * cos(phi));
+
+  // first sample, or the phone was silent for longer than the history is kept: start over from the accelerometer
+  if (!valid_ || (now - time_) * 1000 > config.max_history_time_) {
+    reset();
+    axes_[PHI].angle_ = phi;
+    axes_[THETA].angle_ = theta;
+    time_ = correction_time_ = now;
+    valid_ = true;
+    return;
+  }
+
+  propagate(now, config);
+  // older than the last correction (a replayed bundle sample, frames out of order): the estimate already includes
+  // a newer measurement, and a negative dt would turn the complementary gain negative
+  if (now < correction_time_)
+    return;
+  float dt = now - correction_time_;
+  correction_time_ = now;
+  correct(axes_[PHI], phi, dt, config);
+  correct(axes_[THETA], theta, dt, config);
+}
+
+void OrientationFilter::gravity(float& x, float& y, float& z) const
+{
+  const float phi = axes_[PHI].angle_;
+  const float theta = axes_[THETA].angle_;
+  x = sin(theta);
+  y = cos(theta) * sin(phi);
+  z = cos(theta) * cos(phi);
+}
+
+void OrientationFilter::propagate(double now, const Config& config)
+{
+  float dt = now - time_;
+  if (!valid_ || dt <= 0)
+    return;
+  time_ = now;
+
+  // stale rates (gyroscope frames stopped coming) are not integrated; the accelerometer alone keeps the estimate
+  float phi_rate = 0;
+  float theta_rate = 0;
+  if ((now - rates_time_) * 1000 <= config.fusion_gyro_timeout_) {
+    // dv/dt = omega x v for the gravity vector v = (sin theta, cos theta sin phi, cos theta cos phi)
+    const float phi = axes_[PHI].angle_;
+    float theta = axes_[THETA].angle_;
+    if (theta > max_coupling_theta)
+      theta = max_coupling_theta;
+    if (theta < -max_coupling_theta)
+      theta = -max_coupling_theta;
+    phi_rate = -rates_[0] + tan(theta) * (sin(phi) * rates_[1] + cos(phi) * rates_[2]);
+    theta_rate = cos(phi) * rates_[1] - sin(phi) * rates_[2];
+  }
+
+  const float rates[2] = {phi_rate, theta_rate};
+  for (int i = 0; i < 2; ++i) {
+    Axis& axis = axes_[i];
+    if (!config.fusion_kalman_) {
+      axis.angle_ = wrapAngle(axis.angle_ + rates[i] * dt);
+      continue;
+    }
+    axis.angle_ = wrapAngle(axis.angle_ + (rates[i] - axis.bias_) * dt);
+    float (&p)[2][2] = axis.p_;
+    p[0][0] += dt * (dt * p[1][1] - p[0][1] - p[1][0] + config.fusion_q_angle_);
+    p[0][1] -= dt * p[1][1];
+    p[1][0] -= dt * p[1][1];
+    p[1][1] += config.fusion_q_bias_ * dt;
+  }
+}
+
+void OrientationFilter::correct(Axis& axis, float measured, float dt, const Config& config)
+{
+  const float innovation = wrapAngle(measured - axis.angle_);
+  if (!config.fusion_kalman_) {
+    // first-order low-pass of the accelerometer angle with the time constant tau
+    const float gain = (config.fusion_time_constant_ + dt > 0) ? dt / (config.fusion_time_constant_ + dt) : 1;
+    axis.angle_ = wrapAngle(axis.angle_ + gain * innovation);
+    return;
+  }
+
+  float (&p)[2][2] = axis.p_;
+  const float s = p[0][0] + config.fusion_r_angle_;
+  const float k0 = p[0][0] / s;
+  const float k1 = p[1][0] / s;
+  axis.angle_ = wrapAngle(axis.angle_ + k0 * innovation);
+  axis.bias_ += k1 * innovation;
+  const float p00 = p[0][0];
+  const float p01 = p[0][1];
+  p[0][0] -= k0 * p00;
+  p[0][1] -= k0 * p01;
+  p[1][0] -= k1 * p00;
+  p[1][1] -= k1 * p01;
+}
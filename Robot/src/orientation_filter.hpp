@@ -0,0 +1,71 @@
+#ifndef ORIENTATION_FILTER_HPP_
+#define ORIENTATION_FILTER_HPP_
+
+#include "config.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Fuzja akcelerometru i żyroskopu telefonu: kąty phi/theta (te same, co SteeringModelBase::getPhiRad/getThetaRad)
+     * liczone przez całkowanie prędkości kątowych, z dryfem korygowanym wskazaniami akcelerometru.
+     * Żyroskop nie ma opóźnienia grupowego, więc wynik reaguje na ruch telefonu od razu, a szum akcelerometru
+     * jest tłumiony tak samo mocno jak przez średnią z historii (getCurrentValueFilteredSimple/Exponential),
+     * która opóźnia sterowanie o połowę okna.
+     *
+     * Dwa warianty ([fusion] filter):
+     *   - complementary - kąt z żyroskopu przechodzi przez filtr górnoprzepustowy, kąt z akcelerometru przez
+     *     dolnoprzepustowy o stałej czasowej time_constant,
+     *   - kalman - dla każdego kąta dwustanowy filtr Kalmana (kąt, dryf żyroskopu), stałe macierze 2x2.
+     *
+     * Prędkości kątowe są w osiach wiadomości (x_, y_, z_ jak dla akcelerometru, po zamianie osi przez klienta).
+     * Zamiana osi x i z zmienia skrętność układu, więc wektor grawitacji zmienia się jak dv/dt = omega x v.
+     *
+     * Stan jest per robot (Driver), podobnie jak historia wskazań. Nie alokuje; czas podaje wołający [s].
+     */
+    class OrientationFilter {
+    public:
+      OrientationFilter();
+
+      /// nowe prędkości kątowe [rad/s]; now - czas odbioru [s, zegar monotoniczny]
+      void gyroRates(float x, float y, float z, double now, const Config& config);
+      /// nowe wskazanie akcelerometru (dowolna długość wektora); korekcja dryfu
+      void acceleration(float x, float y, float z, double now, const Config& config);
+      /// zapomnienie stanu; następne wskazanie akcelerometru ustawia kąty od nowa
+      void reset();
+
+      /// czy było już wskazanie akcelerometru
+      bool valid() const { return valid_; }
+      float phiRad() const { return axes_[PHI].angle_; }
+      float thetaRad() const { return axes_[THETA].angle_; }
+      /// jednostkowy wektor grawitacji o kątach (phi, theta) - wejście dla modeli sterowania zamiast x, y, z
+      void gravity(float& x, float& y, float& z) const;
+
+    private:
+      enum { PHI = 0, THETA = 1 };
+
+      /// jeden kąt: estymata, dryf żyroskopu i kowariancja (tylko kalman)
+      struct Axis {
+        float angle_;
+        float bias_;
+        float p_[2][2];
+      };
+
+      /// całkowanie ostatnich prędkości od ostatniego zdarzenia do now
+      void propagate(double now, const Config& config);
+      void correct(Axis& axis, float measured, float dt, const Config& config);
+
+      Axis axes_[2];
+      bool valid_;
+      /// ostatnie prędkości kątowe i czas ich odbioru
+      float rates_[3];
+      double rates_time_;
+      /// czas, do którego stan jest scałkowany, i czas ostatniej korekcji
+      double time_;
+      double correction_time_;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sys/mman.h>
+
+#include "realtime.hpp"
+
+namespace {
+  /// touch stack_bytes of stack below the caller; noinline so that each chunk is really on a fresh frame
+  __attribute__((noinline)) void prefaultStack(std::size_t stack_bytes)
+  {
+    const std::size_t chunk = 64 * 1024;
+    volatile char* stack = static_cast<volatile char*>(alloca(chunk));
+    long page = sysconf(_SC_PAGESIZE);
+    for (std::size_t i = 0; i < chunk; i += page)
+      stack[i] = 0;
+    if (stack_bytes > chunk)
+      prefaultStack(stack_bytes - chunk);
+  }
+}
+
+bool SeekurJrRC::Utils::applyRealtimeThreadPolicy(const std::vector<int>& cpus, int priority, const char* name)
+{
+  bool ok = true;
+
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int i = 0; i < cpus.size(); ++i)
+      if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+        CPU_SET(cpus[i], &set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result) {
+      std::cerr << "Realtime (" << name << "): cannot pin to CPUs: " << strerror(result) << ". Continuing unpinned." << std::endl;
+      ok = false;
+    }
+  }
+
+  if (priority > 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (result) {
+      std::cerr << "Realtime (" << name << "): cannot switch to SCHED_FIFO " << priority << ": " << strerror(result)
+                << (result == EPERM ? " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)" : "") << ". Continuing with normal scheduling." << std::endl;
+      ok = false;
+    }
+  }
+
+  if (ok)
+    std::cout << "Realtime (" << name << "): " << cpus.size() << " CPU(s), SCHED_FIFO " << priority << std::endl;
+  return ok;
+}
+
+bool SeekurJrRC::Utils::applyBackgroundThreadPolicy(const std::vector<int>& avoid_cpus, const char* name)
+{
+  bool ok = true;
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  int result = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+  if (result) {
+    std::cerr << "Realtime (" << name << "): cannot switch to SCHED_OTHER: " << strerror(result) << std::endl;
+    ok = false;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  for (long cpu = 0; cpu < online && cpu < CPU_SETSIZE; ++cpu)
+    CPU_SET(cpu, &set);
+  for (unsigned int i = 0; i < avoid_cpus.size(); ++i)
+    if (avoid_cpus[i] >= 0 && avoid_cpus[i] < CPU_SETSIZE)
+      CPU_CLR(avoid_cpus[i], &set);
+  // all CPUs are control CPUs: stay where we are rather than nowhere
+  if (CPU_COUNT(&set) > 0) {
+    result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result) {
+      std::cerr << "Realtime (" << name << "): cannot move off the control CPUs: " << strerror(result) << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool SeekurJrRC::Utils::lockAndPrefaultMemory(std::size_t stack_bytes, std::size_t heap_bytes)
+{
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    std::cerr << "Realtime: mlockall failed: " << strerror(errno)
+              << (errno == EPERM || errno == ENOMEM ? " (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)" : "")
+              << ". Continuing with pageable memory." << std::endl;
+    return false;
+  }
+
+  // keep freed memory in the heap instead of returning it to the kernel, and never mmap() big blocks:
+  // the prefaulted pages are then reused by later allocations
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (heap_bytes) {
+    char* heap = static_cast<char*>(malloc(heap_bytes));
+    if (heap) {
+      long page = sysconf(_SC_PAGESIZE);
+      for (std::size_t i = 0; i < heap_bytes; i += page)
+        heap[i] = 0;
+      free(heap);
+    }
+  }
+  if (stack_bytes)
+    prefaultStack(stack_bytes);
+
+  std::cout << "Realtime: memory locked, prefaulted " << stack_bytes / 1024 << " KB of stack and "
+            << heap_bytes / 1024 << " KB of heap" << std::endl;
+  return true;
+}
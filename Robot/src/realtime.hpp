@@ -0,0 +1,41 @@
+#ifndef REALTIME_HPP_
+#define REALTIME_HPP_
+
+#include <vector>
+#include <cstddef>
+
+namespace SeekurJrRC {
+  namespace Utils {
+
+    /**
+     * \param cpus     - rdzenie, na których wątek może działać (pusta lista = bez zmian)
+     * \param priority - priorytet SCHED_FIFO (0 = bez zmian)
+     * \param name     - nazwa wątku do komunikatów
+     *
+     * Przypina wywołujący wątek do podanych rdzeni i nadaje mu politykę SCHED_FIFO. Brak uprawnień
+     * (CAP_SYS_NICE, RLIMIT_RTPRIO) nie jest błędem krytycznym - wypisujemy ostrzeżenie i działamy dalej
+     * ze zwykłym szeregowaniem. Zwraca true, jeżeli wszystko się udało.
+     */
+    bool applyRealtimeThreadPolicy(const std::vector<int>& cpus, int priority, const char* name);
+
+    /**
+     * \param avoid_cpus - rdzenie pętli sterowania, z których wątek ma zejść (jeżeli zostają jakieś inne)
+     * \param name       - nazwa wątku do komunikatów
+     *
+     * Odwrotność powyższego dla wątków pomocniczych (telemetria, tryb cienia): nowy wątek dziedziczy SCHED_FIFO
+     * i przypięcie po wątku, który go utworzył, więc wraca do zwykłego szeregowania i pozostałych rdzeni.
+     */
+    bool applyBackgroundThreadPolicy(const std::vector<int>& avoid_cpus, const char* name);
+
+    /**
+     * \param stack_bytes - ile stosu wywołującego wątku zawczasu "dotknąć"
+     * \param heap_bytes  - ile sterty zaalokować, dotknąć i zostawić w alokatorze
+     *
+     * mlockall(MCL_CURRENT | MCL_FUTURE) i prefault stosu oraz sterty, żeby ścieżka sterowania nie łapała
+     * page fault'ów. Podobnie jak wyżej - brak uprawnień kończy się ostrzeżeniem. Zwraca true, jeżeli pamięć jest zablokowana.
+     */
+    bool lockAndPrefaultMemory(std::size_t stack_bytes, std::size_t heap_bytes);
+  }
+}
+
+#endif
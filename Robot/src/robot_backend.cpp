@@ -0,0 +1,252 @@
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <string.h>
+
+#include <boost/thread.hpp>
+
+#include "Aria.h"
+
+#include "robot_backend.hpp"
+#include "utils.hpp"
+#include "config.hpp"
+#include "realtime.hpp"
+
+using SeekurJrRC::Core::AriaRobotBackend;
+using SeekurJrRC::Core::SimulatedRobotBackend;
+using SeekurJrRC::Core::MotionCommand;
+
+int AriaRobotBackend::instances_ = 0;
+
+AriaRobotBackend::AriaRobotBackend(const SeekurJrRC::Core::RobotConfig& robot)
+  : robot_id_(robot.id_), realtime_task_(this, &AriaRobotBackend::applyRealtimePolicy), command_task_(this, &AriaRobotBackend::applyCommand),
+    realtime_task_added_(false), command_task_added_(false), realtime_applied_(false), cycle_stopping_(false), applied_(0),
+    args_storage_("server " + robot.aria_args_)
+{
+  if (instances_++ == 0)
+    Aria::init();
+  robot_ = new ArRobot();
+
+  // split the arguments in place; argv_ points into args_storage_
+  std::string::size_type pos = 0;
+  while (pos < args_storage_.size()) {
+    std::string::size_type start = args_storage_.find_first_not_of(' ', pos);
+    if (start == std::string::npos)
+      break;
+    std::string::size_type end = args_storage_.find(' ', start);
+    if (end == std::string::npos)
+      end = args_storage_.size();
+    else
+      args_storage_[end] = '\0';
+    argv_.push_back(&args_storage_[start]);
+    pos = end + 1;
+  }
+  argc_ = argv_.size();
+  argv_.push_back(NULL);
+
+  robot_arg_parser_ = new ArArgumentParser(&argc_, &argv_[0]);
+  robot_connector_ = new ArRobotConnector(robot_arg_parser_, robot_);
+}
+
+AriaRobotBackend::~AriaRobotBackend()
+{
+  finishCycle();
+  delete robot_;
+  delete robot_arg_parser_;
+  delete robot_connector_;
+  if (--instances_ == 0)
+    Aria::shutdown();
+}
+
+bool AriaRobotBackend::connect()
+{
+  // the previous link's cycle may still be finishing; here, on the connecting thread, it can be waited for
+  finishCycle();
+  if (!robot_connector_->connectRobot())
+  {
+    ArLog::log(ArLog::Terse, "Error, could not connect to robot.");
+    return false;
+  }
+
+  // the robot thread is created by runAsync, so its policy can only be set from inside the robot cycle
+  if (SeekurJrRC::Core::Configuration::current().realtime_enabled_ && !realtime_task_added_) {
+    robot_->addUserTask("realtime", 1, &realtime_task_);
+    realtime_task_added_ = true;
+  }
+  // the last of the sensor interpretation tasks: what it sets goes to the firmware in the same cycle
+  if (!command_task_added_) {
+    robot_->addSensorInterpTask("commands", 1, &command_task_);
+    command_task_added_ = true;
+  }
+  // the cycle is not running yet: whatever was left from the previous link must not move the robot now
+  mailbox_.discard();
+
+  robot_->runAsync(false);
+  robot_->enableMotors();
+  return true;
+}
+
+void AriaRobotBackend::applyRealtimePolicy()
+{
+  if (realtime_applied_)
+    return;
+  realtime_applied_ = true;
+  const SeekurJrRC::Core::ConfigPtr pinned_config = SeekurJrRC::Core::Configuration::snapshot();
+  const SeekurJrRC::Core::Config& config = *pinned_config;
+  SeekurJrRC::Utils::applyRealtimeThreadPolicy(config.realtime_driver_cpus_, config.realtime_driver_priority_, "ARIA robot thread");
+}
+
+void AriaRobotBackend::applyCommand()
+{
+  MotionCommand command;
+  if (!mailbox_.take(command))
+    return;
+  // inside the cycle the robot is already locked by its own thread
+  if (command.stop_)
+    robot_->stop();
+  else {
+    robot_->setRotVel(command.omega_);
+    robot_->setVel(command.v_trans_);
+  }
+  ++applied_;
+  mailbox_latency_.record((SeekurJrRC::Utils::monotonicNowNs() - command.published_ns_) / 1000);
+}
+
+void AriaRobotBackend::publish(float v_trans, float omega, bool stop)
+{
+  MotionCommand command;
+  command.v_trans_ = v_trans;
+  command.omega_ = omega;
+  command.stop_ = stop;
+  command.published_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+  mailbox_.publish(command);
+}
+
+void AriaRobotBackend::disconnect()
+{
+  // called on the Driver's thread (also when the link is lost), so nothing here waits for the cycle to exit;
+  // a stop left in the mailbox could be dropped by stopRunning() before the cycle takes it, so it is applied
+  // directly, under the robot lock, and whatever is still waiting in the mailbox is discarded
+  robot_->lock();
+  mailbox_.discard();
+  robot_->stop();
+  robot_->unlock();
+  robot_->stopRunning();
+  cycle_stopping_ = true;
+}
+
+void AriaRobotBackend::finishCycle()
+{
+  if (!cycle_stopping_)
+    return;
+  cycle_stopping_ = false;
+  robot_->waitForRunExit();
+  // the cycle has ended, so its counters can be read from this thread
+  std::cout << "Robot " << robot_id_ << " cycle: " << applied_ << " commands applied, " << mailbox_.superseded()
+            << " superseded in the mailbox; ";
+  mailbox_latency_.print(std::cout, "mailbox latency");
+  std::cout << std::endl;
+}
+
+bool AriaRobotBackend::isConnected()
+{
+  return robot_->isConnected();
+}
+
+bool AriaRobotBackend::areMotorsEnabled()
+{
+  return robot_->areMotorsEnabled();
+}
+
+void AriaRobotBackend::setVelocities(float v_trans, float omega)
+{
+  publish(v_trans, omega, false);
+}
+
+void AriaRobotBackend::stop()
+{
+  publish(0, 0, true);
+}
+
+unsigned int AriaRobotBackend::cycleTimeMs()
+{
+  return robot_->getCycleTime();
+}
+
+SimulatedRobotBackend::SimulatedRobotBackend(const SeekurJrRC::Core::RobotConfig& robot)
+  : robot_id_(robot.id_), connected_(false), connect_delay_(robot.connect_delay_), failures_left_(robot.connect_failures_),
+    link_lifetime_(robot.link_lifetime_), connected_at_ns_(0), v_trans_(0), omega_(0), x_(0), y_(0), heading_(0), commands_(0), stops_(0)
+{
+  SeekurJrRC::Utils::timeOfDay(&lastUpdate_);
+}
+
+bool SimulatedRobotBackend::connect()
+{
+  // the "serial handshake"; an interruption point, so a shutdown does not wait for it
+  // (a simulation does not sleep: its clock only moves between events)
+  if (connect_delay_ > 0 && !SeekurJrRC::Utils::VirtualClock::enabled())
+    boost::this_thread::sleep(boost::posix_time::milliseconds(connect_delay_));
+  if (failures_left_) {
+    --failures_left_;
+    std::cerr << "Simulated robot " << robot_id_ << ": no answer (" << failures_left_ << " more failures to go)" << std::endl;
+    return false;
+  }
+  connected_ = true;
+  connected_at_ns_ = SeekurJrRC::Utils::monotonicNowNs();
+  SeekurJrRC::Utils::timeOfDay(&lastUpdate_);
+  return true;
+}
+
+bool SimulatedRobotBackend::isConnected()
+{
+  return connected_ && (link_lifetime_ <= 0 || SeekurJrRC::Utils::monotonicNowNs() - connected_at_ns_ < link_lifetime_ * 1000000LL);
+}
+
+void SimulatedRobotBackend::disconnect()
+{
+  stop();
+  connected_ = false;
+  std::cout << "Simulated robot " << robot_id_ << ": " << commands_ << " commands, " << stops_ << " stops, "
+            << "final pose (" << x_ << ", " << y_ << ", " << heading_ << ")" << std::endl;
+}
+
+bool SimulatedRobotBackend::areMotorsEnabled()
+{
+  return connected_;
+}
+
+void SimulatedRobotBackend::setVelocities(float v_trans, float omega)
+{
+  integrate();
+  v_trans_ = v_trans;
+  omega_ = omega;
+  ++commands_;
+}
+
+void SimulatedRobotBackend::stop()
+{
+  integrate();
+  v_trans_ = 0;
+  omega_ = 0;
+  ++stops_;
+}
+
+unsigned int SimulatedRobotBackend::cycleTimeMs()
+{
+  // the default ArRobot cycle
+  return 100;
+}
+
+void SimulatedRobotBackend::integrate()
+{
+  struct timeval now;
+  SeekurJrRC::Utils::timeOfDay(&now);
+  double dt = SeekurJrRC::Utils::gTODDiffToMsec(&now, &lastUpdate_) / 1000.0;
+  lastUpdate_ = now;
+
+  double heading_rad = heading_ / 57.2957795;
+  x_ += v_trans_ * cos(heading_rad) * dt;
+  y_ += v_trans_ * sin(heading_rad) * dt;
+  heading_ = fmod(heading_ + omega_ * dt, 360.0);
+}
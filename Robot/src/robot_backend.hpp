@@ -0,0 +1,142 @@
+#ifndef ROBOT_BACKEND_HPP_
+#define ROBOT_BACKEND_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/time.h> // for struct timeval
+
+#include "Aria.h"
+
+#include "config.hpp"
+#include "command_mailbox.hpp"
+#include "utils.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Wspólny interfejs "fizycznego" robota, z którym rozmawia Driver. Dzięki temu jeden proces może
+     * obsługiwać zarówno prawdziwe roboty (przez ARIA), jak i roboty symulowane (testy floty).
+     *
+     * connect() może trwać długo (nawiązanie łącza szeregowego), więc Driver woła je w osobnym wątku; pozostałe
+     * metody dopiero po udanym connect(), z wątku robota.
+     */
+    class RobotBackend {
+    public:
+      virtual ~RobotBackend() {};
+      /// połączenie z robotem; false w przypadku niepowodzenia
+      virtual bool connect() = 0;
+      /// zatrzymanie robota i rozłączenie
+      virtual void disconnect() = 0;
+      /// false, jeżeli łącze z robotem zostało zerwane (sprawdzane przez watchdog)
+      virtual bool isConnected() = 0;
+      virtual bool areMotorsEnabled() = 0;
+      /// nadanie prędkości postępowej [mm/s] i obrotowej [deg/s]
+      virtual void setVelocities(float v_trans, float omega) = 0;
+      /// natychmiastowe zatrzymanie (watchdog)
+      virtual void stop() = 0;
+      /// długość cyklu synchronizacji z firmware'm [msec]
+      virtual unsigned int cycleTimeMs() = 0;
+    };
+
+    /**
+     *
+     * Robot sterowany przez bibliotekę ARIA - dotychczasowa zawartość Driver'a.
+     *
+     * ArRobot działa we własnym wątku (runAsync), więc setVelocities() i stop() nie wołają go bezpośrednio (co
+     * wymagałoby lock()/unlock() na muteksie robota z wątku Driver'a), tylko wystawiają komendę w CommandMailbox.
+     * Odbiera ją zadanie w cyklu synchronizacji ArRobot (applyCommand), tuż przed wysłaniem stanu do firmware'u:
+     * najwyżej jedna komenda na cykl, najnowsza. Opóźnienie od wystawienia do odbioru jest mierzone i wypisywane
+     * po zakończeniu cyklu (przy następnym połączeniu albo w destruktorze - disconnect() na nie nie czeka).
+     * Wyjątkiem jest disconnect(): stop ustawia bezpośrednio, pod lock() robota, bo cykl zatrzymywany przez
+     * stopRunning() mógłby już nie odebrać komendy z CommandMailbox.
+     */
+    class AriaRobotBackend : public RobotBackend {
+    public:
+      /// robot.aria_args_ - dodatkowe argumenty dla ArArgumentParser (np. "-robotPort /dev/ttyS1")
+      explicit AriaRobotBackend(const RobotConfig& robot);
+      ~AriaRobotBackend();
+      bool connect();
+      void disconnect();
+      bool isConnected();
+      bool areMotorsEnabled();
+      void setVelocities(float v_trans, float omega);
+      void stop();
+      unsigned int cycleTimeMs();
+
+    private:
+      /// zadanie w cyklu ArRobot: za pierwszym razem ustawia politykę czasu rzeczywistego wątku ARIA
+      void applyRealtimePolicy();
+      /// zadanie w cyklu ArRobot: komenda ze skrzynki (jeżeli jest nowa) do stanu robota
+      void applyCommand();
+      void publish(float v_trans, float omega, bool stop);
+      /// czeka na koniec cyklu zatrzymanego przez disconnect() i wypisuje jego statystyki; nie z wątku Driver'a
+      void finishCycle();
+
+      uint32_t robot_id_;
+      ArRobot* robot_;
+      ArFunctorC<AriaRobotBackend> realtime_task_;
+      ArFunctorC<AriaRobotBackend> command_task_;
+      /// zadania dodane do cyklu (przy ponownym połączeniu nie dodajemy ich drugi raz)
+      bool realtime_task_added_;
+      bool command_task_added_;
+      bool realtime_applied_;
+      /// disconnect() zatrzymał cykl, ale nikt jeszcze nie poczekał na jego koniec
+      bool cycle_stopping_;
+      CommandMailbox mailbox_;
+      /// tylko z cyklu ArRobot: opóźnienie skrzynka -> cykl i liczba odebranych komend
+      SeekurJrRC::Utils::JitterStats mailbox_latency_;
+      uint64_t applied_;
+      ArRobotConnector* robot_connector_;
+      ArArgumentParser* robot_arg_parser_;
+      /// ArArgumentParser trzyma wskaźniki do argumentów, więc muszą żyć tak długo jak on
+      std::string args_storage_;
+      std::vector<char*> argv_;
+      int argc_;
+      /// Aria::init/Aria::shutdown wołamy raz na proces, niezależnie od liczby robotów
+      static int instances_;
+    };
+
+    /**
+     *
+     * Robot symulowany: całkuje prędkości zadane przez Driver (model różnicowy) i zlicza komendy.
+     * Nie wymaga żadnego sprzętu, więc na jednej maszynie można uruchomić dziesiątki "robotów".
+     * Może też udawać kapryśne łącze (RobotConfig: connect_delay_, connect_failures_, link_lifetime_).
+     */
+    class SimulatedRobotBackend : public RobotBackend {
+    public:
+      explicit SimulatedRobotBackend(const RobotConfig& robot);
+      bool connect();
+      void disconnect();
+      bool isConnected();
+      bool areMotorsEnabled();
+      void setVelocities(float v_trans, float omega);
+      void stop();
+      unsigned int cycleTimeMs();
+
+    private:
+      /// przesunięcie stanu (x, y, heading) do chwili obecnej ze starymi prędkościami
+      void integrate();
+
+      uint32_t robot_id_;
+      bool connected_;
+      long connect_delay_;
+      unsigned int failures_left_;
+      long link_lifetime_;
+      /// chwila nawiązania połączenia (CLOCK_MONOTONIC) [ns]
+      int64_t connected_at_ns_;
+      float v_trans_;
+      float omega_;
+      double x_;       // [mm]
+      double y_;       // [mm]
+      double heading_; // [deg]
+      struct timeval lastUpdate_;
+      uint64_t commands_;
+      uint64_t stops_;
+    };
+  }
+}
+
+#endif
@@ -1,5 +1,10 @@
 #include <iostream>
 #include <climits>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
 
 #if !(CHAR_BIT == 8)
 #error "Char size is not equal to 8 bits. Will not build here!"
@@ -14,17 +19,33 @@
 #include "driver.hpp"
 #include "server.hpp"
 #include "message.hpp"
+#include "fleet.hpp"
+#include "connection_manager.hpp"
+#include "alloc_tracker.hpp"
+#include "frame_trace.hpp"
+#include "config.hpp"
+
+// reenter/yield macros for boost::asio::coroutine; keep them local to this file
+#include <boost/asio/yield.hpp>
 
 // this will be created following from http://www.boost.org/doc/libs/1_41_0/doc/html/boost_asio/tutorial/tutdaytime7/src.html
 
 using boost::asio::ip::tcp;
 using SeekurJrRC::Core::TCPServer;
 using SeekurJrRC::Core::TCPConnection;
+using SeekurJrRC::Core::HandshakeMessage;
+using SeekurJrRC::Core::ConnectionManager;
+using SeekurJrRC::Core::UringService;
+using SeekurJrRC::Core::makeCustomAllocHandler;
+using SeekurJrRC::Core::SharedTokenBucket;
 
-boost::asio::io_service::id TCPServer::id;
+SharedTokenBucket TCPConnection::_globalBucket;
+// in-class initialized, but bound to const references (posix_time::milliseconds), so they need a definition
+const uint TCPConnection::_messageLength;
+const long TCPServer::_acceptRetryDelay;
 
-boost::shared_ptr<TCPConnection> TCPConnection::create(boost::asio::io_service& io_service) {
-  return boost::shared_ptr<TCPConnection>(new TCPConnection(io_service));
+boost::shared_ptr<TCPConnection> TCPConnection::create(boost::asio::io_service& io_service, SeekurJrRC::Core::Driver* driver) {
+  return boost::shared_ptr<TCPConnection>(new TCPConnection(io_service, driver));
 }
 
 tcp::socket& TCPConnection::socket() {
@@ -32,66 +53,423 @@ tcp::socket& TCPConnection::socket() {
 }
 
 void TCPConnection::scheduleRead() {
-  // dzięki użyciu boost::shared_array możemy z dobrym przybliżeniem
-  // być pewnymi, że bufor zostanie usunięty poprawnie
-  // i nie będzie żadnego wycieku pamięci
-  boost::shared_array<uint8_t> read_buffer(new uint8_t[_messageLength]);
+  // bufor i pamięć handler'a są składowymi połączenia, a handler trzyma shared_ptr do połączenia,
+  // więc oba żyją co najmniej tak długo jak oczekujące czytanie
+  // a frame's header first; the rest of a bundle once the header has told its length
+  const unsigned int wanted = _readFill ? SeekurJrRC::Core::messageLength(_readBuffer) : _messageLength;
   boost::asio::async_read(
     _socket,
-    boost::asio::buffer(read_buffer.get(), _messageLength),
-    boost::bind(
-      &TCPConnection::handleRead,
-      this->shared_from_this(),
-      boost::asio::placeholders::error,
-      read_buffer
+    boost::asio::buffer(_readBuffer + _readFill, wanted - _readFill),
+    makeCustomAllocHandler(
+      _handlerMemory,
+      boost::bind(
+        &TCPConnection::handleRead,
+        this->shared_from_this(),
+        boost::asio::placeholders::error
+      )
     )
   );  
 }
 
 void TCPConnection::start() {
-  scheduleRead();
+  const SeekurJrRC::Core::ConfigPtr pinned_config = SeekurJrRC::Core::Configuration::snapshot();
+  const SeekurJrRC::Core::Config& config = *pinned_config;
+  // io_uring carries robot sessions only; a handshake hands the socket over, which needs an Asio read
+  if (config.io_uring_backend_ && _driver) {
+    _self = shared_from_this();
+    if (boost::asio::use_service<UringService>(_io_service).receive(_socket.native_handle(), this)) {
+      adviseRate(SeekurJrRC::Utils::monotonicNowNs(), config);
+      return;
+    }
+    _self.reset();
+  }
+  if (config.coroutine_read_loop_)
+    readLoop(boost::system::error_code());
+  else
+    scheduleRead();
+  // the phone learns the rate it should send at before its first frame
+  if (_driver)
+    adviseRate(SeekurJrRC::Utils::monotonicNowNs(), config);
+}
+
+void TCPConnection::opened() {
+  boost::system::error_code ec;
+  tcp::endpoint remote = _socket.remote_endpoint(ec);
+  if (!ec) {
+    std::ostringstream peer;
+    peer << remote;
+    _peer = peer.str();
+  }
+  _counters.connected_ = _counters.last_activity_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+void TCPConnection::close() {
+  boost::system::error_code ignored;
+  _socket.shutdown(tcp::socket::shutdown_both, ignored);
+  _socket.close(ignored);
+}
+
+TCPConnection::TCPConnection(boost::asio::io_service& io_service, SeekurJrRC::Core::Driver* driver)
+  : _io_service(io_service), _driver(driver), _socket(io_service), _frameLength(MESSAGE_LENGTH), _readFill(0), _peer("?"), _floodWindowStart(0),
+    _floodDrops(0), _rateWindowStart(SeekurJrRC::Utils::monotonicNowNs()), _rateFrames(0), _rateBusyNs(0), _rateKinds(0),
+    _rateCostNs(0), _writing(false)
+{
+  _counters.frames_ = 0;
+  _counters.bad_frames_ = 0;
+  _counters.rate_limited_ = 0;
+  _counters.global_limited_ = 0;
+  _counters.bytes_ = 0;
+  _counters.rate_advices_ = 0;
+  _counters.advised_interval_us_ = 0;
 }
 
-TCPConnection::TCPConnection(boost::asio::io_service& io_service) : _socket(io_service), _io_service(io_service) { }
+void TCPConnection::readLoop(const boost::system::error_code& error)
+{
+  reenter (_readLoop) {
+    // one reference for the whole session instead of one per frame
+    _self = shared_from_this();
+    for (;;) {
+      yield boost::asio::async_read(
+        _socket,
+        boost::asio::buffer(_readBuffer, _messageLength),
+        makeCustomAllocHandler(_handlerMemory, ReadLoopHandler(this))
+      );
+      // EOF or any other error ends the session
+      if (error) {
+        boost::asio::use_service<ConnectionManager>(_io_service).stop(_self);
+        break;
+      }
+      _frameLength = _driver ? SeekurJrRC::Core::messageLength(_readBuffer) : _messageLength;
+      if (_frameLength > _messageLength) {
+        yield boost::asio::async_read(
+          _socket,
+          boost::asio::buffer(_readBuffer + _messageLength, _frameLength - _messageLength),
+          makeCustomAllocHandler(_handlerMemory, ReadLoopHandler(this))
+        );
+        if (error) {
+          boost::asio::use_service<ConnectionManager>(_io_service).stop(_self);
+          break;
+        }
+      }
+      countFrame(_frameLength);
+      if (!_driver) {
+        handleHandshake(_readBuffer);
+        break;
+      }
+      // the next read is started only after the frame is processed, so _readBuffer cannot be overwritten meanwhile
+      SeekurJrRC::Core::FrameTracer::begin(_driver->robotId());
+      processFrame(_readBuffer, _frameLength);
+    }
+    // last statement: dropping _self may destroy the connection
+    boost::shared_ptr<TCPConnection> self;
+    self.swap(_self);
+  }
+}
 
-void TCPConnection::handleRead(
-  const boost::system::error_code& error,
-  boost::shared_array<uint8_t> read_buffer
-)
+void TCPConnection::handleRead(const boost::system::error_code& error)
 {
+  // EOF or any other error ends the session; re-arming the read here would spin on EOF forever
+  if (error) {
+    boost::asio::use_service<ConnectionManager>(_io_service).stop(shared_from_this());
+    return;
+  }
+
+  if (!_driver) {
+    countFrame(_messageLength);
+    handleHandshake(_readBuffer);
+    return;
+  }
+
+  // a bundle's header has arrived: read the rest first
+  const unsigned int length = SeekurJrRC::Core::messageLength(_readBuffer);
+  if (!_readFill && length > _messageLength) {
+    _readFill = _messageLength;
+    scheduleRead();
+    return;
+  }
+  _readFill = 0;
+  countFrame(length);
+
+  SeekurJrRC::Core::FrameTracer::begin(_driver->robotId());
+  // the next read is started before processing and may complete speculatively into _readBuffer right away
+  uint8_t frame[MESSAGE_MAX_LENGTH];
+  memcpy(frame, _readBuffer, length);
   scheduleRead();
-  if (!error) {
-    // przetwarzamy read_buffer i przekazujemy powstałą wiadomość driverowi
+  processFrame(frame, length);
+}
+
+void TCPConnection::uringCompleted(int32_t result, const uint8_t* data, bool more)
+{
+  if (result > 0 && data) {
+    // the kernel hands over the stream in chunks of any length; cut it into frames here
+    uint32_t length = result;
+    while (length) {
+      // the header first, then (for a bundle) as much as the header says
+      const uint32_t wanted = _readFill < _messageLength ? _messageLength : SeekurJrRC::Core::messageLength(_readBuffer);
+      uint32_t part = std::min(length, wanted - _readFill);
+      memcpy(_readBuffer + _readFill, data, part);
+      _readFill += part;
+      data += part;
+      length -= part;
+      if (_readFill == wanted) {
+        const unsigned int frame_length = SeekurJrRC::Core::messageLength(_readBuffer);
+        // only the header of a bundle so far
+        if (_readFill < frame_length)
+          continue;
+        _readFill = 0;
+        countFrame(frame_length);
+        SeekurJrRC::Core::FrameTracer::begin(_driver->robotId());
+        processFrame(_readBuffer, frame_length);
+      }
+    }
+    if (more)
+      return;
+  }
+
+  // the kernel may end a multishot receive on its own (e.g. out of buffers); re-arm it while the session is alive
+  if ((result > 0 || result == -ENOBUFS) && _socket.is_open()
+      && boost::asio::use_service<UringService>(_io_service).receive(_socket.native_handle(), this))
+    return;
+
+  // EOF, error or close(): the session ends
+  boost::asio::use_service<ConnectionManager>(_io_service).stop(_self);
+  // last statement: dropping _self may destroy the connection
+  boost::shared_ptr<TCPConnection> self;
+  self.swap(_self);
+}
+
+void TCPConnection::countFrame(unsigned int length)
+{
+  ++_counters.frames_;
+  _counters.bytes_ += length;
+  _counters.last_activity_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+bool TCPConnection::admit(int64_t now, const SeekurJrRC::Core::Config& config)
+{
+  if (!_bucket.admit(now, SeekurJrRC::Core::admissionPeriodNs(config.admission_session_rate_), config.admission_session_burst_)) {
+    ++_counters.rate_limited_;
+    // only this session's own excess counts as a flood; the global limit may be hit because of others
+    if (now - _floodWindowStart >= 1000000000LL) {
+      _floodWindowStart = now;
+      _floodDrops = 0;
+    }
+    if (++_floodDrops == config.admission_flood_close_) {
+      std::cerr << "Connection " << _peer << ": " << _floodDrops << " frames over the limit within a second, closing" << std::endl;
+      close();
+    }
+    return false;
+  }
+  if (!_globalBucket.admit(now, SeekurJrRC::Core::admissionPeriodNs(config.admission_global_rate_), config.admission_global_burst_)) {
+    ++_counters.global_limited_;
+    return false;
+  }
+  return true;
+}
+
+void TCPConnection::processFrame(const uint8_t* frame, unsigned int length)
+{
+  // cheapest checks first: over the limit costs a clock read, garbage a CRC; neither reaches the driver
+  const int64_t now = SeekurJrRC::Utils::monotonicNowNs();
+  const SeekurJrRC::Core::ConfigGuard guard;
+  const SeekurJrRC::Core::Config& config = guard.config();
+  if (!admit(now, config)) {
+    SeekurJrRC::Core::FrameTracer::end();
+    return;
+  }
+  const bool bundle = (length > _messageLength);
+  if (!(bundle ? SeekurJrRC::Core::BundleMessage::isValid(frame) : TCPMessage::isValid(frame))) {
+    ++_counters.bad_frames_;
+    // a garbage flood must not become a flood of log lines: report the 1st, 2nd, 4th, 8th... bad frame
+    if (!(_counters.bad_frames_ & (_counters.bad_frames_ - 1)))
+      std::cerr << "Connection " << _peer << ": bad frame (checksum or message kind), " << _counters.bad_frames_ << " so far" << std::endl;
+    SeekurJrRC::Core::FrameTracer::end();
+    return;
+  }
+  SeekurJrRC::Core::FrameTracer::mark(SeekurJrRC::Core::TRACE_CRC_CHECKED);
+
+  uint64_t allocations = SeekurJrRC::Utils::AllocTracker::beginMessage();
+  {
+    // przetwarzamy ramkę i przekazujemy powstałą wiadomość driverowi
     try {
       // debug
       // for (int i = 0; i < _messageLength; ++i) {
-      //   printf("%02X", read_buffer[i]);
+      //   printf("%02X", frame[i]);
       // }
       // std::cout << std::endl;
       
-      TCPMessage message(read_buffer.get());
-      // TCPMessage's constructor may throw. If it throws, the code below won't be executed!
-      SeekurJrRC::Core::Driver& driver = boost::asio::use_service<SeekurJrRC::Core::Driver>(_io_service);
-      driver.processMessage(message);
+      if (bundle) {
+        SeekurJrRC::Core::BundleMessage message(frame);
+        SeekurJrRC::Core::FrameTracer::mark(SeekurJrRC::Core::TRACE_DECODED);
+        SeekurJrRC::Core::FrameTracer::kind(MESSAGE_KIND_BUNDLE);
+        // the advice is per sample, so is the cost it is derived from
+        _rateKinds |= 1u << MESSAGE_KIND_ACCELEROMETER;
+        _rateFrames += message.samples_ - 1;
+        _driver->processBundle(message, config);
+      }
+      else {
+        TCPMessage message(frame);
+        // TCPMessage's constructor may throw. If it throws, the code below won't be executed!
+        SeekurJrRC::Core::FrameTracer::mark(SeekurJrRC::Core::TRACE_DECODED);
+        SeekurJrRC::Core::FrameTracer::kind(message.kind_);
+        _rateKinds |= 1u << message.kind_;
+        _driver->processMessage(message, config);
+      }
     } catch (const char* e) {
+      ++_counters.bad_frames_;
       std::cerr << "Instatiating TCPMessage: " << e << std::endl;
     } catch (...) {
+      ++_counters.bad_frames_;
       std::cerr << "Instatiating TCPMessage: unknown exception." << std::endl;
     }
   }
+  SeekurJrRC::Utils::AllocTracker::endMessage(allocations);
+
+  // the cost of the admitted frames is what the advised rate is derived from
+  const int64_t done = SeekurJrRC::Utils::monotonicNowNs();
+  _rateBusyNs += done - now;
+  ++_rateFrames;
+  if (done - _rateWindowStart >= config.rate_interval_ * 1000000LL)
+    adviseRate(done, config);
+  SeekurJrRC::Core::FrameTracer::end();
+}
+
+void TCPConnection::adviseRate(int64_t now, const SeekurJrRC::Core::Config& config)
+{
+  const int64_t window = now - _rateWindowStart;
+  const uint64_t frames = _rateFrames;
+  const int64_t busy = _rateBusyNs;
+  // one rate per sensor is advised, but both sensors' frames arrive here
+  const unsigned int sensors = (_rateKinds & (1u << MESSAGE_KIND_GYROSCOPE)) ? 2 : 1;
+  _rateWindowStart = now;
+  _rateFrames = 0;
+  _rateBusyNs = 0;
+  _rateKinds = 0;
+  if (!config.rate_advice_enabled_ || _writing || !_socket.is_open())
+    return;
+
+  // what the driver can use: a few fresh readings per control tick, or max_hz when every frame becomes a command
+  double rate = config.control_rate_hz_ ? config.control_rate_hz_ * config.rate_oversample_ : config.rate_max_hz_;
+  rate = std::min(rate, (double)config.rate_max_hz_);
+  // keep a margin below the admission limit, so that a phone following the advice is never rate limited
+  if (config.admission_session_rate_)
+    rate = std::min(rate, 0.8 * config.admission_session_rate_ / sensors);
+  uint32_t load_permille = 0;
+  if (frames && busy > 0 && window > 0) {
+    load_permille = (uint32_t)std::min<int64_t>(1000 * busy / window, 1000);
+    const double cost = (double)busy / frames;
+    _rateCostNs = _rateCostNs > 0 ? 0.5 * (_rateCostNs + cost) : cost;
+    // the frame rate at which this session would take target_load of the thread, at the measured cost per frame
+    rate = std::min(rate, config.rate_target_load_ * 1e9 / _rateCostNs / sensors);
+  }
+  rate = std::max(rate, (double)config.rate_min_hz_);
+  const uint32_t interval_us = (uint32_t)(1e6 / rate);
+
+  // a change of 10% or less is not worth a message
+  const uint32_t advised = _counters.advised_interval_us_;
+  if (advised && 10 * (uint64_t)(interval_us > advised ? interval_us - advised : advised - interval_us) <= advised)
+    return;
+  _counters.advised_interval_us_ = interval_us;
+  ++_counters.rate_advices_;
+  SeekurJrRC::Core::encodeRateAdvice(interval_us, load_permille, config.control_rate_hz_, _writeBuffer);
+  _writing = true;
+  boost::asio::async_write(
+    _socket,
+    boost::asio::buffer(_writeBuffer, _messageLength),
+    makeCustomAllocHandler(
+      _writeHandlerMemory,
+      boost::bind(&TCPConnection::handleWrite, shared_from_this(), boost::asio::placeholders::error)
+    )
+  );
+}
+
+void TCPConnection::handleWrite(const boost::system::error_code& /*error*/)
+{
+  // a failed write needs no handling here: the read side sees the same broken connection and ends the session
+  _writing = false;
 }
 
-TCPServer::TCPServer(boost::asio::io_service& io_service)
-    : _acceptor(io_service, tcp::endpoint(tcp::v4(), _connPort)), service(io_service)
+void TCPConnection::handleHandshake(const uint8_t* read_buffer)
 {
+  ConnectionManager& manager = boost::asio::use_service<ConnectionManager>(_io_service);
+  try {
+    HandshakeMessage handshake(read_buffer);
+    SeekurJrRC::Core::Driver* driver = boost::asio::use_service<SeekurJrRC::Core::Fleet>(_io_service).findDriver(handshake.robotId_);
+    if (!driver) {
+      std::cerr << "Handshake: unknown robot " << handshake.robotId_ << std::endl;
+      manager.stop(shared_from_this());
+      return;
+    }
+    // hand the socket over to a connection living in the robot's thread; this connection dies here
+    boost::shared_ptr<TCPConnection> handover = TCPConnection::create(driver->ioService(), driver);
+    handover->socket().assign(tcp::v4(), _socket.release());
+    manager.release(shared_from_this());
+    driver->ioService().post(
+      boost::bind(
+        &ConnectionManager::start,
+        &boost::asio::use_service<ConnectionManager>(driver->ioService()),
+        handover
+      )
+    );
+  } catch (const char* e) {
+    ++_counters.bad_frames_;
+    std::cerr << "Handshake: " << e << std::endl;
+    manager.stop(shared_from_this());
+  } catch (const boost::system::system_error& e) {
+    std::cerr << "Handshake: " << e.what() << std::endl;
+    manager.stop(shared_from_this());
+  }
+}
+
+TCPServer::TCPServer(boost::asio::io_service& io_service, unsigned short port, SeekurJrRC::Core::Driver* driver)
+    : _io_service(io_service),
+      _connPort(port),
+      _driver(driver),
+      _acceptor(io_service, tcp::endpoint(tcp::v4(), _connPort)),
+      _retryTimer(io_service),
+      _useUring(SeekurJrRC::Core::Configuration::current().io_uring_backend_ && boost::asio::use_service<UringService>(io_service).available())
+{
+  std::cout << "Starting SERVER, listening on port " << _connPort << (_useUring ? " (io_uring)" : "") << std::endl;
+  accept();
+}
+
+void TCPServer::accept()
+{
+  if (_useUring && boost::asio::use_service<UringService>(_io_service).accept(_acceptor.native_handle(), this))
+    return;
   startAccept();
 }
 
+void TCPServer::uringCompleted(int32_t result, const uint8_t* /*data*/, bool more)
+{
+  if (result >= 0) {
+    boost::shared_ptr<TCPConnection> new_connection = TCPConnection::create(_io_service, _driver);
+    boost::system::error_code error;
+    new_connection->socket().assign(tcp::v4(), result, error);
+    if (error)
+      ::close(result);
+    else
+      boost::asio::use_service<ConnectionManager>(_io_service).start(new_connection);
+    if (more)
+      return;
+    accept();
+    return;
+  }
+
+  if (result == -ECANCELED)
+    return;
+  // same policy as the Asio path: report, back off briefly and accept again
+  std::cerr << "Accepting on port " << _connPort << ": " << strerror(-result) << ". Retrying." << std::endl;
+  if (more)
+    return;
+  _retryTimer.expires_from_now(boost::posix_time::milliseconds(_acceptRetryDelay));
+  _retryTimer.async_wait(boost::bind(&TCPServer::handleRetry, this, boost::asio::placeholders::error));
+}
+
 void TCPServer::startAccept()
 {
-  std::cout << "Starting SERVER, listening on port " << _connPort << std::endl;
   boost::shared_ptr<TCPConnection> new_connection =
-    TCPConnection::create(_acceptor.io_service());
+    TCPConnection::create(_io_service, _driver);
 
   _acceptor.async_accept(
     new_connection->socket(),
@@ -101,8 +479,25 @@ void TCPServer::startAccept()
 
 void TCPServer::handleAccept(boost::shared_ptr<TCPConnection> new_connection, const boost::system::error_code& error)
 {
+  if (error == boost::asio::error::operation_aborted)
+    return;
+
   if (!error) {
-    new_connection->start();
+    boost::asio::use_service<ConnectionManager>(_io_service).start(new_connection);
     startAccept();
+    return;
   }
+
+  // transient errors (EMFILE, ECONNABORTED, ...) must not stop the server; back off briefly and accept again
+  std::cerr << "Accepting on port " << _connPort << ": " << error.message() << ". Retrying." << std::endl;
+  _retryTimer.expires_from_now(boost::posix_time::milliseconds(_acceptRetryDelay));
+  _retryTimer.async_wait(boost::bind(&TCPServer::handleRetry, this, boost::asio::placeholders::error));
 }
+
+void TCPServer::handleRetry(const boost::system::error_code& error)
+{
+  if (!error)
+    accept();
+}
+
+#include <boost/asio/unyield.hpp>
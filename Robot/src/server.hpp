@@ -10,20 +10,59 @@
 #include <boost/shared_array.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "message.hpp"
+#include "handler_allocator.hpp"
+#include "uring_service.hpp"
+#include "admission.hpp"
+#include "config.hpp"
 
 namespace SeekurJrRC {
   namespace Core {
+    class Driver;
 
     /**
      * 
      * Klasa reprezentująca pojedyncze połączenie do serwera; tj. jedną wiadomość z telefonu.
+     * Połączenie jest związane z Driver'em jednego robota; jeżeli driver jest NULL (port floty), pierwsza wiadomość
+     * musi być HandshakeMessage - wtedy socket jest przekazywany do nowego połączenia w wątku wybranego robota.
+     *
+     * Pętla czytania ma dwie wersje ([server] read_loop): domyślną - bezstosową korutynę boost::asio (readLoop), której handler
+     * trzyma zwykły wskaźnik na połączenie, więc ramka nie kosztuje ani alokacji, ani operacji na liczniku referencji
+     * (połączenie utrzymuje przy życiu _self, ustawiane raz na całą sesję) - oraz dawną, opartą na wywołaniach zwrotnych
+     * z boost::bind i shared_from_this() przy każdej ramce (handleRead), zostawioną do porównań.
+     * Przy [server] backend = io_uring dane połączeń z robotem odbiera UringService (uringCompleted); strumień jest
+     * wtedy dzielony na ramki tutaj, bo jądro oddaje dane porcjami dowolnej długości.
+     *
+     * Każda ramka przechodzi najpierw kontrolę dopuszczenia ([admission]): limit połączenia, potem limit wspólny
+     * dla całego procesu. Ramka ponad limit jest odrzucana przed sprawdzeniem CRC i przed modelem, a połączenie,
+     * które zalewa serwer ramkami, jest zamykane - zalew kosztuje odczyt zegara na ramkę, a nie pracę drivera.
+     *
+     * W drugą stronę połączenie z robotem wysyła telefonowi tylko zalecenia częstotliwości ([rate], encodeRateAdvice):
+     * na starcie i potem co [rate] interval, jeżeli zalecenie zmieniło się o ponad 10%. Zalecenie wynika z częstotliwości
+     * pętli sterowania i z kosztu przetwarzania ramek tego połączenia zmierzonego w ostatnim okresie.
      */
-    class TCPConnection : public boost::enable_shared_from_this<TCPConnection>
+    class TCPConnection : public boost::enable_shared_from_this<TCPConnection>, public UringClient
     {
     public:
-      static boost::shared_ptr<TCPConnection> create(boost::asio::io_service& io_service);
+      /// liczniki połączenia, wypisywane przez ConnectionManager przy zamknięciu
+      struct Counters {
+        uint64_t frames_;
+        uint64_t bad_frames_;
+        /// ramki odrzucone przez limit połączenia i przez limit wspólny
+        uint64_t rate_limited_;
+        uint64_t global_limited_;
+        uint64_t bytes_;
+        /// wysłane zalecenia częstotliwości i ostatnio zalecany odstęp [usec]
+        uint64_t rate_advices_;
+        uint32_t advised_interval_us_;
+        boost::posix_time::ptime connected_;
+        boost::posix_time::ptime last_activity_;
+      };
+
+      static boost::shared_ptr<TCPConnection> create(boost::asio::io_service& io_service, Driver* driver);
       boost::asio::ip::tcp::socket& socket();
       /**
        * 
@@ -32,40 +71,122 @@ namespace SeekurJrRC {
        * i potem dalej to przekazujemy
        */
       void start();
+      /// zapamiętanie adresu drugiej strony i czasu połączenia; wołane przez ConnectionManager przed start()
+      void opened();
+      /// zamknięcie socket'u; oczekujące czytanie zakończy się błędem i połączenie zniknie
+      void close();
+      /// porzucenie samo-referencji pętli czytania, która już nie zostanie wznowiona (io_service został zniszczony)
+      void abandon() { _self.reset(); }
+      /// odebrane przez io_uring dane albo koniec odbioru
+      void uringCompleted(int32_t result, const uint8_t* data, bool more);
+      const Counters& counters() const { return _counters; }
+      /// adres drugiej strony (zapamiętany w opened())
+      const std::string& peer() const { return _peer; }
 
     private:
-      TCPConnection(boost::asio::io_service& io_service);
+      TCPConnection(boost::asio::io_service& io_service, Driver* driver);
       /**
        * \param error   - czy wystąpił błąd
-       * \param read_buffer - bufor, w którym mamy w formie tablicy charów wiadomość, która przyszła
        * 
-       * Ta metoda zostanie wywołana, gdy boost wczyta dane z socketu. Tutaj zlecamy przetworzenie wiadomości
+       * Ta metoda zostanie wywołana, gdy boost wczyta dane z socketu do _readBuffer. Tutaj zlecamy przetworzenie wiadomości
        * i wysyłamy update stanu do drivera. Generalnie fajnie by było, jakby docelowo driver działał we własnym wątku.
        */
-      void handleRead(const boost::system::error_code& error, boost::shared_array<uint8_t> read_buffer);
+      void handleRead(const boost::system::error_code& error);
       void scheduleRead();
+      /// korutyna czytania; wznawiana przez ReadLoopHandler po każdej ramce
+      void readLoop(const boost::system::error_code& error);
+      /// dekodowanie ramki z bufora i przekazanie jej driverowi; wspólne dla obu pętli czytania.
+      /// Jedna migawka konfiguracji (ConfigGuard) na całą ramkę
+      void processFrame(const uint8_t* frame, unsigned int length);
+      /// liczniki po odebraniu ramki
+      void countFrame(unsigned int length);
+      /// kontrola dopuszczenia ramki (limity [admission]); zamyka połączenie, które zalewa serwer
+      bool admit(int64_t now, const Config& config);
+      /// przeliczenie zalecanej częstotliwości ramek z pomiarów ostatniego okresu i ewentualne wysłanie jej telefonowi
+      void adviseRate(int64_t now, const Config& config);
+      void handleWrite(const boost::system::error_code& error);
+
+      /// handler korutyny: zwykły wskaźnik zamiast shared_ptr (bez operacji atomowych na ramkę)
+      struct ReadLoopHandler {
+        explicit ReadLoopHandler(TCPConnection* connection) : connection_(connection) {};
+        void operator()(const boost::system::error_code& error, std::size_t /*bytes_transferred*/) {
+          connection_->readLoop(error);
+        }
+        TCPConnection* connection_;
+      };
+      /// obsługa wiadomości powitalnej na porcie floty; przekazuje socket do robota o podanym id
+      void handleHandshake(const uint8_t* read_buffer);
       boost::asio::io_service& _io_service;
+      Driver* _driver;
       boost::asio::ip::tcp::socket _socket;
+      Counters _counters;
+      /// bufor na jedną wiadomość; w danej chwili czekamy na co najwyżej jedno czytanie, więc jeden bufor wystarcza
+      /// (pętla na wywołaniach zwrotnych kopiuje ramkę przed zleceniem kolejnego czytania). Paczka (BundleMessage)
+      /// jest czytana w dwóch częściach: nagłówek jak każda ramka, a resztę po odczytaniu z niego długości
+      uint8_t _readBuffer[MESSAGE_MAX_LENGTH];
+      /// długość bieżącej ramki (korutyna czytania)
+      unsigned int _frameLength;
+      /// pamięć na oczekujący handler czytania (bez alokacji na każdą wiadomość)
+      HandlerMemory _handlerMemory;
+      /// stan korutyny czytania
+      boost::asio::coroutine _readLoop;
+      /// połączenie samo siebie utrzymuje przy życiu, dopóki działa korutyna (albo odbiór io_uring)
+      boost::shared_ptr<TCPConnection> _self;
+      /// liczba bajtów niepełnej ramki w _readBuffer (odbiór io_uring i reszta paczki w pętli na wywołaniach zwrotnych)
+      unsigned int _readFill;
+      std::string _peer;
+      /// limit ramek tego połączenia
+      TokenBucket _bucket;
+      /// początek bieżącego okna liczenia odrzuconych ramek [ns] i ich liczba w tym oknie
+      int64_t _floodWindowStart;
+      unsigned int _floodDrops;
+      /// limit ramek wszystkich połączeń we wszystkich wątkach
+      static SharedTokenBucket _globalBucket;
+      /// pomiary bieżącego okresu zalecenia: początek [ns], przyjęte ramki, czas ich przetwarzania [ns]
+      /// i rodzaje wiadomości, które przyszły (bit 1 << MESSAGE_KIND_*)
+      int64_t _rateWindowStart;
+      uint64_t _rateFrames;
+      int64_t _rateBusyNs;
+      unsigned int _rateKinds;
+      /// średni koszt ramki [ns], wygładzany między okresami, żeby zalecenie nie skakało za każdym pomiarem
+      double _rateCostNs;
+      /// bufor wysyłanego zalecenia i pamięć handler'a zapisu; w danej chwili wysyłane jest co najwyżej jedno
+      uint8_t _writeBuffer[MESSAGE_LENGTH];
+      HandlerMemory _writeHandlerMemory;
+      bool _writing;
       const static uint _messageLength = MESSAGE_LENGTH; // 20B
     };
 
     /**
      * 
-     * Klasa reprezentująca serwer zarządzający przychodzącymi połączeniami
+     * Klasa reprezentująca serwer zarządzający przychodzącymi połączeniami na jednym porcie.
+     * Połączenia trafiają do podanego Driver'a, a jeżeli driver jest NULL - do robota wskazanego w wiadomości powitalnej.
+     * Zaakceptowane połączenia przejmuje ConnectionManager. Po błędzie accept'a (np. EMFILE) serwer ponawia
+     * próbę po krótkiej przerwie, zamiast przestać przyjmować połączenia. Przy [server] backend = io_uring
+     * połączenia przyjmuje wielokrotny accept UringService.
      */
-    class TCPServer : public boost::asio::io_service::service
+    class TCPServer : public UringClient
     {
     public:
-      TCPServer(boost::asio::io_service& io_service);
-      void shutdown_service() {};
+      TCPServer(boost::asio::io_service& io_service, unsigned short port, Driver* driver);
+      /// nowe połączenie przyjęte przez io_uring
+      void uringCompleted(int32_t result, const uint8_t* data, bool more);
 
-      static boost::asio::io_service::id id;
     private:
       void startAccept();
       void handleAccept(boost::shared_ptr<TCPConnection> new_connection, const boost::system::error_code& error);
+      void handleRetry(const boost::system::error_code& error);
+      /// accept przez io_uring albo boost::asio, zależnie od konfiguracji
+      void accept();
 
+      boost::asio::io_service& _io_service;
+      const unsigned short _connPort;
+      Driver* _driver;
       boost::asio::ip::tcp::acceptor _acceptor;
-      const static uint _connPort = 1024;
+      boost::asio::deadline_timer _retryTimer;
+      bool _useUring;
+      /// przerwa przed ponowieniem accept'a po błędzie [msec]
+      const static long _acceptRetryDelay = 100;
     };
   } // namespace Core
 } // namespace SeekurJrRC
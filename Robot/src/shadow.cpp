@@ -0,0 +1,175 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+#include <boost/bind.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include "shadow.hpp"
+#include "driver.hpp"
+#include "fleet.hpp"
+#include "config.hpp"
+#include "utils.hpp"
+#include "realtime.hpp"
+
+using SeekurJrRC::Core::ShadowChannel;
+using SeekurJrRC::Core::ShadowEvaluator;
+using SeekurJrRC::Core::ShadowFrame;
+using SeekurJrRC::Core::SteeringModelBase;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::ConfigGuard;
+
+boost::asio::io_service::id ShadowEvaluator::id;
+
+void ShadowChannel::allocate(unsigned int capacity)
+{
+  uint64_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  delete[] frames_;
+  frames_ = new ShadowFrame[size];
+  mask_ = size - 1;
+}
+
+ShadowEvaluator::ShadowEvaluator(boost::asio::io_service& ios)
+  : service(ios), enabled_(false), poll_interval_ms_(0), report_interval_ms_(0)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (!config.shadow_enabled_ || config.shadow_models_.empty())
+    return;
+
+  drivers_ = boost::asio::use_service<Fleet>(ios).drivers();
+  models_.assign(config.shadow_models_.begin(), config.shadow_models_.end());
+  for (unsigned int m = 0; m < models_.size(); ++m) {
+    const uint8_t code = isFusedModelCode(models_[m]) ? fusedModelBaseCode(models_[m]) : models_[m];
+    if (!hasSteeringModel(code))
+      std::cerr << "Shadow model " << (int)models_[m] << " is not available, its statistics are bilinear without filter" << std::endl;
+  }
+  stats_.assign(drivers_.size(), std::vector<Stats>(models_.size()));
+  frames_.assign(drivers_.size(), 0);
+  scratch_.set_capacity(historyCapacity(config.max_history_length_));
+  poll_interval_ms_ = config.shadow_poll_interval_;
+  report_interval_ms_ = config.shadow_report_interval_;
+  enabled_ = true;
+  std::cout << "Shadow evaluation of " << models_.size() << " model(s) for " << drivers_.size() << " robot(s), every "
+            << poll_interval_ms_ << " ms" << std::endl;
+  thread_ = boost::thread(boost::bind(&ShadowEvaluator::run, this));
+}
+
+void ShadowEvaluator::shutdown_service()
+{
+  if (!enabled_)
+    return;
+  thread_.interrupt();
+  thread_.join();
+  // this thread is the only reader now; whatever the robots queued last is still counted
+  for (unsigned int i = 0; i < drivers_.size(); ++i)
+    drain(i);
+  report();
+  enabled_ = false;
+}
+
+void ShadowEvaluator::run()
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.realtime_enabled_)
+    SeekurJrRC::Utils::applyBackgroundThreadPolicy(config.realtime_control_cpus_, "shadow evaluation");
+  int64_t next_report_ns = SeekurJrRC::Utils::monotonicNowNs() + report_interval_ms_ * 1000000LL;
+  try {
+    for (;;) {
+      for (unsigned int i = 0; i < drivers_.size(); ++i)
+        drain(i);
+      if (report_interval_ms_ > 0 && SeekurJrRC::Utils::monotonicNowNs() >= next_report_ns) {
+        report();
+        next_report_ns += report_interval_ms_ * 1000000LL;
+      }
+      // polling instead of a wake-up keeps publish() free of system calls
+      boost::this_thread::sleep(boost::posix_time::milliseconds(poll_interval_ms_));
+    }
+  }
+  catch (const boost::thread_interrupted&) {
+    // shutdown_service()
+  }
+}
+
+void ShadowEvaluator::drain(unsigned int robot)
+{
+  ShadowChannel& channel = drivers_[robot]->shadow();
+  // the models see a reload from the next drain on, as the active one does from the next frame
+  const ConfigGuard guard;
+  for (const ShadowFrame* frame = channel.peek(); frame != NULL; frame = channel.peek()) {
+    evaluate(robot, *frame, guard.config());
+    channel.release();
+  }
+}
+
+void ShadowEvaluator::evaluate(unsigned int robot, const ShadowFrame& frame, const Config& config)
+{
+  ++frames_[robot];
+  for (unsigned int m = 0; m < models_.size(); ++m) {
+    uint8_t code = models_[m];
+    float x = frame.x_, y = frame.y_, z = frame.z_;
+    if (isFusedModelCode(code)) {
+      code = fusedModelBaseCode(code);
+      x = frame.gravity_x_;
+      y = frame.gravity_y_;
+      z = frame.gravity_z_;
+    }
+    // the history as the active model saw it: without the current reading, which the model adds itself
+    scratch_.clear();
+    scratch_.insert(scratch_.end(), frame.history_ + 1, frame.history_ + frame.history_size_);
+
+    const int64_t start_ns = SeekurJrRC::Utils::monotonicNowNs();
+    SteeringModelBase* model = getSteeringModel(code, scratch_, config, x, y, z, storage_);
+    std::pair<float, float> v = model->getSpeedValues();
+    const int64_t cost_ns = SeekurJrRC::Utils::monotonicNowNs() - start_ns;
+
+    Stats& stats = stats_[robot][m];
+    stats.cost_sum_ns_ += cost_ns;
+    if (cost_ns > stats.cost_max_ns_)
+      stats.cost_max_ns_ = cost_ns;
+    if (!boost::math::isfinite(v.first) || !boost::math::isfinite(v.second)) {
+      ++stats.invalid_;
+      continue;
+    }
+    ++stats.frames_;
+    stats.left_sum_ += v.first;
+    stats.right_sum_ += v.second;
+    const float diff = 0.5f * (fabs(v.first - frame.primary_left_) + fabs(v.second - frame.primary_right_));
+    stats.diff_sum_ += diff;
+    if (diff > stats.diff_max_)
+      stats.diff_max_ = diff;
+    // opposite sign of the translational speed; both near zero does not count
+    const float v_trans = v.first + v.second;
+    const float primary_v_trans = frame.primary_left_ + frame.primary_right_;
+    if (v_trans * primary_v_trans < 0)
+      ++stats.reversed_;
+  }
+}
+
+void ShadowEvaluator::report()
+{
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  for (unsigned int r = 0; r < drivers_.size(); ++r) {
+    out << "\rShadow models of robot " << drivers_[r]->robotId() << ": " << frames_[r] << " frames evaluated, "
+        << drivers_[r]->shadow().dropped() << " dropped" << std::endl;
+    for (unsigned int m = 0; m < models_.size(); ++m) {
+      const Stats& stats = stats_[r][m];
+      const uint64_t evaluated = stats.frames_ + stats.invalid_;
+      if (!evaluated)
+        continue;
+      const double n = stats.frames_ ? stats.frames_ : 1;
+      out << "  model " << std::setw(2) << (int)models_[m] << ": mean L " << stats.left_sum_ / n << " R " << stats.right_sum_ / n
+          << " mm/s, |diff| vs active avg " << stats.diff_sum_ / n << " max " << stats.diff_max_ << " mm/s, "
+          << stats.reversed_ << " reversed, " << stats.invalid_ << " invalid, cost avg " << stats.cost_sum_ns_ / evaluated
+          << " ns max " << stats.cost_max_ns_ << " ns" << std::endl;
+    }
+  }
+  std::cout << out.str() << std::flush;
+}
@@ -0,0 +1,155 @@
+#ifndef SHADOW_HPP_
+#define SHADOW_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "steering_model.hpp"
+
+/// najdłuższa historia kopiowana do migawki; dłuższa (history.max_length > 62) - ramka nie trafia do oceny
+#define SHADOW_MAX_HISTORY 64
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    class Driver;
+
+    /**
+     *
+     * Migawka wejścia jednej ramki: wszystko, czego model potrzebuje, żeby policzyć to samo co model aktywny.
+     * history_[0] to bieżące wskazanie, dołożone już przez model aktywny.
+     */
+    struct ShadowFrame {
+      /// kod modelu aktywnego i jego wynik [mm/s]
+      uint8_t primary_code_;
+      float primary_left_;
+      float primary_right_;
+      /// wskazanie akcelerometru i wektor grawitacji z fuzji (wejście modeli *_FUSED_MODEL_CODE)
+      float x_, y_, z_;
+      float gravity_x_, gravity_y_, gravity_z_;
+      unsigned int history_size_;
+      acc_tuple history_[SHADOW_MAX_HISTORY];
+    };
+
+    /**
+     *
+     * Kolejka migawek od wątku robota (jedyny piszący) do wątku oceny (jedyny czytający): pierścień o stałym rozmiarze,
+     * zaalokowany przy starcie, z dwoma licznikami atomowymi. publish() nie alokuje, nie blokuje i nie woła jądra;
+     * jeżeli wątek oceny nie nadąża, ramka jest pomijana (dropped()), a ścieżka sterowania na nikogo nie czeka.
+     */
+    class ShadowChannel : private boost::noncopyable {
+    public:
+      ShadowChannel() : frames_(NULL), mask_(0), head_(0), tail_(0), dropped_(0) {};
+      ~ShadowChannel() { delete[] frames_; };
+
+      /// przydział pierścienia (zaokrąglenie do potęgi dwójki); wołane przy starcie, przed wątkami
+      void allocate(unsigned int capacity);
+      bool enabled() const { return frames_ != NULL; }
+
+      /// wołane tylko z wątku robota, po wysłaniu komendy
+      void publish(uint8_t primary_code, float left, float right, float x, float y, float z,
+                   float gravity_x, float gravity_y, float gravity_z, const acc_history& history)
+      {
+        const uint64_t head = head_.load(boost::memory_order_relaxed);
+        if (head - tail_.load(boost::memory_order_acquire) > mask_ || history.size() > SHADOW_MAX_HISTORY) {
+          dropped_.fetch_add(1, boost::memory_order_relaxed);
+          return;
+        }
+        ShadowFrame& frame = frames_[head & mask_];
+        frame.primary_code_ = primary_code;
+        frame.primary_left_ = left;
+        frame.primary_right_ = right;
+        frame.x_ = x;
+        frame.y_ = y;
+        frame.z_ = z;
+        frame.gravity_x_ = gravity_x;
+        frame.gravity_y_ = gravity_y;
+        frame.gravity_z_ = gravity_z;
+        frame.history_size_ = history.size();
+        std::copy(history.begin(), history.end(), frame.history_);
+        head_.store(head + 1, boost::memory_order_release);
+      }
+
+      /// najstarsza nieprzeczytana migawka albo NULL; wołane tylko z wątku oceny, potem release()
+      const ShadowFrame* peek() const {
+        const uint64_t tail = tail_.load(boost::memory_order_relaxed);
+        return (tail == head_.load(boost::memory_order_acquire)) ? NULL : &frames_[tail & mask_];
+      }
+      void release() { tail_.store(tail_.load(boost::memory_order_relaxed) + 1, boost::memory_order_release); }
+
+      uint64_t dropped() const { return dropped_.load(boost::memory_order_relaxed); }
+
+    private:
+      ShadowFrame* frames_;
+      uint64_t mask_;
+      boost::atomic<uint64_t> head_;
+      boost::atomic<uint64_t> tail_;
+      boost::atomic<uint64_t> dropped_;
+    };
+
+    /**
+     *
+     * Tryb cienia ([shadow]): model wybrany na telefonie steruje robotem, a wybrane inne modele są liczone na tym
+     * samym wejściu w osobnym wątku - bez kolejnego przejazdu i bez wpływu na ścieżkę sterowania. Wątek robota tylko
+     * odkłada migawkę do ShadowChannel (już po wysłaniu komendy); wątek oceny co [shadow] poll_interval opróżnia
+     * kolejki wszystkich robotów, każdy model liczy na własnej kopii historii i zbiera statystyki: wynik, różnicę
+     * względem modelu aktywnego, liczbę ramek z przeciwnym kierunkiem jazdy i koszt obliczenia.
+     * Statystyki są wypisywane co [shadow] report_interval i przy zakończeniu. Czytane przy starcie.
+     */
+    class ShadowEvaluator : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor; roboty bierze z Fleet, więc musi powstać po niej
+      explicit ShadowEvaluator(boost::asio::io_service& ios);
+      ~ShadowEvaluator() {};
+
+    private:
+      /// statystyki jednego modelu cienia dla jednego robota
+      struct Stats {
+        Stats() : frames_(0), invalid_(0), left_sum_(0), right_sum_(0), diff_sum_(0), diff_max_(0), reversed_(0), cost_sum_ns_(0), cost_max_ns_(0) {};
+        uint64_t frames_;
+        /// ramki, dla których model nie dał skończonego wyniku (np. poza zasięgiem punktów kontrolnych); nie wchodzą do średnich
+        uint64_t invalid_;
+        double left_sum_;
+        double right_sum_;
+        /// średnia z |lewe - lewe aktywnego| i |prawe - prawe aktywnego| [mm/s]
+        double diff_sum_;
+        float diff_max_;
+        /// ramki, w których model jechałby w przeciwną stronę niż model aktywny
+        uint64_t reversed_;
+        double cost_sum_ns_;
+        int64_t cost_max_ns_;
+      };
+
+      void shutdown_service();
+      void run();
+      /// ocena wszystkich czekających migawek jednego robota
+      void drain(unsigned int robot);
+      void evaluate(unsigned int robot, const ShadowFrame& frame, const Config& config);
+      void report();
+
+      boost::thread thread_;
+      bool enabled_;
+      std::vector<Driver*> drivers_;
+      std::vector<uint8_t> models_;
+      /// stats_[robot][model]
+      std::vector<std::vector<Stats> > stats_;
+      std::vector<uint64_t> frames_;
+      /// historia i miejsce na model dla oceny (tylko wątek oceny)
+      acc_history scratch_;
+      SteeringModelStorage storage_;
+      long poll_interval_ms_;
+      long report_interval_ms_;
+    };
+  }
+}
+
+#endif
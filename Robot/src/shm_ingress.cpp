@@ -0,0 +1,127 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include <sys/mman.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include "shm_ingress.hpp"
+#include "driver.hpp"
+#include "config.hpp"
+
+using SeekurJrRC::Core::ShmIngress;
+using SeekurJrRC::Core::ShmRing;
+using SeekurJrRC::Core::ShmCommand;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::ConfigGuard;
+
+ShmIngress::ShmIngress(boost::asio::io_service& ios, Driver* driver, const std::string& name, long poll_interval_us)
+  : ios_(ios),
+    driver_(driver),
+    name_(name),
+    poll_interval_us_(poll_interval_us),
+    ring_(mapShmRing(name, true)),
+    timer_(ios),
+    stopped_(false),
+    commands_(0),
+    rejected_(0),
+    clamped_(0)
+{
+  if (ring_ == NULL) {
+    std::cerr << "Robot " << driver_->robotId() << ": shared memory ingress disabled" << std::endl;
+    return;
+  }
+  std::cout << "Robot " << driver_->robotId() << ": shared memory ingress on " << name_
+            << (poll_interval_us_ > 0 ? "" : " (busy polling)") << std::endl;
+  schedulePoll();
+}
+
+ShmIngress::~ShmIngress()
+{
+  if (ring_ != NULL) {
+    munmap(ring_, sizeof(ShmRing));
+    shm_unlink(name_.c_str());
+  }
+}
+
+void ShmIngress::shutdown()
+{
+  if (ring_ == NULL || stopped_)
+    return;
+  stopped_ = true;
+  boost::system::error_code ignored;
+  timer_.cancel(ignored);
+  std::cout << "\rRobot " << driver_->robotId() << " shm ingress: " << commands_ << " commands, "
+            << ring_->dropped_.load(boost::memory_order_relaxed) << " dropped by the producer, "
+            << rejected_ << " wheel velocities rejected, " << clamped_ << " clamped, ";
+  latency_.print(std::cout, "latency");
+  std::cout << std::endl;
+}
+
+void ShmIngress::schedulePoll()
+{
+  if (poll_interval_us_ > 0) {
+    timer_.expires_from_now(boost::posix_time::microseconds(poll_interval_us_));
+    timer_.async_wait(makeCustomAllocHandler(handler_memory_, boost::bind(&ShmIngress::handlePoll, this, boost::asio::placeholders::error)));
+  }
+  else {
+    // posted from within the loop thread, so this does not wake the reactor - no system call per round
+    ios_.post(makeCustomAllocHandler(handler_memory_, boost::bind(&ShmIngress::handlePoll, this, boost::system::error_code())));
+  }
+}
+
+void ShmIngress::handlePoll(const boost::system::error_code& error)
+{
+  if (error || stopped_)
+    return;
+  drain();
+  schedulePoll();
+}
+
+void ShmIngress::drain()
+{
+  uint64_t tail = ring_->tail_.load(boost::memory_order_relaxed);
+  uint64_t head = ring_->head_.load(boost::memory_order_acquire);
+  if (tail == head)
+    return;
+
+  // the same clock as the producer's timestamps, also in simulation
+  int64_t now = SeekurJrRC::Utils::realMonotonicNowNs();
+  const ConfigGuard guard;
+  const Config& config = guard.config();
+  for (; tail != head; ++tail) {
+    const ShmCommand& command = ring_->slots_[tail & (SHM_RING_CAPACITY - 1)];
+    ++commands_;
+    latency_.record((now - command.timestamp_ns_) / 1000);
+    if (command.kind_ == SHM_GYRO_RATES)
+      driver_->processGyroRates(command.a_, command.b_, command.c_, config);
+    if (!command.startStop_) {
+      if (command.kind_ != SHM_GYRO_RATES)
+        driver_->processIdle();
+      continue;
+    }
+    if (command.kind_ == SHM_WHEEL_VELOCITIES) {
+      // the producer is another process - give its velocities the same bounds the steering models' output has
+      if (!boost::math::isfinite(command.a_) || !boost::math::isfinite(command.b_)) {
+        ++rejected_;
+        driver_->processIdle();
+        continue;
+      }
+      const float v_max = fabs(config.v_max_);
+      float left = command.a_, right = command.b_;
+      if (fabs(left) > v_max || fabs(right) > v_max) {
+        ++clamped_;
+        left = std::max(-v_max, std::min(v_max, left));
+        right = std::max(-v_max, std::min(v_max, right));
+      }
+      driver_->processWheelVelocities(left, right, config);
+    }
+    else if (command.kind_ == SHM_ORIENTATION)
+      driver_->processOrientation(command.steeringModelCode_, command.a_, command.b_, command.c_, config);
+  }
+  ring_->tail_.store(tail, boost::memory_order_release);
+}
@@ -0,0 +1,244 @@
+#ifndef SHM_INGRESS_HPP_
+#define SHM_INGRESS_HPP_
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <new>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
+
+#include "handler_allocator.hpp"
+#include "utils.hpp"
+
+/// liczba miejsc w pierścieniu; potęga dwójki
+#define SHM_RING_CAPACITY 256
+#define SHM_RING_MAGIC 0x534A5348
+#define SHM_RING_VERSION 1
+#define SHM_CACHE_LINE 64
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    class Driver;
+
+    /// rodzaj komendy w pierścieniu
+    enum ShmCommandKind {
+      /// gotowe prędkości kół [mm/s]: a_ = lewa, b_ = prawa
+      SHM_WHEEL_VELOCITIES = 1,
+      /// surowa orientacja, jak w TCPMessage: a_ = x, b_ = y, c_ = z, model wg steeringModelCode_
+      SHM_ORIENTATION = 2,
+      /// prędkości kątowe z żyroskopu [rad/s] (fuzja, modele *_FUSED_MODEL_CODE): a_ = x, b_ = y, c_ = z
+      SHM_GYRO_RATES = 3
+    };
+
+    /**
+     *
+     * Jedna komenda w pamięci współdzielonej. Semantyka taka sama jak TCPMessage: startStop_ == 0 oznacza
+     * "nie jedź" - komenda jest ignorowana, a robot zatrzymuje się po timeout'cie watchdog'a.
+     * timestamp_ns_ to CLOCK_MONOTONIC producenta w chwili zapisu (do pomiaru opóźnienia).
+     */
+    struct ShmCommand {
+      uint8_t kind_;
+      uint8_t startStop_;
+      uint8_t steeringModelCode_;
+      uint8_t reserved_;
+      float a_;
+      float b_;
+      float c_;
+      int64_t timestamp_ns_;
+    };
+
+    /**
+     *
+     * Pierścień SPSC w segmencie POSIX shared memory. Producent (proces autonomii na tym samym komputerze) zapisuje
+     * komendę do slots_[head_ % pojemność] i publikuje ją, zwiększając head_ (release); serwer czyta do head_ (acquire)
+     * i zwiększa tail_. Żadna strona nie wykonuje wywołania systemowego na komendę.
+     *
+     * Liczniki leżą w osobnych liniach cache, żeby producent i konsument nie "przepychali" sobie jednej linii.
+     * Atomiki muszą być lock-free, bo tylko wtedy działają pomiędzy procesami.
+     */
+    struct ShmRing {
+      uint32_t magic_;
+      uint32_t version_;
+      uint32_t capacity_;
+      char pad0_[SHM_CACHE_LINE - 3 * sizeof(uint32_t)];
+      boost::atomic<uint64_t> head_;
+      char pad1_[SHM_CACHE_LINE - sizeof(boost::atomic<uint64_t>)];
+      boost::atomic<uint64_t> tail_;
+      char pad2_[SHM_CACHE_LINE - sizeof(boost::atomic<uint64_t>)];
+      /// komendy odrzucone przez producenta przy pełnym pierścieniu
+      boost::atomic<uint64_t> dropped_;
+      char pad3_[SHM_CACHE_LINE - sizeof(boost::atomic<uint64_t>)];
+      ShmCommand slots_[SHM_RING_CAPACITY];
+    };
+
+    BOOST_STATIC_ASSERT((SHM_RING_CAPACITY & (SHM_RING_CAPACITY - 1)) == 0);
+    BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT64_LOCK_FREE == 2);
+
+    /// nazwa segmentu dla robota: <prefix><robot_id>, np. /seekurjrrc_robot_0
+    inline std::string shmSegmentName(const std::string& prefix, uint32_t robot_id)
+    {
+      std::ostringstream name;
+      name << prefix << robot_id;
+      return name.str();
+    }
+
+    /**
+     *
+     * Mapuje segment pierścienia; create - tworzy go od zera (serwer) i inicjalizuje, w przeciwnym razie
+     * otwiera istniejący (producent) i sprawdza format. NULL w razie błędu (opis na std::cerr).
+     */
+    inline ShmRing* mapShmRing(const std::string& name, bool create)
+    {
+      int fd = create ? shm_open(name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0660) : shm_open(name.c_str(), O_RDWR, 0);
+      if (fd < 0) {
+        std::cerr << "shm_open(" << name << "): " << strerror(errno) << std::endl;
+        return NULL;
+      }
+      if (create && ftruncate(fd, sizeof(ShmRing)) != 0) {
+        std::cerr << "ftruncate(" << name << "): " << strerror(errno) << std::endl;
+        ::close(fd);
+        return NULL;
+      }
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ShmRing)) {
+        std::cerr << name << ": segment too small" << std::endl;
+        ::close(fd);
+        return NULL;
+      }
+      void* memory = mmap(NULL, sizeof(ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (memory == MAP_FAILED) {
+        std::cerr << "mmap(" << name << "): " << strerror(errno) << std::endl;
+        return NULL;
+      }
+
+      ShmRing* ring = static_cast<ShmRing*>(memory);
+      if (create) {
+        // a fresh segment is zero-filled; construct the atomics in place before the magic becomes visible
+        new (&ring->head_) boost::atomic<uint64_t>(0);
+        new (&ring->tail_) boost::atomic<uint64_t>(0);
+        new (&ring->dropped_) boost::atomic<uint64_t>(0);
+        ring->capacity_ = SHM_RING_CAPACITY;
+        ring->version_ = SHM_RING_VERSION;
+        boost::atomic_thread_fence(boost::memory_order_release);
+        ring->magic_ = SHM_RING_MAGIC;
+      }
+      else if (ring->magic_ != SHM_RING_MAGIC || ring->version_ != SHM_RING_VERSION || ring->capacity_ != SHM_RING_CAPACITY) {
+        std::cerr << name << ": not a command ring (or a different version)" << std::endl;
+        munmap(memory, sizeof(ShmRing));
+        return NULL;
+      }
+      return ring;
+    }
+
+    /**
+     *
+     * Strona producenta, do użycia w procesie autonomii (wystarczy ten nagłówek, boost::atomic i -lrt).
+     * Segment tworzy serwer; producent tylko go otwiera, więc musi wystartować po serwerze.
+     */
+    class ShmCommandWriter : private boost::noncopyable {
+    public:
+      ShmCommandWriter() : ring_(NULL) {};
+      ~ShmCommandWriter() { close(); };
+
+      /// otwiera istniejący segment; false, jeżeli go nie ma albo ma inny format
+      bool open(const std::string& name) {
+        close();
+        ring_ = mapShmRing(name, false);
+        return ring_ != NULL;
+      }
+      void close() {
+        if (ring_ != NULL)
+          munmap(ring_, sizeof(ShmRing));
+        ring_ = NULL;
+      }
+
+      /// false, jeżeli segment nie jest otwarty albo pierścień jest pełny (komenda jest wtedy porzucana i liczona w dropped_)
+      bool pushWheelVelocities(float left, float right, bool start = true) {
+        return push(SHM_WHEEL_VELOCITIES, start, 0, left, right, 0);
+      }
+      bool pushOrientation(uint8_t steering_model_code, float x, float y, float z, bool start = true) {
+        return push(SHM_ORIENTATION, start, steering_model_code, x, y, z);
+      }
+      bool pushGyroRates(float x, float y, float z) {
+        return push(SHM_GYRO_RATES, true, 0, x, y, z);
+      }
+
+    private:
+      bool push(uint8_t kind, bool start, uint8_t code, float a, float b, float c) {
+        if (ring_ == NULL)
+          return false;
+        uint64_t head = ring_->head_.load(boost::memory_order_relaxed);
+        if (head - ring_->tail_.load(boost::memory_order_acquire) >= SHM_RING_CAPACITY) {
+          ring_->dropped_.fetch_add(1, boost::memory_order_relaxed);
+          return false;
+        }
+        ShmCommand& slot = ring_->slots_[head & (SHM_RING_CAPACITY - 1)];
+        slot.kind_ = kind;
+        slot.startStop_ = start ? 1 : 0;
+        slot.steeringModelCode_ = code;
+        slot.a_ = a;
+        slot.b_ = b;
+        slot.c_ = c;
+        // the producer never runs on virtual time, and monotonicNowNs() would need VirtualClock from utils.cpp
+        slot.timestamp_ns_ = SeekurJrRC::Utils::realMonotonicNowNs();
+        ring_->head_.store(head + 1, boost::memory_order_release);
+        return true;
+      }
+
+      ShmRing* ring_;
+    };
+
+    /**
+     *
+     * Strona serwera: tworzy segment dla jednego robota i przekazuje komendy z pierścienia do jego Driver'a - tą samą
+     * ścieżką, co wiadomości TCP (model sterowania, pętla sterowania, watchdog).
+     *
+     * Pierścień jest sprawdzany w wątku robota: co poll_interval mikrosekund (timer) albo, przy poll_interval == 0,
+     * bez przerwy (handler sam się ponownie kolejkuje; zajmuje cały rdzeń, ale opóźnienie to pojedyncze mikrosekundy).
+     */
+    class ShmIngress : private boost::noncopyable {
+    public:
+      ShmIngress(boost::asio::io_service& ios, Driver* driver, const std::string& name, long poll_interval_us);
+      ~ShmIngress();
+
+      /// zatrzymanie odpytywania; wołane przy zakończeniu programu, przed usunięciem Driver'a
+      void shutdown();
+
+    private:
+      void schedulePoll();
+      void handlePoll(const boost::system::error_code& error);
+      void drain();
+
+      boost::asio::io_service& ios_;
+      Driver* driver_;
+      std::string name_;
+      long poll_interval_us_;
+      ShmRing* ring_;
+      boost::asio::deadline_timer timer_;
+      HandlerMemory handler_memory_;
+      bool stopped_;
+
+      /// opóźnienie zapis-odczyt komend
+      SeekurJrRC::Utils::JitterStats latency_;
+      uint64_t commands_;
+      /// prędkości kół odrzucone (NaN/inf) i przycięte do v_max
+      uint64_t rejected_;
+      uint64_t clamped_;
+    };
+  }
+}
+
+#endif
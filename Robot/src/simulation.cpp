@@ -0,0 +1,276 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <time.h>
+
+#include "simulation.hpp"
+#include "driver.hpp"
+#include "fleet.hpp"
+#include "config.hpp"
+#include "flight_recorder.hpp"
+#include "virtual_timer.hpp"
+#include "utils.hpp"
+
+using SeekurJrRC::Core::Simulation;
+using SeekurJrRC::Core::Driver;
+using SeekurJrRC::Core::Fleet;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::ConfigGuard;
+using SeekurJrRC::Core::FlightRecord;
+using SeekurJrRC::Core::FlightDumpHeader;
+using SeekurJrRC::Utils::VirtualClock;
+using SeekurJrRC::Utils::VirtualScheduler;
+
+boost::asio::io_service::id Simulation::id;
+
+namespace {
+  /// zegar ścienny, bo monotonicNowNs() w symulacji zwraca czas wirtualny
+  int64_t wallNowNs()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+  }
+
+  /// rekord nagrania z numerem od startu programu, do odtworzenia kolejności
+  struct ReplayRecord {
+    uint64_t index_;
+    FlightRecord record_;
+
+    bool operator<(const ReplayRecord& other) const { return index_ < other.index_; }
+  };
+
+  /// przyspieszenie ziemskie [m/s^2] i największe przechylenie telefonu w generatorze
+  const float gravity = 9.81;
+  const float max_tilt = 6.0;
+}
+
+Simulation::Simulation(boost::asio::io_service& ios)
+  : service(ios), ios_(ios), end_ns_(0), period_ns_(0), replay_position_(0), frames_(0), skipped_(0), samples_(0), bytes_(0)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  const std::vector<Driver*>& drivers = boost::asio::use_service<Fleet>(ios).drivers();
+  end_ns_ = config.simulation_duration_ * 1000000000LL;
+
+  if (!config.simulation_replay_.empty()) {
+    loadReplay(config.simulation_replay_);
+    // the whole recording and a moment for the watchdog to stop the robots
+    if (!config.simulation_duration_)
+      end_ns_ = (replay_.empty() ? 0 : replay_.back().time_ns_) + 1000000000LL;
+    std::cout << "Simulation: replaying " << replay_.size() << " frames from " << config.simulation_replay_;
+    if (skipped_)
+      std::cout << " (" << skipped_ << " of robots not in the fleet skipped)";
+    std::cout << ", " << end_ns_ / 1000000 << " ms of virtual time" << std::endl;
+    return;
+  }
+
+  period_ns_ = 1000000000LL / config.simulation_rate_hz_;
+  for (unsigned int i = 0; i < drivers.size(); ++i) {
+    Generator generator;
+    generator.driver_ = drivers[i];
+    generator.random_ = (config.simulation_seed_ + 1) * 0x9E3779B97F4A7C15ULL + i;
+    generator.next_ns_ = period_ns_;
+    generator.phase_end_ns_ = period_ns_ + config.simulation_drive_time_ * 1000000LL;
+    generator.driving_ = true;
+    generator.pauses_ = 0;
+    generator.x_ = 0;
+    generator.y_ = 0;
+    generator.has_pending_ = false;
+    generators_.push_back(generator);
+  }
+  std::cout << "Simulation: " << drivers.size() << " robot(s), model " << config.simulation_model_ << ", "
+            << config.simulation_rate_hz_ << " Hz, seed " << config.simulation_seed_ << ", "
+            << config.simulation_duration_ << " s of virtual time";
+  if (config.simulation_bundle_ > 1)
+    std::cout << ", bundles of " << config.simulation_bundle_;
+  std::cout << std::endl;
+}
+
+void Simulation::loadReplay(const std::string& path)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  FlightDumpHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    throw std::runtime_error("simulation.replay: cannot read " + path);
+  if (header.magic_ != FLIGHT_DUMP_MAGIC || header.version_ != FLIGHT_DUMP_VERSION || header.record_size_ != sizeof(FlightRecord))
+    throw std::runtime_error("simulation.replay: " + path + " is not a flight recorder dump (or another version)");
+
+  // the same reconstruction of the order as in tools/flight_decode
+  std::vector<ReplayRecord> records;
+  for (uint32_t i = 0; i < header.capacity_; ++i) {
+    ReplayRecord entry;
+    if (!in.read(reinterpret_cast<char*>(&entry.record_), sizeof(entry.record_)))
+      break;
+    // the older samples of bundles (FLIGHT_FRAME_BUNDLED) are not replayed, only the newest one of each
+    const uint8_t event = entry.record_.event_;
+    if (entry.record_.sequence_ == 0 || (event != FLIGHT_FRAME_DRIVE && event != FLIGHT_FRAME_IDLE && event != FLIGHT_FRAME_GYRO))
+      continue;
+    const int32_t behind = (int32_t)((uint32_t)header.next_ - entry.record_.sequence_);
+    if (behind <= -(int64_t)header.capacity_ || behind >= (int64_t)header.capacity_)
+      continue;
+    entry.index_ = header.next_ - behind - 1;
+    records.push_back(entry);
+  }
+  std::sort(records.begin(), records.end());
+
+  Fleet& fleet = boost::asio::use_service<Fleet>(ios_);
+  for (size_t i = 0; i < records.size(); ++i) {
+    const FlightRecord& record = records[i].record_;
+    Frame frame;
+    frame.driver_ = fleet.findDriver(record.robot_id_);
+    if (frame.driver_ == NULL) {
+      ++skipped_;
+      continue;
+    }
+    // the recording's own spacing, from its first frame on
+    frame.time_ns_ = record.time_ns_ - records[0].record_.time_ns_;
+    frame.length_ = MESSAGE_LENGTH;
+    encodeMessage(record.event_ != FLIGHT_FRAME_IDLE, record.code_,
+                  record.event_ == FLIGHT_FRAME_GYRO ? MESSAGE_KIND_GYROSCOPE : MESSAGE_KIND_ACCELEROMETER,
+                  record.values_[0], record.values_[1], record.values_[2], frame.buffer_);
+    replay_.push_back(frame);
+  }
+}
+
+double Simulation::uniform(uint64_t& state)
+{
+  // xorshift64*: the same sequence on every platform, unlike rand()
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return ((state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool Simulation::generate(Generator& generator, Frame& frame)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  for (;;) {
+    if (generator.next_ns_ >= generator.phase_end_ns_) {
+      generator.driving_ = !generator.driving_;
+      if (!generator.driving_)
+        ++generator.pauses_;
+      generator.phase_end_ns_ += (generator.driving_ ? config.simulation_drive_time_ : config.simulation_pause_time_) * 1000000LL;
+      continue;
+    }
+    // every other pause the phone goes silent and the watchdog has to stop the robot
+    if (!generator.driving_ && !(generator.pauses_ & 1)) {
+      generator.next_ns_ = generator.phase_end_ns_;
+      continue;
+    }
+    break;
+  }
+
+  // a bundle goes out with its newest sample and ends early where the phase does
+  float x[BUNDLE_MAX_SAMPLES], y[BUNDLE_MAX_SAMPLES], z[BUNDLE_MAX_SAMPLES];
+  unsigned int samples = 0;
+  do {
+    if (generator.driving_) {
+      generator.x_ += 0.4 * (uniform(generator.random_) - 0.5);
+      generator.y_ += 0.4 * (uniform(generator.random_) - 0.5);
+      generator.x_ = std::max(-max_tilt, std::min(max_tilt, generator.x_));
+      generator.y_ = std::max(-max_tilt, std::min(max_tilt, generator.y_));
+    }
+    x[samples] = generator.x_;
+    y[samples] = generator.y_;
+    z[samples] = sqrt(gravity * gravity - generator.x_ * generator.x_ - generator.y_ * generator.y_);
+    ++samples;
+    const long jitter_us = config.simulation_jitter_ * 1000;
+    frame.time_ns_ = generator.next_ns_ + (int64_t)((2 * uniform(generator.random_) - 1) * jitter_us) * 1000;
+    generator.next_ns_ += period_ns_;
+  } while (samples < config.simulation_bundle_ && generator.next_ns_ < generator.phase_end_ns_);
+
+  frame.driver_ = generator.driver_;
+  if (samples == 1) {
+    encodeMessage(generator.driving_, config.simulation_model_, MESSAGE_KIND_ACCELEROMETER, x[0], y[0], z[0], frame.buffer_);
+    frame.length_ = MESSAGE_LENGTH;
+  }
+  else
+    frame.length_ = encodeBundle(generator.driving_, config.simulation_model_, samples, period_ns_ / 1000, x, y, z, frame.buffer_);
+  return true;
+}
+
+bool Simulation::nextFrame(Frame& frame)
+{
+  if (!generators_.empty()) {
+    // the earliest of the robots' next frames; at equal times the first robot in the configuration
+    Generator* earliest = NULL;
+    for (size_t i = 0; i < generators_.size(); ++i) {
+      Generator& generator = generators_[i];
+      if (!generator.has_pending_)
+        generator.has_pending_ = generate(generator, generator.pending_);
+      if (generator.has_pending_ && (earliest == NULL || generator.pending_.time_ns_ < earliest->pending_.time_ns_))
+        earliest = &generator;
+    }
+    if (earliest == NULL)
+      return false;
+    frame = earliest->pending_;
+    earliest->has_pending_ = false;
+    return true;
+  }
+  if (replay_position_ >= replay_.size())
+    return false;
+  frame = replay_[replay_position_++];
+  return true;
+}
+
+void Simulation::run()
+{
+  const int64_t started_ns = wallNowNs();
+  uint64_t bad_frames = 0;
+  Frame frame;
+  bool have_frame = nextFrame(frame);
+  for (;;) {
+    // whatever the last event made ready: the handlers of an expired timer, a reconnect
+    ios_.reset();
+    ios_.poll();
+    if (ios_.stopped())
+      break;
+
+    int64_t timer_ns = 0;
+    const bool have_timer = VirtualScheduler::next(timer_ns);
+    if (have_frame && frame.time_ns_ > end_ns_)
+      have_frame = false;
+    if (have_frame && (!have_timer || frame.time_ns_ <= timer_ns)) {
+      VirtualClock::advanceTo(frame.time_ns_);
+      ++frames_;
+      bytes_ += frame.length_;
+      try {
+        const ConfigGuard guard;
+        if (frame.length_ > MESSAGE_LENGTH) {
+          BundleMessage message(frame.buffer_);
+          samples_ += message.samples_;
+          frame.driver_->processBundle(message, guard.config());
+        }
+        else {
+          TCPMessage message(frame.buffer_);
+          ++samples_;
+          frame.driver_->processMessage(message, guard.config());
+        }
+      } catch (const char* e) {
+        ++bad_frames;
+      }
+      have_frame = nextFrame(frame);
+    }
+    else if (have_timer && timer_ns <= end_ns_)
+      VirtualScheduler::fireNext();
+    else
+      break;
+  }
+  VirtualClock::advanceTo(end_ns_);
+
+  const double wall_ms = (wallNowNs() - started_ns) / 1e6;
+  std::cout << "\rSimulation: " << VirtualClock::nowNs() / 1000000 << " ms of virtual time, " << frames_ << " frames";
+  if (bad_frames)
+    std::cout << " (" << bad_frames << " bad)";
+  if (samples_ != frames_)
+    std::cout << ", " << samples_ << " samples at " << (double)bytes_ / std::max(samples_, (uint64_t)1) << " B/sample";
+  std::cout << ", " << VirtualScheduler::fired() << " timer events" << std::endl;
+  std::cerr << "Simulation took " << wall_ms << " ms of real time (" << VirtualClock::nowNs() / 1e6 / std::max(wall_ms, 1e-3)
+            << "x real time)" << std::endl;
+}
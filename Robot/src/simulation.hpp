@@ -0,0 +1,96 @@
+#ifndef SIMULATION_HPP_
+#define SIMULATION_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+
+#include "message.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    class Driver;
+
+    /**
+     *
+     * Tryb symulacji ([simulation] enabled = 1): serwer na zegarze wirtualnym (VirtualClock), bez sieci i bez wątków,
+     * z robotami symulowanymi. Wejściem są ramki odtwarzane z nagrania rejestratora ([simulation] replay - zdarzenia
+     * FLIGHT_FRAME_* z zachowanymi odstępami i id robotów) albo wygenerowane: jazdy o długości drive_time z losowo
+     * błądzącym przechyleniem telefonu, przedzielone przerwami - na przemian z komendą "stop" i bez żadnych ramek
+     * (wtedy robota zatrzymuje watchdog).
+     *
+     * run() wykonuje zdarzenia po kolei - ramki wejścia i oczekiwania timerów (VirtualScheduler) - i przesuwa zegar
+     * od razu do następnego, więc godziny pracy mijają w sekundy, a wynik na stdout jest przy tej samej konfiguracji
+     * i tym samym wejściu identyczny co do bajtu. Przy równych chwilach ramka idzie przed timerem. Czas rzeczywisty
+     * przebiegu trafia tylko na stderr. Sieć (porty, [shm]), telemetria i tryb cienia w symulacji nie działają.
+     * Generator może wysyłać wskazania w paczkach ([simulation] bundle), jak telefon przy zatłoczonym Wi-Fi;
+     * paczka nigdy nie obejmuje przejścia z jazdy do przerwy.
+     */
+    class Simulation : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor; wczytuje nagranie (wyjątek std::runtime_error, jeżeli się nie da) albo przygotowuje generator.
+      /// Roboty bierze z Fleet, więc musi powstać po niej
+      explicit Simulation(boost::asio::io_service& ios);
+      ~Simulation() {};
+
+      /// przebieg symulacji, zamiast io_service::run() pętli programu; kończy się też po io_service::stop()
+      void run();
+
+    private:
+      void shutdown_service() {};
+
+      /// jedna ramka wejścia, gotowa w formacie TCPMessage albo paczka (BundleMessage, length_ > MESSAGE_LENGTH)
+      struct Frame {
+        int64_t time_ns_;
+        Driver* driver_;
+        unsigned int length_;
+        uint8_t buffer_[MESSAGE_MAX_LENGTH];
+      };
+
+      /// generator ramek jednego robota
+      struct Generator {
+        Driver* driver_;
+        /// stan xorshift64*
+        uint64_t random_;
+        /// chwila następnej ramki (przed rozrzutem) i końca bieżącej jazdy albo przerwy [ns]
+        int64_t next_ns_;
+        int64_t phase_end_ns_;
+        bool driving_;
+        unsigned int pauses_;
+        /// przechylenie telefonu [m/s^2]
+        float x_;
+        float y_;
+        /// następna ramka, już z rozrzutem
+        bool has_pending_;
+        Frame pending_;
+      };
+
+      void loadReplay(const std::string& path);
+      /// następna ramka wejścia w kolejności czasu; false, jeżeli wejście się skończyło
+      bool nextFrame(Frame& frame);
+      /// następna ramka jednego generatora
+      bool generate(Generator& generator, Frame& frame);
+      static double uniform(uint64_t& state);
+
+      boost::asio::io_service& ios_;
+      int64_t end_ns_;
+      int64_t period_ns_;
+      std::vector<Frame> replay_;
+      size_t replay_position_;
+      std::vector<Generator> generators_;
+      uint64_t frames_;
+      uint64_t skipped_;
+      /// wskazania i bajty wszystkich ramek wejścia (do porównania zwykłych ramek z paczkami)
+      uint64_t samples_;
+      uint64_t bytes_;
+    };
+  }
+}
+
+#endif
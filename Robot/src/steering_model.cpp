@@ -5,11 +5,6 @@
 
 using SeekurJrRC::Core::SteeringModelBase;
 
-const float SteeringModelBase::c_arr_phi[9] =   { -90,    0,   90, -90,   0,  90, -90,   0,   90};
-const float SteeringModelBase::c_arr_theta[9] = { -90,  -90,  -90,   0,   0,   0,  90,  90,   90};
-const float SteeringModelBase::c_arr_z_a[9] =   {-0.5, -1.0, -0.5, 0.0, 0.0, 0.0, 0.5, 1.0,  0.5};
-const float SteeringModelBase::c_arr_z_b[9] =   {-0.5,    0,  0.5, 0.0, 0.0, 0.0, 0.5, 0.0, -0.5};
-
 using SeekurJrRC::Core::BilinearNoFiltModel;
 using SeekurJrRC::Core::BilinearSimpleFiltModel;
 using SeekurJrRC::Core::BilinearExpFiltModel;
@@ -31,9 +26,6 @@ using SeekurJrRC::Core::Genetic2SimpleFiltModel;
 using SeekurJrRC::Core::Genetic2ExpFiltModel;
 
 
-// instancja historii - żeby kompilator się nie burzył
-std::deque<SeekurJrRC::Core::acc_tuple> SteeringModelBase::history_;
-
 std::pair<float, float> BilinearNoFiltModel::getSpeedValues()
 {
 //   std::cout << "phi: " << getPhiDeg(current_acc_) << "theta: " << getThetaDeg(current_acc_) << std::endl;
@@ -120,39 +112,39 @@ std::pair<float, float> Genetic2ExpFiltModel::getSpeedValues()
   return speedValuesFromAB(genetic2(acc));
 }
 
-boost::shared_ptr<SteeringModelBase> SeekurJrRC::Core::getSteeringModel(uint8_t modelCode, const float& x, const float& y, const float& z)
+SteeringModelBase* SeekurJrRC::Core::getSteeringModel(uint8_t modelCode, acc_history& history, const Config& config, const float& x, const float& y, const float& z, SteeringModelStorage& storage)
 {
     
   if (modelCode == BILINEAR_NO_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new BilinearNoFiltModel(x,y,z));
+    return storage.emplace<BilinearNoFiltModel>(history,config,x,y,z);
   if (modelCode == BILINEAR_SIMPLE_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new BilinearSimpleFiltModel(x,y,z));
+    return storage.emplace<BilinearSimpleFiltModel>(history,config,x,y,z);
   if (modelCode == BILINEAR_EXP_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new BilinearExpFiltModel(x,y,z));
+    return storage.emplace<BilinearExpFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_1_5_NO_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard1_5NoFiltModel(x,y,z));
+    return storage.emplace<Shepard1_5NoFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_1_5_SIMPLE_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard1_5SimpleFiltModel(x,y,z));
+    return storage.emplace<Shepard1_5SimpleFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_1_5_EXP_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard1_5ExpFiltModel(x,y,z));
+    return storage.emplace<Shepard1_5ExpFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_4_5_NO_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard4_5NoFiltModel(x,y,z));
+    return storage.emplace<Shepard4_5NoFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_4_5_SIMPLE_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard4_5SimpleFiltModel(x,y,z));
+    return storage.emplace<Shepard4_5SimpleFiltModel>(history,config,x,y,z);
   if (modelCode == SHEPARD_4_5_EXP_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Shepard4_5ExpFiltModel(x,y,z));
+    return storage.emplace<Shepard4_5ExpFiltModel>(history,config,x,y,z);
 //   if (modelCode == GENETIC_1_NO_FILT_MODEL_CODE)
-//     return boost::shared_ptr<SteeringModelBase>(new Genetic1NoFiltModel(x,y,z));
+//     return storage.emplace<Genetic1NoFiltModel>(history,config,x,y,z);
 //   if (modelCode == GENETIC_1_SIMPLE_FILT_MODEL_CODE)
-//     return boost::shared_ptr<SteeringModelBase>(new Genetic1SimpleFiltModel(x,y,z));
+//     return storage.emplace<Genetic1SimpleFiltModel>(history,config,x,y,z);
 //   if (modelCode == GENETIC_1_EXP_FILT_MODEL_CODE)
-//     return boost::shared_ptr<SteeringModelBase>(new Genetic1ExpFiltModel(x,y,z));
+//     return storage.emplace<Genetic1ExpFiltModel>(history,config,x,y,z);
   if (modelCode == GENETIC_2_NO_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Genetic2NoFiltModel(x,y,z));
+    return storage.emplace<Genetic2NoFiltModel>(history,config,x,y,z);
   if (modelCode == GENETIC_2_SIMPLE_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Genetic2SimpleFiltModel(x,y,z));
+    return storage.emplace<Genetic2SimpleFiltModel>(history,config,x,y,z);
   if (modelCode == GENETIC_2_EXP_FILT_MODEL_CODE)
-    return boost::shared_ptr<SteeringModelBase>(new Genetic2ExpFiltModel(x,y,z));
+    return storage.emplace<Genetic2ExpFiltModel>(history,config,x,y,z);
 
-  return boost::shared_ptr<SteeringModelBase>(new BilinearNoFiltModel(x,y,z));
+  return storage.emplace<BilinearNoFiltModel>(history,config,x,y,z);
 }
@@ -3,16 +3,21 @@
 
 #include <stdint.h>
 #include <utility> // for std::pair
-#include <deque> // for std::deque
+#include <new> // for placement new
 #include <sys/time.h> // for struct timeval
 #include <boost/tuple/tuple.hpp>
-#include <boost/shared_ptr.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/aligned_storage.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
 #include <cmath>
 
 #include "utils.hpp"
+#include "config.hpp"
+#include "control_points.hpp"
+#include "fixed_point.hpp"
 
 #define RAD_TO_DEG 57.2957795
-#define V_MAX 1200
 
 #define BILINEAR_NO_FILT_MODEL_CODE 0
 #define BILINEAR_SIMPLE_FILT_MODEL_CODE 1
@@ -29,11 +34,43 @@
 #define GENETIC_2_NO_FILT_MODEL_CODE 12
 #define GENETIC_2_SIMPLE_FILT_MODEL_CODE 13
 #define GENETIC_2_EXP_FILT_MODEL_CODE 14
+// te same modele na kątach z fuzji akcelerometru i żyroskopu (OrientationFilter w Driver'ze)
+#define BILINEAR_FUSED_MODEL_CODE 15
+#define SHEPARD_1_5_FUSED_MODEL_CODE 16
+#define SHEPARD_4_5_FUSED_MODEL_CODE 17
+#define GENETIC_1_FUSED_MODEL_CODE 18
+#define GENETIC_2_FUSED_MODEL_CODE 19
 
 
 namespace SeekurJrRC {
   namespace Core {
-    typedef boost::tuple<const float, const float, const float, struct timeval> acc_tuple;
+    typedef boost::tuple<float, float, float, struct timeval> acc_tuple;
+    /// historia wskazań akcelerometru; każdy robot (Driver) ma własną. Bufor cykliczny o pojemności ustalonej
+    /// przy starcie (historyCapacity), więc w przeciwieństwie do std::deque nie alokuje przy każdym push/pop.
+    typedef boost::circular_buffer<acc_tuple> acc_history;
+
+    /// czy model liczy na kątach z fuzji (OrientationFilter) zamiast na wskazaniach akcelerometru
+    inline bool isFusedModelCode(uint8_t model_code) {
+      return model_code >= BILINEAR_FUSED_MODEL_CODE && model_code <= GENETIC_2_FUSED_MODEL_CODE;
+    }
+
+    /// czy getSteeringModel ma model dla kodu (bez fuzji); dla pozostałych, m.in. wyłączonego genetic1 (9-11),
+    /// zwraca BilinearNoFiltModel
+    inline bool hasSteeringModel(uint8_t model_code) {
+      return model_code <= SHEPARD_4_5_EXP_FILT_MODEL_CODE
+        || (model_code >= GENETIC_2_NO_FILT_MODEL_CODE && model_code <= GENETIC_2_EXP_FILT_MODEL_CODE);
+    }
+
+    /// kod modelu bez filtra, który na wektorze grawitacji z fuzji liczy to samo, co model z fuzją
+    inline uint8_t fusedModelBaseCode(uint8_t model_code) {
+      return (model_code - BILINEAR_FUSED_MODEL_CODE) * 3;
+    }
+
+    /// pojemność historii potrzebna przy danym max_history_length_ (konstruktor modelu przycina do
+    /// max_length + 1 elementów i dopiero potem dokłada nowy)
+    inline unsigned int historyCapacity(unsigned int max_history_length) {
+      return max_history_length + 2;
+    }
 
     /**
      *
@@ -57,21 +94,31 @@ namespace SeekurJrRC {
       /// konstruktor; tylko inicjalizacja składowych, zapisanie historii
       /// będziemy kopiowali wartości z referencji, więc jeżeli referencja nagle stałaby się
       /// "invalid", nie będzie nam to groziło.
-      SteeringModelBase(const float& x, const float& y, const float& z) : current_acc_(getNormalizedAccTuple(x,y,z)) {
-        // here, in the constructor, we only care about the size
-        // whether the data is outdated will be decided in the getter method
-        int no_of_elems_to_pop = history_.size() - max_history_length_ - 1;
-        for (int i = 0; i < no_of_elems_to_pop; ++i)
-          history_.pop_back();
-
+      /// config - migawka, w której liczy cały model; musi żyć, dopóki model jest używany (ConfigGuard wołającego)
+      SteeringModelBase(acc_history& history, const Config& config, const float& x, const float& y, const float& z)
+        : config_(config), current_acc_(getNormalizedAccTuple(x,y,z)), history_(history) {
+        trimHistory(history_, config_);
         // history is sane now
         history_.push_front(current_acc_);
       };
+
+      /**
+       *
+       * Starsze wskazanie z paczki (BundleMessage), z chwilą, w której zostało zmierzone: tylko do historii,
+       * bez modelu - model liczy się raz, dla najnowszego wskazania paczki.
+       */
+      static void addToHistory(acc_history& history, const Config& config, float x, float y, float z, const struct timeval& time) {
+        acc_tuple sample = getNormalizedAccTuple(x, y, z, false);
+        sample.get<3>() = time;
+        trimHistory(history, config);
+        history.push_front(sample);
+      }
       /**
        *
        * metoda, którą muszą zaimplementować klasy pochodne; jedyna metoda (poza ctorem i dtorem), która interesuje świat zewnętrzny
        */
       virtual std::pair<float, float> getSpeedValues() = 0;
+      virtual ~SteeringModelBase() {};
     protected:
       /// zwracamy wartości, nie starsze niż max_history_time_ [msec]
       /// ze względu na relatywnie mały "rozmiar" historii, po prostu przeglądamy
@@ -82,12 +129,12 @@ namespace SeekurJrRC {
       /// 2. w przeciwnym razie oszacować indeks elementu znajdującego się na granicy łapania się, od tego elementu przejść
       ///    się nieco w odpowiednim kierunku, żeby znaleźć ten element graniczny
       /// 3. wszystkie za stare hurtowo usunąć
-      const std::deque<acc_tuple>& getHistory() {
+      const acc_history& getHistory() {
         // we actually acquire the timer only once
         // to be precise, we should do it in every step
         // however, for a relatively low number of elements, this is more effective
         struct timeval now_time;
-        gettimeofday(&now_time, NULL);
+        SeekurJrRC::Utils::timeOfDay(&now_time);
         
         int size = history_.size();
         for (unsigned int i = 0; i < size; ++i) {
@@ -98,7 +145,7 @@ namespace SeekurJrRC {
           
           // access last element
           const acc_tuple & element = history_.back();
-          if (SeekurJrRC::Utils::gTODDiffToMsec(&now_time, &element.get<3>()) > max_history_time_)
+          if (SeekurJrRC::Utils::gTODDiffToMsec(&now_time, &element.get<3>()) > config_.max_history_time_)
             history_.pop_back();
           else
             break; // we have reached a "good" element
@@ -113,9 +160,24 @@ namespace SeekurJrRC {
       /// AB.second - beta
       std::pair<float, float> speedValuesFromAB(std::pair<float,float> AB) {
         // explicit type casting, to avoid confusion
-        return std::make_pair((float)V_MAX * (AB.first-AB.second), (float)V_MAX * (AB.first+AB.second));
+        return std::make_pair(config_.v_max_ * (AB.first-AB.second), config_.v_max_ * (AB.first+AB.second));
       }
       
+      /// phi i theta w stopniach naraz; przy SEEKURJRRC_FIXED_POINT bez libm (fixedOrientationDeg)
+      void getOrientationDeg(const acc_tuple& tuple, float& phi, float& theta) {
+#ifdef SEEKURJRRC_FIXED_POINT
+        SeekurJrRC::Utils::fixed_t fixed_phi, fixed_theta;
+        SeekurJrRC::Utils::fixedOrientationDeg(SeekurJrRC::Utils::toFixed(tuple.get<0>(), FIXED_UNIT_BITS),
+                                               SeekurJrRC::Utils::toFixed(tuple.get<1>(), FIXED_UNIT_BITS),
+                                               SeekurJrRC::Utils::toFixed(tuple.get<2>(), FIXED_UNIT_BITS), fixed_phi, fixed_theta);
+        phi = SeekurJrRC::Utils::toFloat(fixed_phi);
+        theta = SeekurJrRC::Utils::toFloat(fixed_theta);
+#else
+        phi = getPhiDeg(tuple);
+        theta = getThetaDeg(tuple);
+#endif
+      }
+
       /// get Phi in degrees
       float getPhiDeg(const acc_tuple& tuple) {
         return RAD_TO_DEG * getPhiRad(tuple);
@@ -148,13 +210,15 @@ namespace SeekurJrRC {
       /// get current value according to simple moving average (SMA)
       /// let's hope for RWO
       const acc_tuple getCurrentValueFilteredSimple() {
-          const std::deque<acc_tuple>& history = getHistory();
-          
+          const acc_history& history = getHistory();
+#ifdef SEEKURJRRC_FIXED_POINT
+          return averageFixed(history, false);
+#else
           float f_ax = 0;
           float f_ay = 0;
           float f_az = 0;
           int count = 0;
-          for (std::deque<acc_tuple>::const_iterator it = history.begin(); it != history.end(); ++it) {
+          for (acc_history::const_iterator it = history.begin(); it != history.end(); ++it) {
               ++count;
               f_ax += (*it).get<0>();
               f_ay += (*it).get<1>();
@@ -167,16 +231,19 @@ namespace SeekurJrRC {
           f_az /= (float) count;
           
           acc_tuple ret(f_ax, f_ay, f_az);
-          gettimeofday(&ret.get<3>(), NULL);
+          SeekurJrRC::Utils::timeOfDay(&ret.get<3>());
           
           return ret;
+#endif
       }
       
       /// get current value according to exponentially-weighted moving average (EMA)
       /// let's hope for RWO
       const acc_tuple getCurrentValueFilteredExponential() {
-          const std::deque<acc_tuple>& history = getHistory();
-          
+          const acc_history& history = getHistory();
+#ifdef SEEKURJRRC_FIXED_POINT
+          return averageFixed(history, true);
+#else
           float f_ax = 0;
           float f_ay = 0;
           float f_az = 0;
@@ -185,7 +252,7 @@ namespace SeekurJrRC {
           float denum = 0;
           float coeff = 1.0/(1 - alpha); // for ease of later calculations :P
           
-          for (std::deque<acc_tuple>::const_iterator it = history.begin(); it != history.end(); ++it) {
+          for (acc_history::const_iterator it = history.begin(); it != history.end(); ++it) {
               // bo:
               // begin -- najwcześniejsze próbki
               // end   -- najstarsze próbki              
@@ -203,9 +270,10 @@ namespace SeekurJrRC {
           f_az /= denum;
           
           acc_tuple ret(f_ax, f_ay, f_az);
-          gettimeofday(&ret.get<3>(), NULL);
+          SeekurJrRC::Utils::timeOfDay(&ret.get<3>());
           
-          return ret;         
+          return ret;
+#endif
       }
       
       /// funkcje potrzebne do bezpośredniego wykorzystania danych z ewolucji
@@ -234,16 +302,18 @@ namespace SeekurJrRC {
       }
       
       std::pair<float, float> genetic1(const acc_tuple& acc) {
-        const float phi = getPhiDeg(acc);
-        const float theta = getThetaDeg(acc);
+        float phi, theta;
+        getOrientationDeg(acc, phi, theta);
         float alpha = gp_mul(gp_div(gp_sqrt(gp_add(theta, theta)), theta), gp_sqrt(gp_add(gp_sqrt(theta), gp_sqrt(theta))));
         float beta = gp_div(theta, gp_sub(gp_div(gp_sub(theta, theta), phi), gp_add(phi, phi)));
         return std::make_pair(alpha,beta);
       }
       
       std::pair<float, float> genetic2(const acc_tuple& acc) {
-        const float phi = getPhiDeg(acc)/90.0;
-        const float theta = getThetaDeg(acc)/90.0;
+        float phi, theta;
+        getOrientationDeg(acc, phi, theta);
+        phi /= 90.0;
+        theta /= 90.0;
         
         // taken straight from pyevolve
         // float alpha = gp_sub(theta, gp_mul(gp_mul(gp_sub(gp_sqrt(gp_add(theta, theta)), gp_sqrt(gp_mul(theta, theta))), gp_sqrt(gp_mul(gp_sqrt(phi), phi))), theta));
@@ -253,30 +323,44 @@ namespace SeekurJrRC {
         return std::make_pair(alpha,beta);
       }
       
+      /// punkty kontrolne z pliku: lokalna (zmodyfikowana) metoda Sheparda, w przeciwnym razie suma po całej siatce 3x3
       std::pair<float, float> shepard(const acc_tuple& acc, float p) {
-        const float phi = getPhiDeg(acc);
-        const float theta = getThetaDeg(acc);
+        float phi, theta;
+        getOrientationDeg(acc, phi, theta);
+        if (config_.control_points_)
+          return config_.control_points_->shepard(phi, theta, p);
+#ifdef SEEKURJRRC_FIXED_POINT
+        // p is 1.5 or 4.5: a whole number of halves
+        std::pair<SeekurJrRC::Utils::fixed_t, SeekurJrRC::Utils::fixed_t> fixed_ab = SeekurJrRC::Utils::fixedShepard(
+          SeekurJrRC::Utils::toFixed(phi), SeekurJrRC::Utils::toFixed(theta), config_.c_fixed_phi_, config_.c_fixed_theta_,
+          config_.c_fixed_z_a_, config_.c_fixed_z_b_, CONTROL_POINTS_COUNT, (unsigned int)(2 * p + 0.5f));
+        return std::make_pair(SeekurJrRC::Utils::toFloat(fixed_ab.first), SeekurJrRC::Utils::toFloat(fixed_ab.second));
+#else
         float weight = 0;
         float weight_sum = 0;
         float nominator_a = 0;
         float nominator_b = 0;
         
         for (int i = 0; i < 9; ++i) {
-          weight = pow(dist(phi, theta, c_arr_phi[i], c_arr_theta[i]),-p);
+          weight = pow(dist(phi, theta, config_.c_arr_phi_[i], config_.c_arr_theta_[i]),-p);
           weight_sum += weight;
-          nominator_a += weight * c_arr_z_a[i];
-          nominator_b += weight * c_arr_z_b[i];
+          nominator_a += weight * config_.c_arr_z_a_[i];
+          nominator_b += weight * config_.c_arr_z_b_[i];
         }
         
         float alpha = nominator_a / weight_sum;
         float beta  = nominator_b / weight_sum;
         
         return std::make_pair(alpha,beta);
+#endif
       }
       
+      /// punkty kontrolne z pliku nie tworzą siatki; wtedy płaszczyzna dopasowana do sąsiadów (ControlPointSet::localLinear)
       std::pair<float, float> bilinear(const acc_tuple& acc) {
-        const float phi = getPhiDeg(acc); // == x
-        const float theta = getThetaDeg(acc); // == y
+        float phi, theta; // == x, y
+        getOrientationDeg(acc, phi, theta);
+        if (config_.control_points_)
+          return config_.control_points_->localLinear(phi, theta);
         
         // normally, this wouldn't be a part of the algorithm
         int i_11, i_12, i_21, i_22; // indeksy odpowiadające punktom Q_11, Q_12, Q_21, Q_22 w dokumentacji; x - pierwszy indeks, y - drugi indeks
@@ -309,28 +393,30 @@ namespace SeekurJrRC {
             i_22 = 4;
           }
         }
+#ifdef SEEKURJRRC_FIXED_POINT
+        std::pair<SeekurJrRC::Utils::fixed_t, SeekurJrRC::Utils::fixed_t> fixed_ab = SeekurJrRC::Utils::fixedBilinear(
+          SeekurJrRC::Utils::toFixed(phi), SeekurJrRC::Utils::toFixed(theta), config_.c_fixed_phi_, config_.c_fixed_theta_,
+          config_.c_fixed_z_a_, config_.c_fixed_z_b_, i_11, i_12, i_21, i_22);
+        return std::make_pair(SeekurJrRC::Utils::toFloat(fixed_ab.first), SeekurJrRC::Utils::toFloat(fixed_ab.second));
+#else
+        float dx = config_.c_arr_phi_[i_22] - config_.c_arr_phi_[i_11];
+        float dy = config_.c_arr_theta_[i_22]-config_.c_arr_theta_[i_11];
+        float f_R1_a =  config_.c_arr_z_a_[i_11] * (config_.c_arr_phi_[i_22] - phi) / dx + config_.c_arr_z_a_[i_21] * (phi - config_.c_arr_phi_[i_11]) / dx;
+        float f_R1_b =  config_.c_arr_z_b_[i_11] * (config_.c_arr_phi_[i_22] - phi) / dx + config_.c_arr_z_b_[i_21] * (phi - config_.c_arr_phi_[i_11]) / dx;
         
-        float dx = c_arr_phi[i_22] - c_arr_phi[i_11];
-        float dy = c_arr_theta[i_22]-c_arr_theta[i_11];
-        float f_R1_a =  c_arr_z_a[i_11] * (c_arr_phi[i_22] - phi) / dx + c_arr_z_a[i_21] * (phi - c_arr_phi[i_11]) / dx;
-        float f_R1_b =  c_arr_z_b[i_11] * (c_arr_phi[i_22] - phi) / dx + c_arr_z_b[i_21] * (phi - c_arr_phi[i_11]) / dx;
+        float f_R2_a =  config_.c_arr_z_a_[i_12] * (config_.c_arr_phi_[i_22] - phi) / dx + config_.c_arr_z_a_[i_22] * (phi - config_.c_arr_phi_[i_11]) / dx;
+        float f_R2_b =  config_.c_arr_z_b_[i_12] * (config_.c_arr_phi_[i_22] - phi) / dx + config_.c_arr_z_b_[i_22] * (phi - config_.c_arr_phi_[i_11]) / dx;
         
-        float f_R2_a =  c_arr_z_a[i_12] * (c_arr_phi[i_22] - phi) / dx + c_arr_z_a[i_22] * (phi - c_arr_phi[i_11]) / dx;
-        float f_R2_b =  c_arr_z_b[i_12] * (c_arr_phi[i_22] - phi) / dx + c_arr_z_b[i_22] * (phi - c_arr_phi[i_11]) / dx;
-        
-        float alpha = f_R1_a * (c_arr_theta[i_22] - theta) / dy + f_R2_a * (theta - c_arr_theta[i_11]) / dy;
-        float beta  = f_R1_b * (c_arr_theta[i_22] - theta) / dy + f_R2_b * (theta - c_arr_theta[i_11]) / dy;
+        float alpha = f_R1_a * (config_.c_arr_theta_[i_22] - theta) / dy + f_R2_a * (theta - config_.c_arr_theta_[i_11]) / dy;
+        float beta  = f_R1_b * (config_.c_arr_theta_[i_22] - theta) / dy + f_R2_b * (theta - config_.c_arr_theta_[i_11]) / dy;
         
         return std::make_pair(alpha,beta);
+#endif
       }
       
-      //                                         0     1     2    3    4     5    6    7     8
-      //                                      -------------------------------------------------
-      static const float c_arr_phi[9];//   = { -90,    0,   90, -90,   0,   90, -90,   0,   90};
-      static const float c_arr_theta[9];// = { -90,  -90,  -90,   0,   0,    0,  90,  90,   90};
-      static const float c_arr_z_a[9];//   = {-0.5, -1.0, -0.5, 0.0, 0.0,  0.0, 0.5, 1.0,  0.5};
-      static const float c_arr_z_b[9];//   = {-0.5,    0,  0.5, 1.0, 0.0, -1.0, 0.5, 0.0, -0.5};
-
+      /// migawka konfiguracji, z której korzysta cały model (m.in. punkty kontrolne config_.c_arr_*);
+      /// jedna na cały model, więc przeładowanie w trakcie obliczeń nie da wyników "pół na pół"
+      const Config& config_;
 
       /// aktualne wartości wskazań akcelerometru
       /// alternatywnie modele pochodne mogą korzystać tylko z tego, jeżeli nie
@@ -338,15 +424,52 @@ namespace SeekurJrRC {
       const acc_tuple current_acc_;
 
     private:
+      /// miejsce na nowe wskazanie: historia przycięta do max_history_length_ + 1 elementów
+      static void trimHistory(acc_history& history, const Config& config) {
+        // a reload may have raised max_length; this is the only place the history can allocate
+        if (history.capacity() < historyCapacity(config.max_history_length_))
+          history.set_capacity(historyCapacity(config.max_history_length_));
+
+        // here we only care about the size
+        // whether the data is outdated will be decided in the getter method
+        int no_of_elems_to_pop = history.size() - config.max_history_length_ - 1;
+        for (int i = 0; i < no_of_elems_to_pop; ++i)
+          history.pop_back();
+      }
+
+#ifdef SEEKURJRRC_FIXED_POINT
+      /// SMA albo EMA historii stałoprzecinkowo (FixedAverage); wynik jak getCurrentValueFiltered*
+      acc_tuple averageFixed(const acc_history& history, bool exponential) {
+        SeekurJrRC::Utils::FixedAverage average(exponential, history.size());
+        for (acc_history::const_iterator it = history.begin(); it != history.end(); ++it)
+          average.add(SeekurJrRC::Utils::toFixed((*it).get<0>(), FIXED_UNIT_BITS), SeekurJrRC::Utils::toFixed((*it).get<1>(), FIXED_UNIT_BITS),
+                      SeekurJrRC::Utils::toFixed((*it).get<2>(), FIXED_UNIT_BITS));
+        SeekurJrRC::Utils::fixed_t x, y, z;
+        average.result(x, y, z);
+        acc_tuple ret(SeekurJrRC::Utils::toFloat(x, FIXED_UNIT_BITS), SeekurJrRC::Utils::toFloat(y, FIXED_UNIT_BITS),
+                      SeekurJrRC::Utils::toFloat(z, FIXED_UNIT_BITS));
+        SeekurJrRC::Utils::timeOfDay(&ret.get<3>());
+        return ret;
+      }
+#endif
+
       /// w tej metodzie zwracamy tuple 4-elementowe; czas ustawiamy, jeżeli setTime == true (domyślnie)
-      acc_tuple getNormalizedAccTuple(const float& x, const float& y, const float& z, bool setTime = true) {
+      static acc_tuple getNormalizedAccTuple(const float& x, const float& y, const float& z, bool setTime = true) {
+#ifdef SEEKURJRRC_FIXED_POINT
+        SeekurJrRC::Utils::fixed_t f_x = SeekurJrRC::Utils::toFixed(x, FIXED_RAW_BITS), f_y = SeekurJrRC::Utils::toFixed(y, FIXED_RAW_BITS),
+                                  f_z = SeekurJrRC::Utils::toFixed(z, FIXED_RAW_BITS);
+        SeekurJrRC::Utils::fixedNormalize(f_x, f_y, f_z);
+        acc_tuple ret(SeekurJrRC::Utils::toFloat(f_x, FIXED_UNIT_BITS), SeekurJrRC::Utils::toFloat(f_y, FIXED_UNIT_BITS),
+                      SeekurJrRC::Utils::toFloat(f_z, FIXED_UNIT_BITS));
+#else
         float len = sqrt(x*x + y*y + z*z);
         float a_x = (fabs(x) < 0.8) ? 0 : x;
         float a_y = (fabs(y) < 0.8) ? 0 : y;
         float a_z = (fabs(z) < 0.8) ? 0 : z;
         acc_tuple ret(x/len, y/len, z/len);
+#endif
         if (setTime)
-          gettimeofday(&ret.get<3>(), NULL);
+          SeekurJrRC::Utils::timeOfDay(&ret.get<3>());
         return ret;
       };
       
@@ -356,112 +479,144 @@ namespace SeekurJrRC {
       };
       
       /// historia wartości wskazań akcelerometru
-      /// uczynienie tego statycznym pozwala nam na wykorzystanie tych samych danych
+      /// historia należy do Driver'a (jedna na robota), a nie do modelu, co pozwala nam na wykorzystanie tych samych danych
       /// w różnych modelach (tj. płynne zmienianie modeli - nie będzie potrzeby zbierania danych od nowa)
-      static std::deque<acc_tuple> history_;
-      static const unsigned int max_history_length_ = 20;
-      static const unsigned int max_history_time_ = 1000; // [msec]
+      acc_history& history_;
     };
        
     class BilinearNoFiltModel : public SteeringModelBase {
     public:
-      BilinearNoFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      BilinearNoFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class BilinearSimpleFiltModel : public SteeringModelBase {
     public:
-      BilinearSimpleFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      BilinearSimpleFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class BilinearExpFiltModel : public SteeringModelBase {
     public:
-      BilinearExpFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      BilinearExpFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard1_5NoFiltModel : public SteeringModelBase {
     public:
-      Shepard1_5NoFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard1_5NoFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard1_5SimpleFiltModel : public SteeringModelBase {
     public:
-      Shepard1_5SimpleFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard1_5SimpleFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard1_5ExpFiltModel : public SteeringModelBase {
     public:
-      Shepard1_5ExpFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard1_5ExpFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard4_5NoFiltModel : public SteeringModelBase {
     public:
-      Shepard4_5NoFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard4_5NoFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard4_5SimpleFiltModel : public SteeringModelBase {
     public:
-      Shepard4_5SimpleFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard4_5SimpleFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Shepard4_5ExpFiltModel : public SteeringModelBase {
     public:
-      Shepard4_5ExpFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Shepard4_5ExpFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic1NoFiltModel : public SteeringModelBase {
     public:
-      Genetic1NoFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic1NoFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic1SimpleFiltModel : public SteeringModelBase {
     public:
-      Genetic1SimpleFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic1SimpleFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic1ExpFiltModel : public SteeringModelBase {
     public:
-      Genetic1ExpFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic1ExpFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic2NoFiltModel : public SteeringModelBase {
     public:
-      Genetic2NoFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic2NoFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic2SimpleFiltModel : public SteeringModelBase {
     public:
-      Genetic2SimpleFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic2SimpleFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
     class Genetic2ExpFiltModel : public SteeringModelBase {
     public:
-      Genetic2ExpFiltModel(const float& x, const float& y, const float& z) : SteeringModelBase(x, y, z) {};
+      Genetic2ExpFiltModel(acc_history& history, const Config& config, const float& x, const float& y, const float& z) : SteeringModelBase(history, config, x, y, z) {};
       std::pair<float, float> getSpeedValues();
     };
     
 
 
+    /**
+     *
+     * Miejsce na jeden obiekt modelu sterowania, zaalokowane razem z właścicielem (Driver'em). Model jest konstruowany
+     * w tym miejscu (placement new) przy każdej wiadomości, a poprzedni niszczony - bez alokacji na stercie.
+     * Klasy pochodne nie dodają składowych, więc wszystkie mają rozmiar BilinearNoFiltModel; pilnuje tego BOOST_STATIC_ASSERT.
+     */
+    class SteeringModelStorage : private boost::noncopyable {
+    public:
+      SteeringModelStorage() : model_(NULL) {};
+      ~SteeringModelStorage() { reset(); };
+
+      template <class Model>
+      SteeringModelBase* emplace(acc_history& history, const Config& config, const float& x, const float& y, const float& z) {
+        BOOST_STATIC_ASSERT(sizeof(Model) <= sizeof(storage_));
+        reset();
+        model_ = new (storage_.address()) Model(history, config, x, y, z);
+        return model_;
+      }
+
+      void reset() {
+        if (model_) {
+          model_->~SteeringModelBase();
+          model_ = NULL;
+        }
+      }
+
+    private:
+      boost::aligned_storage<sizeof(BilinearNoFiltModel)> storage_;
+      SteeringModelBase* model_;
+    };
+
     /**
      * \param modelCode - kod modelu odpowiadający jednem z define'ów
+     * \param history   - historia wskazań akcelerometru robota, do którego trafi wynik
+     * \param config    - migawka konfiguracji; musi żyć, dopóki model jest używany
      * \param x,y,z     - wartości wskazań akcelerometru
+     * \param storage   - miejsce, w którym model zostanie skonstruowany (poprzedni model z tego miejsca jest niszczony)
      *
-     * Metoda konstruująca odpowiedni model i zwracająca do niego wskaźnik. W przypadku niepowodzenia prawdopodobnie rzucimy wyjątek.
+     * Metoda konstruująca odpowiedni model i zwracająca do niego wskaźnik; wskaźnik jest ważny do następnego wywołania z tym samym storage.
      */
-    boost::shared_ptr<SteeringModelBase> getSteeringModel(uint8_t modelCode, const float& x, const float& y, const float& z);
+    SteeringModelBase* getSteeringModel(uint8_t modelCode, acc_history& history, const Config& config, const float& x, const float& y, const float& z, SteeringModelStorage& storage);
   }
 }
 
@@ -0,0 +1,239 @@
+#include <iostream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+
+#include "telemetry.hpp"
+#include "driver.hpp"
+#include "fleet.hpp"
+#include "config.hpp"
+#include "realtime.hpp"
+
+using boost::asio::ip::tcp;
+using SeekurJrRC::Core::TelemetryHub;
+using SeekurJrRC::Core::TelemetryObserver;
+using SeekurJrRC::Core::TelemetryBuffer;
+using SeekurJrRC::Core::TelemetrySample;
+using SeekurJrRC::Core::Config;
+using SeekurJrRC::Core::Configuration;
+using SeekurJrRC::Core::ConfigPtr;
+using SeekurJrRC::Core::makeCustomAllocHandler;
+
+boost::asio::io_service::id TelemetryHub::id;
+
+TelemetryObserver::TelemetryObserver(boost::asio::io_service& ios) : socket_(ios), peer_("?"), sent_(0), skipped_(0)
+{
+}
+
+void TelemetryObserver::start()
+{
+  boost::system::error_code ec;
+  tcp::endpoint remote = socket_.remote_endpoint(ec);
+  if (!ec) {
+    std::ostringstream peer;
+    peer << remote;
+    peer_ = peer.str();
+  }
+  // the server sends as soon as a write completes; do not wait for the observer's ACKs to fill a segment
+  socket_.set_option(tcp::no_delay(true), ec);
+  // a small kernel buffer, so that a slow observer's backlog is skipped here instead of queueing in the kernel
+  socket_.set_option(boost::asio::socket_base::send_buffer_size(send_buffer_size_), ec);
+  scheduleRead();
+}
+
+void TelemetryObserver::send(const TelemetryBuffer& buffer)
+{
+  if (closed())
+    return;
+  if (writing_) {
+    // slow observer: keep only the newest state
+    if (pending_)
+      ++skipped_;
+    pending_ = buffer;
+    return;
+  }
+  write(buffer);
+}
+
+void TelemetryObserver::write(const TelemetryBuffer& buffer)
+{
+  writing_ = buffer;
+  boost::asio::async_write(
+    socket_,
+    boost::asio::buffer(*writing_),
+    makeCustomAllocHandler(
+      write_handler_memory_,
+      boost::bind(&TelemetryObserver::handleWrite, shared_from_this(), boost::asio::placeholders::error)
+    )
+  );
+}
+
+void TelemetryObserver::handleWrite(const boost::system::error_code& error)
+{
+  writing_.reset();
+  if (error) {
+    close();
+    return;
+  }
+  ++sent_;
+  if (pending_) {
+    TelemetryBuffer next;
+    next.swap(pending_);
+    write(next);
+  }
+}
+
+void TelemetryObserver::scheduleRead()
+{
+  socket_.async_read_some(
+    boost::asio::buffer(discard_),
+    makeCustomAllocHandler(
+      read_handler_memory_,
+      boost::bind(&TelemetryObserver::handleRead, shared_from_this(), boost::asio::placeholders::error)
+    )
+  );
+}
+
+void TelemetryObserver::handleRead(const boost::system::error_code& error)
+{
+  // observers are read-only; anything they send is dropped, EOF or an error ends the session
+  if (error) {
+    close();
+    return;
+  }
+  scheduleRead();
+}
+
+void TelemetryObserver::close()
+{
+  boost::system::error_code ignored;
+  socket_.shutdown(tcp::socket::shutdown_both, ignored);
+  socket_.close(ignored);
+  pending_.reset();
+}
+
+TelemetryHub::TelemetryHub(boost::asio::io_service& ios)
+  : service(ios), work_(ios_), acceptor_(ios_), timer_(ios_), enabled_(false), period_us_(0), max_observers_(0),
+    buffers_(0), rejected_(0)
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (!config.telemetry_port_)
+    return;
+
+  acceptor_.open(tcp::v4());
+  acceptor_.set_option(tcp::acceptor::reuse_address(true));
+  acceptor_.bind(tcp::endpoint(tcp::v4(), config.telemetry_port_));
+  acceptor_.listen();
+  drivers_ = boost::asio::use_service<Fleet>(ios).drivers();
+  sequences_.assign(drivers_.size(), 0);
+  period_us_ = 1000000 / config.telemetry_rate_hz_;
+  max_observers_ = config.telemetry_max_observers_;
+  enabled_ = true;
+  std::cout << "Telemetry for " << drivers_.size() << " robot(s) on port " << config.telemetry_port_
+            << ", " << config.telemetry_rate_hz_ << " Hz" << std::endl;
+
+  startAccept();
+  timer_.expires_from_now(boost::posix_time::microseconds(period_us_));
+  scheduleTick();
+  thread_ = boost::thread(boost::bind(&TelemetryHub::run, this));
+}
+
+void TelemetryHub::run()
+{
+  const ConfigPtr pinned_config = Configuration::snapshot();
+  const Config& config = *pinned_config;
+  if (config.realtime_enabled_)
+    SeekurJrRC::Utils::applyBackgroundThreadPolicy(config.realtime_control_cpus_, "telemetry");
+  ios_.run();
+}
+
+void TelemetryHub::shutdown_service()
+{
+  if (!enabled_)
+    return;
+  ios_.stop();
+  thread_.join();
+  for (std::set<boost::shared_ptr<TelemetryObserver> >::const_iterator it = observers_.begin(); it != observers_.end(); ++it)
+    (*it)->close();
+  std::cout << "Telemetry: " << buffers_ << " samples encoded, " << observers_.size() << " observers connected, "
+            << rejected_ << " rejected" << std::endl;
+  observers_.clear();
+  enabled_ = false;
+}
+
+void TelemetryHub::startAccept()
+{
+  boost::shared_ptr<TelemetryObserver> observer(new TelemetryObserver(ios_));
+  acceptor_.async_accept(
+    observer->socket(),
+    boost::bind(&TelemetryHub::handleAccept, this, observer, boost::asio::placeholders::error)
+  );
+}
+
+void TelemetryHub::handleAccept(boost::shared_ptr<TelemetryObserver> observer, const boost::system::error_code& error)
+{
+  if (error == boost::asio::error::operation_aborted)
+    return;
+  if (!error) {
+    observer->start();
+    if (observers_.size() >= max_observers_) {
+      ++rejected_;
+      std::cerr << "Telemetry observer " << observer->peer() << " rejected: limit of " << max_observers_ << " reached" << std::endl;
+      observer->close();
+    }
+    else {
+      observers_.insert(observer);
+      if (latest_)
+        observer->send(latest_);
+    }
+  }
+  else
+    std::cerr << "Accepting telemetry observer: " << error.message() << std::endl;
+  startAccept();
+}
+
+void TelemetryHub::scheduleTick()
+{
+  timer_.async_wait(boost::bind(&TelemetryHub::tick, this, boost::asio::placeholders::error));
+}
+
+void TelemetryHub::tick(const boost::system::error_code& error)
+{
+  if (error)
+    return;
+  // fixed rate, not drifting with the time spent here
+  timer_.expires_at(timer_.expires_at() + boost::posix_time::microseconds(period_us_));
+  scheduleTick();
+
+  // forget the observers that went away
+  for (std::set<boost::shared_ptr<TelemetryObserver> >::iterator it = observers_.begin(); it != observers_.end(); ) {
+    if ((*it)->closed()) {
+      std::cout << "\rTelemetry observer " << (*it)->peer() << " closed: " << (*it)->sent() << " samples sent, "
+                << (*it)->skipped() << " skipped" << std::endl;
+      observers_.erase(it++);
+    }
+    else
+      ++it;
+  }
+
+  std::vector<TelemetrySample> samples(drivers_.size());
+  std::vector<uint32_t> sequences(drivers_.size());
+  for (unsigned int i = 0; i < drivers_.size(); ++i) {
+    // a robot kept writing through every attempt: try again next tick
+    if (!drivers_[i]->telemetry().read(samples[i], sequences[i]))
+      return;
+  }
+  if (sequences == sequences_)
+    return;
+  sequences_.swap(sequences);
+
+  // encoded once, shared by every observer; freed when the last write of it completes
+  std::vector<uint8_t>* encoded = new std::vector<uint8_t>(drivers_.size() * TELEMETRY_LENGTH);
+  for (unsigned int i = 0; i < samples.size(); ++i)
+    encodeTelemetry(samples[i], &(*encoded)[i * TELEMETRY_LENGTH]);
+  latest_.reset(encoded);
+  ++buffers_;
+  for (std::set<boost::shared_ptr<TelemetryObserver> >::const_iterator it = observers_.begin(); it != observers_.end(); ++it)
+    (*it)->send(latest_);
+}
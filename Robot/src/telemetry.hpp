@@ -0,0 +1,165 @@
+#ifndef TELEMETRY_HPP_
+#define TELEMETRY_HPP_
+
+#include <set>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include "message.hpp"
+#include "handler_allocator.hpp"
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    class Driver;
+
+    /**
+     *
+     * Ostatni stan robota dla telemetrii: seqlock z jednym piszącym (wątek robota) i jednym czytającym (wątek
+     * telemetrii). Zapis to dwie operacje atomowe i kopia kilkudziesięciu bajtów - bez blokad, alokacji
+     * i wywołań systemowych, więc ścieżka sterowania nie zależy od tego, ilu jest obserwatorów.
+     */
+    class TelemetrySlot {
+    public:
+      TelemetrySlot() : sequence_(0) { memset(&sample_, 0, sizeof(sample_)); };
+
+      /// wołane tylko z wątku robota
+      void publish(const TelemetrySample& sample) {
+        const uint32_t sequence = sequence_.load(boost::memory_order_relaxed);
+        sequence_.store(sequence + 1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        sample_ = sample;
+        sequence_.store(sequence + 2, boost::memory_order_release);
+      }
+
+      /**
+       * \param sequence - numer wersji odczytanego stanu; zmienia się przy każdym publish()
+       *
+       * Spójna kopia stanu; false, jeżeli kilka prób trafiło akurat na zapis (wtedy w następnym cyklu).
+       */
+      bool read(TelemetrySample& sample, uint32_t& sequence) const {
+        for (int attempt = 0; attempt < 4; ++attempt) {
+          const uint32_t before = sequence_.load(boost::memory_order_acquire);
+          if (before & 1)
+            continue;
+          sample = sample_;
+          boost::atomic_thread_fence(boost::memory_order_acquire);
+          if (sequence_.load(boost::memory_order_relaxed) == before) {
+            sequence = before;
+            return true;
+          }
+        }
+        return false;
+      }
+
+    private:
+      boost::atomic<uint32_t> sequence_;
+      TelemetrySample sample_;
+    };
+
+    /// niezmienny bufor z zakodowanymi ramkami, współdzielony przez wszystkich obserwatorów
+    typedef boost::shared_ptr<const std::vector<uint8_t> > TelemetryBuffer;
+
+    /**
+     *
+     * Połączenie obserwatora (tylko do odczytu): serwer wyłącznie wysyła mu ramki telemetrii, a to, co obserwator
+     * przyśle, jest ignorowane (czytamy tylko po to, żeby zauważyć rozłączenie).
+     *
+     * W danej chwili wysyłany jest co najwyżej jeden bufor. Jeżeli obserwator nie nadąża, kolejny bufor czeka
+     * w pending_, a jeszcze nowszy go zastępuje - wolny obserwator przeskakuje do najnowszego stanu, zamiast
+     * kolejkować stare (i zajmować pamięć serwera). Bufor nadawczy jądra jest mały z tego samego powodu.
+     */
+    class TelemetryObserver : public boost::enable_shared_from_this<TelemetryObserver>
+    {
+    public:
+      explicit TelemetryObserver(boost::asio::io_service& ios);
+      boost::asio::ip::tcp::socket& socket() { return socket_; }
+      /// zapamiętanie adresu i start czytania (wykrywanie rozłączenia)
+      void start();
+      /// wysłanie bufora albo - jeżeli poprzedni jeszcze się wysyła - podmiana oczekującego
+      void send(const TelemetryBuffer& buffer);
+      void close();
+      bool closed() const { return !socket_.is_open(); }
+
+      const std::string& peer() const { return peer_; }
+      uint64_t sent() const { return sent_; }
+      uint64_t skipped() const { return skipped_; }
+
+    private:
+      void write(const TelemetryBuffer& buffer);
+      void handleWrite(const boost::system::error_code& error);
+      void scheduleRead();
+      void handleRead(const boost::system::error_code& error);
+
+      boost::asio::ip::tcp::socket socket_;
+      /// bufor w trakcie wysyłania (trzymany, dopóki jądro go nie przejmie) i najnowszy oczekujący
+      TelemetryBuffer writing_;
+      TelemetryBuffer pending_;
+      uint8_t discard_[64];
+      HandlerMemory write_handler_memory_;
+      HandlerMemory read_handler_memory_;
+      std::string peer_;
+      uint64_t sent_;
+      uint64_t skipped_;
+      /// bufor nadawczy jądra [B]; domyślny (setki KB) mieściłby minuty nieaktualnych próbek
+      static const int send_buffer_size_ = 4096;
+    };
+
+    /**
+     *
+     * Rozsyłanie telemetrii do obserwatorów (pulpity, programy zapisujące) na osobnym porcie ([telemetry] port).
+     *
+     * Usługa ma własny wątek i io_service, więc obserwatorzy w ogóle nie dzielą pętli z robotami. Wątek
+     * robota tylko publikuje swój stan w TelemetrySlot; wątek telemetrii [telemetry] rate_hz razy na sekundę
+     * odczytuje stany wszystkich robotów i, jeżeli któryś się zmienił, koduje je raz - do jednego niezmiennego
+     * bufora ze zliczaniem referencji - i przekazuje ten sam bufor wszystkim obserwatorom.
+     * Czytane przy starcie; port 0 = wyłączone.
+     */
+    class TelemetryHub : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      /// konstruktor; roboty bierze z Fleet, więc musi powstać po niej
+      explicit TelemetryHub(boost::asio::io_service& ios);
+      ~TelemetryHub() {};
+
+    private:
+      void shutdown_service();
+      void startAccept();
+      void handleAccept(boost::shared_ptr<TelemetryObserver> observer, const boost::system::error_code& error);
+      void scheduleTick();
+      void tick(const boost::system::error_code& error);
+      void run();
+
+      /// własna pętla wątku telemetrii
+      boost::asio::io_service ios_;
+      boost::asio::io_service::work work_;
+      boost::asio::ip::tcp::acceptor acceptor_;
+      boost::asio::deadline_timer timer_;
+      boost::thread thread_;
+      bool enabled_;
+
+      std::vector<Driver*> drivers_;
+      /// ostatnio odczytane wersje stanów robotów
+      std::vector<uint32_t> sequences_;
+      std::set<boost::shared_ptr<TelemetryObserver> > observers_;
+      /// ostatni bufor - nowy obserwator dostaje go od razu
+      TelemetryBuffer latest_;
+      long period_us_;
+      unsigned int max_observers_;
+      uint64_t buffers_;
+      uint64_t rejected_;
+    };
+  }
+}
+
+#endif
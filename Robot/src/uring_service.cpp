@@ -0,0 +1,334 @@
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "uring_service.hpp"
+
+#ifdef SEEKURJRRC_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using SeekurJrRC::Core::UringService;
+using SeekurJrRC::Core::UringClient;
+using SeekurJrRC::Core::makeCustomAllocHandler;
+
+boost::asio::io_service::id UringService::id;
+
+UringService::UringService(boost::asio::io_service& ios)
+  : service(ios),
+    ring_fd_(-1),
+    event_fd_(-1),
+    notifier_(ios),
+    event_count_(0),
+    sq_ring_(NULL),
+    cq_ring_(NULL),
+    sq_ring_size_(0),
+    cq_ring_size_(0),
+    sqes_(NULL),
+    sq_pending_(0),
+    buffer_ring_(NULL),
+    buffers_(NULL),
+    buffer_tail_(0),
+    reaping_(false),
+    enter_calls_(0),
+    wakeups_(0),
+    completions_(0),
+    buffers_exhausted_(0)
+{
+  if (!setUp()) {
+    tearDown();
+    std::cerr << "io_uring not available, falling back to epoll" << std::endl;
+  }
+}
+
+UringService::~UringService()
+{
+  tearDown();
+}
+
+void UringService::shutdown_service()
+{
+  if (available())
+    std::cout << "io_uring: " << completions_ << " completions, " << wakeups_ << " wake-ups, "
+              << enter_calls_ << " io_uring_enter calls, " << buffers_exhausted_ << " times out of buffers" << std::endl;
+  tearDown();
+}
+
+#ifdef SEEKURJRRC_IO_URING
+
+namespace {
+  inline unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+  inline void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+  void* mapRing(int fd, size_t size, off_t offset)
+  {
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (memory == MAP_FAILED) ? NULL : memory;
+  }
+
+  /// pamięć na bufory spoza sterty: gdyby jądro pisało do bufora już po zamknięciu pierścienia, dostanie EFAULT,
+  /// a nie nadpisze cudzych danych
+  void* mapAnonymous(size_t size)
+  {
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    return (memory == MAP_FAILED) ? NULL : memory;
+  }
+}
+
+bool UringService::setUp()
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+  if (ring_fd_ < 0) {
+    std::cerr << "io_uring_setup: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  sq_ring_ = mapRing(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+  cq_ring_ = single_mmap ? sq_ring_ : mapRing(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+  sqes_ = static_cast<struct io_uring_sqe*>(mapRing(ring_fd_, params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES));
+  if (!sq_ring_ || !cq_ring_ || !sqes_) {
+    std::cerr << "io_uring mmap: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // provided buffers: the kernel picks one for every chunk a multishot receive completes
+  buffer_ring_ = static_cast<struct io_uring_buf*>(mapAnonymous(URING_BUFFER_COUNT * sizeof(struct io_uring_buf)));
+  buffers_ = static_cast<uint8_t*>(mapAnonymous(URING_BUFFER_COUNT * URING_BUFFER_SIZE));
+  if (!buffer_ring_ || !buffers_)
+    return false;
+  struct io_uring_buf_reg registration;
+  memset(&registration, 0, sizeof(registration));
+  registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+  registration.ring_entries = URING_BUFFER_COUNT;
+  registration.bgid = 0;
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+    std::cerr << "io_uring provided buffers (needs Linux 5.19): " << strerror(errno) << std::endl;
+    return false;
+  }
+  for (uint16_t i = 0; i < URING_BUFFER_COUNT; ++i)
+    provideBuffer(i);
+
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd_ < 0 || syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) != 0) {
+    std::cerr << "io_uring eventfd: " << strerror(errno) << std::endl;
+    return false;
+  }
+  boost::system::error_code error;
+  notifier_.assign(event_fd_, error);
+  if (error) {
+    std::cerr << "io_uring eventfd: " << error.message() << std::endl;
+    return false;
+  }
+  // the descriptor now belongs to notifier_
+  event_fd_ = -1;
+  scheduleWait();
+  return true;
+}
+
+void UringService::tearDown()
+{
+  boost::system::error_code ignored;
+  notifier_.close(ignored);
+  if (event_fd_ >= 0)
+    close(event_fd_);
+  event_fd_ = -1;
+  // closing the ring cancels every operation still in flight
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+  ring_fd_ = -1;
+  if (sqes_)
+    munmap(sqes_, sq_entries_ * sizeof(struct io_uring_sqe));
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    munmap(sq_ring_, sq_ring_size_);
+  if (buffer_ring_)
+    munmap(buffer_ring_, URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+  if (buffers_)
+    munmap(buffers_, URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+  sqes_ = NULL;
+  sq_ring_ = cq_ring_ = NULL;
+  buffer_ring_ = NULL;
+  buffers_ = NULL;
+}
+
+struct io_uring_sqe* UringService::nextSqe()
+{
+  // entries queued since the last submit() are not published yet, the next free slot is past them
+  if (*sq_tail_ + sq_pending_ - loadAcquire(sq_head_) >= sq_entries_) {
+    submit();
+    if (*sq_tail_ - loadAcquire(sq_head_) >= sq_entries_)
+      return NULL;
+  }
+  unsigned index = (*sq_tail_ + sq_pending_) & *sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  return sqe;
+}
+
+bool UringService::submit()
+{
+  if (!sq_pending_)
+    return true;
+  // publish the queued entries, then hand them to the kernel in one call
+  storeRelease(sq_tail_, *sq_tail_ + sq_pending_);
+  unsigned pending = sq_pending_;
+  sq_pending_ = 0;
+  ++enter_calls_;
+  if (syscall(__NR_io_uring_enter, ring_fd_, pending, 0, 0, NULL, 0) < 0) {
+    std::cerr << "io_uring_enter: " << strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool UringService::accept(int listen_fd, UringClient* client)
+{
+  if (!available())
+    return false;
+  struct io_uring_sqe* sqe = nextSqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listen_fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = reinterpret_cast<uint64_t>(client);
+  ++sq_pending_;
+  // inside reapCompletions() everything queued goes out in one io_uring_enter at the end
+  return reaping_ ? true : submit();
+}
+
+bool UringService::receive(int fd, UringClient* client)
+{
+  if (!available())
+    return false;
+  struct io_uring_sqe* sqe = nextSqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = reinterpret_cast<uint64_t>(client);
+  ++sq_pending_;
+  return reaping_ ? true : submit();
+}
+
+void UringService::provideBuffer(uint16_t buffer_id)
+{
+  // struct io_uring_buf_ring has a flexible array that C++ lays out 8 bytes too far, so the ring is addressed
+  // as a plain array of io_uring_buf here, with the tail overlaid on the resv field of the first entry
+  struct io_uring_buf* buffer = &buffer_ring_[buffer_tail_ & (URING_BUFFER_COUNT - 1)];
+  buffer->addr = reinterpret_cast<uint64_t>(buffers_ + buffer_id * URING_BUFFER_SIZE);
+  buffer->len = URING_BUFFER_SIZE;
+  buffer->bid = buffer_id;
+  ++buffer_tail_;
+  __atomic_store_n(&buffer_ring_[0].resv, buffer_tail_, __ATOMIC_RELEASE);
+}
+
+void UringService::scheduleWait()
+{
+  // reading the eventfd (speculatively, before waiting in epoll) also clears it, so a completion that arrives
+  // between reapCompletions() and this read wakes us up again instead of being missed
+  notifier_.async_read_some(
+    boost::asio::buffer(&event_count_, sizeof(event_count_)),
+    makeCustomAllocHandler(
+      handler_memory_,
+      boost::bind(&UringService::handleWakeup, this, boost::asio::placeholders::error)
+    )
+  );
+}
+
+void UringService::handleWakeup(const boost::system::error_code& error)
+{
+  if (error || !available())
+    return;
+  ++wakeups_;
+  reapCompletions();
+  scheduleWait();
+}
+
+void UringService::reapCompletions()
+{
+  reaping_ = true;
+  unsigned head = *cq_head_;
+  unsigned tail;
+  while (head != (tail = loadAcquire(cq_tail_))) {
+    for (; head != tail; ++head) {
+      struct io_uring_cqe cqe = cqes_[head & *cq_mask_];
+      // free the slot first; the client may queue new requests from the callback
+      storeRelease(cq_head_, head + 1);
+      if (!cqe.user_data)
+        continue;
+      ++completions_;
+      int buffer_id = -1;
+      const uint8_t* data = NULL;
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        data = buffers_ + buffer_id * URING_BUFFER_SIZE;
+      }
+      if (cqe.res == -ENOBUFS)
+        ++buffers_exhausted_;
+      reinterpret_cast<UringClient*>(cqe.user_data)->uringCompleted(cqe.res, data, cqe.flags & IORING_CQE_F_MORE);
+      if (buffer_id >= 0)
+        provideBuffer(buffer_id);
+    }
+  }
+  reaping_ = false;
+  submit();
+}
+
+#else
+
+bool UringService::setUp()
+{
+  std::cerr << "io_uring support not compiled in (make IO_URING=1)" << std::endl;
+  return false;
+}
+
+void UringService::tearDown()
+{
+}
+
+bool UringService::accept(int /*listen_fd*/, UringClient* /*client*/)
+{
+  return false;
+}
+
+bool UringService::receive(int /*fd*/, UringClient* /*client*/)
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef URING_SERVICE_HPP_
+#define URING_SERVICE_HPP_
+
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+
+#include "handler_allocator.hpp"
+
+/// rozmiar kolejki zgłoszeń i liczba/rozmiar buforów udostępnionych jądru
+#define URING_ENTRIES 64
+#define URING_BUFFER_COUNT 64
+#define URING_BUFFER_SIZE 512
+
+// z <linux/io_uring.h>, dołączanego tylko w uring_service.cpp
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+namespace SeekurJrRC {
+  namespace Core {
+
+    /**
+     *
+     * Odbiorca zakończeń operacji io_uring (TCPServer - accept, TCPConnection - odbiór danych).
+     */
+    class UringClient {
+    public:
+      virtual ~UringClient() {};
+      /**
+       * \param result - wynik operacji: liczba bajtów, deskryptor nowego połączenia albo -errno
+       * \param data   - odebrane dane (tylko przy odbiorze); bufor wraca do jądra zaraz po powrocie z metody
+       * \param more   - czy operacja wielokrotna (multishot) dalej jest aktywna; false = ostatnie zakończenie
+       */
+      virtual void uringCompleted(int32_t result, const uint8_t* data, bool more) = 0;
+    };
+
+    /**
+     *
+     * Alternatywny (wybierany przy starcie, [server] backend = io_uring) mechanizm przyjmowania połączeń i odbioru danych,
+     * oparty na io_uring z Linuksa, wołanym bezpośrednio przez syscall(2) (bez liburing). Jedna instancja na io_service.
+     *
+     * Accept i odbiór są operacjami wielokrotnymi (multishot): zgłaszane raz na serwer/połączenie, potem jądro samo
+     * wystawia kolejne zakończenia. Dane trafiają do buforów, które przekazaliśmy jądru z góry (provided buffer ring,
+     * IORING_REGISTER_PBUF_RING); zwrot bufora to zapis do pamięci współdzielonej, bez wywołania systemowego.
+     * O nowych zakończeniach informuje eventfd, na który czeka zwykły reaktor boost::asio, więc wszystkie handlery
+     * dalej wykonują się w wątku io_service - jedno budzenie obsługuje wszystkie zaległe zakończenia.
+     *
+     * Wymaga jądra >= 5.19 i budowania z make IO_URING=1; w przeciwnym razie available() zwraca false, a serwer
+     * wraca do boost::asio (epoll).
+     */
+    class UringService : public boost::asio::io_service::service
+    {
+    public:
+      /// konieczne ze względu na dziedziczenie po boost::asio::io_service::service
+      static boost::asio::io_service::id id;
+      explicit UringService(boost::asio::io_service& ios);
+      ~UringService();
+
+      /// czy io_uring działa (wkompilowany, jądro go obsługuje)
+      bool available() const { return ring_fd_ >= 0; }
+
+      /// wielokrotny accept na gniazdzie nasłuchującym; nowe deskryptory trafiają do client
+      bool accept(int listen_fd, UringClient* client);
+      /// wielokrotny odbiór z gniazda do buforów udostępnionych jądru
+      bool receive(int fd, UringClient* client);
+
+    private:
+      void shutdown_service();
+      bool setUp();
+      void tearDown();
+      /// wolne miejsce w kolejce zgłoszeń; NULL, jeżeli pełna mimo wysłania zaległych
+      struct io_uring_sqe* nextSqe();
+      /// io_uring_enter dla zgłoszeń czekających w kolejce
+      bool submit();
+      void provideBuffer(uint16_t buffer_id);
+      void scheduleWait();
+      void handleWakeup(const boost::system::error_code& error);
+      void reapCompletions();
+
+      int ring_fd_;
+      int event_fd_;
+      boost::asio::posix::stream_descriptor notifier_;
+      uint64_t event_count_;
+      HandlerMemory handler_memory_;
+
+      // pierścienie współdzielone z jądrem
+      void* sq_ring_;
+      void* cq_ring_;
+      size_t sq_ring_size_;
+      size_t cq_ring_size_;
+      struct io_uring_sqe* sqes_;
+      unsigned* sq_head_;
+      unsigned* sq_tail_;
+      unsigned* sq_mask_;
+      unsigned* sq_array_;
+      unsigned sq_entries_;
+      unsigned* cq_head_;
+      unsigned* cq_tail_;
+      unsigned* cq_mask_;
+      struct io_uring_cqe* cqes_;
+      unsigned sq_pending_;
+
+      // bufory udostępnione jądru
+      /// pierścień opisów buforów; ogon pierścienia leży w polu resv pierwszego elementu
+      struct io_uring_buf* buffer_ring_;
+      uint8_t* buffers_;
+      uint16_t buffer_tail_;
+      /// w trakcie reapCompletions() nowe zgłoszenia czekają i idą do jądra jednym io_uring_enter
+      bool reaping_;
+
+      // statystyki, wypisywane przy zakończeniu
+      uint64_t enter_calls_;
+      uint64_t wakeups_;
+      uint64_t completions_;
+      uint64_t buffers_exhausted_;
+    };
+  }
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "utils.hpp"
 
+bool SeekurJrRC::Utils::VirtualClock::enabled_ = false;
+int64_t SeekurJrRC::Utils::VirtualClock::now_ns_ = 0;
+
 long SeekurJrRC::Utils::gTODDiffToMsec(const struct timeval* t2, const struct timeval* t1)
 {
   uint64_t t1_int = 1000*t1->tv_sec + t1->tv_usec/1000;
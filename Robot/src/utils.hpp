@@ -2,8 +2,12 @@
 #define UTILS_HPP_
 
 #include <sys/time.h>
+#include <time.h>
 #include <stdint.h>
 #include <string>
+#include <ostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace SeekurJrRC {
   namespace Utils {
@@ -11,6 +15,102 @@ namespace SeekurJrRC {
     /// i zwraca ją w milisekundach (t2 - t1)
     long gTODDiffToMsec(const struct timeval* t2, const struct timeval* t1);
     uint32_t getCrc32(const uint8_t* data, uint32_t length);
+
+    /**
+     *
+     * Zegar wirtualny trybu symulacji ([simulation], simulation.hpp). Po enable() monotonicNowNs(), timeOfDay()
+     * i universalTime() zwracają czas symulacji zamiast zegarów systemowych, a czas płynie tylko przez advanceTo(),
+     * skokami od zdarzenia do zdarzenia. Włączany przy starcie, przed utworzeniem usług; w trybie symulacji wszystko
+     * działa w jednym wątku, więc stan nie musi być atomowy.
+     */
+    class VirtualClock {
+    public:
+      /// czas symulacji zaczyna się od 0 (także jako czas zegarowy: 1970-01-01)
+      static void enable() { enabled_ = true; now_ns_ = 0; }
+      static bool enabled() { return enabled_; }
+      static int64_t nowNs() { return now_ns_; }
+      /// przesunięcie zegara; czas się nie cofa
+      static void advanceTo(int64_t ns) {
+        if (ns > now_ns_)
+          now_ns_ = ns;
+      }
+
+    private:
+      static bool enabled_;
+      static int64_t now_ns_;
+    };
+
+    /// CLOCK_MONOTONIC [ns], zawsze systemowy; bez VirtualClock, więc nie wymaga utils.cpp (ShmCommandWriter)
+    inline int64_t realMonotonicNowNs()
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    /// CLOCK_MONOTONIC [ns] albo czas symulacji
+    inline int64_t monotonicNowNs()
+    {
+      if (VirtualClock::enabled())
+        return VirtualClock::nowNs();
+      return realMonotonicNowNs();
+    }
+
+    /// gettimeofday() albo czas symulacji
+    inline void timeOfDay(struct timeval* now)
+    {
+      if (!VirtualClock::enabled()) {
+        gettimeofday(now, NULL);
+        return;
+      }
+      now->tv_sec = VirtualClock::nowNs() / 1000000000LL;
+      now->tv_usec = (VirtualClock::nowNs() % 1000000000LL) / 1000;
+    }
+
+    /// microsec_clock::universal_time() albo czas symulacji; czas timerów (Timer, virtual_timer.hpp)
+    inline boost::posix_time::ptime universalTime()
+    {
+      if (!VirtualClock::enabled())
+        return boost::posix_time::microsec_clock::universal_time();
+      return boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1)) + boost::posix_time::microseconds(VirtualClock::nowNs() / 1000);
+    }
+
+    /// statystyka jittera timerów, tj. o ile później niż planowano obudził się handler [usec]
+    struct JitterStats {
+      JitterStats() : samples_(0), sum_us_(0), max_us_(0) {
+        for (int i = 0; i < buckets_; ++i)
+          histogram_[i] = 0;
+      };
+      void record(long us) {
+        if (us < 0)
+          us = 0;
+        ++samples_;
+        sum_us_ += us;
+        if (us > max_us_)
+          max_us_ = us;
+        int bucket = 0;
+        while (bucket < buckets_ - 1 && us >= bucketLimitUs(bucket))
+          ++bucket;
+        ++histogram_[bucket];
+      }
+      /// średnia, maksimum i histogram: <50us, <200us, <1ms, <5ms, reszta; what - nazwa mierzonej wielkości
+      void print(std::ostream& out, const char* what = "jitter") const {
+        out << what << " avg " << (samples_ ? sum_us_ / samples_ : 0) << " us, max " << max_us_ << " us [";
+        for (int i = 0; i < buckets_; ++i)
+          out << (i ? " " : "") << histogram_[i];
+        out << "]";
+      }
+      static long bucketLimitUs(int bucket) {
+        static const long limits[buckets_ - 1] = {50, 200, 1000, 5000};
+        return limits[bucket];
+      }
+
+      static const int buckets_ = 5;
+      uint64_t samples_;
+      double sum_us_;
+      long max_us_;
+      uint64_t histogram_[buckets_];
+    };
     inline bool isSystemBigEndian(void)
     {
       union {
@@ -0,0 +1,70 @@
+#include <boost/bind.hpp>
+
+#include "virtual_timer.hpp"
+
+using SeekurJrRC::Utils::VirtualScheduler;
+using SeekurJrRC::Utils::VirtualClock;
+using SeekurJrRC::Utils::Timer;
+
+VirtualScheduler::Queue VirtualScheduler::queue_;
+uint64_t VirtualScheduler::sequence_ = 0;
+uint64_t VirtualScheduler::fired_ = 0;
+
+int64_t VirtualScheduler::toNs(const boost::posix_time::ptime& time)
+{
+  static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+  return (time - epoch).total_microseconds() * 1000;
+}
+
+void VirtualScheduler::add(Timer* timer, const boost::posix_time::ptime& expiry, boost::asio::io_service& ios, const Handler& handler)
+{
+  Wait wait;
+  wait.timer_ = timer;
+  wait.ios_ = &ios;
+  wait.handler_ = handler;
+  queue_.insert(std::make_pair(std::make_pair(toNs(expiry), sequence_++), wait));
+}
+
+std::size_t VirtualScheduler::cancel(Timer* timer)
+{
+  std::size_t cancelled = 0;
+  for (Queue::iterator it = queue_.begin(); it != queue_.end(); ) {
+    if (it->second.timer_ == timer) {
+      it->second.ios_->post(boost::bind(it->second.handler_, boost::system::error_code(boost::asio::error::operation_aborted)));
+      queue_.erase(it++);
+      ++cancelled;
+    }
+    else
+      ++it;
+  }
+  return cancelled;
+}
+
+void VirtualScheduler::remove(Timer* timer)
+{
+  for (Queue::iterator it = queue_.begin(); it != queue_.end(); ) {
+    if (it->second.timer_ == timer)
+      queue_.erase(it++);
+    else
+      ++it;
+  }
+}
+
+bool VirtualScheduler::next(int64_t& due_ns)
+{
+  if (queue_.empty())
+    return false;
+  due_ns = queue_.begin()->first.first;
+  return true;
+}
+
+void VirtualScheduler::fireNext()
+{
+  if (queue_.empty())
+    return;
+  Queue::iterator first = queue_.begin();
+  VirtualClock::advanceTo(first->first.first);
+  first->second.ios_->post(boost::bind(first->second.handler_, boost::system::error_code()));
+  queue_.erase(first);
+  ++fired_;
+}
@@ -0,0 +1,117 @@
+#ifndef VIRTUAL_TIMER_HPP_
+#define VIRTUAL_TIMER_HPP_
+
+#include <map>
+#include <utility>
+#include <stdint.h>
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "utils.hpp"
+
+namespace SeekurJrRC {
+  namespace Utils {
+
+    class Timer;
+
+    /**
+     *
+     * Kolejka zdarzeń czasu wirtualnego: oczekiwania wszystkich Timer'ów w kolejności terminu, a przy równych
+     * terminach - zlecenia. Symulacja (simulation.hpp) przesuwa VirtualClock od razu do terminu najbliższego
+     * zdarzenia i zleca jego handler w io_service timera, więc godzina pracy serwera trwa tyle, ile obliczenia w niej,
+     * a kolejność zdarzeń jest przy każdym uruchomieniu ta sama. Tylko przy włączonym VirtualClock, z jednego wątku.
+     */
+    class VirtualScheduler {
+    public:
+      typedef boost::function<void (const boost::system::error_code&)> Handler;
+
+      static void add(Timer* timer, const boost::posix_time::ptime& expiry, boost::asio::io_service& ios, const Handler& handler);
+      /// zleca handlery oczekiwań timera z operation_aborted (jak deadline_timer::cancel); zwraca ich liczbę
+      static std::size_t cancel(Timer* timer);
+      /// usuwa oczekiwania timera bez wołania handlerów (niszczony timer)
+      static void remove(Timer* timer);
+      /// termin najbliższego zdarzenia [ns czasu wirtualnego]; false, jeżeli nic nie czeka
+      static bool next(int64_t& due_ns);
+      /// przesuwa zegar do terminu najbliższego zdarzenia i zleca jego handler
+      static void fireNext();
+      /// liczba zdarzeń, które nastąpiły
+      static uint64_t fired() { return fired_; }
+
+      /// czas wirtualny [ns] odpowiadający chwili z universalTime()
+      static int64_t toNs(const boost::posix_time::ptime& time);
+
+    private:
+      struct Wait {
+        Timer* timer_;
+        boost::asio::io_service* ios_;
+        Handler handler_;
+      };
+      /// (termin [ns], numer zlecenia) -> oczekiwanie
+      typedef std::map<std::pair<int64_t, uint64_t>, Wait> Queue;
+
+      static Queue queue_;
+      static uint64_t sequence_;
+      static uint64_t fired_;
+    };
+
+    /**
+     *
+     * Timer o interfejsie boost::asio::deadline_timer (w zakresie, którego używa serwer), liczący czas wg universalTime().
+     * Bez trybu symulacji to zwykły deadline_timer - bez żadnej różnicy, także w alokacjach handlerów z własnym
+     * alokatorem; przy włączonym VirtualClock oczekiwania trafiają do VirtualScheduler.
+     */
+    class Timer : private boost::noncopyable {
+    public:
+      explicit Timer(boost::asio::io_service& ios) : ios_(ios), timer_(ios), expiry_(universalTime()) {};
+      Timer(boost::asio::io_service& ios, const boost::posix_time::time_duration& expiry_time)
+        : ios_(ios), timer_(ios), expiry_(universalTime())
+      {
+        expires_from_now(expiry_time);
+      };
+      ~Timer() {
+        if (VirtualClock::enabled())
+          VirtualScheduler::remove(this);
+      };
+
+      boost::posix_time::ptime expires_at() const { return expiry_; }
+
+      /// nowy termin; oczekujące handlery dostają operation_aborted
+      std::size_t expires_at(const boost::posix_time::ptime& expiry_time) {
+        expiry_ = expiry_time;
+        if (VirtualClock::enabled())
+          return VirtualScheduler::cancel(this);
+        return timer_.expires_at(expiry_time);
+      }
+
+      std::size_t expires_from_now(const boost::posix_time::time_duration& expiry_time) {
+        return expires_at(universalTime() + expiry_time);
+      }
+
+      template <typename WaitHandler>
+      void async_wait(WaitHandler handler) {
+        if (VirtualClock::enabled())
+          VirtualScheduler::add(this, expiry_, ios_, handler);
+        else
+          timer_.async_wait(handler);
+      }
+
+      std::size_t cancel(boost::system::error_code& ec) {
+        if (VirtualClock::enabled()) {
+          ec = boost::system::error_code();
+          return VirtualScheduler::cancel(this);
+        }
+        return timer_.cancel(ec);
+      }
+
+    private:
+      boost::asio::io_service& ios_;
+      boost::asio::deadline_timer timer_;
+      boost::posix_time::ptime expiry_;
+    };
+  }
+}
+
+#endif
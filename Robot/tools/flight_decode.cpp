@@ -0,0 +1,179 @@
+/**
+ *
+ * Dekoder zrzutów rejestratora lotu (FlightRecorder, flight_recorder.hpp): wypisuje rekordy w kolejności
+ * chronologicznej, z czasem zegarowym i czasem względem chwili zrzutu, po jednym zdarzeniu w linii.
+ * Rekordy, które w chwili zrzutu były w trakcie zapisu (sequence_ == 0), są pomijane.
+ *
+ *   flight_decode [--robot id] [--last msec] plik.bin...
+ */
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include "flight_recorder.hpp"
+
+using namespace SeekurJrRC::Core;
+
+namespace {
+  struct Entry {
+    /// numer rekordu od startu programu
+    uint64_t index_;
+    FlightRecord record_;
+
+    bool operator<(const Entry& other) const { return index_ < other.index_; }
+  };
+
+  const char* reasonName(uint32_t reason)
+  {
+    switch (reason) {
+      case FLIGHT_DUMP_WATCHDOG: return "watchdog stop";
+      case FLIGHT_DUMP_SIGNAL: return "signal";
+      case FLIGHT_DUMP_FATAL: return "fatal signal";
+      default: return "unknown";
+    }
+  }
+
+  /// czas zegarowy (lokalny) z dokładnością do mikrosekund
+  std::string wallClock(int64_t realtime_ns)
+  {
+    time_t seconds = realtime_ns / 1000000000LL;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    std::ostringstream out;
+    out << text << "." << std::setw(6) << std::setfill('0') << (realtime_ns % 1000000000LL) / 1000;
+    return out.str();
+  }
+
+  /// opis zdarzenia; kolumny jak w komentarzach FlightEvent
+  std::string describe(const FlightRecord& record)
+  {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    const float* v = record.values_;
+    switch (record.event_) {
+      case FLIGHT_FRAME_DRIVE:
+      case FLIGHT_FRAME_IDLE:
+        out << (record.event_ == FLIGHT_FRAME_DRIVE ? "frame drive" : "frame idle ")
+            << "  model " << (int)record.code_ << " x " << v[0] << " y " << v[1] << " z " << v[2];
+        break;
+      case FLIGHT_FRAME_BUNDLED:
+        out << "bundled      model " << (int)record.code_ << " x " << v[0] << " y " << v[1] << " z " << v[2]
+            << " (" << v[3] << " ms older)";
+        break;
+      case FLIGHT_FRAME_GYRO:
+        out << "frame gyro   rates " << v[0] << " " << v[1] << " " << v[2] << " rad/s";
+        break;
+      case FLIGHT_ORIENTATION:
+        out << "orientation  model " << (int)record.code_ << " x " << v[0] << " y " << v[1] << " z " << v[2];
+        break;
+      case FLIGHT_COMMAND:
+        out << "command      left " << v[0] << " right " << v[1] << " mm/s, v_trans " << v[2] << " mm/s, omega " << v[3] << " deg/s";
+        break;
+      case FLIGHT_WATCHDOG_OK:
+        out << "watchdog ok  " << v[0] << " ms since command (timeout " << v[1] << ")";
+        break;
+      case FLIGHT_WATCHDOG_STOP:
+        out << "watchdog STOP " << v[0] << " ms since command (timeout " << v[1] << ")"
+            << (record.code_ ? ", requested by the client" : ", UNEXPECTED");
+        break;
+      case FLIGHT_DUMP:
+        out << "dump         " << reasonName(record.code_);
+        if (record.code_ != FLIGHT_DUMP_WATCHDOG)
+          out << " " << (int)v[0];
+        break;
+      default:
+        out << "event " << (int)record.event_ << " code " << (int)record.code_
+            << " " << v[0] << " " << v[1] << " " << v[2] << " " << v[3];
+    }
+    return out.str();
+  }
+
+  bool decode(const std::string& path, long robot, double last_ms)
+  {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    FlightDumpHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+      std::cerr << path << ": cannot read the header" << std::endl;
+      return false;
+    }
+    if (header.magic_ != FLIGHT_DUMP_MAGIC || header.version_ != FLIGHT_DUMP_VERSION || header.record_size_ != sizeof(FlightRecord)) {
+      std::cerr << path << ": not a flight recorder dump (or another version)" << std::endl;
+      return false;
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(header.capacity_);
+    for (uint32_t i = 0; i < header.capacity_; ++i) {
+      Entry entry;
+      if (!in.read(reinterpret_cast<char*>(&entry.record_), sizeof(entry.record_))) {
+        std::cerr << path << ": truncated after " << i << " records" << std::endl;
+        break;
+      }
+      if (entry.record_.sequence_ == 0)
+        continue;
+      // the sequence is the low 32 bits of index + 1; records written while dumping may be slightly past next_
+      const int32_t behind = (int32_t)((uint32_t)header.next_ - entry.record_.sequence_);
+      if (behind <= -(int64_t)header.capacity_ || behind >= (int64_t)header.capacity_)
+        continue;
+      entry.index_ = header.next_ - behind - 1;
+      if (robot >= 0 && entry.record_.robot_id_ != robot)
+        continue;
+      if (last_ms > 0 && (header.monotonic_ns_ - entry.record_.time_ns_) / 1e6 > last_ms)
+        continue;
+      entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::cout << "# " << path << ": " << reasonName(header.reason_)
+              << (header.reason_ == FLIGHT_DUMP_WATCHDOG ? " of robot " : " ") << header.detail_
+              << ", pid " << header.pid_ << ", at " << wallClock(header.realtime_ns_) << ", "
+              << entries.size() << " records (" << header.next_ << " since start, " << header.capacity_ << " kept)" << std::endl;
+    std::cout << "# wall clock                 before dump [ms]  robot  event" << std::endl;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      const FlightRecord& record = entries[i].record_;
+      const int64_t before_ns = header.monotonic_ns_ - record.time_ns_;
+      std::cout << wallClock(header.realtime_ns_ - before_ns) << "  " << std::fixed << std::setprecision(3)
+                << std::setw(16) << std::setfill(' ') << -before_ns / 1e6 << "  " << std::setw(5) << record.robot_id_
+                << "  " << describe(record) << std::endl;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long robot = -1;
+  double last_ms = 0;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--robot" && i + 1 < argc)
+      robot = atol(argv[++i]);
+    else if (arg == "--last" && i + 1 < argc)
+      last_ms = atof(argv[++i]);
+    else if (arg.size() > 1 && arg[0] == '-') {
+      std::cerr << "usage: flight_decode [--robot id] [--last msec] dump.bin..." << std::endl;
+      return 2;
+    }
+    else
+      paths.push_back(arg);
+  }
+  if (paths.empty()) {
+    std::cerr << "usage: flight_decode [--robot id] [--last msec] dump.bin..." << std::endl;
+    return 2;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < paths.size(); ++i)
+    ok = decode(paths[i], robot, last_ms) && ok;
+  return ok ? 0 : 1;
+}